@@ -0,0 +1,703 @@
+/**
+    @file bench_dsp.c
+    @brief Microbenchmarks for the individual DSP units (filters, delay lines,
+    convolvers, reverb, compressor and each grain source's fill function).
+    Each unit is run on its own at realistic block sizes, and the cost is
+    reported as cycles per sample and throughput, as JSON.
+
+    Usage:
+        bench_dsp [-o results.json] [-d seconds] [-u unit] [-h hrtf_path]
+        bench_dsp --compare original.json optimized.json [-t threshold]
+
+    To check that the _opt.c variants actually help, build once normally and
+    once with -DOPENGRAIN_OPTIMIZED=1, run both, and compare the two files.
+    Every unit which is not faster in the optimized build is reported.
+
+    Cycles are read from the time stamp counter on x86; on other platforms
+    only the throughput is reported, and cycles per sample is 0.
+
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "audio.h"
+#include "biquad.h"
+#include "svf.h"
+#include "moddelayline.h"
+#include "allpass.h"
+#include "convolver.h"
+#include "hrtf.h"
+#include "random_reverb.h"
+#include "compressor.h"
+#include "grain_stream.h"
+#include "grain_model.h"
+#include "grain_tests.h"
+#include "stats.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BENCH_HAVE_CYCLES 1
+#endif
+
+#ifndef OPENGRAIN_OPTIMIZED
+#define OPENGRAIN_OPTIMIZED 0
+#endif
+
+#define BENCH_SAMPLE_RATE 44100
+#define BENCH_DEFAULT_DURATION 0.25
+#define BENCH_DEFAULT_THRESHOLD 0.02
+#define BENCH_MAX_RESULTS 1024
+#define BENCH_MAX_NAME 64
+
+// length of the grains used to time the fill functions, in seconds
+#define BENCH_GRAIN_DURATION 1.0
+
+typedef void *(*SetupFunction)(int arg);
+typedef void (*RunFunction)(void *state, Buffer *in, Buffer *out);
+typedef void (*TeardownFunction)(void *state);
+
+typedef struct DSPUnit
+{
+    const char *name;
+    SetupFunction setup;
+    RunFunction run;
+    TeardownFunction teardown;
+    int arg;
+} DSPUnit;
+
+typedef struct DSPResult
+{
+    char unit[BENCH_MAX_NAME];
+    int block_size;
+    int optimized;
+    double cycles_per_sample;
+    double msamples_per_second;
+} DSPResult;
+
+
+static char *hrtf_path = "../hrtf";
+
+// the realistic block sizes
+static int block_sizes[] = {64, 256, 1024};
+#define N_BLOCK_SIZES (sizeof(block_sizes)/sizeof(block_sizes[0]))
+
+
+// read the cycle counter (0 if there isn't one)
+static unsigned long long read_cycles(void)
+{
+#ifdef BENCH_HAVE_CYCLES
+    unsigned int lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((unsigned long long)hi << 32) | lo;
+#else
+    return 0;
+#endif
+}
+
+
+// set up the global audio state for a given block size
+static void init_bench_state(int block_size)
+{
+    AudioState prototype;
+    prototype.sample_rate = BENCH_SAMPLE_RATE;
+    prototype.frames_per_buffer = block_size;
+    prototype.n_channels = 2;
+    prototype.n_input_channels = 0;
+    prototype.input_channel = 0;
+    prototype.in_device = 0;
+    prototype.out_device = 0;
+    prototype.latency = 0.0;
+    prototype.max_grains = 16;
+    prototype.max_active_grains = 0;
+    
+    // replace the state for the last block size
+    if(current_audio_state)
+        destroy_audio_state(current_audio_state);
+    init_audio_state(&prototype);
+}
+
+
+/////////////////// biquad
+static void *setup_biquad(int arg)
+{
+    Biquad *biquad = create_biquad();
+    biquad_lowpass(biquad, 1000.0, 2.0);
+    return biquad;
+}
+
+static void run_biquad(void *state, Buffer *in, Buffer *out)
+{
+    int i;
+    for(i=0;i<in->n_samples;i++)
+        out->x[i] = process_biquad((Biquad *)state, in->x[i]);
+}
+
+static void teardown_biquad(void *state)
+{
+    destroy_biquad((Biquad *)state);
+}
+
+
+/////////////////// state variable filter
+static void *setup_svf(int arg)
+{
+    SVF *svf = create_SVF();
+    set_SVF(svf, 1000.0, 2.0, 0.1, SVF_LOWPASS);
+    return svf;
+}
+
+static void run_svf(void *state, Buffer *in, Buffer *out)
+{
+    int i;
+    for(i=0;i<in->n_samples;i++)
+        out->x[i] = compute_SVF((SVF *)state, in->x[i]);
+}
+
+static void teardown_svf(void *state)
+{
+    destroy_SVF((SVF *)state);
+}
+
+
+/////////////////// modulated delay line
+static void *setup_mdelay(int arg)
+{
+    ModDelayLine *delay = create_mdelay();
+    set_mdelay(delay, 1000);
+    set_modulation_mdelay(delay, 8.0, 0.5);
+    return delay;
+}
+
+static void run_mdelay(void *state, Buffer *in, Buffer *out)
+{
+    int i;
+    for(i=0;i<in->n_samples;i++)
+        out->x[i] = mdelay((ModDelayLine *)state, in->x[i]);
+}
+
+static void teardown_mdelay(void *state)
+{
+    destroy_mdelay((ModDelayLine *)state);
+}
+
+
+/////////////////// thiran allpass
+static void *setup_thiran(int arg)
+{
+    ThiranAllpass *allpass = create_thiran_allpass();
+    set_thiran_allpass_delay(allpass, 100.5);
+    return allpass;
+}
+
+static void run_thiran(void *state, Buffer *in, Buffer *out)
+{
+    int i;
+    for(i=0;i<in->n_samples;i++)
+        out->x[i] = process_thiran_allpass((ThiranAllpass *)state, in->x[i]);
+}
+
+static void teardown_thiran(void *state)
+{
+    destroy_thiran_allpass((ThiranAllpass *)state);
+}
+
+
+/////////////////// convolver, with an impulse of arg samples
+static void *setup_convolver(int arg)
+{
+    Convolver *convolver;
+    Buffer *impulse;
+    int i;
+    convolver = create_convolver();
+    impulse = create_buffer(arg);
+    for(i=0;i<arg;i++)
+        impulse->x[i] = (uniform_double() * 2 - 1) * exp(-4.0 * i / arg);
+    set_impulse_convolver(convolver, impulse);
+    destroy_buffer(impulse);
+    return convolver;
+}
+
+static void run_convolver(void *state, Buffer *in, Buffer *out)
+{
+    process_convolver((Convolver *)state, in, out);
+}
+
+static void teardown_convolver(void *state)
+{
+    destroy_convolver((Convolver *)state);
+}
+
+
+/////////////////// hrtf convolver (needs the HRTF data)
+typedef struct HRTFBench
+{
+    HRTFModel *model;
+    HRTFConvolver *convolver;
+    Buffer *right;
+} HRTFBench;
+
+static void *setup_hrtf(int arg)
+{
+    HRTFBench *bench;
+    HRTFModel *model;
+    model = create_hrtf_model(hrtf_path);
+    if(list_size(model->impulses)==0)
+    {
+        destroy_hrtf_model(model);
+        return NULL;
+    }
+    bench = malloc(sizeof(*bench));
+    bench->model = model;
+    bench->convolver = create_hrtf_convolver(model);
+    set_hrtf_convolver(bench->convolver, 30.0, 0.0);
+    bench->right = create_buffer(GLOBAL_STATE.frames_per_buffer);
+    return bench;
+}
+
+static void run_hrtf(void *state, Buffer *in, Buffer *out)
+{
+    HRTFBench *bench = (HRTFBench *)state;
+    hrtf_convolve(bench->convolver, in, out, bench->right);
+}
+
+static void teardown_hrtf(void *state)
+{
+    HRTFBench *bench = (HRTFBench *)state;
+    destroy_hrtf_convolver(bench->convolver);
+    destroy_hrtf_model(bench->model);
+    destroy_buffer(bench->right);
+    free(bench);
+}
+
+
+/////////////////// random reverb, stereo in and out
+typedef struct ReverbBench
+{
+    RandomReverb *reverb;
+    Buffer *ins[2];
+    Buffer *outs[2];
+} ReverbBench;
+
+static void *setup_reverb(int arg)
+{
+    ReverbBench *bench;
+    bench = malloc(sizeof(*bench));
+    bench->reverb = create_random_reverb(2);
+    bench->ins[1] = create_buffer(GLOBAL_STATE.frames_per_buffer);
+    bench->outs[1] = create_buffer(GLOBAL_STATE.frames_per_buffer);
+    return bench;
+}
+
+static void run_reverb(void *state, Buffer *in, Buffer *out)
+{
+    ReverbBench *bench = (ReverbBench *)state;
+    bench->ins[0] = in;
+    bench->outs[0] = out;
+    copy_buffer(bench->ins[1], in);
+    compute_random_reverb(bench->reverb, bench->ins, 2, bench->outs);
+}
+
+static void teardown_reverb(void *state)
+{
+    ReverbBench *bench = (ReverbBench *)state;
+    destroy_random_reverb(bench->reverb);
+    destroy_buffer(bench->ins[1]);
+    destroy_buffer(bench->outs[1]);
+    free(bench);
+}
+
+
+/////////////////// stereo compressor
+static void *setup_compressor(int arg)
+{
+    return create_compressor();
+}
+
+static void run_compressor(void *state, Buffer *in, Buffer *out)
+{
+    int i;
+    float l, r;
+    for(i=0;i<in->n_samples;i++)
+    {
+        compute_compressor((StereoCompressor *)state, in->x[i], -in->x[i], &l, &r);
+        out->x[i] = l + r;
+    }
+}
+
+static void teardown_compressor(void *state)
+{
+    destroy_compressor((StereoCompressor *)state);
+}
+
+
+/////////////////// grain source fill functions
+typedef void (*SourceFunction)(GrainStream *stream);
+
+typedef struct FillSource
+{
+    SourceFunction source;
+    // sample file the scene loads, or NULL if it doesn't need one
+    const char *data_file;
+} FillSource;
+
+// the sources from grain_tests.c, in the same order as the fill_ units below
+static FillSource fill_sources[] =
+{
+    {test_sinegrain, NULL},
+    {test_noisegrain, NULL},
+    {test_impulsegrain, "..\\samples\\materials\\ping000.wav"},
+    {test_fmgrain, NULL},
+    {test_analoggrain, NULL},
+    {test_dsfgrain, NULL},
+    {test_wavegrain, "..\\samples\\speech.wav"},
+    {test_glissgrain, NULL},
+    {test_padsyngrain, "..\\samples\\right.wav"},
+    {test_pluckgrain, "excite-plucked.wav"},
+    {test_multisinegrain, NULL},
+    {test_voicegrain, NULL}
+};
+
+typedef struct FillBench
+{
+    GrainStream *stream;
+    Grain *grain;
+    int samples_left;
+} FillBench;
+
+// (re)start the benchmark grain; returns 0 if the source could not make one
+static int spawn_fill_bench(FillBench *bench)
+{
+    Grain *grain = bench->grain;
+    if(grain->specifics)
+        kill_specifics_source(grain->source, grain->specifics);
+    grain->specifics = NULL;
+    if(!fill_from_grain_model(bench->stream->model, bench->stream->source_list, 0, grain))
+        return 0;
+    bench->samples_left = grain->duration_samples;
+    return 1;
+}
+
+static void *setup_fill(int arg)
+{
+    FillBench *bench;
+    FILE *f;
+
+    // the sample based sources can't run without their data
+    if(fill_sources[arg].data_file)
+    {
+        f = fopen(fill_sources[arg].data_file, "rb");
+        if(!f)
+            return NULL;
+        fclose(f);
+    }
+
+    bench = malloc(sizeof(*bench));
+    bench->stream = create_stream(2);
+    fill_sources[arg].source(bench->stream);
+    test_default_grain_model(bench->stream);
+    set_constant_distribution(get_grain_model_stream(bench->stream)->duration, BENCH_GRAIN_DURATION);
+    bench->grain = create_grain();
+    bench->grain->specifics = NULL;
+    if(!spawn_fill_bench(bench))
+    {
+        destroy_grain(bench->grain);
+        destroy_stream(bench->stream);
+        free(bench);
+        return NULL;
+    }
+    return bench;
+}
+
+static void run_fill(void *state, Buffer *in, Buffer *out)
+{
+    FillBench *bench = (FillBench *)state;
+    Grain *grain = bench->grain;
+
+    // start a new grain when this one runs out (counted in the timing,
+    // just as the spawn is part of a real stream)
+    if(bench->samples_left < out->n_samples)
+        spawn_fill_bench(bench);
+    grain->source->fill_grain(grain->specifics, out);
+    bench->samples_left -= out->n_samples;
+}
+
+static void teardown_fill(void *state)
+{
+    FillBench *bench = (FillBench *)state;
+    if(bench->grain->specifics)
+        kill_specifics_source(bench->grain->source, bench->grain->specifics);
+    destroy_grain(bench->grain);
+    destroy_stream(bench->stream);
+    free(bench);
+}
+
+
+static DSPUnit units[] =
+{
+    {"process_biquad", setup_biquad, run_biquad, teardown_biquad, 0},
+    {"compute_SVF", setup_svf, run_svf, teardown_svf, 0},
+    {"mdelay", setup_mdelay, run_mdelay, teardown_mdelay, 0},
+    {"process_thiran_allpass", setup_thiran, run_thiran, teardown_thiran, 0},
+    {"process_convolver_64", setup_convolver, run_convolver, teardown_convolver, 64},
+    {"process_convolver_512", setup_convolver, run_convolver, teardown_convolver, 512},
+    {"process_convolver_4096", setup_convolver, run_convolver, teardown_convolver, 4096},
+    {"process_convolver_32768", setup_convolver, run_convolver, teardown_convolver, 32768},
+    {"hrtf_convolve", setup_hrtf, run_hrtf, teardown_hrtf, 0},
+    {"compute_random_reverb", setup_reverb, run_reverb, teardown_reverb, 0},
+    {"compute_compressor", setup_compressor, run_compressor, teardown_compressor, 0},
+    {"fill_sinegrain", setup_fill, run_fill, teardown_fill, 0},
+    {"fill_noisegrain", setup_fill, run_fill, teardown_fill, 1},
+    {"fill_impulsegrain", setup_fill, run_fill, teardown_fill, 2},
+    {"fill_fmgrain", setup_fill, run_fill, teardown_fill, 3},
+    {"fill_analoggrain", setup_fill, run_fill, teardown_fill, 4},
+    {"fill_dsfgrain", setup_fill, run_fill, teardown_fill, 5},
+    {"fill_wavegrain", setup_fill, run_fill, teardown_fill, 6},
+    {"fill_glissgrain", setup_fill, run_fill, teardown_fill, 7},
+    {"fill_padsyngrain", setup_fill, run_fill, teardown_fill, 8},
+    {"fill_pluckgrain", setup_fill, run_fill, teardown_fill, 9},
+    {"fill_multisinegrain", setup_fill, run_fill, teardown_fill, 10},
+    {"fill_voicegrain", setup_fill, run_fill, teardown_fill, 11},
+    {NULL, NULL, NULL, NULL, 0}
+};
+
+
+/** Time one unit at one block size.
+    @arg unit The unit to time
+    @arg block_size The number of samples processed per call
+    @arg duration Minimum wall clock time to spend timing, in seconds
+    @arg result Filled in with the result
+    @return 1 if the unit ran, 0 if it could not be set up (e.g. missing data files)
+*/
+static int run_unit(DSPUnit *unit, int block_size, double duration, DSPResult *result)
+{
+    Buffer *in, *out;
+    void *state;
+    double start, elapsed, samples;
+    unsigned long long start_cycles, cycles;
+    int i, n_blocks;
+
+    init_bench_state(block_size);
+    state = unit->setup(unit->arg);
+    if(!state)
+        return 0;
+
+    in = create_buffer(block_size);
+    out = create_buffer(block_size);
+    for(i=0;i<block_size;i++)
+        in->x[i] = uniform_double() * 2 - 1;
+
+    // warm up the caches, and get a rough per-block time
+    n_blocks = 0;
+    start = get_time_stats();
+    do
+    {
+        unit->run(state, in, out);
+        n_blocks++;
+    } while(get_time_stats() - start < duration * 0.1);
+    n_blocks = MAX(1, n_blocks * 10);
+
+    start_cycles = read_cycles();
+    start = get_time_stats();
+    for(i=0;i<n_blocks;i++)
+        unit->run(state, in, out);
+    cycles = read_cycles() - start_cycles;
+    elapsed = get_time_stats() - start;
+
+    samples = (double)n_blocks * block_size;
+    strncpy(result->unit, unit->name, BENCH_MAX_NAME-1);
+    result->unit[BENCH_MAX_NAME-1] = '\0';
+    result->block_size = block_size;
+    result->optimized = OPENGRAIN_OPTIMIZED;
+    result->cycles_per_sample = cycles / samples;
+    result->msamples_per_second = elapsed>0 ? samples / elapsed / 1e6 : 0.0;
+
+    unit->teardown(state);
+    destroy_buffer(in);
+    destroy_buffer(out);
+    return 1;
+}
+
+
+// write one result as a single JSON line (compare_runs() relies on this layout)
+static void write_result(FILE *f, DSPResult *result)
+{
+    fprintf(f, "{\"unit\": \"%s\", \"block_size\": %d, \"optimized\": %d, "
+               "\"cycles_per_sample\": %.3f, \"msamples_per_second\": %.3f}",
+               result->unit, result->block_size, result->optimized,
+               result->cycles_per_sample, result->msamples_per_second);
+}
+
+// read one line written by write_result; returns 1 if the line held a result
+static int read_result(const char *line, DSPResult *result)
+{
+    return sscanf(line, " {\"unit\": \"%63[^\"]\", \"block_size\": %d, \"optimized\": %d, "
+               "\"cycles_per_sample\": %lf, \"msamples_per_second\": %lf}",
+               result->unit, &result->block_size, &result->optimized,
+               &result->cycles_per_sample, &result->msamples_per_second) == 5;
+}
+
+
+// load all the results from a JSON file; returns the number read, or -1 on failure
+static int load_results(const char *path, DSPResult *results, int max_results)
+{
+    FILE *f;
+    char line[1024];
+    int n;
+
+    f = fopen(path, "r");
+    if(!f)
+    {
+        fprintf(stderr, "Could not open %s\n", path);
+        return -1;
+    }
+    n = 0;
+    while(n<max_results && fgets(line, sizeof(line), f))
+    {
+        if(read_result(line, &results[n]))
+            n++;
+    }
+    fclose(f);
+    return n;
+}
+
+
+// compare an original and an optimized run, and report every unit which the
+// optimized build does not speed up by more than threshold
+// returns the number of such units
+static int compare_runs(const char *original_path, const char *optimized_path, double threshold)
+{
+    DSPResult *original, *optimized;
+    int n_original, n_optimized, i, j, failures;
+    double speedup;
+
+    original = malloc(sizeof(*original) * BENCH_MAX_RESULTS);
+    optimized = malloc(sizeof(*optimized) * BENCH_MAX_RESULTS);
+    n_original = load_results(original_path, original, BENCH_MAX_RESULTS);
+    n_optimized = load_results(optimized_path, optimized, BENCH_MAX_RESULTS);
+    failures = 0;
+
+    if(n_original<0 || n_optimized<0)
+        failures = -1;
+
+    for(i=0;i<n_optimized;i++)
+    {
+        for(j=0;j<n_original;j++)
+        {
+            if(strcmp(optimized[i].unit, original[j].unit) || optimized[i].block_size != original[j].block_size)
+               continue;
+
+            if(original[j].msamples_per_second<=0.0 || optimized[i].msamples_per_second<=0.0)
+                break;
+
+            speedup = optimized[i].msamples_per_second / original[j].msamples_per_second;
+            printf("%-24s block %5d: %10.3f -> %10.3f Msamples/s (%5.2fx)%s\n",
+                optimized[i].unit, optimized[i].block_size,
+                original[j].msamples_per_second, optimized[i].msamples_per_second, speedup,
+                speedup < 1.0 + threshold ? "  NO GAIN" : "");
+            if(speedup < 1.0 + threshold)
+                failures++;
+            break;
+        }
+    }
+
+    free(original);
+    free(optimized);
+    return failures;
+}
+
+
+// time every unit at every block size, writing JSON to f
+static void run_all(FILE *f, double duration, const char *only_unit)
+{
+    DSPResult result;
+    int u, b, first;
+
+    fprintf(f, "{\n\"version\": \"%s\",\n\"sample_rate\": %d,\n\"optimized\": %d,\n\"cycles\": %d,\n\"results\": [\n",
+        OPENGRAIN_VERSION_STRING, BENCH_SAMPLE_RATE, OPENGRAIN_OPTIMIZED, read_cycles()!=0);
+
+    first = 1;
+    for(u=0;units[u].name;u++)
+    {
+        if(only_unit && strcmp(only_unit, units[u].name))
+            continue;
+        for(b=0;b<N_BLOCK_SIZES;b++)
+        {
+            if(!run_unit(&units[u], block_sizes[b], duration, &result))
+            {
+                fprintf(stderr, "%s: could not be set up, skipped\n", units[u].name);
+                break;
+            }
+            // the separator goes on the end of the previous line
+            if(!first)
+                fprintf(f, ",\n");
+            write_result(f, &result);
+            fflush(f);
+            fprintf(stderr, "%s block=%d: %.2f cycles/sample, %.2f Msamples/s\n",
+                result.unit, result.block_size, result.cycles_per_sample, result.msamples_per_second);
+            first = 0;
+        }
+    }
+    fprintf(f, "\n]\n}\n");
+}
+
+
+int main(int argc, char **argv)
+{
+    FILE *f;
+    double duration, threshold;
+    const char *out_path, *only_unit;
+    int i, failures;
+
+    duration = BENCH_DEFAULT_DURATION;
+    threshold = BENCH_DEFAULT_THRESHOLD;
+    out_path = NULL;
+    only_unit = NULL;
+
+    // comparison mode
+    if(argc>=4 && !strcmp(argv[1], "--compare"))
+    {
+        if(argc>=6 && !strcmp(argv[4], "-t"))
+            threshold = atof(argv[5]);
+        failures = compare_runs(argv[2], argv[3], threshold);
+        if(failures<0)
+            return 2;
+        printf("%d unit(s) not sped up by more than %.0f%%\n", failures, threshold*100.0);
+        return failures>0 ? 1 : 0;
+    }
+
+    for(i=1;i<argc-1;i++)
+    {
+        if(!strcmp(argv[i], "-o"))
+            out_path = argv[++i];
+        else if(!strcmp(argv[i], "-d"))
+            duration = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-u"))
+            only_unit = argv[++i];
+        else if(!strcmp(argv[i], "-h"))
+            hrtf_path = argv[++i];
+    }
+
+    f = stdout;
+    if(out_path)
+    {
+        f = fopen(out_path, "w");
+        if(!f)
+        {
+            fprintf(stderr, "Could not open %s for writing\n", out_path);
+            return 2;
+        }
+    }
+
+    run_all(f, duration, only_unit);
+
+    if(f!=stdout)
+        fclose(f);
+    return 0;
+}
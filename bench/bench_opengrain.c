@@ -0,0 +1,426 @@
+/**
+    @file bench_opengrain.c
+    @brief Scene-level benchmark. Renders each of the grain_tests.c scenes offline
+    (no audio device is opened) while sweeping grain density, buffer size and
+    number of streams, and writes the results as JSON. Two JSON files can be
+    compared to find performance regressions.
+
+    Usage:
+        bench_opengrain [-o results.json] [-d seconds] [-s scene]
+        bench_opengrain --compare baseline.json new.json [-t threshold]
+
+    Run from the build directory, so the relative paths used by the scenes
+    (e.g. ../hrtf and ../samples) can be found.
+
+    On POSIX systems each configuration is rendered in its own child process,
+    so peak_memory_kb is the peak resident size for that configuration alone
+    rather than a running maximum over the sweep.
+
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "audio.h"
+#include "grain_stream.h"
+#include "grainmixer.h"
+#include "grain_tests.h"
+#include "stats.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define BENCH_SAMPLE_RATE 44100
+#define BENCH_DEFAULT_DURATION 5.0
+#define BENCH_DEFAULT_THRESHOLD 0.1
+#define BENCH_MAX_RESULTS 1024
+#define BENCH_MAX_NAME 64
+
+// extra setup applied after the source has been added
+#define SCENE_PLAIN 0
+#define SCENE_HRTF 1
+#define SCENE_CROSS_DELAY 2
+
+typedef void (*SceneFunction)(GrainStream *stream);
+
+typedef struct Scene
+{
+    const char *name;
+    SceneFunction source;
+    int extra;
+} Scene;
+
+typedef struct BenchResult
+{
+    char scene[BENCH_MAX_NAME];
+    int density;
+    int buffer_size;
+    int streams;
+    double ns_per_grain_sample;
+    double realtime_factor;
+    long peak_memory_kb;
+} BenchResult;
+
+
+static Scene scenes[] =
+{
+    {"sinegrain", test_sinegrain, SCENE_PLAIN},
+    {"noisegrain", test_noisegrain, SCENE_PLAIN},
+    {"impulsegrain", test_impulsegrain, SCENE_PLAIN},
+    {"fmgrain", test_fmgrain, SCENE_PLAIN},
+    {"analoggrain", test_analoggrain, SCENE_PLAIN},
+    {"dsfgrain", test_dsfgrain, SCENE_PLAIN},
+    {"wavegrain", test_wavegrain, SCENE_PLAIN},
+    {"glissgrain", test_glissgrain, SCENE_PLAIN},
+    {"padsyngrain", test_padsyngrain, SCENE_PLAIN},
+    {"pluckgrain", test_pluckgrain, SCENE_PLAIN},
+    {"multisinegrain", test_multisinegrain, SCENE_PLAIN},
+    {"voicegrain", test_voicegrain, SCENE_PLAIN},
+    {"hrtf_mode", test_sinegrain, SCENE_HRTF},
+    {"cross_delay", test_sinegrain, SCENE_CROSS_DELAY},
+    {NULL, NULL, 0}
+};
+
+// the sweep
+static int densities[] = {10, 100, 1000};
+static int buffer_sizes[] = {64, 256, 1024};
+static int stream_counts[] = {1, 4};
+
+#define N_DENSITIES (sizeof(densities)/sizeof(densities[0]))
+#define N_BUFFER_SIZES (sizeof(buffer_sizes)/sizeof(buffer_sizes[0]))
+#define N_STREAM_COUNTS (sizeof(stream_counts)/sizeof(stream_counts[0]))
+
+
+// peak resident memory of this process, in kilobytes (only meaningful
+// inside the child that run_scene_isolated() forks for one configuration)
+static long peak_memory_kb(void)
+{
+#ifndef _WIN32
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+#else
+    return 0;
+#endif
+}
+
+
+// render one scene with the given settings, and fill in the result
+static void run_scene(Scene *scene, int density, int buffer_size, int n_streams, double duration, BenchResult *result)
+{
+    AudioState prototype, *state;
+    GrainMixer *mixer;
+    GrainStream **streams;
+    Buffer **channels;
+    double start, elapsed, grain_samples;
+    int i, n_blocks;
+
+    prototype.sample_rate = BENCH_SAMPLE_RATE;
+    prototype.frames_per_buffer = buffer_size;
+    prototype.n_channels = 2;
+    prototype.n_input_channels = 0;
+    prototype.input_channel = 0;
+    prototype.in_device = 0;
+    prototype.out_device = 0;
+    prototype.latency = 0.0;
+    // enough grains that none are dropped at the highest density
+    prototype.max_grains = 256 + density;
+    prototype.max_active_grains = 0;
+    state = init_audio_state(&prototype);
+
+    mixer = create_mixer();
+    test_default_mixer_settings(mixer);
+    // always measure full quality synthesis
+    disable_lod_mixer(mixer);
+
+    streams = malloc(sizeof(*streams) * n_streams);
+    for(i=0;i<n_streams;i++)
+    {
+        streams[i] = create_stream(2);
+        scene->source(streams[i]);
+        test_default_grain_model(streams[i]);
+        set_constant_distribution(get_grain_model_stream(streams[i])->rate, density);
+        if(scene->extra==SCENE_HRTF)
+            test_hrtf_mode(streams[i]);
+        if(scene->extra==SCENE_CROSS_DELAY)
+            test_cross_delay(streams[i]);
+        add_stream(mixer, streams[i]);
+    }
+
+    channels = create_planar_buffers(get_n_channels_mixer(mixer), buffer_size);
+
+    // render a short warm up, so the grain population is steady
+    n_blocks = 0.5 * BENCH_SAMPLE_RATE / buffer_size;
+    for(i=0;i<n_blocks;i++)
+        grain_mix(mixer, channels);
+
+    n_blocks = duration * BENCH_SAMPLE_RATE / buffer_size;
+    grain_samples = 0.0;
+    start = get_time_stats();
+    for(i=0;i<n_blocks;i++)
+    {
+        start_block_stats(mixer->stats);
+        grain_mix(mixer, channels);
+        end_block_stats(mixer->stats);
+        grain_samples += (double)mixer->stats->current.active_grains * buffer_size;
+    }
+    elapsed = get_time_stats() - start;
+
+    strncpy(result->scene, scene->name, BENCH_MAX_NAME-1);
+    result->scene[BENCH_MAX_NAME-1] = '\0';
+    result->density = density;
+    result->buffer_size = buffer_size;
+    result->streams = n_streams;
+    result->ns_per_grain_sample = grain_samples>0 ? elapsed * 1e9 / grain_samples : 0.0;
+    result->realtime_factor = elapsed>0 ? (n_blocks * buffer_size / (double)BENCH_SAMPLE_RATE) / elapsed : 0.0;
+    result->peak_memory_kb = peak_memory_kb();
+
+    // clean up
+    for(i=0;i<n_streams;i++)
+    {
+        remove_stream(mixer, streams[i]);
+        destroy_stream(streams[i]);
+    }
+    free(streams);
+    destroy_planar_buffers(channels, get_n_channels_mixer(mixer));
+    destroy_mixer(mixer);
+    destroy_audio_state(state);
+}
+
+
+// render one scene in a child process, so that the memory figures of one
+// configuration don't carry over into the next. Falls back to rendering in
+// this process (with no memory figure) where fork() isn't available.
+// Returns 1 if the result was filled in.
+static int run_scene_isolated(Scene *scene, int density, int buffer_size, int n_streams, double duration, BenchResult *result)
+{
+#ifndef _WIN32
+    int fds[2], status;
+    pid_t pid;
+    ssize_t n;
+
+    if(pipe(fds)!=0)
+    {
+        perror("pipe");
+        return 0;
+    }
+    // nothing buffered may be written twice
+    fflush(NULL);
+    pid = fork();
+    if(pid<0)
+    {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    if(pid==0)
+    {
+        close(fds[0]);
+        run_scene(scene, density, buffer_size, n_streams, duration, result);
+        n = write(fds[1], result, sizeof(*result));
+        close(fds[1]);
+        _exit(n==sizeof(*result) ? 0 : 1);
+    }
+    close(fds[1]);
+    n = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+    waitpid(pid, &status, 0);
+    if(n!=sizeof(*result) || !WIFEXITED(status) || WEXITSTATUS(status)!=0)
+    {
+        fprintf(stderr, "%s density=%d buffer=%d streams=%d: failed\n", scene->name, density, buffer_size, n_streams);
+        return 0;
+    }
+    return 1;
+#else
+    run_scene(scene, density, buffer_size, n_streams, duration, result);
+    return 1;
+#endif
+}
+
+
+// write one result as a single JSON line (compare_runs() relies on this layout)
+static void write_result(FILE *f, BenchResult *result)
+{
+    fprintf(f, "{\"scene\": \"%s\", \"density\": %d, \"buffer_size\": %d, \"streams\": %d, "
+               "\"ns_per_grain_sample\": %.4f, \"realtime_factor\": %.4f, \"peak_memory_kb\": %ld}",
+               result->scene, result->density, result->buffer_size, result->streams,
+               result->ns_per_grain_sample, result->realtime_factor, result->peak_memory_kb);
+}
+
+// read one line written by write_result; returns 1 if the line held a result
+static int read_result(const char *line, BenchResult *result)
+{
+    return sscanf(line, " {\"scene\": \"%63[^\"]\", \"density\": %d, \"buffer_size\": %d, \"streams\": %d, "
+               "\"ns_per_grain_sample\": %lf, \"realtime_factor\": %lf, \"peak_memory_kb\": %ld}",
+               result->scene, &result->density, &result->buffer_size, &result->streams,
+               &result->ns_per_grain_sample, &result->realtime_factor, &result->peak_memory_kb) == 7;
+}
+
+
+// load all the results from a JSON file; returns the number read, or -1 on failure
+static int load_results(const char *path, BenchResult *results, int max_results)
+{
+    FILE *f;
+    char line[1024];
+    int n;
+
+    f = fopen(path, "r");
+    if(!f)
+    {
+        fprintf(stderr, "Could not open %s\n", path);
+        return -1;
+    }
+    n = 0;
+    while(n<max_results && fgets(line, sizeof(line), f))
+    {
+        if(read_result(line, &results[n]))
+            n++;
+    }
+    fclose(f);
+    return n;
+}
+
+
+// compare two runs, and report any configuration which got slower by more than threshold
+// returns the number of regressions found
+static int compare_runs(const char *baseline_path, const char *new_path, double threshold)
+{
+    BenchResult *baseline, *current;
+    int n_baseline, n_current, i, j, regressions;
+    double change;
+
+    baseline = malloc(sizeof(*baseline) * BENCH_MAX_RESULTS);
+    current = malloc(sizeof(*current) * BENCH_MAX_RESULTS);
+    n_baseline = load_results(baseline_path, baseline, BENCH_MAX_RESULTS);
+    n_current = load_results(new_path, current, BENCH_MAX_RESULTS);
+    regressions = 0;
+
+    if(n_baseline<0 || n_current<0)
+        regressions = -1;
+
+    for(i=0;i<n_current;i++)
+    {
+        for(j=0;j<n_baseline;j++)
+        {
+            if(strcmp(current[i].scene, baseline[j].scene) || current[i].density != baseline[j].density ||
+               current[i].buffer_size != baseline[j].buffer_size || current[i].streams != baseline[j].streams)
+               continue;
+
+            if(baseline[j].ns_per_grain_sample<=0.0 || current[i].ns_per_grain_sample<=0.0)
+                break;
+
+            change = current[i].ns_per_grain_sample / baseline[j].ns_per_grain_sample - 1.0;
+            printf("%-16s density %5d buffer %5d streams %2d: %9.3f -> %9.3f ns/grain-sample (%+6.1f%%)%s\n",
+                current[i].scene, current[i].density, current[i].buffer_size, current[i].streams,
+                baseline[j].ns_per_grain_sample, current[i].ns_per_grain_sample, change*100.0,
+                change > threshold ? "  REGRESSION" : "");
+            if(change > threshold)
+                regressions++;
+            break;
+        }
+    }
+
+    free(baseline);
+    free(current);
+    return regressions;
+}
+
+
+// run the full sweep, writing JSON to f
+static void run_sweep(FILE *f, double duration, const char *only_scene)
+{
+    BenchResult result;
+    int s, d, b, c, first;
+
+    fprintf(f, "{\n\"version\": \"%s\",\n\"sample_rate\": %d,\n\"duration\": %.2f,\n\"results\": [\n",
+        OPENGRAIN_VERSION_STRING, BENCH_SAMPLE_RATE, duration);
+
+    first = 1;
+    for(s=0;scenes[s].name;s++)
+    {
+        if(only_scene && strcmp(only_scene, scenes[s].name))
+            continue;
+        for(d=0;d<N_DENSITIES;d++)
+            for(b=0;b<N_BUFFER_SIZES;b++)
+                for(c=0;c<N_STREAM_COUNTS;c++)
+                {
+                    if(!run_scene_isolated(&scenes[s], densities[d], buffer_sizes[b], stream_counts[c], duration, &result))
+                        continue;
+                    // the separator goes on the end of the previous line
+                    if(!first)
+                        fprintf(f, ",\n");
+                    write_result(f, &result);
+                    fflush(f);
+                    fprintf(stderr, "%s density=%d buffer=%d streams=%d: %.3f ns/grain-sample, %.1fx realtime\n",
+                        result.scene, result.density, result.buffer_size, result.streams,
+                        result.ns_per_grain_sample, result.realtime_factor);
+                    first = 0;
+                }
+    }
+    fprintf(f, "\n]\n}\n");
+}
+
+
+int main(int argc, char **argv)
+{
+    FILE *f;
+    double duration, threshold;
+    const char *out_path, *only_scene;
+    int i, regressions;
+
+    duration = BENCH_DEFAULT_DURATION;
+    threshold = BENCH_DEFAULT_THRESHOLD;
+    out_path = NULL;
+    only_scene = NULL;
+
+    // comparison mode
+    if(argc>=4 && !strcmp(argv[1], "--compare"))
+    {
+        if(argc>=6 && !strcmp(argv[4], "-t"))
+            threshold = atof(argv[5]);
+        regressions = compare_runs(argv[2], argv[3], threshold);
+        if(regressions<0)
+            return 2;
+        printf("%d regression(s) above %.0f%%\n", regressions, threshold*100.0);
+        return regressions>0 ? 1 : 0;
+    }
+
+    for(i=1;i<argc-1;i++)
+    {
+        if(!strcmp(argv[i], "-o"))
+            out_path = argv[++i];
+        else if(!strcmp(argv[i], "-d"))
+            duration = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-s"))
+            only_scene = argv[++i];
+    }
+
+    f = stdout;
+    if(out_path)
+    {
+        f = fopen(out_path, "w");
+        if(!f)
+        {
+            fprintf(stderr, "Could not open %s for writing\n", out_path);
+            return 2;
+        }
+    }
+
+    run_sweep(f, duration, only_scene);
+
+    if(f!=stdout)
+        fclose(f);
+    return 0;
+}
@@ -1,7 +1,129 @@
 %module opengrain
 %{
 #include "gr.h"
+#include <string.h>
+
+/* Check that a buffer holds single items of the given struct code (e.g. 'f'), in native size */
+static int check_format(Py_buffer *view, char code, int itemsize)
+{
+    const char *format;
+    format = view->format ? view->format : "B";
+    if(*format=='@' || *format=='=' || *format=='<')
+        format++;
+    return format[0]==code && format[1]=='\0' && view->itemsize==itemsize;
+}
+
+
+/* render(buffer, frames=-1): synthesise audio into a writable float32 buffer (e.g. a numpy
+   array or an array.array('f')), as interleaved output channels. The GIL is released while
+   rendering. Fills the buffer if frames is not given. Returns the number of frames rendered. */
+static PyObject *py_render(PyObject *self, PyObject *args)
+{
+    PyObject *object;
+    Py_buffer view;
+    int frames, max_frames, channels, rendered;
+
+    frames = -1;
+    if(!PyArg_ParseTuple(args, "O|i:render", &object, &frames))
+        return NULL;
+    if(PyObject_GetBuffer(object, &view, PyBUF_WRITABLE | PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) < 0)
+        return NULL;
+    if(!check_format(&view, 'f', sizeof(float)))
+    {
+        PyBuffer_Release(&view);
+        PyErr_SetString(PyExc_TypeError, "render() needs a buffer of float32");
+        return NULL;
+    }
+
+    channels = grGetAudioParameteri(GR_OUTPUT_CHANNELS);
+    max_frames = channels>0 ? (int)(view.len / (sizeof(float) * channels)) : 0;
+    if(frames<0)
+        frames = max_frames;
+    if(frames>max_frames)
+    {
+        PyBuffer_Release(&view);
+        PyErr_Format(PyExc_ValueError, "render() buffer only has space for %d frames", max_frames);
+        return NULL;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    rendered = grRender((float *)view.buf, frames);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+
+    if(rendered<0)
+    {
+        PyErr_SetString(PyExc_RuntimeError, grGetLastErrorMessage());
+        return NULL;
+    }
+    return PyLong_FromLong(rendered);
+}
+
+
+/* stream_parameters(stream, parameters, values): set many parameters of a stream at once.
+   parameters is a buffer of int32 or int64 GR_STREAM_* codes, and values a buffer of
+   float32 or float64 of the same length. Returns the number of parameters set. */
+static PyObject *py_stream_parameters(PyObject *self, PyObject *args)
+{
+    PyObject *parameter_object, *value_object;
+    Py_buffer parameter_view, value_view;
+    int stream, n, i, set;
+    int *parameters;
+    float *values;
+
+    if(!PyArg_ParseTuple(args, "iOO:stream_parameters", &stream, &parameter_object, &value_object))
+        return NULL;
+    if(PyObject_GetBuffer(parameter_object, &parameter_view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) < 0)
+        return NULL;
+    if(PyObject_GetBuffer(value_object, &value_view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) < 0)
+    {
+        PyBuffer_Release(&parameter_view);
+        return NULL;
+    }
+
+    n = 0;
+    parameters = NULL;
+    values = NULL;
+    if(!(check_format(&parameter_view, 'i', 4) || check_format(&parameter_view, 'l', 4) ||
+         check_format(&parameter_view, 'l', 8) || check_format(&parameter_view, 'q', 8)) ||
+       !(check_format(&value_view, 'f', 4) || check_format(&value_view, 'd', 8)))
+        PyErr_SetString(PyExc_TypeError, "stream_parameters() needs int32/int64 parameters and float32/float64 values");
+    else if(parameter_view.len / parameter_view.itemsize != value_view.len / value_view.itemsize)
+        PyErr_SetString(PyExc_ValueError, "stream_parameters() needs as many values as parameters");
+    else
+    {
+        // convert to the types the api takes
+        n = (int)(parameter_view.len / parameter_view.itemsize);
+        parameters = malloc(sizeof(*parameters) * (n+1));
+        values = malloc(sizeof(*values) * (n+1));
+        for(i=0;i<n;i++)
+        {
+            if(parameter_view.itemsize==4)
+                parameters[i] = ((int *)parameter_view.buf)[i];
+            else
+                parameters[i] = (int)((long long *)parameter_view.buf)[i];
+            if(value_view.itemsize==4)
+                values[i] = ((float *)value_view.buf)[i];
+            else
+                values[i] = (float)((double *)value_view.buf)[i];
+        }
+    }
+    PyBuffer_Release(&parameter_view);
+    PyBuffer_Release(&value_view);
+    if(!parameters)
+        return NULL;
+
+    set = grStreamParameterfv(stream, n, parameters, values);
+    free(parameters);
+    free(values);
+    return PyLong_FromLong(set);
+}
 %}
 
+/* the pointer versions are wrapped by render() and stream_parameters() */
+%ignore grRender;
+%ignore grStreamParameterfv;
+%native(render) PyObject *py_render(PyObject *self, PyObject *args);
+%native(stream_parameters) PyObject *py_stream_parameters(PyObject *self, PyObject *args);
 
-%include "gr.h"
\ No newline at end of file
+%include "gr.h"
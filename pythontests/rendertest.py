@@ -0,0 +1,23 @@
+import sys
+sys.path.append("..\\build\\python")
+from opengrain import *
+
+# render offline, straight into an array (numpy if it is there)
+try:
+    import numpy
+    buffer = numpy.zeros((44100, 2), dtype=numpy.float32)
+    parameters = numpy.array([GR_STREAM_RATE, GR_STREAM_DURATION], dtype=numpy.int32)
+    values = numpy.array([50.0, 0.05], dtype=numpy.float32)
+except ImportError:
+    import array
+    buffer = array.array('f', [0.0]) * (44100 * 2)
+    parameters = array.array('i', [GR_STREAM_RATE, GR_STREAM_DURATION])
+    values = array.array('f', [50.0, 0.05])
+
+grInit()
+grInitAudio()
+print("%d parameters set" % stream_parameters(0, parameters, values))
+print("%d frames rendered" % render(buffer))
+print("%d frames rendered" % render(buffer, 1000))
+grShutdownAudio()
+grShutdown()
@@ -0,0 +1,163 @@
+/**
+    @file alloc_tripwire.c
+    @brief Debugging aid which reports any memory allocation made inside the
+    audio callback. On glibc, malloc/calloc/realloc/free are replaced by
+    versions which check whether the calling thread is inside the callback
+    and, if so, print a backtrace to stderr before passing the call through
+    to the real allocator.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include "alloc_tripwire.h"
+
+#ifdef USE_ALLOC_TRIPWIRE
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __GLIBC__
+#include <unistd.h>
+#include <execinfo.h>
+
+// the real allocator
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+#endif
+
+// true while this thread is running the audio callback
+static __thread int in_realtime_section = 0;
+
+// true while a report is being written (so the report can't trip the wire)
+static __thread int in_report = 0;
+
+// set once the tripwire is ready to report
+static int armed = 0;
+
+// total number of allocations made inside the callback
+static volatile int violations = 0;
+
+
+// write a string to stderr without allocating
+static void write_string_alloc_tripwire(const char *str)
+{
+#ifdef __GLIBC__
+    if(write(2, str, strlen(str))<0)
+        return;
+#endif
+}
+
+// write an unsigned number to stderr without allocating
+static void write_number_alloc_tripwire(unsigned long n)
+{
+    char digits[32];
+    int i;
+    i = sizeof(digits)-1;
+    digits[i] = '\0';
+    do
+    {
+        digits[--i] = '0' + (n % 10);
+        n /= 10;
+    } while(n && i>0);
+    write_string_alloc_tripwire(&digits[i]);
+}
+
+
+// record a violation, and print where it came from
+static void report_alloc_tripwire(const char *function, size_t size)
+{
+#ifdef __GLIBC__
+    void *frames[ALLOC_TRIPWIRE_BACKTRACE_DEPTH];
+    int n_frames;
+#endif
+
+    if(!armed || !in_realtime_section || in_report)
+        return;
+
+    in_report = 1;
+    violations++;
+
+    // only give details of the first few, to avoid flooding the output
+    if(violations <= ALLOC_TRIPWIRE_MAX_REPORTS)
+    {
+        write_string_alloc_tripwire("OpenGrain: ");
+        write_string_alloc_tripwire(function);
+        write_string_alloc_tripwire("(");
+        write_number_alloc_tripwire(size);
+        write_string_alloc_tripwire(") called in the audio callback\n");
+#ifdef __GLIBC__
+        n_frames = backtrace(frames, ALLOC_TRIPWIRE_BACKTRACE_DEPTH);
+        backtrace_symbols_fd(frames, n_frames, 2);
+#endif
+    }
+    in_report = 0;
+}
+
+
+// start watching for allocations. backtrace() may itself allocate the first time
+// it is called (to load the unwinder), so call it once here, outside the callback
+void arm_alloc_tripwire(void)
+{
+#ifdef __GLIBC__
+    void *frames[1];
+    backtrace(frames, 1);
+#endif
+    armed = 1;
+}
+
+// mark the start of the audio callback on this thread
+void enter_realtime_alloc_tripwire(void)
+{
+    in_realtime_section = 1;
+}
+
+// mark the end of the audio callback on this thread
+void leave_realtime_alloc_tripwire(void)
+{
+    in_realtime_section = 0;
+}
+
+// return the number of allocations made in the callback so far
+int get_violations_alloc_tripwire(void)
+{
+    return violations;
+}
+
+
+#ifdef __GLIBC__
+
+void *malloc(size_t size)
+{
+    report_alloc_tripwire("malloc", size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    report_alloc_tripwire("calloc", n*size);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    report_alloc_tripwire("realloc", size);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    if(ptr)
+        report_alloc_tripwire("free", 0);
+    __libc_free(ptr);
+}
+
+#endif
+
+#endif
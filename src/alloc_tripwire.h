@@ -0,0 +1,38 @@
+/**
+    @file alloc_tripwire.h
+    @brief Debugging aid which reports any memory allocation made inside the
+    audio callback, with a backtrace showing where it came from. Only active
+    when built with OPENGRAIN_ALLOC_TRIPWIRE (which defines USE_ALLOC_TRIPWIRE);
+    otherwise all of these calls compile away to nothing.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#ifndef __ALLOC_TRIPWIRE_H__
+#define __ALLOC_TRIPWIRE_H__
+#include "opengrain.h"
+
+// maximum number of violations that get a full backtrace printed
+#define ALLOC_TRIPWIRE_MAX_REPORTS 16
+
+// maximum depth of the reported backtrace
+#define ALLOC_TRIPWIRE_BACKTRACE_DEPTH 32
+
+#ifdef USE_ALLOC_TRIPWIRE
+void arm_alloc_tripwire(void);
+void enter_realtime_alloc_tripwire(void);
+void leave_realtime_alloc_tripwire(void);
+int get_violations_alloc_tripwire(void);
+#else
+#define arm_alloc_tripwire()
+#define enter_realtime_alloc_tripwire()
+#define leave_realtime_alloc_tripwire()
+#define get_violations_alloc_tripwire() 0
+#endif
+
+#endif
@@ -0,0 +1,328 @@
+/**
+    @file ambisonic.c
+    @brief First to third order ambisonic bus. Sources are encoded into B-format
+    (ACN channel order, SN3D normalisation) with spherical harmonic gains, and the
+    bus is decoded once per block, either to a speaker layout (by panning a dense
+    set of virtual speakers onto it with VBAP) or to binaural output (through filters
+    built from an HRTF model's impulses).
+
+    Both decoders sample the sphere with AMBISONIC_VIRTUAL_SPEAKERS evenly spread
+    directions and weight the orders for the tightest energy spread (max-rE). The
+    speaker decoder is normalised so that a source has unit power on average, like
+    the stereo panner; the binaural one keeps the level of the HRTF impulses.
+    Designing the decoder is slow, and done when the layout or HRTF model is set.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include "ambisonic.h"
+#include <string.h>
+
+
+/** Compute the spherical harmonic gains for a direction.
+    @arg order Ambisonic order (1-3)
+    @arg x,y,z Direction (need not be normalised; a zero vector encodes to the omni component only)
+    @arg gains (order+1)^2 gains, in ACN order, SN3D normalised
+*/
+void encode_ambisonic(int order, float x, float y, float z, float *gains)
+{
+    float r, x2, y2, z2;
+
+    r = sqrt(x*x + y*y + z*z);
+    if(r<1e-9)
+    {
+        memset(gains, 0, sizeof(*gains) * (order+1)*(order+1));
+        gains[0] = 1.0;
+        return;
+    }
+    x /= r; y /= r; z /= r;
+    x2 = x*x; y2 = y*y; z2 = z*z;
+
+    gains[0] = 1.0;
+    gains[1] = y;
+    gains[2] = z;
+    gains[3] = x;
+    if(order<2)
+        return;
+
+    gains[4] = 1.7320508f * x * y;
+    gains[5] = 1.7320508f * y * z;
+    gains[6] = 0.5f * (3*z2 - 1);
+    gains[7] = 1.7320508f * x * z;
+    gains[8] = 0.8660254f * (x2 - y2);
+    if(order<3)
+        return;
+
+    gains[9] = 0.7905694f * y * (3*x2 - y2);
+    gains[10] = 3.8729833f * x * y * z;
+    gains[11] = 0.6123724f * y * (5*z2 - 1);
+    gains[12] = 0.5f * z * (5*z2 - 3);
+    gains[13] = 0.6123724f * x * (5*z2 - 1);
+    gains[14] = 1.9364917f * z * (x2 - y2);
+    gains[15] = 0.7905694f * x * (x2 - 3*y2);
+}
+
+
+// order (degree) of an ACN component
+static int component_order_ambisonic(int c)
+{
+    return (int)floor(sqrt((double)c));
+}
+
+// the i'th of n directions spread evenly over the sphere (a Fibonacci lattice)
+static void virtual_speaker_ambisonic(int i, int n, float *v)
+{
+    float z, r, phi;
+    z = 1.0 - (2.0*i + 1.0) / n;
+    r = sqrt(1.0 - z*z);
+    phi = i * M_PI * (3.0 - sqrt(5.0));
+    v[0] = r * cos(phi);
+    v[1] = r * sin(phi);
+    v[2] = z;
+}
+
+// the decoding weights for a virtual speaker: sampling decoder, with max-rE order weighting
+static void virtual_weights_ambisonic(AmbisonicBus *bus, float *v, float *weights)
+{
+    float re, p[AMBISONIC_MAX_ORDER+1];
+    int c, l;
+
+    // Legendre polynomials at the max-rE angle
+    re = cos(TO_RADIANS(137.9 / (bus->order + 1.51)));
+    p[0] = 1.0;
+    p[1] = re;
+    p[2] = 0.5 * (3*re*re - 1);
+    p[3] = 0.5 * (5*re*re*re - 3*re);
+
+    encode_ambisonic(bus->order, v[0], v[1], v[2], weights);
+    for(c=0;c<bus->n_components;c++)
+    {
+        l = component_order_ambisonic(c);
+        weights[c] *= p[l] * (2*l + 1) / (float)AMBISONIC_VIRTUAL_SPEAKERS;
+    }
+}
+
+// the average power a decoder with these gains gives a source (SN3D harmonics have mean square 1/(2l+1))
+static double power_ambisonic(AmbisonicBus *bus, float *gains, int n_rows)
+{
+    double power;
+    int i, c;
+    power = 0.0;
+    for(i=0;i<n_rows;i++)
+        for(c=0;c<bus->n_components;c++)
+            power += gains[i*bus->n_components+c] * gains[i*bus->n_components+c] / (2*component_order_ambisonic(c) + 1);
+    return power;
+}
+
+
+// get rid of any decoder
+static void destroy_decoder_ambisonic_bus(AmbisonicBus *bus)
+{
+    int c;
+    if(bus->binaural)
+    {
+        for(c=0;c<bus->n_components;c++)
+        {
+            destroy_convolver(bus->left[c]);
+            destroy_convolver(bus->right[c]);
+        }
+        destroy_buffer(bus->temp);
+    }
+    free(bus->decoder);
+    bus->decoder = NULL;
+    bus->binaural = 0;
+    bus->n_outputs = 0;
+}
+
+
+/** Create an ambisonic bus, with no decoder.
+    @arg order Ambisonic order; 1 (4 channels), 2 (9 channels) or 3 (16 channels)
+    @return The new bus
+*/
+AmbisonicBus *create_ambisonic_bus(int order)
+{
+    AmbisonicBus *bus;
+    int c;
+    bus = malloc(sizeof(*bus));
+    bus->order = MAX(1, MIN(AMBISONIC_MAX_ORDER, order));
+    bus->n_components = (bus->order+1) * (bus->order+1);
+    for(c=0;c<bus->n_components;c++)
+    {
+        bus->channels[c] = create_buffer(GLOBAL_STATE.frames_per_buffer);
+        zero_buffer(bus->channels[c]);
+    }
+    bus->decoder = NULL;
+    bus->binaural = 0;
+    bus->n_outputs = 0;
+    return bus;
+}
+
+
+// destroy an ambisonic bus
+void destroy_ambisonic_bus(AmbisonicBus *bus)
+{
+    int c;
+    destroy_decoder_ambisonic_bus(bus);
+    for(c=0;c<bus->n_components;c++)
+        destroy_buffer(bus->channels[c]);
+    free(bus);
+}
+
+
+/** Decode to a speaker layout. The virtual speakers are panned onto the real ones with
+    VBAP, so irregular layouts (and ones covering only part of the sphere) work.
+    @arg bus The bus
+    @arg speaker_locations List of Location3D* speaker positions, relative to the listener
+*/
+void set_speakers_ambisonic_bus(AmbisonicBus *bus, list_t *speaker_locations)
+{
+    VBAPTable *vbap;
+    VBAPGain gain;
+    float v[3], weights[AMBISONIC_MAX_COMPONENTS];
+    double power;
+    int i, k, c, n;
+
+    destroy_decoder_ambisonic_bus(bus);
+    n = bus->n_components;
+    bus->n_outputs = list_size(speaker_locations);
+    bus->decoder = calloc(MAX(1, bus->n_outputs) * n, sizeof(*bus->decoder));
+    if(bus->n_outputs==0)
+        return;
+
+    vbap = create_vbap_table(speaker_locations);
+    for(i=0;i<AMBISONIC_VIRTUAL_SPEAKERS;i++)
+    {
+        virtual_speaker_ambisonic(i, AMBISONIC_VIRTUAL_SPEAKERS, v);
+        virtual_weights_ambisonic(bus, v, weights);
+        get_gains_vbap_table(vbap, TO_DEGREES(atan2(v[1], v[0])), TO_DEGREES(asin(v[2])), &gain);
+        for(k=0;k<3;k++)
+            for(c=0;c<n;c++)
+                bus->decoder[gain.speakers[k]*n + c] += gain.gains[k] * weights[c];
+    }
+    destroy_vbap_table(vbap);
+
+    power = power_ambisonic(bus, bus->decoder, bus->n_outputs);
+    if(power>0)
+        for(i=0;i<bus->n_outputs*n;i++)
+            bus->decoder[i] /= sqrt(power);
+}
+
+
+/** Decode to binaural (two channel) output, with one pair of filters per component
+    built from the HRTF impulses nearest each virtual speaker.
+    @arg bus The bus
+    @arg model The HRTF model
+*/
+void set_binaural_ambisonic_bus(AmbisonicBus *bus, HRTFModel *model)
+{
+    HRTFImpulse *impulse;
+    Buffer *left[AMBISONIC_MAX_COMPONENTS], *right[AMBISONIC_MAX_COMPONENTS];
+    float v[3], weights[AMBISONIC_MAX_COMPONENTS];
+    int i, c, n;
+
+    destroy_decoder_ambisonic_bus(bus);
+    n = bus->n_components;
+    for(c=0;c<n;c++)
+    {
+        left[c] = create_buffer(get_hrtf_buffer_size(model));
+        right[c] = create_buffer(get_hrtf_buffer_size(model));
+        zero_buffer(left[c]);
+        zero_buffer(right[c]);
+    }
+
+    // each component's filter is the sum of the virtual speakers' impulses, weighted by their
+    // decoding gains (the impulses near a source add coherently, so this is not power normalised)
+    for(i=0;i<AMBISONIC_VIRTUAL_SPEAKERS;i++)
+    {
+        virtual_speaker_ambisonic(i, AMBISONIC_VIRTUAL_SPEAKERS, v);
+        virtual_weights_ambisonic(bus, v, weights);
+        impulse = get_hrtf(model, TO_DEGREES(atan2(v[1], v[0])), TO_DEGREES(asin(v[2])), 0);
+        if(!impulse)
+            continue;
+        for(c=0;c<n;c++)
+        {
+            mix_buffer(left[c], impulse->sound->left, weights[c]);
+            mix_buffer(right[c], impulse->sound->right, weights[c]);
+        }
+    }
+
+    for(c=0;c<n;c++)
+    {
+        bus->left[c] = create_convolver();
+        bus->right[c] = create_convolver();
+        set_impulse_convolver(bus->left[c], left[c]);
+        set_impulse_convolver(bus->right[c], right[c]);
+        destroy_buffer(left[c]);
+        destroy_buffer(right[c]);
+    }
+    bus->temp = create_buffer(GLOBAL_STATE.frames_per_buffer);
+    bus->binaural = 1;
+    bus->n_outputs = 2;
+}
+
+
+// number of channels the bus decodes to
+int get_n_outputs_ambisonic_bus(AmbisonicBus *bus)
+{
+    return bus->n_outputs;
+}
+
+
+// clear the bus, ready for the next block
+void zero_ambisonic_bus(AmbisonicBus *bus)
+{
+    int c;
+    for(c=0;c<bus->n_components;c++)
+        zero_buffer(bus->channels[c]);
+}
+
+
+/** Encode (part of) a block of a mono source into the bus.
+    @arg bus The bus
+    @arg gains The source's encoding gains, from encode_ambisonic()
+    @arg mono The source
+    @arg offset Where in the block the source starts
+    @arg len Number of samples to mix
+    @arg gain Overall gain
+*/
+void mix_ambisonic_bus(AmbisonicBus *bus, float *gains, Buffer *mono, int offset, int len, float gain)
+{
+    int c;
+    for(c=0;c<bus->n_components;c++)
+        mix_buffer_offset_weighted(bus->channels[c], mono, offset, len, gains[c] * gain);
+}
+
+
+/** Decode the block held in the bus, and mix it into the outputs.
+    @arg bus The bus
+    @arg outs get_n_outputs_ambisonic_bus() buffers (left and right, for binaural decoding)
+*/
+void decode_ambisonic_bus(AmbisonicBus *bus, Buffer **outs)
+{
+    int i, c;
+    float g;
+    if(bus->binaural)
+    {
+        for(c=0;c<bus->n_components;c++)
+        {
+            process_convolver(bus->left[c], bus->channels[c], bus->temp);
+            mix_buffer(outs[0], bus->temp, 1.0);
+            process_convolver(bus->right[c], bus->channels[c], bus->temp);
+            mix_buffer(outs[1], bus->temp, 1.0);
+        }
+        return;
+    }
+
+    for(i=0;i<bus->n_outputs;i++)
+        for(c=0;c<bus->n_components;c++)
+        {
+            g = bus->decoder[i*bus->n_components + c];
+            if(g!=0.0)
+                mix_buffer(outs[i], bus->channels[c], g);
+        }
+}
@@ -0,0 +1,74 @@
+/**
+    @file ambisonic.h
+    @brief First to third order ambisonic bus. Sources are encoded into B-format
+    (ACN channel order, SN3D normalisation) with spherical harmonic gains, and the
+    bus is decoded once per block, either to a speaker layout (by panning a dense
+    set of virtual speakers onto it with VBAP) or to binaural output (through filters
+    built from an HRTF model's impulses).
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#ifndef __AMBISONIC_H__
+#define __AMBISONIC_H__
+
+#include "audio.h"
+#include "location.h"
+#include "hrtf.h"
+#include "convolver.h"
+#include "vbap.h"
+
+#define AMBISONIC_MAX_ORDER 3
+#define AMBISONIC_MAX_COMPONENTS ((AMBISONIC_MAX_ORDER+1)*(AMBISONIC_MAX_ORDER+1))
+
+// number of virtual speakers (spread evenly over the sphere) the decoders are designed with
+#define AMBISONIC_VIRTUAL_SPEAKERS 240
+
+
+/** @struct AmbisonicEncoding
+    The gains a source is encoded with: spherical harmonics, scaled by the distance
+    attenuation, and the send to the reverb. */
+typedef struct AmbisonicEncoding
+{
+    float gains[AMBISONIC_MAX_COMPONENTS];
+    float reverb_gain;
+    int valid;
+} AmbisonicEncoding;
+
+
+/** @struct AmbisonicBus */
+typedef struct AmbisonicBus
+{
+    int order;
+    int n_components;
+    Buffer *channels[AMBISONIC_MAX_COMPONENTS];     // the B-format signal for this block
+
+    // speaker decoding: n_outputs rows of n_components gains
+    int n_outputs;
+    float *decoder;
+
+    // binaural decoding: one filter per component, per ear
+    int binaural;
+    Convolver *left[AMBISONIC_MAX_COMPONENTS];
+    Convolver *right[AMBISONIC_MAX_COMPONENTS];
+    Buffer *temp;
+} AmbisonicBus;
+
+
+void encode_ambisonic(int order, float x, float y, float z, float *gains);
+
+AmbisonicBus *create_ambisonic_bus(int order);
+void destroy_ambisonic_bus(AmbisonicBus *bus);
+void set_speakers_ambisonic_bus(AmbisonicBus *bus, list_t *speaker_locations);
+void set_binaural_ambisonic_bus(AmbisonicBus *bus, HRTFModel *model);
+int get_n_outputs_ambisonic_bus(AmbisonicBus *bus);
+void zero_ambisonic_bus(AmbisonicBus *bus);
+void mix_ambisonic_bus(AmbisonicBus *bus, float *gains, Buffer *mono, int offset, int len, float gain);
+void decode_ambisonic_bus(AmbisonicBus *bus, Buffer **outs);
+
+#endif
@@ -12,9 +12,12 @@
 #include "gr.h"
 #include "errors.h"
 #include "base_api.h"
+#include "audio_api.h"
 #include "../audio.h"
 #include "../sys_audio.h"
 #include "../output.h"
+#include "../alloc_tripwire.h"
+#include <string.h>
 
 
 /** 
@@ -22,7 +25,7 @@
     
     GR_SAMPLE_RATE      The output sample rate, in Hz. Default is 44100
     GR_INPUT_CHANNELS   The number of input channels to use. Default is 0.
-    GR_OUTPUT_CHANNELS  The number of output channels to use  (e.g. 2 for stereo). Default is 2.
+    GR_OUTPUT_CHANNELS  The number of output channels to use  (e.g. 2 for stereo, or one per speaker). Default is 2.
     GR_BUFFER_SIZE      Buffer size in samples. Smaller buffers are less efficient but allow smoother effects. Default size is 512.
                         Note that buffer size and latency are different things; buffer sizes can be smaller or larger than the 
                         underlying audio buffer.
@@ -32,6 +35,16 @@
                         GR_PUMP_THREAD (background thread pumps automatically), GR_PUMP_BLOCKING (blocks until synthesis
                         is complete) or GR_PUMP_CALLBACK (minimum latency
                         but may cause stability issues if synthesis takes a long time). Default is GR_PUMP_THREAD                      
+    GR_MAX_GRAINS       The number of grains each stream (and grain specifics each source) allocates in advance. 
+                        Grains triggered beyond this limit are dropped rather than allocated in the audio callback. Default is 256.
+                        When a stream reaches this limit, its least important grain is faded out to make room.
+    GR_MAX_ACTIVE_GRAINS The maximum number of grains playing at once over all streams. When it is reached the least
+                        important grains are faded out and replaced. 0 (the default) means no global limit. 
+                        Takes effect immediately if audio is running.
+    GR_DEVICE_SAMPLE_RATE The rate to run the audio device at, if it differs from GR_SAMPLE_RATE. Synthesis always runs at
+                        GR_SAMPLE_RATE; output (and input) is resampled to and from the device. 0 (the default) means the
+                        device runs at GR_SAMPLE_RATE.
+    GR_RESAMPLE_QUALITY Quality of the device rate conversion: GR_RESAMPLE_LOW, GR_RESAMPLE_MEDIUM (the default) or GR_RESAMPLE_HIGH.
    
     
 */    
@@ -60,6 +73,20 @@ void grAudioParameteri(int parameter, int value)
         case GR_OUTPUT_DEVICE:        
             gr_context->prototype->out_device = value;
             break;
+        case GR_MAX_GRAINS:
+            gr_context->prototype->max_grains = value;
+            break;
+        case GR_MAX_ACTIVE_GRAINS:
+            gr_context->prototype->max_active_grains = value;
+            if(gr_context->output_info)
+                set_max_grains_mixer(gr_context->output_info->mixer, value);
+            break;
+        case GR_DEVICE_SAMPLE_RATE:
+            gr_context->prototype->device_sample_rate = value;
+            break;
+        case GR_RESAMPLE_QUALITY:
+            gr_context->prototype->resample_quality = value;
+            break;
         default:
             grError(GR_ERROR_BAD_PARAMETER, "Invalid parameter code %d for querying in grAudioParameteri", parameter);
             return;
@@ -74,7 +101,7 @@ void grAudioParameteri(int parameter, int value)
     
     GR_SAMPLE_RATE      The output sample rate, in Hz. Default is 44100
     GR_INPUT_CHANNELS   The number of input channels to use. Default is 0.
-    GR_OUTPUT_CHANNELS  The number of output channels to use  (e.g. 2 for stereo). Default is 2.
+    GR_OUTPUT_CHANNELS  The number of output channels to use  (e.g. 2 for stereo, or one per speaker). Default is 2.
     GR_LATENCY          Desired latency in seconds. This value is not guaranteed to be acheived; use grGetAudioParameteri(GR_LATENCY)
                         to determine the actual latency. Default is 0.01 (10ms).
     GR_BUFFER_SIZE      Buffer size in samples. Smaller buffers are less efficient but allow smoother effects. Default size is 512.
@@ -93,6 +120,10 @@ void grAudioParameterf(int parameter, float value)
         case GR_OUTPUT_CHANNELS:
         case GR_BUFFER_SIZE:        
         case GR_PUMP_MODE:
+        case GR_MAX_GRAINS:
+        case GR_MAX_ACTIVE_GRAINS:
+        case GR_DEVICE_SAMPLE_RATE:
+        case GR_RESAMPLE_QUALITY:
             grAudioParameteri(parameter, value);   
             break;            
         case GR_LATENCY:
@@ -110,6 +141,8 @@ void grAudioParameterf(int parameter, float value)
     GR_N_DEVICES        Number of available devices. Use grAudioDeviceName(x) to get the device name for each device.
     GR_DEFAULT_INPUT_DEVICE        The ID of the default device for input.
     GR_DEFAULT_OUTPUT_DEVICE       The ID of the default device for output.
+    GR_CALLBACK_ALLOCATIONS        Number of memory allocations made inside the audio callback. Only counted when 
+                                   built with OPENGRAIN_ALLOC_TRIPWIRE; otherwise always 0.
     @return The value of the parameter
     @arg parameter The parameter to return.
 */
@@ -146,6 +179,21 @@ int grGetAudioParameteri(int parameter)
         case GR_N_DEVICES:
             return get_n_devices_sys_audio();
             break;
+        case GR_MAX_GRAINS:
+            return gr_context->prototype->max_grains;
+            break;
+        case GR_MAX_ACTIVE_GRAINS:
+            return gr_context->prototype->max_active_grains;
+            break;
+        case GR_DEVICE_SAMPLE_RATE:
+            return gr_context->prototype->device_sample_rate;
+            break;
+        case GR_RESAMPLE_QUALITY:
+            return gr_context->prototype->resample_quality;
+            break;
+        case GR_CALLBACK_ALLOCATIONS:
+            return get_violations_alloc_tripwire();
+            break;
         default:
             grError(GR_ERROR_BAD_PARAMETER, "Invalid parameter code %d for in grAudioParameteri", parameter);
             return 0;
@@ -175,6 +223,11 @@ int grGetAudioParameterf(int parameter)
         case GR_DEFAULT_OUTPUT_DEVICE:
         case GR_DEFAULT_INPUT_DEVICE:        
         case GR_PUMP_MODE:
+        case GR_MAX_GRAINS:
+        case GR_MAX_ACTIVE_GRAINS:
+        case GR_DEVICE_SAMPLE_RATE:
+        case GR_RESAMPLE_QUALITY:
+        case GR_CALLBACK_ALLOCATIONS:
             return (float) grGetAudioParameteri(parameter);    
         case GR_LATENCY:
             return gr_context->prototype->latency;
@@ -267,9 +320,18 @@ int grQueryAudioDevice(int device, int property, int value)
 void grInitAudio(void)
 {
     
+    // this context's engine, current on this thread
+    gr_context->state = create_audio_state(gr_context->prototype);
+    bind_audio_state(gr_context->state);
+    
     // open audio device
-    init_audio(gr_context->prototype, audio_callback_output_info, audio_finished_output_info, &gr_context->output_info);    
+    init_audio(gr_context->state, audio_callback_output_info, audio_finished_output_info, &gr_context->output_info);    
     gr_context->output_info = create_output_info(); 
+    apply_lod_audio_api();
+    
+    // nothing left over for grRender() yet
+    gr_context->render_block = malloc(sizeof(*gr_context->render_block) * GLOBAL_STATE.frames_per_buffer * GLOBAL_STATE.n_channels);
+    gr_context->render_position = GLOBAL_STATE.frames_per_buffer;
     
     // set up pumping            
         
@@ -280,14 +342,24 @@ void grInitAudio(void)
 */    
 void grStartAudio(void)
 {
-    start_audio();
+    if(!gr_context->state)
+    {
+        grError(GR_ERROR_AUDIO_NOT_INITIALISED, "grStartAudio() called before grInitAudio()");
+        return;
+    }
+    start_audio(gr_context->state);
 }
 
 /** Stops/pauses the audio playback. Playback can later be restared by calling grStartAudio() 
 */
 void grStopAudio(void)
 {
-    stop_audio();
+    if(!gr_context->state)
+    {
+        grError(GR_ERROR_AUDIO_NOT_INITIALISED, "grStopAudio() called before grInitAudio()");
+        return;
+    }
+    stop_audio(gr_context->state);
 }
 
 
@@ -297,8 +369,15 @@ void grStopAudio(void)
 */
 void grShutdownAudio(void)
 {
-    shutdown_audio();
+    if(!gr_context->state)
+        return;
+    shutdown_audio(gr_context->state);
     destroy_output_info(gr_context->output_info);
+    gr_context->output_info = NULL;
+    free(gr_context->render_block);
+    gr_context->render_block = NULL;
+    destroy_audio_state(gr_context->state);
+    gr_context->state = NULL;
 
 }
 
@@ -324,6 +403,10 @@ void set_default_audio_api(void)
     gr_context->prototype->in_device = GR_DEFAULT_DEVICE;
     gr_context->prototype->out_device = GR_DEFAULT_DEVICE;        
     gr_context->prototype->latency = GR_DEFAULT_LATENCY;
+    gr_context->prototype->max_grains = GR_DEFAULT_MAX_GRAINS;
+    gr_context->prototype->max_active_grains = GR_DEFAULT_MAX_ACTIVE_GRAINS;
+    gr_context->prototype->device_sample_rate = GR_DEFAULT_DEVICE_SAMPLE_RATE;
+    gr_context->prototype->resample_quality = GR_DEFAULT_RESAMPLE_QUALITY;
 
 }
 
@@ -343,5 +426,82 @@ void set_default_audio_api(void)
     */
 int grPump(int output)
 {
-    return pump_audio(output);
-}
\ No newline at end of file
+    if(!gr_context->state)
+    {
+        grError(GR_ERROR_AUDIO_NOT_INITIALISED, "grPump() called before grInitAudio()");
+        return 0;
+    }
+    return pump_audio(gr_context->state, output);
+}
+
+
+// turn the mixer's adaptive level of detail on or off, to match the GR_LOD flag
+void apply_lod_audio_api(void)
+{
+    if(!gr_context->output_info)
+        return;
+    if(gr_context->global_flags[GR_LOD])
+        enable_lod_mixer(gr_context->output_info->mixer);
+    else
+        disable_lod_mixer(gr_context->output_info->mixer);
+}
+
+
+/** Synthesise audio straight into a buffer, without the audio device: for rendering offline.
+    grInitAudio() must have been called, but the audio must not be running (don't call grStartAudio()
+    or grPump()). Output continues seamlessly from one call to the next, whatever the number of
+    frames asked for; whole buffers are synthesised straight into out. There is no deadline
+    offline, so the level of detail is never reduced (whatever GR_LOD is set to), and the output
+    doesn't depend on how heavily loaded the machine is.
+    @arg out Space for n_frames frames of GR_OUTPUT_CHANNELS interleaved channels
+    @arg n_frames Number of frames to render
+    @return The number of frames rendered, or -1 on error
+*/
+int grRender(float *out, int n_frames)
+{
+    GrainMixer *mixer;
+    int done, len, block, channels;
+    
+    if(!gr_context->output_info)
+    {
+        grError(GR_ERROR_AUDIO_NOT_INITIALISED, "grRender() called before grInitAudio()");
+        return -1;
+    }
+    if(!out || n_frames<0)
+    {
+        grError(GR_ERROR_BAD_PARAMETER, "Invalid buffer or number of frames (%d) in grRender", n_frames);
+        return -1;
+    }
+    
+    // full quality throughout, while rendering
+    mixer = gr_context->output_info->mixer;
+    if(mixer->lod->enabled)
+        disable_lod_mixer(mixer);
+    
+    block = GLOBAL_STATE.frames_per_buffer;
+    channels = GLOBAL_STATE.n_channels;
+    done = 0;
+    while(done < n_frames)
+    {
+        // whole blocks go straight into the caller's buffer
+        if(gr_context->render_position==block && n_frames-done >= block)
+        {
+            render_output_info(gr_context->output_info, &out[done*channels]);
+            done += block;
+            continue;
+        }
+        
+        // otherwise through the render block, keeping what is left over for the next call
+        if(gr_context->render_position==block)
+        {
+            render_output_info(gr_context->output_info, gr_context->render_block);
+            gr_context->render_position = 0;
+        }
+        len = MIN(n_frames - done, block - gr_context->render_position);
+        memcpy(&out[done*channels], &gr_context->render_block[gr_context->render_position*channels], sizeof(*out) * len * channels);
+        gr_context->render_position += len;
+        done += len;
+    }
+    apply_lod_audio_api();
+    return n_frames;
+}
@@ -14,5 +14,6 @@
 
 
 void set_default_audio_api(void);
+void apply_lod_audio_api(void);
 
 #endif
\ No newline at end of file
@@ -14,7 +14,11 @@
 #include "../sys_audio.h"
 #include "errors.h"
 #include "audio_api.h"
-GRContext *gr_context;
+THREAD_LOCAL GRContext *gr_thread_context = NULL;
+
+// the first context made current; calls from threads which have never made one current use it,
+// so single-engine programs can call OpenGrain from any thread, as before contexts existed
+GRContext *gr_default_context = NULL;
 
 
 /** Set the default settings for the context.
@@ -27,38 +31,108 @@ static void setDefaultGrContext(GRContext *context)
     int i;
     
     // first disable everything
-    for(i=0;i<GR_MAX_FLAGS;i++)
+    for(i=0;i<=GR_MAX_FLAGS;i++)
         context->global_flags[i] = 0;
     
+    // except the level of detail, which is on unless turned off
+    context->global_flags[GR_LOD] = 1;
+    
+    // no audio until grInitAudio()
+    context->state = NULL;
+    context->output_info = NULL;
+    context->render_block = NULL;
+    context->render_position = 0;
+    
     
     
 }
 
 
 
-/** Initialises the OpenGrain system. This must be called _before_ any other OpenGrain calls. */
-void grInit(void)
+/** Create a new context: a complete OpenGrain engine, with its own audio settings, device,
+    streams and random numbers, independent of any other context. Contexts can run at the
+    same time on different threads. The new context is not made current.
+    @return The new context
+*/
+GRContext *grCreateContext(void)
 {
-    gr_context = malloc(sizeof(*gr_context));
-    if(!gr_context)
+    GRContext *context, *current;
+    context = malloc(sizeof(*context));
+    if(!context)
     {
         // can't use grFatalError because that relies on a working context!
         fprintf(stderr, "Fatal error: Out of memory when allocating context.\n");
         exit(-1);
     }    
+    
+    // the defaults are set with the new context current
+    current = gr_thread_context;
+    gr_thread_context = context;
     grClearError();
-    setDefaultGrContext(gr_context);  
+    setDefaultGrContext(context);  
     set_default_audio_api();    
     pre_init_sys_audio();
+    grMakeCurrent(current);
+    return context;
+}
+
+/** Destroy a context, releasing its audio device (call grShutdownAudio() with it current first). 
+    If it is current on this thread, the default context (if it isn't this one) is current afterwards.
+    @arg context The context to destroy
+*/
+void grDestroyContext(GRContext *context)
+{
+    post_shutdown_sys_audio();
+    lock_global_mutex();
+    if(gr_default_context==context)
+        gr_default_context = NULL;
+    unlock_global_mutex();
+    if(gr_thread_context==context)
+        grMakeCurrent(NULL);
+    free(context->prototype);
+    free(context);
+}
+
+/** Make a context current on the calling thread. All other OpenGrain calls on this thread
+    act on the current context. A context can be current on more than one thread (e.g. to read
+    its statistics while another thread renders), but only where calls are documented as safe to overlap.
+    The first context made current is also the default: threads which have no context current
+    (including after grMakeCurrent(NULL)) use it.
+    @arg context The context to use, or NULL for none
+*/
+void grMakeCurrent(GRContext *context)
+{
+    gr_thread_context = context;
+    if(context && !gr_default_context)
+    {
+        lock_global_mutex();
+        if(!gr_default_context)
+            gr_default_context = context;
+        unlock_global_mutex();
+    }
+    bind_audio_state(context ? context->state : NULL);
+}
+
+/** Get the context that is current on the calling thread (or the default context, if none is).
+    @return The current context, or NULL if there is none
+*/
+GRContext *grGetCurrentContext(void)
+{
+    return gr_context;
+}
+
+/** Initialises the OpenGrain system, creating a context and making it current on the calling thread.
+    This must be called _before_ any other OpenGrain calls (except grCreateContext()). */
+void grInit(void)
+{
+    grMakeCurrent(grCreateContext());
 }
 
 /** Shuts down the OpenGrain system, stopping playback, releasing audio devices, shutting down all
-    playback threads and freeing all allocated memory */
+    playback threads and freeing all allocated memory of the current context */
 void grShutdown(void)
 {
-    post_shutdown_sys_audio();
-    free(gr_context->prototype);
-    free(gr_context);
+    grDestroyContext(gr_context);
 }
 
 /** 
@@ -98,7 +172,11 @@ char *grGetLastErrorMessage(void)
 void grEnable(int flag)
 {
     if(flag>=0 && flag<=GR_MAX_FLAGS)    
+    {
         gr_context->global_flags[flag] = 1;
+        if(flag==GR_LOD)
+            apply_lod_audio_api();
+    }
    else
         grError(GR_ERROR_BAD_FLAG, "Invalid flag in grEnable()");
     
@@ -110,7 +188,11 @@ void grEnable(int flag)
 void grDisable(int flag)
 {
    if(flag>=0 && flag<=GR_MAX_FLAGS)    
+    {
         gr_context->global_flags[flag] = 0;
+        if(flag==GR_LOD)
+            apply_lod_audio_api();
+    }
     else
         grError(GR_ERROR_BAD_FLAG, "Invalid flag in grDisable()");
     
@@ -21,19 +21,20 @@
 struct GrainMixer;
 
 /** @struct GRContext
-    Structure which holds complete state of the current OpenGrain context.
+    Structure which holds complete state of one OpenGrain context (an independent engine).
 **/
-typedef struct GRContext
+struct GRContext
 {
     /* Error reporting */
     int last_error;    
     char last_error_string[GR_MAX_ERROR_STRING_LENGTH+1];
     
     /* Global flags */
-    int global_flags[GR_MAX_FLAGS];
+    int global_flags[GR_MAX_FLAGS+1];
     
     /* Audio state for the device */
     AudioState *prototype;        
+    AudioState *state;              /* the running engine's state; NULL until grInitAudio() */
     OutputInfo *output_info;
     int pump_mode;
     
@@ -44,9 +45,16 @@ typedef struct GRContext
     /* Mixer */
     struct GrainMixer *mixer;
     
-} GRContext;
+    /* For grRender(): the last block synthesised, and how many of its frames have been handed out */
+    float *render_block;
+    int render_position;
+    
+};
 
-extern GRContext *gr_context;
+/* the context bound to the calling thread, and the one used by threads with none bound */
+extern THREAD_LOCAL GRContext *gr_thread_context;
+extern GRContext *gr_default_context;
+#define gr_context (gr_thread_context ? gr_thread_context : gr_default_context)
 
 
 
@@ -20,5 +20,6 @@ const char *opengrain_error_codes[] =
     "Bad device number",
     "Bad parameter",
     "Bad flag",
+    "Audio not initialised",
     
 };
@@ -50,11 +50,17 @@ void grError(int code, char *str, ...)
     char error_temp[GR_MAX_ERROR_STRING_LENGTH+1];
     va_list args;
     va_start (args, str);
-    gr_context->last_error = code;    
-    
     vsnprintf(error_temp, GR_MAX_ERROR_STRING_LENGTH, str, args);
-    snprintf(gr_context->last_error_string, GR_MAX_ERROR_STRING_LENGTH, "Error %d (%s): %s", gr_context->last_error, opengrain_error_codes[gr_context->last_error], error_temp);
     va_end(args);
+    
+    // no context anywhere (grInit() not called yet): there is nowhere to keep the error
+    if(!gr_context)
+    {
+        fprintf(stderr, "Error %d (%s): %s\n", code, opengrain_error_codes[code], error_temp);
+        return;
+    }
+    gr_context->last_error = code;    
+    snprintf(gr_context->last_error_string, GR_MAX_ERROR_STRING_LENGTH, "Error %d (%s): %s", gr_context->last_error, opengrain_error_codes[gr_context->last_error], error_temp);
 }
 
 
@@ -17,11 +17,40 @@
 
 /* This section implemented in base_api.c */
 
-/** Initialises the OpenGrain system. This must be called _before_ any other OpenGrain calls. */
+/* A complete, independent OpenGrain engine. Every call acts on the context current on the calling thread. */
+typedef struct GRContext GRContext;
+
+/** Create a new context: a complete OpenGrain engine, with its own audio settings, device,
+    streams and random numbers, independent of any other context. Contexts can run at the
+    same time on different threads. The new context is not made current.
+    @return The new context
+*/
+GRContext *grCreateContext(void);
+
+/** Destroy a context, releasing its audio device (call grShutdownAudio() with it current first). 
+    If it is current on this thread, no context is current afterwards.
+    @arg context The context to destroy
+*/
+void grDestroyContext(GRContext *context);
+
+/** Make a context current on the calling thread. All other OpenGrain calls on this thread
+    act on the current context. A context can be current on more than one thread (e.g. to read
+    its statistics while another thread renders), but only where calls are documented as safe to overlap.
+    @arg context The context to use, or NULL for none
+*/
+void grMakeCurrent(GRContext *context);
+
+/** Get the context that is current on the calling thread.
+    @return The current context, or NULL if there is none
+*/
+GRContext *grGetCurrentContext(void);
+
+/** Initialises the OpenGrain system, creating a context and making it current on the calling thread.
+    This must be called _before_ any other OpenGrain calls (except grCreateContext()). */
 void grInit(void);
 
 /** Shuts down the OpenGrain system, stopping playback, releasing audio devices, shutting down all
-    playback threads and freeing all allocated memory */
+    playback threads and freeing all allocated memory of the current context */
 void grShutdown(void);
 
 /** 
@@ -57,12 +86,22 @@ char *grGetLastErrorMessage(void);
 #define GR_N_DEVICES 10
 #define GR_DEFAULT_INPUT_DEVICE 11
 #define GR_DEFAULT_OUTPUT_DEVICE 12
+#define GR_MAX_GRAINS 13
+#define GR_CALLBACK_ALLOCATIONS 14
+#define GR_MAX_ACTIVE_GRAINS 15
+#define GR_DEVICE_SAMPLE_RATE 16
+#define GR_RESAMPLE_QUALITY 17
 
 
 
 /* Devices */
 #define GR_DEFAULT_DEVICE -1
 
+/* Resampling qualities */
+#define GR_RESAMPLE_LOW 0
+#define GR_RESAMPLE_MEDIUM 1
+#define GR_RESAMPLE_HIGH 2
+
 /* Pump types */
 #define GR_PUMP_MANUAL 0
 #define GR_PUMP_THREAD 1
@@ -75,6 +114,10 @@ char *grGetLastErrorMessage(void);
 #define GR_DEFAULT_INPUT_CHANNELS 0
 #define GR_DEFAULT_OUTPUT_CHANNELS 2
 #define GR_DEFAULT_LATENCY 0.01
+#define GR_DEFAULT_MAX_GRAINS 256
+#define GR_DEFAULT_MAX_ACTIVE_GRAINS 0
+#define GR_DEFAULT_DEVICE_SAMPLE_RATE 0
+#define GR_DEFAULT_RESAMPLE_QUALITY GR_RESAMPLE_MEDIUM
 
 
 /** 
@@ -82,7 +125,7 @@ char *grGetLastErrorMessage(void);
     
     GR_SAMPLE_RATE      The output sample rate, in Hz. Default is 44100
     GR_INPUT_CHANNELS   The number of input channels to use. Default is 0.
-    GR_OUTPUT_CHANNELS  The number of output channels to use  (e.g. 2 for stereo). Default is 2.
+    GR_OUTPUT_CHANNELS  The number of output channels to use  (e.g. 2 for stereo, or one per speaker). Default is 2.
     GR_BUFFER_SIZE      Buffer size in samples. Smaller buffers are less efficient but allow smoother effects. Default size is 512.
                         Note that buffer size and latency are different things; buffer sizes can be smaller or larger than the 
                         underlying audio buffer.
@@ -92,6 +135,13 @@ char *grGetLastErrorMessage(void);
                         GR_PUMP_THREAD (background thread pumps automatically), GR_PUMP_BLOCKING (blocks until synthesis
                         is complete) or GR_PUMP_CALLBACK (minimum latency
                         but may cause stability issues if synthesis takes a long time). Default is GR_PUMP_THREAD
+    GR_MAX_ACTIVE_GRAINS The maximum number of grains playing at once over all streams. When it is reached the least
+                        important grains are faded out and replaced. 0 (the default) means no global limit; each stream
+                        is still limited to GR_MAX_GRAINS.
+    GR_DEVICE_SAMPLE_RATE The rate to run the audio device at, if it differs from GR_SAMPLE_RATE. Synthesis always runs at
+                        GR_SAMPLE_RATE; output (and input) is resampled to and from the device. 0 (the default) means the
+                        device runs at GR_SAMPLE_RATE.
+    GR_RESAMPLE_QUALITY Quality of the device rate conversion: GR_RESAMPLE_LOW, GR_RESAMPLE_MEDIUM (the default) or GR_RESAMPLE_HIGH.
  
 */    
 void grAudioParameteri(int parameter, int value);
@@ -102,7 +152,7 @@ void grAudioParameteri(int parameter, int value);
     
     GR_SAMPLE_RATE      The output sample rate, in Hz. Default is 44100
     GR_INPUT_CHANNELS   The number of input channels to use. Default is 0.
-    GR_OUTPUT_CHANNELS  The number of output channels to use  (e.g. 2 for stereo). Default is 2.
+    GR_OUTPUT_CHANNELS  The number of output channels to use  (e.g. 2 for stereo, or one per speaker). Default is 2.
     GR_LATENCY          Desired latency in seconds. This value is not guaranteed to be acheived; use grGetAudioParameteri(GR_LATENCY)
                         to determine the actual latency. Default is 0.01 (10ms).
     GR_BUFFER_SIZE      Buffer size in samples. Smaller buffers are less efficient but allow smoother effects. Default size is 512.
@@ -207,6 +257,16 @@ void grShutdownAudio(void);
     */
 int grPump(int output);
 
+/** Synthesise audio straight into a buffer, without the audio device: for rendering offline.
+    grInitAudio() must have been called, but the audio must not be running (don't call grStartAudio()
+    or grPump()). Output continues seamlessly from one call to the next, whatever the number of
+    frames asked for; whole buffers are synthesised straight into out.
+    @arg out Space for n_frames frames of GR_OUTPUT_CHANNELS interleaved channels
+    @arg n_frames Number of frames to render
+    @return The number of frames rendered, or -1 on error
+*/
+int grRender(float *out, int n_frames);
+
 /*****************************************************************************************/
 
 /* This section implemented in mixer_api.c */
@@ -289,6 +349,131 @@ void grGetEq2f(int section, float *frequency, float *gaindB);
     
     
 
+/*****************************************************************************************/
+
+/* This section implemented in stats_api.c */
+
+/* Stages of synthesis which are timed (indices into GRStatistics stage_mean and stage_max) */
+#define GR_STAGE_TRIGGERS 0
+#define GR_STAGE_SPAWN 1
+#define GR_STAGE_SYNTHESIZE 2
+#define GR_STAGE_SPATIALIZER 3
+#define GR_STAGE_STREAM_FX 4
+#define GR_STAGE_MASTER 5
+#define GR_STAGE_REVERB 6
+#define GR_STAGE_OUTPUT 7
+#define GR_N_STAGES 8
+
+/* Levels of detail (GRStatistics lod_level). Each level includes the reductions of the ones below it. */
+#define GR_LOD_FULL 0                   /* full quality */
+#define GR_LOD_PAN 1                    /* distant or quiet grains are panned rather than 3D filtered */
+#define GR_LOD_NO_INTERPOLATION 2       /* wave grains are not interpolated */
+#define GR_LOD_THIN 3                   /* only some of the triggered grains are started */
+#define GR_LOD_SHORT_REVERB 4           /* reverb tails are shortened */
+
+/* Reasons for the current level of detail (GRStatistics lod_reason) */
+#define GR_LOD_REASON_NONE 0
+#define GR_LOD_REASON_CALIBRATING 1
+#define GR_LOD_REASON_MEASURED_LOAD 2
+#define GR_LOD_REASON_PREDICTED_LOAD 3
+#define GR_LOD_REASON_OVERRUN 4
+#define GR_LOD_REASON_RECOVERED 5
+#define GR_LOD_REASON_DISABLED 6
+
+/** @struct GRStatistics
+    Load statistics for the audio callback, computed over the most recent blocks.
+    All times are given as a fraction of the buffer deadline (buffer size / sample rate), 
+    so 1.0 means the block took exactly as long as it had available.
+*/
+typedef struct GRStatistics
+{
+    int n_blocks;                   /* number of recent blocks the statistics were computed over */
+    float callback_p50;             /* median time for the whole callback */
+    float callback_p99;             /* 99th percentile time for the whole callback */
+    float callback_max;             /* maximum time for the whole callback */
+    float stage_mean[GR_N_STAGES];  /* mean time spent in each stage */
+    float stage_max[GR_N_STAGES];   /* maximum time spent in each stage */
+    int active_grains;              /* grains active in the most recent block */
+    int spawned_grains;             /* grains started during the recent blocks */
+    int killed_grains;              /* grains finished during the recent blocks */
+    int dropped_grains;             /* grains dropped because no grain was free, since grInitAudio() */
+    int stolen_grains;              /* grains stolen (or never started) to stay within the grain caps, since grInitAudio() */
+    int culled_grains;              /* grains too quiet to hear, either when spawned or once decayed, since grInitAudio() */
+    int dropped_buffers;            /* buffers the audio device had to go without, since grInitAudio() */
+    int overruns;                   /* blocks which took longer than the deadline, since grInitAudio() */
+    int record_overruns;            /* blocks dropped from the recording because the disk could not keep up, since recording started */
+    int lod_level;                  /* current level of detail (one of GR_LOD_*) */
+    int lod_reason;                 /* why that level was chosen (one of GR_LOD_REASON_*) */
+    float lod_load;                 /* smoothed callback time used by the level of detail controller */
+    float lod_predicted_load;       /* callback time predicted by the controller's cost model */
+} GRStatistics;
+
+/** @struct GRStreamStatistics
+    Grain counts for a single stream, since the stream was created.
+*/
+typedef struct GRStreamStatistics
+{
+    int active_grains;
+    int spawned_grains;
+    int killed_grains;
+    int dropped_grains;
+    int stolen_grains;
+    int culled_grains;
+} GRStreamStatistics;
+
+/** Get the load statistics for the audio callback. Can be called from any thread
+    while audio is running. 
+    @arg statistics Structure to fill in
+*/
+void grGetStatistics(GRStatistics *statistics);
+
+/** Get the grain counts for one stream, as of the most recent block. Can be called
+    from any thread while audio is running. Only the first 64 streams are reported.
+    @arg stream The index of the stream in the mixer (0 is the first stream added)
+    @arg statistics Structure to fill in
+    @return 1 if the stream exists, 0 otherwise
+*/
+int grGetStreamStatistics(int stream, GRStreamStatistics *statistics);
+
+/** Get a description of one of the level of detail reasons.
+    @arg reason One of the GR_LOD_REASON_* codes (e.g. from GRStatistics lod_reason)
+    @return A description of the reason
+*/
+const char *grGetLODReasonString(int reason);
+
+/*****************************************************************************************/
+
+/* This section implemented in stream_api.c */
+
+/* grStreamParameterf parameters. Each sets the stream's distribution for that parameter to a constant. */
+#define GR_STREAM_RATE 0                /* grains per second */
+#define GR_STREAM_DURATION 1            /* seconds */
+#define GR_STREAM_AMPLITUDE 2           /* decibels */
+#define GR_STREAM_FREQUENCY 3           /* Hz */
+#define GR_STREAM_AZIMUTH 4             /* degrees */
+#define GR_STREAM_ELEVATION 5           /* degrees */
+#define GR_STREAM_DISTANCE 6            /* metres */
+#define GR_STREAM_ATTACK 7              /* envelope attack */
+#define GR_STREAM_DECAY 8               /* envelope decay */
+#define GR_STREAM_GAIN 9                /* overall gain of the stream, in decibels (set instantly) */
+#define GR_N_STREAM_PARAMETERS 10
+
+/** Set a parameter of a stream. 
+    @arg stream The index of the stream in the mixer (0 is the first stream added)
+    @arg parameter One of GR_STREAM_*
+    @arg value The new value
+*/
+void grStreamParameterf(int stream, int parameter, float value);
+
+/** Set several parameters of a stream at once (e.g. between renders of many clips).
+    @arg stream The index of the stream in the mixer
+    @arg n Number of parameters to set
+    @arg parameters n GR_STREAM_* codes
+    @arg values n values, one for each parameter
+    @return The number of parameters set (parameters after an invalid one are not set)
+*/
+int grStreamParameterfv(int stream, int n, const int *parameters, const float *values);
+
 /*****************************************************************************************/
 
 /* This section implemented in global_api.c */ 
@@ -300,8 +485,9 @@ void grGetEq2f(int section, float *frequency, float *gaindB);
 #define GR_COMPRESSOR 2
 #define GR_CLIPPER 3
 #define GR_TEST_TONE 4
+#define GR_LOD 5        /* adaptive level of detail while playing in real time (enabled by default; grRender() always renders at full quality) */
 
-#define GR_MAX_FLAGS 4 // update as the above increases
+#define GR_MAX_FLAGS 5 // update as the above increases
 
 /** Enable one of the global flags.
     @arg flag Flag to enable 
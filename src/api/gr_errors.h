@@ -20,8 +20,9 @@
 #define GR_ERROR_BAD_DEVICE 4
 #define GR_ERROR_BAD_PARAMETER 5
 #define GR_ERROR_BAD_FLAG 6
+#define GR_ERROR_AUDIO_NOT_INITIALISED 7
 
-#define GR_MAX_ERROR_CODE 6
+#define GR_MAX_ERROR_CODE 7
 #define GR_MAX_ERROR_STRING_LENGTH 2048
 
 extern const char *opengrain_error_codes[];
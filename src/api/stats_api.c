@@ -0,0 +1,163 @@
+/**
+    @file stats_api.c
+    @brief Implementation of the load statistics parts of the opengrain api
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+#include "gr.h"
+#include "errors.h"
+#include "base_api.h"
+#include "../audio.h"
+#include "../grainmixer.h"
+#include "../stats.h"
+#include "../lod.h"
+#include <string.h>
+
+
+// comparison for sorting callback times
+static int compare_times(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    if(x<y) return -1;
+    if(x>y) return 1;
+    return 0;
+}
+
+// return the p'th percentile (0.0--1.0) of a sorted array
+static double percentile(double *sorted, int n, double p)
+{
+    int index;
+    if(n==0)
+        return 0.0;
+    index = (int)(p * (n-1) + 0.5);
+    return sorted[index];
+}
+
+
+/** Get the load statistics for the audio callback. Can be called from any thread
+    while audio is running.
+    @arg statistics Structure to fill in
+*/
+void grGetStatistics(GRStatistics *statistics)
+{
+    GrainMixer *mixer;
+    StatsSnapshot *snapshot;
+    BlockStats *blocks;
+    double *times;
+    double deadline;
+    int i, j, n;
+
+    memset(statistics, 0, sizeof(*statistics));
+    if(!gr_context->output_info)
+    {
+        grError(GR_ERROR_AUDIO_NOT_INITIALISED, "grGetStatistics() called before grInitAudio()");
+        return;
+    }
+
+    mixer = gr_context->output_info->mixer;
+    deadline = get_deadline_stats();
+
+    // take a copy of the history
+    blocks = malloc(sizeof(*blocks) * STATS_HISTORY_LENGTH);
+    times = malloc(sizeof(*times) * STATS_HISTORY_LENGTH);
+    n = get_history_stats(mixer->stats, blocks, STATS_HISTORY_LENGTH);
+
+    for(i=0;i<n;i++)
+    {
+        times[i] = blocks[i].callback_time;
+        for(j=0;j<GR_N_STAGES;j++)
+        {
+            statistics->stage_mean[j] += blocks[i].stage_time[j] / (deadline * n);
+            statistics->stage_max[j] = MAX(statistics->stage_max[j], blocks[i].stage_time[j] / deadline);
+        }
+        statistics->spawned_grains += blocks[i].spawned_grains;
+        statistics->killed_grains += blocks[i].killed_grains;
+    }
+
+    qsort(times, n, sizeof(*times), compare_times);
+    statistics->n_blocks = n;
+    statistics->callback_p50 = percentile(times, n, 0.5) / deadline;
+    statistics->callback_p99 = percentile(times, n, 0.99) / deadline;
+    statistics->callback_max = percentile(times, n, 1.0) / deadline;
+    if(n>0)
+        statistics->active_grains = blocks[n-1].active_grains;
+
+    // totals since the audio was started, from the snapshot the audio thread
+    // takes every block (the stream list itself belongs to the audio thread)
+    snapshot = malloc(sizeof(*snapshot));
+    get_snapshot_stats(mixer->stats, snapshot);
+    statistics->dropped_grains = snapshot->totals.dropped_grains;
+    statistics->stolen_grains = snapshot->totals.stolen_grains;
+    statistics->culled_grains = snapshot->totals.culled_grains;
+    free(snapshot);
+
+    statistics->dropped_buffers = GLOBAL_STATE.dropped_buffers;
+    statistics->overruns = mixer->stats->overruns;
+    statistics->record_overruns = get_overruns_wavewriter(gr_context->output_info->writer);
+    statistics->lod_level = get_level_lod(mixer->lod);
+    statistics->lod_reason = get_reason_lod(mixer->lod);
+    statistics->lod_load = mixer->lod->load;
+    statistics->lod_predicted_load = mixer->lod->predicted_load;
+
+    free(blocks);
+    free(times);
+}
+
+
+/** Get a description of one of the level of detail reasons.
+    @arg reason One of the GR_LOD_REASON_* codes (e.g. from GRStatistics lod_reason)
+    @return A description of the reason
+*/
+const char *grGetLODReasonString(int reason)
+{
+    return get_reason_string_lod(reason);
+}
+
+
+/** Get the grain counts for one stream, as of the most recent block. Can be called
+    from any thread while audio is running.
+    @arg stream The index of the stream in the mixer (0 is the first stream added)
+    @arg statistics Structure to fill in
+    @return 1 if the stream exists, 0 otherwise
+*/
+int grGetStreamStatistics(int stream, GRStreamStatistics *statistics)
+{
+    GrainMixer *mixer;
+    StatsSnapshot *snapshot;
+    int found;
+
+    memset(statistics, 0, sizeof(*statistics));
+    if(!gr_context->output_info)
+    {
+        grError(GR_ERROR_AUDIO_NOT_INITIALISED, "grGetStreamStatistics() called before grInitAudio()");
+        return 0;
+    }
+
+    // read the snapshot the audio thread takes every block, not the stream list
+    mixer = gr_context->output_info->mixer;
+    snapshot = malloc(sizeof(*snapshot));
+    get_snapshot_stats(mixer->stats, snapshot);
+    found = 0;
+    if(stream<0 || stream>=snapshot->n_streams)
+        grError(GR_ERROR_BAD_PARAMETER, "Invalid stream %d in grGetStreamStatistics", stream);
+    else if(stream>=STATS_MAX_STREAMS)
+        grError(GR_ERROR_BAD_PARAMETER, "grGetStreamStatistics only reports the first %d streams", STATS_MAX_STREAMS);
+    else
+    {
+        statistics->active_grains = snapshot->streams[stream].active_grains;
+        statistics->spawned_grains = snapshot->streams[stream].spawned_grains;
+        statistics->killed_grains = snapshot->streams[stream].killed_grains;
+        statistics->dropped_grains = snapshot->streams[stream].dropped_grains;
+        statistics->stolen_grains = snapshot->streams[stream].stolen_grains;
+        statistics->culled_grains = snapshot->streams[stream].culled_grains;
+        found = 1;
+    }
+    free(snapshot);
+    return found;
+}
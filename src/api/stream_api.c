@@ -0,0 +1,115 @@
+/**
+    @file stream_api.c
+    @brief Implementation of the stream parameter parts of the opengrain api
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+#include "gr.h"
+#include "errors.h"
+#include "base_api.h"
+#include "../audio.h"
+#include "../grainmixer.h"
+#include <string.h>
+
+
+// look up a stream by its index in the mixer, or NULL (with an error) if there isn't one
+static GrainStream *get_stream(int stream, char *caller)
+{
+    GrainMixer *mixer;
+    if(!gr_context->output_info)
+    {
+        grError(GR_ERROR_AUDIO_NOT_INITIALISED, "%s() called before grInitAudio()", caller);
+        return NULL;
+    }
+    mixer = gr_context->output_info->mixer;
+    if(stream<0 || stream>=list_size(mixer->stream_list))
+    {
+        grError(GR_ERROR_BAD_PARAMETER, "Invalid stream %d in %s", stream, caller);
+        return NULL;
+    }
+    return (GrainStream *) list_get_at(mixer->stream_list, stream);
+}
+
+
+// set one parameter of a stream; returns 0 if the parameter is invalid
+static int set_parameter_stream(GrainStream *stream, int parameter, float value, char *caller)
+{
+    GrainModel *model;
+    Distribution *distribution;
+
+    model = get_grain_model_stream(stream);
+    switch(parameter)
+    {
+        case GR_STREAM_RATE: distribution = model->rate; break;
+        case GR_STREAM_DURATION: distribution = model->duration; break;
+        case GR_STREAM_AMPLITUDE: distribution = model->amplitude; break;
+        case GR_STREAM_FREQUENCY: distribution = model->frequency; break;
+        case GR_STREAM_AZIMUTH: distribution = model->azimuth; break;
+        case GR_STREAM_ELEVATION: distribution = model->elevation; break;
+        case GR_STREAM_DISTANCE: distribution = model->distance; break;
+        case GR_STREAM_ATTACK: distribution = model->attack; break;
+        case GR_STREAM_DECAY: distribution = model->decay; break;
+        case GR_STREAM_GAIN:
+            set_gain_stream(stream, value);
+            return 1;
+        default:
+            grError(GR_ERROR_BAD_PARAMETER, "Invalid stream parameter %d in %s", parameter, caller);
+            return 0;
+    }
+    set_constant_distribution(distribution, value);
+    return 1;
+}
+
+
+/** Set a parameter of a stream. Valid values for parameter are:
+
+    GR_STREAM_RATE          Grains per second
+    GR_STREAM_DURATION      Grain duration, in seconds
+    GR_STREAM_AMPLITUDE     Grain amplitude, in dB
+    GR_STREAM_FREQUENCY     Grain frequency, in Hz
+    GR_STREAM_AZIMUTH       Azimuth, in degrees
+    GR_STREAM_ELEVATION     Elevation, in degrees
+    GR_STREAM_DISTANCE      Distance, in metres
+    GR_STREAM_ATTACK        Envelope attack
+    GR_STREAM_DECAY         Envelope decay
+    GR_STREAM_GAIN          Overall gain of the stream, in dB
+
+    All but GR_STREAM_GAIN replace the distribution for that parameter with a constant.
+    @arg stream The index of the stream in the mixer (0 is the first stream added)
+    @arg parameter One of GR_STREAM_*
+    @arg value The new value
+*/
+void grStreamParameterf(int stream, int parameter, float value)
+{
+    GrainStream *grain_stream;
+    grain_stream = get_stream(stream, "grStreamParameterf");
+    if(!grain_stream)
+        return;
+    set_parameter_stream(grain_stream, parameter, value, "grStreamParameterf");
+}
+
+
+/** Set several parameters of a stream at once (e.g. between renders of many clips).
+    @arg stream The index of the stream in the mixer
+    @arg n Number of parameters to set
+    @arg parameters n GR_STREAM_* codes
+    @arg values n values, one for each parameter
+    @return The number of parameters set (parameters after an invalid one are not set)
+*/
+int grStreamParameterfv(int stream, int n, const int *parameters, const float *values)
+{
+    GrainStream *grain_stream;
+    int i;
+    grain_stream = get_stream(stream, "grStreamParameterfv");
+    if(!grain_stream)
+        return 0;
+    for(i=0;i<n;i++)
+        if(!set_parameter_stream(grain_stream, parameters[i], values[i], "grStreamParameterfv"))
+            break;
+    return i;
+}
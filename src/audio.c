@@ -12,6 +12,8 @@
 
 #include "audio.h"
 #include "sys_audio.h"
+#include "alloc_tripwire.h"
+#include "resampler.h"
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
@@ -19,15 +21,208 @@
 
 #define RANDOM_SEED 50
 
-/*** GLOBAL STATE VARIABLES ***/
-AudioState GLOBAL_STATE;          // Audio device state
-static void *audio_stream;
+// the engine bound to each thread
+THREAD_LOCAL AudioState *current_audio_state = NULL;
 
+// the engine used by threads which have none bound (the first one bound anywhere)
+AudioState *default_audio_state = NULL;
 
+// the shared tables are only built once
+static int tables_made = 0;
 
 
-// Initialise the audio system
-void init_audio(AudioState *prototype, AudioCallback callback, AudioFinishedCallback finished_callback, void *stream_data)
+/** Create the state for a new engine, copying the settings from prototype. Does not open a
+    device or bind the state to any thread.
+    Engines can be created on any thread; the shared tables are built by the first.
+    @arg prototype The settings (sample rate, channels, etc.) to use
+    @return The new state
+*/
+AudioState *create_audio_state(AudioState *prototype)
+{
+    AudioState *state;
+    state = malloc(sizeof(*state));
+    
+    // reset the state
+    state->sample_rate = prototype->sample_rate;
+    state->n_channels = prototype->n_channels;    
+    state->n_input_channels = prototype->n_input_channels;    
+    state->input_channel = prototype->input_channel;    
+    state->in_device = prototype->in_device;
+    state->out_device = prototype->out_device;
+    
+    state->frames_per_buffer = prototype->frames_per_buffer;
+    state->device_sample_rate = prototype->device_sample_rate;
+    state->resample_quality = prototype->resample_quality;
+    state->max_grains = prototype->max_grains;
+    state->max_active_grains = prototype->max_active_grains;
+    state->elapsed = 0.0;
+    state->elapsed_samples = 0;
+    state->dropped_buffers = 0;
+    state->lod_level = 0;
+    state->random = create_random(RANDOM_SEED);
+    state->audio_stream = NULL;
+    state->rate_adapter = NULL;
+    
+    // shared between all engines
+    lock_global_mutex();
+    if(!tables_made)
+    {
+        make_sine_table();
+        tables_made = 1;
+    }
+    unlock_global_mutex();
+    
+    // start watching for allocations in the audio callback (debug builds only)
+    arm_alloc_tripwire();
+    return state;
+}
+
+
+// free an engine's state (its device must have been shut down)
+void destroy_audio_state(AudioState *state)
+{
+    if(current_audio_state==state)
+        current_audio_state = NULL;
+    lock_global_mutex();
+    if(default_audio_state==state)
+        default_audio_state = NULL;
+    unlock_global_mutex();
+    destroy_random(state->random);
+    free(state);
+}
+
+
+// make state the engine that GLOBAL_STATE refers to on the calling thread.
+// The first state bound also becomes the default for threads with nothing bound.
+void bind_audio_state(AudioState *state)
+{
+    current_audio_state = state;
+    if(state && !default_audio_state)
+    {
+        lock_global_mutex();
+        if(!default_audio_state)
+            default_audio_state = state;
+        unlock_global_mutex();
+    }
+}
+
+
+// Set up the state for an engine and bind it to this thread, without opening a device.
+// Used directly for offline (headless) rendering.
+AudioState *init_audio_state(AudioState *prototype)
+{
+    AudioState *state;
+    state = create_audio_state(prototype);
+    bind_audio_state(state);
+    return state;
+}
+
+
+// run the engine at the internal rate for one device block, resampling input and output
+static void rate_adapter_callback(void *data, float *in, float *out)
+{
+    RateAdapter *adapter;
+    int n, drop, in_size, out_size;
+    adapter = (RateAdapter *)data;
+    in_size = adapter->n_input_channels * sizeof(float);
+    out_size = adapter->n_channels * sizeof(float);
+    
+    // queue the input at the internal rate (dropping the oldest if the engine isn't keeping up)
+    if(adapter->in_resampler && in)
+    {
+        n = get_max_output_resampler(adapter->in_resampler, adapter->device_frames_per_buffer);
+        drop = adapter->in_queued + n - adapter->in_capacity;
+        if(drop > 0)
+        {
+            adapter->in_queued -= drop;
+            memmove(adapter->in_queue, &adapter->in_queue[drop*adapter->n_input_channels], adapter->in_queued * in_size);
+        }
+        adapter->in_queued += process_resampler(adapter->in_resampler, in, adapter->device_frames_per_buffer, 
+                                               &adapter->in_queue[adapter->in_queued*adapter->n_input_channels]);
+    }
+    
+    // synthesize internal blocks until there is a device block of output
+    while(adapter->out_queued < adapter->device_frames_per_buffer)
+    {
+        if(adapter->in_resampler)
+        {
+            // input which hasn't arrived yet is silent
+            if(adapter->in_queued >= adapter->frames_per_buffer)
+            {
+                memcpy(adapter->in_block, adapter->in_queue, adapter->frames_per_buffer * in_size);
+                adapter->in_queued -= adapter->frames_per_buffer;
+                memmove(adapter->in_queue, &adapter->in_queue[adapter->frames_per_buffer*adapter->n_input_channels], adapter->in_queued * in_size);
+            }
+            else
+                memset(adapter->in_block, 0, adapter->frames_per_buffer * in_size);
+        }
+        adapter->callback(adapter->user_data, adapter->in_resampler ? adapter->in_block : NULL, adapter->out_block);
+        adapter->out_queued += process_resampler(adapter->out_resampler, adapter->out_block, adapter->frames_per_buffer, 
+                                                &adapter->out_queue[adapter->out_queued*adapter->n_channels]);
+    }
+    
+    memcpy(out, adapter->out_queue, adapter->device_frames_per_buffer * out_size);
+    adapter->out_queued -= adapter->device_frames_per_buffer;
+    memmove(adapter->out_queue, &adapter->out_queue[adapter->device_frames_per_buffer*adapter->n_channels], adapter->out_queued * out_size);
+}
+
+
+// create an adapter to run the engine callback at the internal rate for a device at another rate
+static RateAdapter *create_rate_adapter(AudioState *state, AudioCallback callback, void *user_data)
+{
+    RateAdapter *adapter;
+    double ratio;
+    
+    adapter = malloc(sizeof(*adapter));
+    adapter->callback = callback;
+    adapter->user_data = user_data;
+    adapter->n_channels = state->n_channels;
+    adapter->n_input_channels = state->n_input_channels;
+    adapter->frames_per_buffer = state->frames_per_buffer;
+    
+    // device blocks last (about) as long as internal blocks
+    ratio = state->device_sample_rate / (double)state->sample_rate;
+    adapter->device_frames_per_buffer = MAX(1, (int)(state->frames_per_buffer * ratio + 0.5));
+    
+    adapter->out_resampler = create_resampler(ratio, state->n_channels, state->resample_quality);
+    adapter->out_block = malloc(sizeof(float) * state->n_channels * state->frames_per_buffer);
+    adapter->out_capacity = adapter->device_frames_per_buffer + get_max_output_resampler(adapter->out_resampler, state->frames_per_buffer);
+    adapter->out_queue = malloc(sizeof(float) * state->n_channels * adapter->out_capacity);
+    adapter->out_queued = 0;
+    
+    adapter->in_resampler = NULL;
+    adapter->in_block = NULL;
+    adapter->in_queue = NULL;
+    adapter->in_queued = 0;
+    adapter->in_capacity = 0;
+    if(state->n_input_channels>0)
+    {
+        adapter->in_resampler = create_resampler(1.0/ratio, state->n_input_channels, state->resample_quality);
+        adapter->in_block = malloc(sizeof(float) * state->n_input_channels * state->frames_per_buffer);
+        adapter->in_capacity = 2 * (state->frames_per_buffer + get_max_output_resampler(adapter->in_resampler, adapter->device_frames_per_buffer));
+        adapter->in_queue = malloc(sizeof(float) * state->n_input_channels * adapter->in_capacity);
+    }
+    return adapter;
+}
+
+
+// destroy a rate adapter
+static void destroy_rate_adapter(RateAdapter *adapter)
+{
+    destroy_resampler(adapter->out_resampler);
+    free(adapter->out_block);
+    free(adapter->out_queue);
+    if(adapter->in_resampler)
+        destroy_resampler(adapter->in_resampler);
+    free(adapter->in_block);
+    free(adapter->in_queue);
+    free(adapter);
+}
+
+
+// Initialise the audio system for an engine. If the device runs at a different rate to 
+// the engine, the callback is run through a rate adapter
+void init_audio(AudioState *state, AudioCallback callback, AudioFinishedCallback finished_callback, void *stream_data)
 {
 
     AudioInfo *info;
@@ -37,58 +232,57 @@ void init_audio(AudioState *prototype, AudioCallback callback, AudioFinishedCall
     info->finished_callback = finished_callback;
     info->user_data = stream_data;
                     
-    // reset the state
-    GLOBAL_STATE.sample_rate = prototype->sample_rate;
-    GLOBAL_STATE.n_channels = prototype->n_channels;    
-    GLOBAL_STATE.n_input_channels = prototype->n_input_channels;    
-    GLOBAL_STATE.input_channel = prototype->input_channel;    
-    GLOBAL_STATE.in_device = prototype->in_device;
-    GLOBAL_STATE.out_device = prototype->out_device;
-    
-    GLOBAL_STATE.frames_per_buffer = prototype->frames_per_buffer;
-    GLOBAL_STATE.elapsed = 0.0;
-    GLOBAL_STATE.elapsed_samples = 0;
-    
-    info->state = &GLOBAL_STATE;
+    info->state = state;
+    info->device_sample_rate = state->sample_rate;
+    info->device_frames_per_buffer = state->frames_per_buffer;
     
-    
-    // INITIALISE GLOBAL STATES 
-    make_sine_table();
-    init_random(RANDOM_SEED);
+    state->rate_adapter = NULL;
+    if(state->device_sample_rate>0 && state->device_sample_rate!=state->sample_rate)
+    {
+        state->rate_adapter = create_rate_adapter(state, callback, stream_data);
+        info->callback = rate_adapter_callback;
+        info->user_data = state->rate_adapter;
+        info->device_sample_rate = state->device_sample_rate;
+        info->device_frames_per_buffer = state->rate_adapter->device_frames_per_buffer;
+    }
     
     // initialise sys_audio
-    audio_stream = init_sys_audio(info);            
+    state->audio_stream = init_sys_audio(info);            
 }
 
 
 // shutdown the audio subsystem and close the audio stream
-void shutdown_audio()
+void shutdown_audio(AudioState *state)
 {
-    shutdown_sys_audio(audio_stream);
+    shutdown_sys_audio(state->audio_stream);
+    state->audio_stream = NULL;
+    if(state->rate_adapter)
+        destroy_rate_adapter(state->rate_adapter);
+    state->rate_adapter = NULL;
 }
 
 
 // Start the audio playback
-void start_audio(void)
+void start_audio(AudioState *state)
 {
-    start_sys_audio(audio_stream);    
+    start_sys_audio(state->audio_stream);    
 }
 
 // Stop the audio playback
-void stop_audio(void)
+void stop_audio(AudioState *state)
 {
-    stop_sys_audio(audio_stream);
+    stop_sys_audio(state->audio_stream);
 }
 
 
-int pump_audio(int synthesize)
+int pump_audio(AudioState *state, int synthesize)
 {
-    return pump_sys_audio(audio_stream, synthesize);
+    return pump_sys_audio(state->audio_stream, synthesize);
 }
 
 
 
-int buffers_remaining_audio(void)
+int buffers_remaining_audio(AudioState *state)
 {
-    return buffers_remaining_sys_audio(audio_stream);
-}
\ No newline at end of file
+    return buffers_remaining_sys_audio(state->audio_stream);
+}
@@ -3,8 +3,10 @@
     @brief System independent audio handing code. Handles opening and closing of devices,
     starting and stopping devices and interrogating available devices
     
-    @warning This file contains the only static global variable in OpenGrain: GLOBAL_STATE. 
-    This represents the (read-only) state of the audio driver (channels, sample rate, etc.)
+    Every engine has its own AudioState: the (read-only) state of its audio driver (channels,
+    sample rate, etc.), its random number generator and its device. GLOBAL_STATE is the state
+    of the engine bound to the calling thread (see bind_audio_state()), so several engines can
+    run at once on different threads. The audio callbacks bind their own engine.
     
     @author John Williamson
     
@@ -23,6 +25,7 @@
 #include "random.h"
 #include "buffer.h"
 #include "simclist.h"
+#include "threads.h"
 
 #define AUDIO_NO_INPUT 0
 #define AUDIO_WITH_INPUT 1
@@ -46,10 +49,35 @@ typedef struct AudioState
     int sample_rate;
     int frames_per_buffer;
     
+    // rate the device runs at, if it is not sample_rate (0 means the same). The engine
+    // always runs at sample_rate; output and input are resampled to and from the device
+    int device_sample_rate;
+    int resample_quality;   // one of RESAMPLER_QUALITY_*
+    
     float latency;
+    
+    // number of grains (per stream) and grain specifics (per source) 
+    // which are allocated in advance
+    int max_grains;
+    
+    // cap on the number of grains playing at once over all streams (0 = no cap)
+    int max_active_grains;
+    
     // updated automatically in output.c
     double elapsed;
     int elapsed_samples;       
+    // updated automatically by the sys_audio driver
+    volatile int dropped_buffers;
+    // updated by the level of detail controller (one of LOD_LEVEL_*); 
+    // sources can use it to choose cheaper synthesis
+    volatile int lod_level;
+    
+    // this engine's random number stream
+    randctx *random;
+    
+    // the open device, and the adapter if it runs at another rate (NULL if it doesn't)
+    void *audio_stream;
+    struct RateAdapter *rate_adapter;
 } AudioState;
 
 
@@ -60,18 +88,55 @@ typedef struct AudioInfo
     void *user_data;
     AudioState *state;
     
+    // what the driver should open the device with
+    int device_sample_rate;
+    int device_frames_per_buffer;
     
     void *stream;    
 } AudioInfo;
 
 
-extern AudioState GLOBAL_STATE;
-void init_audio(AudioState *prototype, AudioCallback callback, AudioFinishedCallback finished_callback, void *stream_data);
-void start_audio(void);
-void stop_audio(void);
-void shutdown_audio(void);
-int pump_audio(int synthesize);
-int buffers_remaining_audio(void);
+struct Resampler;
+
+/** @struct RateAdapter
+    Runs the engine's callback at the internal rate for a device running at another
+    rate: device blocks of input are resampled into a queue of internal rate input, and
+    as many internal blocks are synthesized as needed to fill each device block of output */
+typedef struct RateAdapter
+{
+    AudioCallback callback;     // the engine's callback
+    void *user_data;
+    int n_channels, n_input_channels;
+    int frames_per_buffer, device_frames_per_buffer;
+    
+    struct Resampler *out_resampler;
+    float *out_block;           // one internal block of output
+    float *out_queue;           // resampled output not yet sent to the device
+    int out_queued, out_capacity;
+    
+    struct Resampler *in_resampler; // NULL if there is no input
+    float *in_block;            // one internal block of input
+    float *in_queue;            // resampled input not yet given to the engine
+    int in_queued, in_capacity;
+} RateAdapter;
+
+
+// the state of the engine bound to this thread, or the default engine if none is bound
+extern THREAD_LOCAL AudioState *current_audio_state;
+extern AudioState *default_audio_state;
+#define CURRENT_AUDIO_STATE (current_audio_state ? current_audio_state : default_audio_state)
+#define GLOBAL_STATE (*CURRENT_AUDIO_STATE)
+
+AudioState *create_audio_state(AudioState *prototype);
+void destroy_audio_state(AudioState *state);
+void bind_audio_state(AudioState *state);
+AudioState *init_audio_state(AudioState *prototype);
+void init_audio(AudioState *state, AudioCallback callback, AudioFinishedCallback finished_callback, void *stream_data);
+void start_audio(AudioState *state);
+void stop_audio(AudioState *state);
+void shutdown_audio(AudioState *state);
+int pump_audio(AudioState *state, int synthesize);
+int buffers_remaining_audio(AudioState *state);
 
 
 
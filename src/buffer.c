@@ -184,6 +184,36 @@ void mix_buffer(Buffer *dest, Buffer *src, float weight)
         dest->x[i] += src->x[i]*weight;    
 }
 
+
+/** mix a buffer into a destination buffer with a weight for every sample (e.g. a gain curve)
+    @param dest destination buffer
+    @param src source buffer
+    @param weights weighting of each sample of source to mix into dest
+*/
+void mix_buffer_gains(Buffer *dest, Buffer *src, Buffer *weights)
+{
+    int i;
+    int n;
+    n = MIN(dest->n_samples, src->n_samples);
+    n = MIN(n, weights->n_samples);
+    for(i=0;i<n;i++)
+        dest->x[i] += src->x[i]*weights->x[i];
+}
+
+
+/** multiply a buffer, sample by sample, by another buffer
+    @param buffer buffer to scale
+    @param weights weighting of each sample
+*/
+void multiply_buffer(Buffer *buffer, Buffer *weights)
+{
+    int i;
+    int n;
+    n = MIN(buffer->n_samples, weights->n_samples);
+    for(i=0;i<n;i++)
+        buffer->x[i] *= weights->x[i];
+}
+
 /** Apply a biquad to an entire buffer.
     @arg biquad The filter to apply.
     @arg buffer The buffer to apply it to.
@@ -206,4 +236,75 @@ void scale_buffer(Buffer *buffer, float weight)
     int i;    
     for(i=0;i<buffer->n_samples;i++)                
         buffer->x[i] *= weight;
-}
\ No newline at end of file
+}
+
+
+/** Create a set of buffers, one per channel, which share one contiguous block of 
+    data (channel after channel). Free with destroy_planar_buffers().
+    @param n_channels Number of channels
+    @param n_samples Length of each channel
+    @return An array of n_channels buffers
+*/
+Buffer **create_planar_buffers(int n_channels, int n_samples)
+{
+    Buffer **channels;
+    float *block;
+    int i;
+    channels = malloc(sizeof(*channels) * n_channels);
+    block = calloc(sizeof(*block), n_channels * n_samples);
+    for(i=0;i<n_channels;i++)
+    {
+        channels[i] = malloc(sizeof(*channels[i]));
+        channels[i]->x = &block[i*n_samples];
+        channels[i]->n_samples = n_samples;
+    }
+    return channels;
+}
+
+
+/** Destroy a set of buffers created with create_planar_buffers()
+    @param channels The buffers
+    @param n_channels Number of channels
+*/
+void destroy_planar_buffers(Buffer **channels, int n_channels)
+{
+    int i;
+    free(channels[0]->x);
+    for(i=0;i<n_channels;i++)
+        free(channels[i]);
+    free(channels);
+}
+
+
+/** Interleave a set of channels into a single block of frames.
+    Stereo (the common case) has its own loop; otherwise each channel is 
+    written at a stride, which keeps the reads contiguous.
+    @param channels The channels (all of the same length)
+    @param n_channels Number of channels
+    @param out Output; must have room for n_channels * channels[0]->n_samples values
+*/
+void interleave_buffers(Buffer **channels, int n_channels, float *out)
+{
+    int i, c, n;
+    float *x, *y;
+    n = channels[0]->n_samples;
+    
+    if(n_channels==2)
+    {
+        x = channels[0]->x;
+        y = channels[1]->x;
+        for(i=0;i<n;i++)
+        {
+            out[2*i] = x[i];
+            out[2*i+1] = y[i];
+        }
+        return;
+    }
+    
+    for(c=0;c<n_channels;c++)
+    {
+        x = channels[c]->x;
+        for(i=0;i<n;i++)
+            out[i*n_channels+c] = x[i];
+    }
+}
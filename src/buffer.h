@@ -33,12 +33,18 @@ void clip_buffer(Buffer *buffer);
 void soft_clip_buffer(Buffer *buffer);
 void zero_buffer(Buffer *buffer);
 void mix_buffer(Buffer *dest, Buffer *src, float weight);
+void mix_buffer_gains(Buffer *dest, Buffer *src, Buffer *weights);
 void mix_buffer_offset(Buffer *dest, Buffer *src, int offset, int len);
 void mix_buffer_offset_weighted(Buffer *dest, Buffer *src, int offset, int len, float weight);
 void linear_resample_buffer(Buffer *dest, Buffer *source, float rate);
 Buffer *duplicate_buffer(Buffer *a);
 void copy_buffer_partial(Buffer *a, int offset_a, int len_a, Buffer *b, int offset_b, int len_b);
 void scale_buffer(Buffer *buffer, float weight);
+void multiply_buffer(Buffer *buffer, Buffer *weights);
 void biquad_buffer(Buffer *buffer, struct Biquad *biquad);
 
+Buffer **create_planar_buffers(int n_channels, int n_samples);
+void destroy_planar_buffers(Buffer **channels, int n_channels);
+void interleave_buffers(Buffer **channels, int n_channels, float *out);
+
 #endif
\ No newline at end of file
@@ -117,3 +117,36 @@ void compute_compressor(StereoCompressor *compressor, float l, float r, float *o
     *out_r = r * compressor->gain * compressor->compress_gain;
     
 }
+
+
+// apply the compressor to a block of any number of channels (ins and outs may be the same)
+// the channels are linked: the gain follows the total power over all of them
+void process_compressor(StereoCompressor *compressor, Buffer **ins, Buffer **outs, int n_channels)
+{
+    int i, c;
+    float power, x, gain;
+    
+    for(i=0;i<ins[0]->n_samples;i++)
+    {
+        power = 0.0;
+        for(c=0;c<n_channels;c++)
+        {
+            x = ins[c]->x[i];
+            power += x*x;
+        }
+        power = sqrt(power);
+        
+        // trigger compressor
+        if(power>compressor->threshold)        
+            // attack
+            compressor->compress_gain = compressor->attack_coeff * compressor->compress_gain + (1-compressor->attack_coeff) * (1.0/compressor->ratio);
+        else            
+            // decay
+            compressor->compress_gain = compressor->decay_coeff * compressor->compress_gain + (1-compressor->decay_coeff) * (1.0);
+        
+        // apply output gain
+        gain = compressor->gain * compressor->compress_gain;
+        for(c=0;c<n_channels;c++)
+            outs[c]->x[i] = ins[c]->x[i] * gain;
+    }
+}
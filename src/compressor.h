@@ -44,6 +44,7 @@ void set_attack_compressor(StereoCompressor *compressor, float attack);
 void set_decay_compressor(StereoCompressor *compressor, float decay);
 void set_gain_compressor(StereoCompressor *compressor, float gaindB);
 void compute_compressor(StereoCompressor *compressor, float l, float r, float *out_l, float *out_r);
+void process_compressor(StereoCompressor *compressor, Buffer **ins, Buffer **outs, int n_channels);
 
 
 #endif
\ No newline at end of file
@@ -11,6 +11,7 @@
 */              
 
 #include "convolver.h"
+#include "sample_cache.h"
 
 
 Convolver *create_convolver()
@@ -98,9 +99,11 @@ void set_impulse_convolver(Convolver *convolver, Buffer *impulse)
 void load_impulse_from_file_convolver(Convolver *convolver, char *fname)
 {
         WaveSound *sound;
-        sound = create_wave_sound(fname);
+        sound = acquire_sample(fname, SAMPLE_CACHE_NATIVE_RATE, WAVESOUND_STORAGE_FLOAT);
+        if(!sound)
+            return;
         set_impulse_convolver(convolver, get_channel_wave_sound(sound, 0));
-        destroy_wave_sound(sound);       
+        release_sample(sound);       
 }
 
 // destroy a convolver object
@@ -1,13 +1,588 @@
-/**    
+/**
     @file curve.c
-    @brief
+    @brief Handling of time varying functions: breakpoint curves, computed a block at a time,
+    which automate gains and parameters with sample accuracy.
+
+    A curve starts at a value and moves through a list of segments, each of which reaches
+    its own value after its own time, in one of the CURVE_* shapes. A run of segments can
+    loop. Once a block, the curve manager computes the value of every registered curve for
+    every sample of the block into the curve's value buffer: readers that need sample
+    accuracy (e.g. gains) use the buffer, and any target (a float, a double such as the
+    mean of a distribution, or a callback for an effect parameter) is set to the value at
+    the end of the block. Each segment is computed in one run over the samples it covers,
+    with no per sample branching or smoothing, and a curve which has finished costs nothing
+    until it changes. Segment time is kept in fractional samples, so segments don't drift
+    against the sample clock however they fall across blocks.
+
+    The segments are stored in the curve, so nothing allocates while it runs. Curves can be
+    edited while they play: edits (adding, changing or removing segments, clearing, ramping,
+    looping and seeking) don't touch the curve, but go into a lock-free queue in it, and are
+    applied by the thread running the curve at the start of its next block (update_curve() or
+    get_interpolated_value_curve()). So the audio thread never sees a half made edit, and the
+    values buffer is only ever written by the thread reading it. The queue has one writer:
+    edits to the same curve from more than one thread must be serialised by the caller.
     @author John Williamson
-    
+
     Copyright (c) 2011 All rights reserved.
     Licensed under the BSD 3 clause license. See COPYING.
-    
+
     This file is part of the OpenGrain distribution.
-    http://opengrain.sourceforge.net   
-*/              
+    http://opengrain.sourceforge.net
+*/
 
 #include "curve.h"
+#include <string.h>
+
+static void apply_clear_curve(Curve *curve, float value);
+
+
+/** Create a curve, holding a value.
+    @arg value The value to start at
+    @return The new curve
+*/
+Curve *create_curve(float value)
+{
+    Curve *curve;
+    curve = malloc(sizeof(*curve));
+    curve->values = create_buffer(GLOBAL_STATE.frames_per_buffer);
+    curve->value_ptr = NULL;
+    curve->double_ptr = NULL;
+    curve->callback = NULL;
+    curve->callback_data = NULL;
+    PaUtil_InitializeRingBuffer(&curve->edits, CURVE_EDIT_QUEUE_BYTES, curve->edit_storage);
+    curve->dropped_edits = 0;
+    apply_clear_curve(curve, value);
+    return curve;
+}
+
+
+// destroy a curve (it must not be registered with a manager)
+void destroy_curve(Curve *curve)
+{
+    destroy_buffer(curve->values);
+    free(curve);
+}
+
+
+// set a float to be updated with the value of the curve every block (NULL for none)
+void set_target_curve(Curve *curve, float *target)
+{
+    curve->value_ptr = target;
+}
+
+
+// set a double to be updated with the value of the curve every block (NULL for none)
+void set_double_target_curve(Curve *curve, double *target)
+{
+    curve->double_ptr = target;
+}
+
+
+/** Make the curve drive a distribution.
+    @arg component The component whose mean is set, or -1 to set the constant value
+    (see set_constant_distribution())
+*/
+void set_distribution_target_curve(Curve *curve, Distribution *distribution, int component)
+{
+    SingleDistribution *single;
+    if(component<0)
+    {
+        curve->double_ptr = &distribution->value;
+        return;
+    }
+    single = get_component_distribution(distribution, component);
+    curve->double_ptr = single ? &single->mean : NULL;
+}
+
+
+// set a function to be called with the value of the curve every block, e.g. to set an effect parameter (NULL for none)
+void set_callback_curve(Curve *curve, CurveCallback callback, void *data)
+{
+    curve->callback_data = data;
+    curve->callback = callback;
+}
+
+
+// the edits which can be queued
+#define CURVE_EDIT_ADD 0
+#define CURVE_EDIT_SET 1
+#define CURVE_EDIT_REMOVE 2
+#define CURVE_EDIT_CLEAR 3
+#define CURVE_EDIT_RAMP 4
+#define CURVE_EDIT_LOOP 5
+#define CURVE_EDIT_POSITION 6
+
+
+// queue an edit, to be applied at the start of the next block
+static void queue_edit_curve(Curve *curve, int op, int segment, float value, float time, int type)
+{
+    CurveEdit edit;
+    edit.op = op;
+    edit.segment = segment;
+    edit.value = value;
+    edit.time = time;
+    edit.type = type;
+    if(PaUtil_GetRingBufferWriteAvailable(&curve->edits) < (long)sizeof(edit))
+    {
+        curve->dropped_edits++;
+        return;
+    }
+    PaUtil_WriteRingBuffer(&curve->edits, &edit, sizeof(edit));
+}
+
+
+// add a segment to the end of the curve (if the curve had finished, it carries on from its last value)
+static void apply_add_segment_curve(Curve *curve, float value, float time, int type)
+{
+    CurveSegment *segment;
+    if(curve->n_segments >= CURVE_MAX_SEGMENTS)
+        return;
+    segment = &curve->segments[curve->n_segments];
+    segment->value = value;
+    segment->time = time;
+    segment->type = type;
+    curve->n_segments++;
+}
+
+
+// change one of the segments of the curve
+static void apply_set_segment_curve(Curve *curve, int segment, float value, float time, int type)
+{
+    if(segment<0 || segment>=curve->n_segments)
+        return;
+    curve->segments[segment].value = value;
+    curve->segments[segment].time = time;
+    curve->segments[segment].type = type;
+}
+
+
+// remove one of the segments of the curve (the segment after it takes its place)
+static void apply_remove_segment_curve(Curve *curve, int segment)
+{
+    if(segment<0 || segment>=curve->n_segments)
+        return;
+    memmove(&curve->segments[segment], &curve->segments[segment+1], sizeof(*curve->segments) * (curve->n_segments - segment - 1));
+    curve->n_segments--;
+    if(curve->segment > segment)
+        curve->segment--;
+    if(curve->loop_end >= curve->n_segments)
+        curve->loop_start = curve->loop_end = -1;
+}
+
+
+// remove every segment, and hold a value
+static void apply_clear_curve(Curve *curve, float value)
+{
+    int i;
+    curve->n_segments = 0;
+    curve->loop_start = curve->loop_end = -1;
+    curve->start_value = value;
+    curve->segment = 0;
+    curve->position = 0.0;
+    curve->elapsed = 0.0;
+    curve->from = curve->before = value;
+    curve->value = value;
+    for(i=0;i<curve->values->n_samples;i++)
+        curve->values->x[i] = value;
+    curve->constant = 1;
+}
+
+
+// replace the curve with a single segment from its current value
+static void apply_ramp_curve(Curve *curve, float value, float time, int type)
+{
+    float start;
+    start = curve->value;
+    curve->n_segments = 0;
+    curve->loop_start = curve->loop_end = -1;
+    curve->start_value = start;
+    curve->segment = 0;
+    curve->position = 0.0;
+    curve->elapsed = 0.0;
+    curve->from = curve->before = start;
+    apply_add_segment_curve(curve, value, time, type);
+}
+
+
+// loop segments start -> end (inclusive) once end has finished; start<0 turns looping off
+static void apply_loop_curve(Curve *curve, int start, int end)
+{
+    if(start<0 || end<start || end>=curve->n_segments)
+        start = end = -1;
+    curve->loop_start = start;
+    curve->loop_end = end;
+}
+
+
+// the current value of the curve (the value of the last sample computed)
+float get_value_curve(Curve *curve)
+{
+    return curve->value;
+}
+
+
+// the largest value the curve has now or will reach (not counting overshoot of CURVE_HERMITE segments)
+float get_peak_curve(Curve *curve)
+{
+    int i, first;
+    float peak;
+    peak = curve->value;
+    first = curve->segment;
+    if(curve->loop_start>=0 && curve->loop_start<first)
+        first = curve->loop_start;
+    for(i=first;i<curve->n_segments;i++)
+        peak = MAX(peak, curve->segments[i].value);
+    return peak;
+}
+
+
+// the time, in seconds, since the start of the curve
+float get_position_curve(Curve *curve)
+{
+    return curve->elapsed / GLOBAL_STATE.sample_rate;
+}
+
+
+// the values of the curve for every sample of the last block
+Buffer *get_values_curve(Curve *curve)
+{
+    return curve->values;
+}
+
+
+// true if every sample of the last block had the same value
+int is_constant_curve(Curve *curve)
+{
+    return curve->constant;
+}
+
+
+// the segment after the current one (following the loop)
+static int next_index_curve(Curve *curve, int segment)
+{
+    segment++;
+    if(curve->loop_start>=0 && curve->loop_end<curve->n_segments && segment==curve->loop_end+1)
+        segment = curve->loop_start;
+    return segment;
+}
+
+
+// compute n samples of a segment, starting position samples into it (length samples long)
+static void render_segment_curve(Curve *curve, CurveSegment *segment, float *out, int n, double position, double length)
+{
+    int i, next;
+    float a, b, step;
+    double v, ratio, t, dt, c0, c1, c2, c3, m1, m2, p3;
+
+    a = curve->from;
+    b = segment->value;
+    switch(segment->type)
+    {
+        case CURVE_STEP:
+            for(i=0;i<n;i++)
+                out[i] = b;
+            return;
+
+        case CURVE_EXPLOG:
+            if(a*b > 0)
+            {
+                ratio = pow(b/a, 1.0/length);
+                v = a * pow(b/a, position/length);
+                for(i=0;i<n;i++)
+                {
+                    out[i] = v;
+                    v *= ratio;
+                }
+                return;
+            }
+            break;
+
+        case CURVE_REVEXPLOG:
+            if(a*b > 0)
+            {
+                // the exponential run backwards from the end, upside down
+                ratio = pow(b/a, -1.0/length);
+                v = a * pow(b/a, (length-position)/length);
+                for(i=0;i<n;i++)
+                {
+                    out[i] = a + b - v;
+                    v *= ratio;
+                }
+                return;
+            }
+            break;
+
+        case CURVE_HERMITE:
+            // Catmull-Rom tangents from the values either side
+            next = next_index_curve(curve, curve->segment);
+            p3 = next<curve->n_segments ? curve->segments[next].value : b;
+            m1 = 0.5 * (b - curve->before);
+            m2 = 0.5 * (p3 - a);
+            c0 = a;
+            c1 = m1;
+            c2 = -3*a + 3*b - 2*m1 - m2;
+            c3 = 2*a - 2*b + m1 + m2;
+            t = position / length;
+            dt = 1.0 / length;
+            for(i=0;i<n;i++)
+            {
+                out[i] = ((c3*t + c2)*t + c1)*t + c0;
+                t += dt;
+            }
+            return;
+    }
+
+    // linear (and the exponential shapes when they can't be used)
+    step = (b - a) / length;
+    for(i=0;i<n;i++)
+        out[i] = a + step * (position + i);
+}
+
+
+// move the curve forward n samples, computing the values into out (if it isn't NULL)
+static void advance_curve(Curve *curve, float *out, int n)
+{
+    int i, len, stalled;
+    double length;
+    CurveSegment *segment;
+
+    i = 0;
+    stalled = 0;
+    while(i<n)
+    {
+        // finished: hold the last value
+        if(curve->segment >= curve->n_segments)
+        {
+            if(out)
+                for(;i<n;i++)
+                    out[i] = curve->from;
+            break;
+        }
+
+        segment = &curve->segments[curve->segment];
+        length = segment->time * GLOBAL_STATE.sample_rate;
+        if(curve->position >= length)
+        {
+            curve->position = length>0 ? curve->position - length : curve->position;
+            curve->before = curve->from;
+            curve->from = segment->value;
+            curve->segment = next_index_curve(curve, curve->segment);
+
+            // a loop with no length would never finish
+            if(++stalled > curve->n_segments)
+                curve->segment = curve->n_segments;
+            continue;
+        }
+
+        len = MIN(n - i, (int)ceil(length - curve->position));
+        if(out)
+            render_segment_curve(curve, segment, &out[i], len, curve->position, length);
+        curve->position += len;
+        i += len;
+        stalled = 0;
+    }
+    curve->elapsed += n;
+}
+
+
+// restart the curve and skip forward to a time (in seconds) from its start
+static void apply_position_curve(Curve *curve, float position)
+{
+    int samples;
+    curve->segment = 0;
+    curve->position = 0.0;
+    curve->elapsed = 0.0;
+    curve->from = curve->before = curve->start_value;
+    samples = (int)(position * GLOBAL_STATE.sample_rate);
+    if(samples > 0)
+    {
+        advance_curve(curve, NULL, samples - 1);
+        advance_curve(curve, &curve->value, 1);
+    }
+    else
+        curve->value = curve->start_value;
+    curve->constant = 0;
+}
+
+
+// apply the edits queued since the last block, in order
+static void apply_edits_curve(Curve *curve)
+{
+    CurveEdit edit;
+    while(PaUtil_GetRingBufferReadAvailable(&curve->edits) >= (long)sizeof(edit))
+    {
+        PaUtil_ReadRingBuffer(&curve->edits, &edit, sizeof(edit));
+        switch(edit.op)
+        {
+            case CURVE_EDIT_ADD:
+                apply_add_segment_curve(curve, edit.value, edit.time, edit.type);
+                break;
+            case CURVE_EDIT_SET:
+                apply_set_segment_curve(curve, edit.segment, edit.value, edit.time, edit.type);
+                break;
+            case CURVE_EDIT_REMOVE:
+                apply_remove_segment_curve(curve, edit.segment);
+                break;
+            case CURVE_EDIT_CLEAR:
+                apply_clear_curve(curve, edit.value);
+                break;
+            case CURVE_EDIT_RAMP:
+                apply_ramp_curve(curve, edit.value, edit.time, edit.type);
+                break;
+            case CURVE_EDIT_LOOP:
+                apply_loop_curve(curve, edit.segment, (int)edit.time);
+                break;
+            case CURVE_EDIT_POSITION:
+                apply_position_curve(curve, edit.time);
+                break;
+        }
+    }
+}
+
+
+// add a segment to the end of the curve (if the curve had finished, it carries on from its last value)
+void add_segment_curve(Curve *curve, float value, float time, int type)
+{
+    queue_edit_curve(curve, CURVE_EDIT_ADD, -1, value, time, type);
+}
+
+
+// change one of the segments of the curve
+void set_segment_curve(Curve *curve, int segment, float value, float time, int type)
+{
+    queue_edit_curve(curve, CURVE_EDIT_SET, segment, value, time, type);
+}
+
+
+// remove one of the segments of the curve (the segment after it takes its place)
+void remove_segment_curve(Curve *curve, int segment)
+{
+    queue_edit_curve(curve, CURVE_EDIT_REMOVE, segment, 0.0, 0.0, 0);
+}
+
+
+// remove every segment, and hold a value
+void clear_curve(Curve *curve, float value)
+{
+    queue_edit_curve(curve, CURVE_EDIT_CLEAR, -1, value, 0.0, 0);
+}
+
+
+/** Replace the curve with a single segment from its current value (when the edit is applied),
+    e.g. to fade a gain.
+    @arg value The value to move to
+    @arg time Time to reach it, in seconds
+    @arg type One of CURVE_*
+*/
+void ramp_curve(Curve *curve, float value, float time, int type)
+{
+    queue_edit_curve(curve, CURVE_EDIT_RAMP, -1, value, time, type);
+}
+
+
+// loop segments start -> end (inclusive) once end has finished; start<0 turns looping off
+void set_loop_curve(Curve *curve, int start, int end)
+{
+    queue_edit_curve(curve, CURVE_EDIT_LOOP, start, 0.0, end, 0);
+}
+
+
+// restart the curve and skip forward to a time (in seconds) from its start
+void set_position_curve(Curve *curve, float position)
+{
+    queue_edit_curve(curve, CURVE_EDIT_POSITION, -1, 0.0, position, 0);
+}
+
+
+// compute the next output->n_samples values of the curve into output, and move it on
+void get_interpolated_value_curve(Curve *curve, Buffer *output)
+{
+    apply_edits_curve(curve);
+    if(output->n_samples<=0)
+        return;
+    advance_curve(curve, output->x, output->n_samples);
+    curve->value = output->x[output->n_samples-1];
+    curve->constant = 0;
+}
+
+
+// compute the next block of the curve into its value buffer, and update its targets
+void update_curve(Curve *curve, int samples)
+{
+    int n;
+    apply_edits_curve(curve);
+    while(samples > 0)
+    {
+        n = MIN(samples, curve->values->n_samples);
+
+        // a finished curve already holds its value everywhere
+        if(curve->segment >= curve->n_segments && curve->constant && curve->values->x[0]==curve->from)
+            curve->elapsed += n;
+        else
+        {
+            curve->constant = curve->segment >= curve->n_segments;
+            advance_curve(curve, curve->values->x, n);
+        }
+        curve->value = curve->values->x[n-1];
+        samples -= n;
+    }
+
+    if(curve->value_ptr)
+        *curve->value_ptr = curve->value;
+    if(curve->double_ptr)
+        *curve->double_ptr = curve->value;
+    if(curve->callback)
+        curve->callback(curve->callback_data, curve->value);
+}
+
+
+// create an empty curve manager
+CurveManager *create_curve_manager()
+{
+    CurveManager *manager;
+    manager = malloc(sizeof(*manager));
+    manager->curves = malloc(sizeof(*manager->curves));
+    list_init(manager->curves);
+    return manager;
+}
+
+
+// destroy a curve manager (the curves are not destroyed)
+void destroy_curve_manager(CurveManager *manager)
+{
+    list_destroy(manager->curves);
+    free(manager->curves);
+    free(manager);
+}
+
+
+// compute the next block of every registered curve
+void pump_curve_manager(CurveManager *manager, int samples)
+{
+    Curve *curve;
+    list_iterator_start(manager->curves);
+    while(list_iterator_hasnext(manager->curves))
+    {
+        curve = (Curve *) list_iterator_next(manager->curves);
+        update_curve(curve, samples);
+    }
+    list_iterator_stop(manager->curves);
+}
+
+
+// have the manager run a curve every block
+void register_with_curve_manager(CurveManager *manager, Curve *curve)
+{
+    if(list_locate(manager->curves, curve)<0)
+        list_append(manager->curves, curve);
+}
+
+
+// stop the manager running a curve
+void remove_from_curve_manager(CurveManager *manager, Curve *curve)
+{
+    int index;
+    index = list_locate(manager->curves, curve);
+    if(index>=0)
+        list_delete_at(manager->curves, index);
+}
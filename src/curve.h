@@ -1,60 +1,115 @@
-/**    
+/**
     @file curve.h
-    @brief Handling of time varying functions
+    @brief Handling of time varying functions: breakpoint curves, computed a block at a time,
+    which automate gains and parameters with sample accuracy.
     @author John Williamson
-    
+
     Copyright (c) 2011 All rights reserved.
     Licensed under the BSD 3 clause license. See COPYING.
-    
+
     This file is part of the OpenGrain distribution.
-    http://opengrain.sourceforge.net   
-*/              
+    http://opengrain.sourceforge.net
+*/
 
 #ifndef __CURVE_H__
 #define __CURVE_H__
 #include "audio.h"
+#include "distributions.h"
+#include "pa_ringbuffer.h"
 #include <stdlib.h>
 #include <math.h>
 
-#define CURVE_STEP 0
-#define CURVE_LINEAR 1
-#define CURVE_EXPLOG 2
-#define CURVE_REVEXPLOG 3
-#define CURVE_HERMITE 4
+// how a segment moves from the previous value to its own
+#define CURVE_STEP 0        // jumps to the value at the start of the segment
+#define CURVE_LINEAR 1      // straight line
+#define CURVE_EXPLOG 2      // exponential (a straight line in dB, for gains); linear if the ends differ in sign or are zero
+#define CURVE_REVEXPLOG 3   // the exponential curve reversed in time (fast at the start, slow at the end)
+#define CURVE_HERMITE 4     // smooth cubic through the neighbouring values
+
+// segments are stored in place, so curves never allocate while they run
+#define CURVE_MAX_SEGMENTS 64
+
+// bytes of edits that can be waiting to be applied to a curve (a power of 2; enough to rewrite every segment)
+#define CURVE_EDIT_QUEUE_BYTES 4096
 
-typedef struct CurveSegement
+// called with the curve's value at the end of every block
+typedef void (*CurveCallback)(void *data, float value);
+
+
+/** @struct CurveEdit
+    A change to a curve, queued by the thread making it and applied at the start of the next block */
+typedef struct CurveEdit
 {
+    int op;             // which edit (see curve.c)
+    int segment;        // segment to change, or loop start
     float value;
-    float time;
+    float time;         // or loop end
     int type;
-    CurveSegment *next;
-    CurveSegment *prevprev;
-    CurveSegment *prev;    
+} CurveEdit;
+
+
+/** @struct CurveSegment */
+typedef struct CurveSegment
+{
+    float value;        // value at the end of the segment
+    float time;         // length of the segment, in seconds
+    int type;           // one of CURVE_*
 } CurveSegment;
 
 
+/** @struct Curve */
 typedef struct Curve
 {
-    CurveSegment *head;
-    int loop_start, loop_end;
-    float value;
+    CurveSegment segments[CURVE_MAX_SEGMENTS];
+    int n_segments;
+    int loop_start, loop_end;   // segments loop_start -> loop_end repeat (-1 for no loop)
+
+    float start_value;          // value before the first segment
+    int segment;                // segment being played (n_segments once the curve has finished)
+    double position;            // samples into the segment
+    double elapsed;             // samples since the start of the curve
+    float from, before;         // value at the start of the segment, and of the one before (for CURVE_HERMITE)
+    float value;                // current value
+
+    Buffer *values;             // the value for every sample of the last block
+    int constant;               // true if every sample of the last block had the same value
+
+    // targets, updated every block
     float *value_ptr;
+    double *double_ptr;
+    CurveCallback callback;
+    void *callback_data;
+
+    // edits waiting for the next block (written by one editing thread, read by the thread running the curve)
+    PaUtilRingBuffer edits;
+    char edit_storage[CURVE_EDIT_QUEUE_BYTES];
+    volatile int dropped_edits; // edits lost because the queue was full
 } Curve;
 
-Curve *create_curve();
+Curve *create_curve(float value);
 void destroy_curve(Curve *curve);
 void set_target_curve(Curve *curve, float *target);
+void set_double_target_curve(Curve *curve, double *target);
+void set_distribution_target_curve(Curve *curve, Distribution *distribution, int component);
+void set_callback_curve(Curve *curve, CurveCallback callback, void *data);
 void add_segment_curve(Curve *curve, float value, float time, int type);
 void set_segment_curve(Curve *curve, int segment, float value, float time, int type);
 void remove_segment_curve(Curve *curve, int segment);
+void clear_curve(Curve *curve, float value);
+void ramp_curve(Curve *curve, float value, float time, int type);
 void set_loop_curve(Curve *curve, int start, int end);
 float get_value_curve(Curve *curve);
-float get_position_curve(Curve *curve); 
+float get_peak_curve(Curve *curve);
+float get_position_curve(Curve *curve);
+Buffer *get_values_curve(Curve *curve);
+int is_constant_curve(Curve *curve);
 void get_interpolated_value_curve(Curve *curve, Buffer *output);
-void set_position_curve(Curve *curve, float position); 
+void set_position_curve(Curve *curve, float position);
 void update_curve(Curve *curve, int samples);
 
 
+/** @struct CurveManager
+    Runs every curve registered with it once per block */
 typedef struct CurveManager
 {
     list_t *curves;
@@ -67,4 +122,4 @@ void register_with_curve_manager(CurveManager *manager, Curve *curve);
 void remove_from_curve_manager(CurveManager *manager, Curve *curve);
 
 
-#endif
\ No newline at end of file
+#endif
@@ -22,28 +22,34 @@ static float double_side_normalization[DSF_TABLE_SIZE];
 static int tables_created = 0;
 
 
+// fill the normalization tables, once for the whole process (engines on other threads may race to do it)
 static void create_dsf_tables(void)
 {
     int i;
     float a;
-    for(i=0;i<DSF_TABLE_SIZE;i++)
+    lock_global_mutex();
+    if(!tables_created)
     {
-        a = i / (float)DSF_TABLE_SIZE;
-        single_side_normalization[i] = sqrt(1-a*a);
-        double_side_normalization[i] = (sqrt((1-a*a)/(1+a*a)));        
-    }    
-    tables_created = 1;
+        for(i=0;i<DSF_TABLE_SIZE;i++)
+        {
+            a = i / (float)DSF_TABLE_SIZE;
+            single_side_normalization[i] = sqrt(1-a*a);
+            double_side_normalization[i] = (sqrt((1-a*a)/(1+a*a)));        
+        }    
+        tables_created = 1;
+    }
+    unlock_global_mutex();
 }
 
 // create a sine grain parameter structure
 DSFGrainParameters *create_dsf_parameters(GrainSource *source)
 {
 
+    DSFGrainParameters *dsfgrain;
+    
     // make sure normalization tables have been created
-    if(!tables_created)
-        create_dsf_tables();
+    create_dsf_tables();
         
-    DSFGrainParameters *dsfgrain;
     dsfgrain = malloc(sizeof(*dsfgrain));
     dsfgrain->frequency = create_rc_generator();
     dsfgrain->ratio = create_rc_generator();
@@ -11,6 +11,7 @@
 */              
 
 #include "envelope.h"
+#include <limits.h>
 
 
 
@@ -86,7 +87,11 @@ void set_envelope(Envelope *env, int type, float attack, float decay, float shap
 // recompute envelope coefficients after a change of parameters
 void recompute_envelope(Envelope *env)
 {
-   env->duration_samples = env->duration * GLOBAL_STATE.sample_rate;
+   // (DURATION_INFINITE would overflow the sample count; this is the same limit as the grain's)
+   if(env->duration * GLOBAL_STATE.sample_rate >= INT_MAX/2)
+       env->duration_samples = INT_MAX/2;
+   else
+       env->duration_samples = env->duration * GLOBAL_STATE.sample_rate;
    env->mid_samples = env->duration_samples/4;
    env->sample_divide = 1.0/env->duration_samples;
     
@@ -291,3 +296,14 @@ void envelope_buffer(Envelope *env, Buffer *buffer)
 }
 
 
+// move an envelope on without applying it (e.g. while its grain isn't being synthesized)
+void skip_envelope(Envelope *env, int samples)
+{
+    int i;
+    // only the linear and exponential envelopes have state which depends on every sample
+    if(env->type == ENVELOPE_TYPE_LINEAR || env->type == ENVELOPE_TYPE_EXP)
+        for(i=0;i<samples;i++)
+            compute_envelope(env);
+    else
+        env->phase_samples += samples;
+}
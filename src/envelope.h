@@ -72,5 +72,6 @@ void recompute_envelope(Envelope *env);
 void retrigger_envelope(Envelope *env);
 float compute_envelope(Envelope *env);
 void envelope_buffer(Envelope *env, Buffer *buffer);
+void skip_envelope(Envelope *env, int samples);
 
 #endif
\ No newline at end of file
@@ -1,6 +1,7 @@
 /**    
     @file eq.c
-    @brief
+    @brief Master equalizer: low and high shelves and three peaking filters, with
+    one set of filters for each output channel.
     @author John Williamson
     
     Copyright (c) 2011 All rights reserved.
@@ -12,161 +13,145 @@
 
 #include "eq.h"
 
-// Create a stereo EQ object, with no initial eq objects
-StereoEQ *create_eq()
+// Create an EQ object for n_channels, with no bands enabled
+MultichannelEQ *create_eq(int n_channels)
 {
-    StereoEQ *eq = malloc(sizeof(*eq));
-    eq->left_low = NULL;
-    eq->right_low = NULL;
-    eq->left_high = NULL;
-    eq->right_high = NULL;
-    eq->left_peak_1= NULL;
-    eq->right_peak_1 = NULL;
-    eq->left_peak_2= NULL;
-    eq->right_peak_2 = NULL;
-    eq->left_peak_3= NULL;
-    eq->right_peak_3 = NULL;    
+    int i;
+    MultichannelEQ *eq = malloc(sizeof(*eq));
+    eq->n_channels = n_channels;
+    for(i=0;i<EQ_N_BANDS;i++)
+        eq->bands[i] = NULL;
     return eq;
 }
 
 
-// destroy the eq object, and any sub-biquads if they were created
-void destroy_eq(StereoEQ *eq)
+// free the filters for one band, disabling it
+static void disable_band_eq(MultichannelEQ *eq, int band)
 {
-    if(eq->left_low) free(eq->left_low);
-    if(eq->right_low) free(eq->right_low);
-    if(eq->left_high) free(eq->left_high);
-    if(eq->right_high) free(eq->right_high);
-    
-    if(eq->left_peak_1) free(eq->left_peak_1);
-    if(eq->right_peak_1) free(eq->right_peak_1);
-    if(eq->left_peak_2) free(eq->left_peak_2);
-    if(eq->right_peak_2) free(eq->right_peak_2);
-    if(eq->left_peak_3) free(eq->left_peak_3);
-    if(eq->right_peak_3) free(eq->right_peak_3);
-    
-    
-    free(eq);
+    int i;
+    if(!eq->bands[band])
+        return;
+    for(i=0;i<eq->n_channels;i++)
+        destroy_biquad(eq->bands[band][i]);
+    free(eq->bands[band]);
+    eq->bands[band] = NULL;
 }
 
 
-// process a stereo sample
-void compute_eq(StereoEQ *eq, float l, float r, float *out_l, float *out_r)
+// return the filters for one band, creating them if the band was disabled
+static Biquad **enable_band_eq(MultichannelEQ *eq, int band)
 {
-       if(eq->left_low) l=process_biquad(eq->left_low, l);
-       if(eq->right_low) r=process_biquad(eq->right_low, r);
-       
-       if(eq->left_high) l=process_biquad(eq->left_high, l);
-       if(eq->right_high) r=process_biquad(eq->right_high, r);
-       
-       if(eq->left_peak_1) l=process_biquad(eq->left_peak_1, l);
-       if(eq->right_peak_1) r=process_biquad(eq->right_peak_1, r);
-       if(eq->left_peak_2) l=process_biquad(eq->left_peak_2, l);
-       if(eq->right_peak_2) r=process_biquad(eq->right_peak_2, r);
-       if(eq->left_peak_3) l=process_biquad(eq->left_peak_3, l);
-       if(eq->right_peak_3) r=process_biquad(eq->right_peak_3, r);
-       
-       
-       *out_l = l;
-       *out_r = r;
-
+    int i;
+    if(!eq->bands[band])
+    {
+        eq->bands[band] = malloc(sizeof(*eq->bands[band]) * eq->n_channels);
+        for(i=0;i<eq->n_channels;i++)
+            eq->bands[band][i] = create_biquad();
+    }
+    return eq->bands[band];
 }
 
 
-// set the low-shelf eq, and enable low-shelfing if it wasn't already enabled
-void set_low_eq(StereoEQ *eq, float freq, float boostdB)
+// destroy the eq object, and any sub-biquads if they were created
+void destroy_eq(MultichannelEQ *eq)
 {
-
-    if(freq==0.0 || boostdB==0.0)
-    {
-        if(eq->left_low) destroy_biquad(eq->left_low);
-        if(eq->right_low) destroy_biquad(eq->right_low);
-        eq->left_low = NULL;
-        eq->right_low = NULL;        
-        return;
-    }
-    if(!eq->left_low) eq->left_low = create_biquad();
-    if(!eq->right_low) eq->right_low = create_biquad();
-    biquad_lowshelf(eq->left_low , freq, boostdB, 0.5);
-    biquad_lowshelf(eq->right_low , freq, boostdB, 0.5);
-   
+    int i;
+    for(i=0;i<EQ_N_BANDS;i++)
+        disable_band_eq(eq, i);
+    free(eq);
 }
 
 
-// set the high-shelf eq, and enable high-shelfing if it wasn't already enabled
-void set_high_eq(StereoEQ *eq, float freq, float boostdB)
+// process a block of every channel (ins and outs may be the same)
+void process_eq(MultichannelEQ *eq, Buffer **ins, Buffer **outs)
 {
-     if(freq==0.0 || boostdB==0.0)
+    int b, c, i;
+    float *in, *out;
+    Biquad *biquad;
+    
+    for(c=0;c<eq->n_channels;c++)
     {
-        if(eq->left_high) destroy_biquad(eq->left_high);
-        if(eq->right_high) destroy_biquad(eq->right_high);
-        eq->left_high = NULL;
-        eq->right_high = NULL;
+        in = ins[c]->x;
+        out = outs[c]->x;
+        if(in!=out)
+            copy_buffer(outs[c], ins[c]);
         
-        return;
+        // each enabled band in turn, over the whole block
+        for(b=0;b<EQ_N_BANDS;b++)
+        {
+            if(!eq->bands[b])
+                continue;
+            biquad = eq->bands[b][c];
+            for(i=0;i<outs[c]->n_samples;i++)
+                out[i] = process_biquad(biquad, out[i]);
+        }
     }
-
-    if(!eq->left_high) eq->left_high = create_biquad();
-    if(!eq->right_high) eq->right_high = create_biquad();
-    biquad_highshelf(eq->left_high , freq, boostdB, 0.5);
-    biquad_highshelf(eq->right_high , freq, boostdB, 0.5);
-
 }
 
-// set the peaking eq, and enable peaking if it wasn't already enabled
-void set_peak_eq_1(StereoEQ *eq, float freq, float boostdB)
+
+// set the low-shelf eq, and enable low-shelfing if it wasn't already enabled
+void set_low_eq(MultichannelEQ *eq, float freq, float boostdB)
 {
+    Biquad **band;
+    int i;
     if(freq==0.0 || boostdB==0.0)
     {
-        if(eq->left_peak_1) destroy_biquad(eq->left_peak_1);
-        if(eq->right_peak_1) destroy_biquad(eq->right_peak_1);
-        eq->left_peak_1 = NULL;
-        eq->right_peak_1 = NULL;
-        
+        disable_band_eq(eq, EQ_LOW);
         return;
     }
-    if(!eq->left_peak_1) eq->left_peak_1 = create_biquad();
-    if(!eq->right_peak_1) eq->right_peak_1 = create_biquad();
-    biquad_peaking(eq->left_peak_1 , freq, boostdB, 0.5);
-    biquad_peaking(eq->right_peak_1 , freq, boostdB, 0.5);
+    band = enable_band_eq(eq, EQ_LOW);
+    for(i=0;i<eq->n_channels;i++)
+        biquad_lowshelf(band[i], freq, boostdB, 0.5);
 }
 
 
-// set the peaking eq, and enable peaking if it wasn't already enabled
-void set_peak_eq_2(StereoEQ *eq, float freq, float boostdB)
+// set the high-shelf eq, and enable high-shelfing if it wasn't already enabled
+void set_high_eq(MultichannelEQ *eq, float freq, float boostdB)
 {
+    Biquad **band;
+    int i;
     if(freq==0.0 || boostdB==0.0)
     {
-        if(eq->left_peak_2) destroy_biquad(eq->left_peak_2);
-        if(eq->right_peak_2) destroy_biquad(eq->right_peak_2);
-        eq->left_peak_2 = NULL;
-        eq->right_peak_2 = NULL;
-        
+        disable_band_eq(eq, EQ_HIGH);
         return;
     }
-    if(!eq->left_peak_2) eq->left_peak_2 = create_biquad();
-    if(!eq->right_peak_2) eq->right_peak_2 = create_biquad();
-    biquad_peaking(eq->left_peak_2 , freq, boostdB, 0.5);
-    biquad_peaking(eq->right_peak_2 , freq, boostdB, 0.5);
+    band = enable_band_eq(eq, EQ_HIGH);
+    for(i=0;i<eq->n_channels;i++)
+        biquad_highshelf(band[i], freq, boostdB, 0.5);
 }
 
-// set the peaking eq, and enable peaking if it wasn't already enabled
-void set_peak_eq_3(StereoEQ *eq, float freq, float boostdB)
+
+// set one of the peaking filters
+static void set_peak_eq(MultichannelEQ *eq, int peak, float freq, float boostdB)
 {
+    Biquad **band;
+    int i;
     if(freq==0.0 || boostdB==0.0)
     {
-        if(eq->left_peak_3) destroy_biquad(eq->left_peak_3);
-        if(eq->right_peak_3) destroy_biquad(eq->right_peak_3);
-        eq->left_peak_3 = NULL;
-        eq->right_peak_3 = NULL;
-        
+        disable_band_eq(eq, peak);
         return;
     }
-    if(!eq->left_peak_3) eq->left_peak_3 = create_biquad();
-    if(!eq->right_peak_3) eq->right_peak_3 = create_biquad();
-    biquad_peaking(eq->left_peak_3 , freq, boostdB, 0.5);
-    biquad_peaking(eq->right_peak_3 , freq, boostdB, 0.5);
+    band = enable_band_eq(eq, peak);
+    for(i=0;i<eq->n_channels;i++)
+        biquad_peaking(band[i], freq, boostdB, 0.5);
 }
 
 
+// set the peaking eq, and enable peaking if it wasn't already enabled
+void set_peak_eq_1(MultichannelEQ *eq, float freq, float boostdB)
+{
+    set_peak_eq(eq, EQ_PEAK_1, freq, boostdB);
+}
+
+
+// set the peaking eq, and enable peaking if it wasn't already enabled
+void set_peak_eq_2(MultichannelEQ *eq, float freq, float boostdB)
+{
+    set_peak_eq(eq, EQ_PEAK_2, freq, boostdB);
+}
 
+// set the peaking eq, and enable peaking if it wasn't already enabled
+void set_peak_eq_3(MultichannelEQ *eq, float freq, float boostdB)
+{
+    set_peak_eq(eq, EQ_PEAK_3, freq, boostdB);
+}
@@ -1,6 +1,7 @@
 /**    
     @file eq.h
-    @brief
+    @brief Master equalizer: low and high shelves and three peaking filters, with
+    one set of filters for each output channel.
     @author John Williamson
     
     Copyright (c) 2011 All rights reserved.
@@ -16,25 +17,29 @@
 #include "biquad.h"
 #include <math.h>
 
-typedef struct StereoEQ
-{
-    Biquad *left_low, *right_low;
-    Biquad *left_high, *right_high;
-    Biquad *left_peak_1, *right_peak_1;
-    Biquad *left_peak_2, *right_peak_2;
-    Biquad *left_peak_3, *right_peak_3;
-    
-} StereoEQ;
-
-StereoEQ *create_eq();
-void destroy_eq(StereoEQ *eq);
-void compute_eq(StereoEQ *eq, float l, float r, float *out_l, float *out_r);
-void set_low_eq(StereoEQ *eq, float freq, float boostdB);
-void set_high_eq(StereoEQ *eq, float freq, float boostdB);
+// the bands of the eq
+#define EQ_LOW 0
+#define EQ_HIGH 1
+#define EQ_PEAK_1 2
+#define EQ_PEAK_2 3
+#define EQ_PEAK_3 4
+#define EQ_N_BANDS 5
 
+/** @struct MultichannelEQ
+    Each band is either NULL (disabled) or one biquad per channel. */
+typedef struct MultichannelEQ
+{
+    int n_channels;
+    Biquad **bands[EQ_N_BANDS];
+} MultichannelEQ;
 
-void set_peak_eq_1(StereoEQ *eq, float freq, float boostdB);
-void set_peak_eq_2(StereoEQ *eq, float freq, float boostdB);
-void set_peak_eq_3(StereoEQ *eq, float freq, float boostdB);
+MultichannelEQ *create_eq(int n_channels);
+void destroy_eq(MultichannelEQ *eq);
+void process_eq(MultichannelEQ *eq, Buffer **ins, Buffer **outs);
+void set_low_eq(MultichannelEQ *eq, float freq, float boostdB);
+void set_high_eq(MultichannelEQ *eq, float freq, float boostdB);
+void set_peak_eq_1(MultichannelEQ *eq, float freq, float boostdB);
+void set_peak_eq_2(MultichannelEQ *eq, float freq, float boostdB);
+void set_peak_eq_3(MultichannelEQ *eq, float freq, float boostdB);
 
-#endif
\ No newline at end of file
+#endif
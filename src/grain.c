@@ -29,6 +29,17 @@ Grain *create_grain(void)
     grain->finished = 0;
     grain->source = NULL;
     grain->frequency = 0;
+    grain->next = NULL;
+    grain->prev = NULL;
+    grain->serial = 0;
+    grain->due = 0;
+    grain->waiting = 0;
+    grain->cost = 0.0;
+    grain->fade_samples = 0;
+    grain->fade_remaining = 0;
+    grain->culled = 0;
+    grain->mean_square = 0.0;
+    grain->encoding.valid = 0;
     grain->location = create_location();
     set_cartesian_location(grain->location, 0, 0, 0);
     return grain;
@@ -45,9 +56,78 @@ void finish_grain(Grain *grain)
 // reset grain, and update duration in samples
 void reset_grain(Grain *grain)
 {
-    grain->duration_samples = grain->duration * GLOBAL_STATE.sample_rate;
+    // (DURATION_INFINITE would overflow the sample count)
+    if(grain->duration * GLOBAL_STATE.sample_rate >= GRAIN_MAX_DURATION_SAMPLES)
+        grain->duration_samples = GRAIN_MAX_DURATION_SAMPLES;
+    else
+        grain->duration_samples = grain->duration * GLOBAL_STATE.sample_rate;
     grain->samples_passed = 0;
     grain->finished = 0;
+    grain->next = NULL;
+    grain->prev = NULL;
+    grain->waiting = 0;
+    grain->fade_samples = 0;
+    grain->fade_remaining = 0;
+    grain->culled = 0;
+    grain->mean_square = 0.0;
+    grain->encoding.valid = 0;
+}
+
+
+// start fading out a grain which has been stolen. It finishes when the fade is complete.
+void steal_grain(Grain *grain)
+{
+    if(grain->fade_samples)
+        return;
+    grain->fade_samples = MAX(1, GRAIN_STEAL_FADE_TIME * GLOBAL_STATE.sample_rate);
+    grain->fade_remaining = grain->fade_samples;
+}
+
+// return true if the grain has been stolen, and is fading out
+int is_stolen_grain(Grain *grain)
+{
+    return grain->fade_samples > 0;
+}
+
+// apply the fade out of a stolen grain to a block of its output
+void fade_stolen_grain(Grain *grain, Buffer *buffer)
+{
+    int i;
+    float step;
+    step = 1.0 / grain->fade_samples;
+    for(i=0;i<buffer->n_samples;i++)
+    {
+        if(grain->fade_remaining>0)
+            buffer->x[i] *= (grain->fade_remaining--) * step;
+        else
+            buffer->x[i] = 0.0;
+    }
+    if(grain->fade_remaining<=0)
+        finish_grain(grain);
+}
+
+
+/** Update the RMS follower of a grain with a block of its output. The follower
+    has a time constant of AMPLTIUDE_CUTOFF_TIME.
+    @arg grain The grain
+    @arg buffer The block just synthesized for the grain
+    @return The current RMS level of the grain's output
+*/
+float follow_rms_grain(Grain *grain, Buffer *buffer)
+{
+    int i;
+    float sum, coeff;
+    
+    if(buffer->n_samples<=0)
+        return sqrt(grain->mean_square);
+        
+    sum = 0.0;
+    for(i=0;i<buffer->n_samples;i++)
+        sum += buffer->x[i] * buffer->x[i];
+    
+    coeff = exp(-buffer->n_samples / (AMPLTIUDE_CUTOFF_TIME * GLOBAL_STATE.sample_rate));
+    grain->mean_square = coeff * grain->mean_square + (1-coeff) * (sum / buffer->n_samples);
+    return sqrt(grain->mean_square);
 }
 
 
@@ -55,6 +135,7 @@ void reset_grain(Grain *grain)
 void destroy_grain(Grain *grain)
 {   
     destroy_envelope(grain->envelope);
+    destroy_location(grain->location);
     free(grain);
 }
 
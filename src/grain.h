@@ -14,14 +14,26 @@
 #define __GRAIN_H__
 
 #include "audio.h"
+#include <limits.h>
 #include "distributions.h"
 #include "envelope.h"
 
 #include "location.h"
+#include "ambisonic.h"
 
 // time in seconds for the RMS power tracker to cutoff the grain
 #define AMPLTIUDE_CUTOFF_TIME 0.1
 
+// longest a grain can last, in samples (DURATION_INFINITE grains are clipped to this);
+// half the int range, so sample counts can't overflow
+#define GRAIN_MAX_DURATION_SAMPLES (INT_MAX/2)
+
+// time in seconds over which a stolen grain fades out
+#define GRAIN_STEAL_FADE_TIME 0.005
+
+// extra grains allocated beyond max_grains, to hold stolen grains while they fade out
+#define GRAIN_FADE_HEADROOM(max_grains) ((max_grains)/4 + 1)
+
 #define TIME_MODE_RELATIVE 0
 #define TIME_MODE_ABSOLUTE 1
 
@@ -43,8 +55,34 @@ typedef struct Grain
     int finished;   
     Location3D *location;
     float frequency;
+    
+    // gains the grain is mixed into an ambisonic bus with (worked out once, when it spawns)
+    AmbisonicEncoding encoding;
+    
+    // length of the fade out if the grain has been stolen (0 if it hasn't)
+    int fade_samples;
+    int fade_remaining;
+    
+    // true while the grain is too quiet to hear; it is kept (and tested again every block), but not synthesized
+    int culled;
+    
+    // smoothed mean square of the grain's output, to cut it off once it has decayed
+    float mean_square;
    
-
+    // block in which a grain waiting in the timing wheel is due, and true while it is in the wheel
+    unsigned int due;
+    int waiting;
+    
+    // estimated cost of synthesizing the grain (seconds per sample), taken from its source when it spawns
+    float cost;
+   
+    // next grain in the stream's list of active grains (or in its timing wheel slot), and the
+    // pointer which points to this one (so that it can be unlinked without searching the list)
+    struct Grain *next;
+    struct Grain **prev;
+    
+    // counts the times the grain has gone back to its pool (so that stale references can be spotted)
+    unsigned int serial;
     
     struct GrainSource *source;
 } Grain;
@@ -54,6 +92,10 @@ typedef struct Grain
 
 struct GrainSource;
 void finish_grain(Grain *grain);
+void steal_grain(Grain *grain);
+int is_stolen_grain(Grain *grain);
+void fade_stolen_grain(Grain *grain, Buffer *buffer);
+float follow_rms_grain(Grain *grain, Buffer *buffer);
 Grain *create_grain(void);
 void reset_grain(Grain *grain);
 void destroy_grain(Grain *grain);
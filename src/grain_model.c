@@ -97,7 +97,6 @@ void destroy_grain_model(GrainModel *model)
     destroy_distribution(model->attack);
     destroy_distribution(model->decay);
     destroy_distribution(model->shape);
-    destroy_distribution(model->duration);        
     free(model);
 }
 
@@ -111,8 +110,9 @@ void destroy_grain_model(GrainModel *model)
     @param sources The list of GrainSources which match the indices in the model->source distribution
     @param when The start time of the grain, in samples
     @param grain The grain structure to fill out   
+    @return 1 if the grain was filled, 0 if there was no valid source or no free grain specifics
 */    
-void fill_from_grain_model(GrainModel *model, list_t *sources, int when, Grain *grain)
+int fill_from_grain_model(GrainModel *model, list_t *sources, int when, Grain *grain)
 {
     void *specifics;
     GrainSource *source;
@@ -166,9 +166,15 @@ void fill_from_grain_model(GrainModel *model, list_t *sources, int when, Grain *
         specifics = revive_specifics_source(source, grain);        
         grain->specifics = specifics;
         
+        // no free specifics object, so this grain can't be played
+        if(specifics==NULL)
+            return 0;
+        
         // set the start time
         grain->samples_passed = -when;               
+        return 1;
     }
+    return 0;
 }
 
 
@@ -88,7 +88,7 @@ typedef struct GrainModel
 GrainModel *create_grain_model(void);
 void destroy_grain_model(GrainModel *model);
 float next_time_grain_model(GrainModel *model);
-void fill_from_grain_model(GrainModel *stream, list_t *sources, int when, Grain *grain);
+int fill_from_grain_model(GrainModel *stream, list_t *sources, int when, Grain *grain);
 
 
 
@@ -29,6 +29,12 @@ void set_grain_source(GrainSource *source, create_grain_func create_func, init_g
     source->fill_grain = fill_func;
     source->init_grain = init_func;
     
+    // allocate all of the specifics up front, so that none are
+    // created in the audio callback (with room for stolen grains which are fading out)
+    if(source->specifics_pool)
+        destroy_pool(source->specifics_pool);
+    source->specifics_pool = create_pool(GLOBAL_STATE.max_grains + GRAIN_FADE_HEADROOM(GLOBAL_STATE.max_grains), create_func, destroy_func, source);
+    
     source->valid = 1;
 }
 
@@ -45,76 +51,42 @@ GrainSource *create_grain_source(void)
     source->destroy_grain = NULL;
     source->fill_grain = NULL;        
     source->valid = 0;
-       
-    source->specifics_list = malloc(sizeof(*source->specifics_list));
-    list_init(source->specifics_list);
-    source->dead_specifics_list = malloc(sizeof(*source->dead_specifics_list));
-    list_init(source->dead_specifics_list);
+    source->specifics_pool = NULL;
+    source->fill_time = 0.0;
+    source->fill_samples = 0.0;
+    source->cost = 0.0;
                 
     return source;
 }
 
 
-// create or return an already created specifics object
+// take a specifics object from the pool and initialise it for this grain
+// returns NULL if every specifics object is already in use
 void *revive_specifics_source(GrainSource *source, Grain *grain)
 {
     void *specifics;
-    if(list_size(source->dead_specifics_list)>0)    
-        specifics = list_extract_at(source->dead_specifics_list, 0);    
-    else    
-        specifics = source->create_grain(source);      
-
-    source->init_grain(specifics, source->source_data, grain);
+    specifics = get_from_pool(source->specifics_pool);
+    if(specifics)
+        source->init_grain(specifics, source->source_data, grain);
     return specifics;
 }
 
 
-// put a specifics object back onto the list
+// put a specifics object back into the pool
 void kill_specifics_source(GrainSource *source, void *specifics)
 {        
-    int index;
-    
-    // remove from list
-    index = list_locate(source->specifics_list, specifics);
-    list_extract_at(source->specifics_list, index);           
-    
-    // put into the dead list
-    list_append(source->dead_specifics_list, specifics);
+    return_to_pool(source->specifics_pool, specifics);
 }
 
 // Destroy a complete GrainSource object
 void destroy_source(GrainSource *source)
 {
-
-    void *specifics;
-    
-    // destroy the active specifcs
-    list_iterator_start(source->specifics_list);    
-    while(list_iterator_hasnext(source->specifics_list))
-    {
-        specifics = list_iterator_next(source->specifics_list);
-        source->destroy_grain(specifics);    
-    }
-    list_iterator_stop(source->specifics_list);       
-    list_destroy(source->specifics_list);
-    free(source->specifics_list);
-    
-    // destroy the dead specifcs    
-    list_iterator_start(source->dead_specifics_list);    
-    while(list_iterator_hasnext(source->dead_specifics_list))
-    {
-        specifics = list_iterator_next(source->dead_specifics_list);
-        source->destroy_grain(specifics);    
-    }
-    list_iterator_stop(source->dead_specifics_list);       
-    list_destroy(source->dead_specifics_list);
-    free(source->dead_specifics_list);
-    
+    // destroy all of the specifics, active or not
+    if(source->specifics_pool)
+        destroy_pool(source->specifics_pool);
     
     // free the source data itself
     free(source);
-    
-    
 }
 
 
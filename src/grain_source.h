@@ -17,6 +17,7 @@
 #include "distributions.h"
 #include "envelope.h"
 #include "grain.h"
+#include "pool.h"
 
 
 
@@ -41,8 +42,15 @@ typedef struct GrainSource
     // add a grain into a pair of existing buffer
     fill_grain_func fill_grain;
     int valid; // true when the source has been set
-    list_t *specifics_list;        
-    list_t *dead_specifics_list;                
+    
+    // preallocated specifics objects, created when the source is set
+    Pool *specifics_pool;
+    
+    // time spent in fill_grain while the level of detail controller is calibrating
+    double fill_time;
+    double fill_samples;
+    // estimated cost of synthesis, in seconds per sample (0 if unknown)
+    float cost;
 } GrainSource;
 
 
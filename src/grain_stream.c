@@ -11,6 +11,20 @@
 */              
 
 #include "grain_stream.h"
+#include <float.h>
+#include <string.h>
+
+
+// wrappers so grains can be preallocated in a pool
+static void *create_grain_pool(void *data)
+{
+    return create_grain();
+}
+
+static void destroy_grain_pool(void *data)
+{
+    destroy_grain((Grain *)data);
+}
 
 
 // Create a new stream object
@@ -23,20 +37,34 @@ GrainStream *create_stream(int channels)
     stream->source_list = malloc(sizeof(*stream->source_list));
     list_init(stream->source_list);
     
-    // grain lists
-    
-    stream->grain_list = malloc(sizeof(*stream->grain_list));
-    list_init(stream->grain_list);
-    stream->dead_grain_list = malloc(sizeof(*stream->dead_grain_list));
-    list_init(stream->dead_grain_list);
+    // grains are all allocated up front (with room for stolen grains which are fading out)
+    stream->active_grains = NULL;
+    stream->pending = create_timing_wheel();
+    stream->in_block = 0;
+    stream->grain_pool = create_pool(GLOBAL_STATE.max_grains + GRAIN_FADE_HEADROOM(GLOBAL_STATE.max_grains), create_grain_pool, destroy_grain_pool, NULL);
+    stream->dropped_grains = 0;
+    stream->n_active_grains = 0;
+    stream->n_waiting_grains = 0;
+    stream->n_silent_grains = 0;
+    stream->spawned_grains = 0;
+    stream->killed_grains = 0;
+    stream->max_grains = GLOBAL_STATE.max_grains;
+    stream->n_fading_grains = 0;
+    stream->stolen_grains = 0;
+    stream->n_victims = 0;
+    stream->victim_threshold = 0.0;
+    stream->cull_threshold = AMPLITUDE_TERMINATION_THRESHOLD;
+    stream->culled_grains = 0;
+    stream->spawn_fraction = 1.0;
+    stream->calibrating = 0;
+    stream->grain_cost = 0.0;
+    stream->stats = NULL;
     
     stream -> time_until_next_grain = 0;
     stream->model = create_grain_model();
     
     
-    stream->gain = 1.0;
-    stream->target_gain = 1.0;
-    stream->gain_coeff = 1.0;
+    stream->gain = create_curve(1.0);
     
     stream->channels = channels;
     
@@ -58,59 +86,37 @@ StreamFX *get_stream_fx_stream(GrainStream *stream)
 }
 
 
-// set the overall gain of the stream in decibels, and the time to fade to that level
-// fade is only computed every buffer
+// set the overall gain of the stream in decibels, and the time (in seconds) to fade to that level
+// the fade is a straight line in dB, exact to the sample
 void fade_gain_stream(GrainStream *stream, float gaindB, float time)
 {
-    stream->target_gain = dB_to_gain(gaindB);
-    stream->gain_coeff = rc_time(time / GLOBAL_STATE.frames_per_buffer, -120);    
+    ramp_curve(stream->gain, dB_to_gain(gaindB), time, CURVE_EXPLOG);
 }
 
 
 // set the current gain in dB
 void set_gain_stream(GrainStream *stream, float gaindB)
 {
-    stream->target_gain = dB_to_gain(gaindB);
-    stream->gain = dB_to_gain(gaindB);
-    
+    clear_curve(stream->gain, dB_to_gain(gaindB));
+}
+
+
+// get the gain curve of the stream (e.g. to automate it with segments)
+Curve *get_gain_curve_stream(GrainStream *stream)
+{
+    return stream->gain;
 }
 
 // delete a stream and all of its attached sources
 void destroy_stream(GrainStream *stream)
 {
-    Grain *grain;
     GrainSource *source;
     
     destroy_grain_model(stream->model);
     
-    // delete each individial grain
-    list_iterator_start(stream->grain_list);    
-    while(list_iterator_hasnext(stream->grain_list))
-    {
-        grain = (Grain *) list_iterator_next(stream->grain_list);
-        destroy_grain(grain);    
-    }
-    list_iterator_stop(stream->grain_list);
-    
-    // destroy the list
-    list_destroy(stream->grain_list);
-    free(stream->grain_list);
-    
-    
-    
-    // delete each individial grain
-    list_iterator_start(stream->dead_grain_list);    
-    while(list_iterator_hasnext(stream->dead_grain_list))
-    {
-        grain = (Grain *) list_iterator_next(stream->dead_grain_list);
-        destroy_grain(grain);    
-    }
-    list_iterator_stop(stream->dead_grain_list);
-    
-    // destroy the list
-    list_destroy(stream->dead_grain_list);
-    free(stream->dead_grain_list);
-    
+    // delete every grain, whether active or not
+    destroy_pool(stream->grain_pool);
+    destroy_timing_wheel(stream->pending);
     
     // free sources    
     list_iterator_start(stream->source_list);    
@@ -127,6 +133,7 @@ void destroy_stream(GrainStream *stream)
     
     destroy_stream_fx(stream->fx);
     destroy_spatializer(stream->spatializer);
+    destroy_curve(stream->gain);
     
     
     // free buffers
@@ -147,34 +154,379 @@ GrainModel *get_grain_model_stream(GrainStream *stream)
     return stream->model;
 }
 
-// if there are grains in the dead list, draw them back out
-// otherwise generate a new one and return
+// take an unused grain from the pool
+// returns NULL if every grain is already in use
 Grain *revive_grain_stream(GrainStream *stream)
 {
-    Grain *grain;
-    if(list_size(stream->dead_grain_list)>0)    
-       grain = list_extract_at(stream->dead_grain_list, 0);    
-    else    
-        grain = create_grain();                
-            
-    return grain;
+    return (Grain *) get_from_pool(stream->grain_pool);
 }
 
 
-// put a grain back into the dead list, and remove it from the active list
+// return a grain (which must already have been removed from the active list) 
+// and its specifics to their pools
 void kill_grain_stream(GrainStream *stream, Grain *grain)
 {
     // old grains never die, they just... go into the dead pool    
-    int index;
+    if(grain->specifics)
+        kill_specifics_source(grain->source, grain->specifics);
+    grain->specifics = NULL;
+    grain->next = NULL;
+    grain->prev = NULL;
+    grain->serial++;
+    return_to_pool(stream->grain_pool, grain);
+}
+
+
+// return a finished grain (which is no longer in any list) to the pool, and count it
+static void release_grain_stream(GrainStream *stream, Grain *grain)
+{
+    if(is_stolen_grain(grain))
+        stream->n_fading_grains--;
+    if(grain->waiting)
+        stream->n_waiting_grains--;
+    else if(grain->culled)
+        stream->n_silent_grains--;
+    else
+        stream->grain_cost -= grain->cost;
+    kill_grain_stream(stream, grain);
+    stream->n_active_grains--;
+    stream->killed_grains++;
+    count_grains_stats(stream->stats, 0, 0, 1);
+}
+
+
+// unlink a grain from the active list (or a timing wheel slot), and return it to the pool
+static void remove_grain_stream(GrainStream *stream, Grain *grain)
+{
+    *grain->prev = grain->next;
+    if(grain->next)
+        grain->next->prev = grain->prev;
+    release_grain_stream(stream, grain);
+}
+
+
+// set the maximum number of grains this stream will play at once (at most GLOBAL_STATE.max_grains)
+// when the limit is reached, the least important grain is stolen
+void set_max_grains_stream(GrainStream *stream, int max_grains)
+{
+    stream->max_grains = MAX(1, MIN(max_grains, GLOBAL_STATE.max_grains));
+}
+
+
+// return the number of grains which count towards the stream's cap
+// (grains which have been stolen and are just fading out don't count)
+int get_n_playing_grains_stream(GrainStream *stream)
+{
+    return stream->n_active_grains - stream->n_fading_grains;
+}
+
+
+// return the number of grains which are sounding, and count towards the mixer's global cap
+// (grains which have not started yet, are culled, or are fading out don't count)
+int get_n_sounding_grains_stream(GrainStream *stream)
+{
+    return stream->n_active_grains - stream->n_fading_grains - stream->n_waiting_grains - stream->n_silent_grains;
+}
+
+
+// put a grain which has just entered the active list into the counts of culled or synthesized grains
+static void enter_active_grain_stream(GrainStream *stream, Grain *grain)
+{
+    grain->next = stream->active_grains;
+    if(grain->next)
+        grain->next->prev = &grain->next;
+    grain->prev = &stream->active_grains;
+    stream->active_grains = grain;
+    if(grain->culled)
+        stream->n_silent_grains++;
+    else
+        stream->grain_cost += grain->cost;
+}
+
+
+// cull a grain in the active list (or bring it back), if it can't (or can) be heard
+// (grains which last forever are culled too, and come back when they can be heard;
+// grains which are fading out are never culled)
+static void cull_grain_stream(GrainStream *stream, Grain *grain, float loudness)
+{
+    int culled;
+    if(is_stolen_grain(grain))
+        return;
+    culled = loudness < stream->cull_threshold;
+    if(culled == grain->culled)
+        return;
+    grain->culled = culled;
+    if(culled)
+    {
+        stream->culled_grains++;
+        stream->n_silent_grains++;
+        stream->grain_cost -= grain->cost;
+    }
+    else
+    {
+        stream->n_silent_grains--;
+        stream->grain_cost += grain->cost;
+    }
+}
+
+
+// return how loud a grain will be in the output, after distance attenuation and the stream gain
+// (if the stream gain is changing, the loudest it will reach is used)
+float loudness_grain_stream(GrainStream *stream, Grain *grain)
+{
+    return grain->amplitude * get_peak_curve(stream->gain) / (1+grain->location->distance * stream->spatializer->distance_attenuation_factor);    
+}
+
+
+// set the level (in dB) below which grains are treated as inaudible. Quieter grains (after
+// distance attenuation and the stream gain) are kept, but not synthesized until they could be
+// heard again, and grains whose output has decayed below it are ended (or, if they last forever,
+// not spatialized until they get louder)
+void set_cull_threshold_stream(GrainStream *stream, float threshold_dB)
+{
+    stream->cull_threshold = dB_to_gain(threshold_dB);
+}
+
+
+// return how far a grain is into its duration, in samples (negative until it starts). Grains
+// in the timing wheel have had their wait counted off already, so what is left of it is put back
+static int get_samples_passed_stream(GrainStream *stream, Grain *grain)
+{
+    unsigned int block;
+    if(!grain->waiting)
+        return grain->samples_passed;
+    
+    // the block being (or next to be) synthesized
+    block = stream->pending->now - (stream->in_block ? 1 : 0);
+    return grain->samples_passed - (int)(grain->due - block) * stream->temp_grain->n_samples;
+}
+
+
+/** Compute how important a grain is, for choosing which grain to steal when a cap is reached.
+    Louder grains (after distance attenuation and the stream gain), grains with more left 
+    to play, and younger grains are all more important; grains which have not started yet
+    count for less the longer they have to wait.
+    @arg stream The stream the grain belongs to
+    @arg grain The grain to rank
+    @return The priority; higher is more important
+*/
+float priority_grain_stream(GrainStream *stream, Grain *grain)
+{
+    float loudness, remaining, age;
     
-    // remove from list
-    index = list_locate(stream->grain_list, grain);
-    grain = list_extract_at(stream->grain_list, index);       
-    kill_specifics_source(grain->source, grain->specifics);
+    // culled grains can't be heard, so are always the first to go
+    if(grain->culled)
+        return 0.0;
     
-    // put into the dead list
-    list_append(stream->dead_grain_list, grain);
+    loudness = loudness_grain_stream(stream, grain);
+    age = get_samples_passed_stream(stream, grain) / (float)GLOBAL_STATE.sample_rate;
+    remaining = grain->duration - MAX(0, age);
+    if(remaining<0)
+        remaining = 0;
     
+    return loudness * (remaining / (remaining + PRIORITY_REMAINING_TIME)) / (1.0 + fabs(age) / PRIORITY_AGE_TIME);
+}
+
+
+// move a victim down the heap until it is in place (the most important victim is at the top)
+static void sift_victims_stream(StreamVictim *victims, int n, int i)
+{
+    StreamVictim swap;
+    int child;
+    while((child = 2*i+1) < n)
+    {
+        if(child+1 < n && victims[child+1].priority > victims[child].priority)
+            child++;
+        if(victims[child].priority <= victims[i].priority)
+            return;
+        swap = victims[i];
+        victims[i] = victims[child];
+        victims[child] = swap;
+        i = child;
+    }
+}
+
+
+// rank the grains in a list which have not already been stolen, keeping the least important 
+// n_victims in the heap (and lowering the threshold to the most important of any left out)
+static void rank_victims_list_stream(GrainStream *stream, Grain *grain)
+{
+    StreamVictim *victims, swap;
+    float priority;
+    int i;
+    
+    victims = stream->victims;
+    for(; grain; grain = grain->next)
+    {
+        if(is_stolen_grain(grain))
+            continue;
+        priority = priority_grain_stream(stream, grain);
+        if(stream->n_victims < STREAM_MAX_VICTIMS)
+        {
+            // add at the bottom, and move up into place
+            i = stream->n_victims++;
+            victims[i].grain = grain;
+            victims[i].serial = grain->serial;
+            victims[i].priority = priority;
+            while(i>0 && victims[(i-1)/2].priority < victims[i].priority)
+            {
+                swap = victims[i];
+                victims[i] = victims[(i-1)/2];
+                victims[(i-1)/2] = swap;
+                i = (i-1)/2;
+            }
+        }
+        else if(priority < victims[0].priority)
+        {
+            stream->victim_threshold = MIN(stream->victim_threshold, victims[0].priority);
+            victims[0].grain = grain;
+            victims[0].serial = grain->serial;
+            victims[0].priority = priority;
+            sift_victims_stream(victims, stream->n_victims, 0);
+        }
+        else
+            stream->victim_threshold = MIN(stream->victim_threshold, priority);
+    }
+}
+
+
+// rank every grain (playing or waiting to start) in one pass, and keep the least important,
+// sorted with the most important first (so that the next victim is taken off the end)
+static void rank_victims_stream(GrainStream *stream)
+{
+    StreamVictim *victims, swap;
+    int i, j, n;
+    
+    stream->n_victims = 0;
+    stream->victim_threshold = FLT_MAX;
+    rank_victims_list_stream(stream, stream->active_grains);
+    for(i=0;i<TIMING_WHEEL_LEVELS;i++)
+        for(j=0;j<TIMING_WHEEL_SLOTS;j++)
+            rank_victims_list_stream(stream, stream->pending->slots[i][j]);
+    
+    // sort the heap (into increasing priority), then reverse it
+    victims = stream->victims;
+    n = stream->n_victims;
+    for(i=n-1;i>0;i--)
+    {
+        swap = victims[0];
+        victims[0] = victims[i];
+        victims[i] = swap;
+        sift_victims_stream(victims, i, 0);
+    }
+    for(i=0;i<n/2;i++)
+    {
+        swap = victims[i];
+        victims[i] = victims[n-1-i];
+        victims[n-1-i] = swap;
+    }
+}
+
+
+// keep a grain which has just been added among the victims, if it is less important than
+// some of the grains which are not (the least important victim is dropped if there is no room)
+static void add_victim_stream(GrainStream *stream, Grain *grain, float priority)
+{
+    StreamVictim *victims;
+    int i;
+    
+    // no victims: the next steal ranks every grain anyway
+    if(stream->n_victims==0 || priority >= stream->victim_threshold)
+        return;
+    
+    victims = stream->victims;
+    if(stream->n_victims==STREAM_MAX_VICTIMS)
+    {
+        stream->victim_threshold = victims[0].priority;
+        memmove(victims, victims+1, (STREAM_MAX_VICTIMS-1) * sizeof(*victims));
+        stream->n_victims--;
+    }
+    for(i=stream->n_victims; i>0 && victims[i-1].priority < priority; i--)
+        victims[i] = victims[i-1];
+    victims[i].grain = grain;
+    victims[i].serial = grain->serial;
+    victims[i].priority = priority;
+    stream->n_victims++;
+}
+
+
+/** Find the least important grain (playing or waiting to start) which has not already been stolen.
+    The least important grains are ranked together, in one pass, and kept until they are used up 
+    (or until the end of the block), so that a burst of grains at the cap doesn't search every 
+    grain for each one.
+    @arg stream The stream
+    @arg priority Set to the priority of the grain
+    @return The grain, or NULL if there is no such grain
+*/
+Grain *find_victim_stream(GrainStream *stream, float *priority)
+{
+    StreamVictim *victim;
+    
+    // drop the victims which have been stolen, or have finished, since they were ranked
+    while(stream->n_victims>0)
+    {
+        victim = &stream->victims[stream->n_victims-1];
+        if(victim->grain->serial == victim->serial && !is_stolen_grain(victim->grain))
+            break;
+        stream->n_victims--;
+    }
+    if(stream->n_victims==0)
+        rank_victims_stream(stream);
+    if(stream->n_victims==0)
+        return NULL;
+    
+    victim = &stream->victims[stream->n_victims-1];
+    *priority = victim->priority;
+    return victim->grain;
+}
+
+
+// steal a grain (playing or waiting to start). Grains which have not started to sound yet 
+// (or are culled) are removed immediately; the others are faded out quickly, so that they don't click
+void steal_grain_stream(GrainStream *stream, Grain *grain)
+{
+    stream->stolen_grains++;
+    if(grain->samples_passed <= 0 || grain->culled)
+    {
+        remove_grain_stream(stream, grain);
+        return;
+    }    
+    steal_grain(grain);
+    stream->n_fading_grains++;
+}
+
+
+// steal a grain in the active list, without unlinking it (so that other grains can be stolen
+// by pointer at the same time). Grains which have not started to sound yet are dropped,
+// unheard, at the start of the next synthesis
+void fade_out_grain_stream(GrainStream *stream, Grain *grain)
+{
+    if(is_stolen_grain(grain))
+        return;
+    stream->stolen_grains++;
+    steal_grain(grain);
+    stream->n_fading_grains++;
+    if(grain->samples_passed <= 0)
+        finish_grain(grain);
+}
+
+
+// cut off the stolen grain which is nearest the end of its fade, to free up a grain
+// returns 0 if no grains are fading out
+static int cut_fading_grain_stream(GrainStream *stream)
+{
+    Grain *grain, *shortest;
+    
+    shortest = NULL;
+    for(grain = stream->active_grains; grain; grain = grain->next)
+    {
+        if(is_stolen_grain(grain) && (!shortest || grain->fade_remaining < shortest->fade_remaining))
+            shortest = grain;
+    }
+    if(!shortest)
+        return 0;
+    remove_grain_stream(stream, shortest);
+    return 1;
 }
 
 
@@ -182,22 +534,111 @@ void kill_grain_stream(GrainStream *stream, Grain *grain)
 // select a source, and add a grain from that source to the active list
 void add_grain_stream(GrainStream *stream, int when)
 {        
-        Grain *grain;
-        int distance_delay;
+        Grain *grain, *victim;
+        float priority, victim_priority;
+        int distance_delay, n_samples, blocks;
         
         grain = revive_grain_stream(stream);
-        fill_from_grain_model(stream->model, stream->source_list, when, grain);                
+        
+        // all the spare grains are held by stolen grains which are fading out;
+        // finish one of those off early. If there are none, drop this grain rather than allocate
+        if(grain==NULL && cut_fading_grain_stream(stream))
+            grain = revive_grain_stream(stream);
+        if(grain==NULL)
+        {
+            stream->dropped_grains++;
+            return;
+        }
+        
+        grain->specifics = NULL;
+        grain->source = NULL;
+        if(!fill_from_grain_model(stream->model, stream->source_list, when, grain))
+        {
+            // no source, or the source has run out of specifics
+            if(grain->source && grain->source->valid)
+                stream->dropped_grains++;
+            kill_grain_stream(stream, grain);
+            return;
+        }
         
         // apply sample delay to grains, according to distance        
         distance_delay = get_sample_delay_spatializer(stream->spatializer, grain->location->distance);        
         grain->samples_passed -= distance_delay;
         
-        // put the grain in the list
-        list_append(stream->grain_list, grain);                        
+        // grains mixed into an ambisonic bus are encoded once, here
+        encode_spatializer(stream->spatializer, grain->location, &grain->encoding);
+        
+        // too quiet to hear: only keep track of when the grain plays, until it can be heard
+        if(loudness_grain_stream(stream, grain) < stream->cull_threshold)
+        {
+            stream->culled_grains++;
+            grain->culled = 1;
+        }
+        
+        // at the cap: steal the least important grain, unless the new grain matters even less
+        priority = priority_grain_stream(stream, grain);
+        if(get_n_playing_grains_stream(stream) >= stream->max_grains)
+        {
+            victim = find_victim_stream(stream, &victim_priority);
+            if(!victim || priority <= victim_priority)
+            {
+                stream->stolen_grains++;
+                kill_grain_stream(stream, grain);
+                return;
+            }
+            steal_grain_stream(stream, victim);
+        }
+        
+        n_samples = stream->temp_grain->n_samples;
+        grain->cost = grain->source->cost;
+        if(grain->samples_passed <= -n_samples)
+        {
+            // grains which start in a later block wait in the timing wheel; the time they 
+            // spend waiting is counted off now, so they come out ready to sound
+            // (during a block the wheel has already moved on to the next one; outside of one,
+            // e.g. when triggered from another thread or by the live triggers, the next block 
+            // to be expired is the next one to be synthesized)
+            blocks = -grain->samples_passed / n_samples;
+            grain->samples_passed += blocks * n_samples;
+            insert_timing_wheel(stream->pending, grain, stream->pending->now + blocks - (stream->in_block ? 1 : 0));
+            grain->waiting = 1;
+            stream->n_waiting_grains++;
+        }
+        else
+        {
+            // put the grain in the list
+            enter_active_grain_stream(stream, grain);
+        }
+        stream->n_active_grains++;
+        stream->spawned_grains++;
+        add_victim_stream(stream, grain, priority);
+        count_grains_stats(stream->stats, 0, 1, 0);
 }
 
 
 
+// take the grains due in this block out of the timing wheel, and start them playing. Call once
+// at the start of every block, before any grains are spawned (so that the grains which are 
+// about to sound are counted by the caps)
+void start_waiting_grains_stream(GrainStream *stream)
+{
+    Grain *grain, *next;
+    grain = expire_timing_wheel(stream->pending);
+    stream->in_block = 1;
+    
+    // the grains are ranked afresh in every block
+    stream->n_victims = 0;
+    while(grain)
+    {
+        next = grain->next;
+        grain->waiting = 0;
+        stream->n_waiting_grains--;
+        enter_active_grain_stream(stream, grain);
+        grain = next;
+    }
+}
+
+
 // trigger grains according to the rate parameter (if not using manual triggering)
 // needs a buffer to know how much data to fill in 
 void auto_trigger_grains_stream(GrainStream *stream, Buffer *buffer)
@@ -230,7 +671,8 @@ void auto_trigger_grains_stream(GrainStream *stream, Buffer *buffer)
         if(interval<0)
             interval = 0;         
                 
-        if(done<buffer->n_samples)
+        // (if the level of detail is reduced, only some of the grains are started)
+        if(done<buffer->n_samples && (stream->spawn_fraction>=1.0 || uniform_double() < stream->spawn_fraction))
             add_grain_stream(stream, done);
         done += interval;
     }                
@@ -241,27 +683,59 @@ void auto_trigger_grains_stream(GrainStream *stream, Buffer *buffer)
 
 
 // add in this streams contributions to the audio output
+// (the block must already have been started with start_waiting_grains_stream, and new grains
+// triggered with auto_trigger_grains_stream)
 // outs should have stream->channels+1 entries (for the channels + diffuse reverb channel)
 void sum_buffer_stream(GrainStream *stream, Buffer **outs)
 {
     
-    int i;
-    
-    // fade the overall gain
-    stream->gain = stream->gain_coeff * stream->gain + (1-stream->gain_coeff) * stream->target_gain;
+    int i, n_channels;
+    double t;
     
+    t = get_time_stats();
     zero_buffer(stream->temp_grain);
-    auto_trigger_grains_stream(stream, outs[0]);              
     start_spatializer(stream->spatializer);        
+    t = stage_stats(stream->stats, STATS_STAGE_SPATIALIZER, t);
+    
+    // synthesize_stream records its own synthesis and spatialization times
     synthesize_stream(stream);        
+    t = get_time_stats();
+    
     stop_spatializer(stream->spatializer);       
         
-    for(i=0;i<get_n_channels_spatializer(stream->spatializer);i++)   
-            mix_buffer(outs[i], get_channel_spatializer(stream->spatializer, i), stream->gain);
-                           
-    mix_buffer(outs[stream->channels], stream->spatializer->reverb, stream->gain);
+    // (a stereo spatializer feeds the first two channels; a multichannel one as many as there are)
+    n_channels = MIN(get_n_channels_spatializer(stream->spatializer), stream->channels);
+    // (the gain curve has already been computed for this block)
+    if(is_constant_curve(stream->gain))
+    {
+        for(i=0;i<n_channels;i++)   
+            mix_buffer(outs[i], get_channel_spatializer(stream->spatializer, i), get_value_curve(stream->gain));
+        mix_buffer(outs[stream->channels], stream->spatializer->reverb, get_value_curve(stream->gain));
+    }
+    else
+    {
+        for(i=0;i<n_channels;i++)   
+            mix_buffer_gains(outs[i], get_channel_spatializer(stream->spatializer, i), get_values_curve(stream->gain));
+        mix_buffer_gains(outs[stream->channels], stream->spatializer->reverb, get_values_curve(stream->gain));
+    }
+    t = stage_stats(stream->stats, STATS_STAGE_SPATIALIZER, t);
+    
     compute_stream_fx(stream->fx, outs, outs);                      
+    stage_stats(stream->stats, STATS_STAGE_STREAM_FX, t);
     
+    count_grains_stats(stream->stats, stream->n_active_grains, 0, 0);
+    stream->in_block = 0;
+    stream->n_victims = 0;
+}
+
+
+// spatialize one block of a grain (with the encoding it spawned with, if it has one)
+static void spatialize_grain_stream(GrainStream *stream, Grain *grain, Buffer *buffer, int offset, int len)
+{
+    if(grain->encoding.valid && stream->spatializer->spatialization_mode == SPATIALIZATION_AMBISONIC)
+        spatialize_encoded(stream->spatializer, &grain->encoding, grain->amplitude, buffer, offset, len);
+    else
+        spatialize(stream->spatializer, grain->location, grain->amplitude, buffer, offset, len);
 }
 
 
@@ -269,21 +743,29 @@ void sum_buffer_stream(GrainStream *stream, Buffer **outs)
 void synthesize_stream(GrainStream *stream)
 {
     Grain *grain;
-    
-    list_t kill_list;
-    list_init(&kill_list);    
-    int offset, len;
+    Grain **link;
+    int offset, len, decayed;
+    float rms, loudness;
+    double start, spatial_start, spatial_time, fill_start;
     
     Buffer fake_buffer;
         
+    start = get_time_stats();
+    spatial_time = 0.0;
     
     //for each grain
-        
-    list_iterator_start(stream->grain_list);
-    
-    while(list_iterator_hasnext(stream->grain_list))
+    link = &stream->active_grains;
+    while(*link)
     {
-        grain = (Grain *) list_iterator_next(stream->grain_list);        
+        grain = *link;
+        
+        // stolen before they started
+        if(grain->finished)
+        {
+            remove_grain_stream(stream, grain);
+            continue;
+        }
+        
         // do the actual synthesis
    
         
@@ -304,43 +786,81 @@ void synthesize_stream(GrainStream *stream)
             // make a "fake" buffer which really points directly into the correct portion of the grain buffer
             fake_buffer.x = &(stream->temp_grain->x[offset]);
             fake_buffer.n_samples = len;           
-    
-            // synthesise
-            grain->source->fill_grain(grain->specifics, &fake_buffer);            
             
-                        
-            // apply envelope
-            envelope_buffer(grain->envelope, &fake_buffer);        
-                           
-            // spatializer
-            spatialize(stream->spatializer, grain->location, grain->amplitude, &fake_buffer, offset, len);
+            // grains which can't be heard (e.g. in a stream which has been turned down) are kept, but 
+            // not synthesized, and are tested again every block; their envelope keeps time, and the
+            // source carries on from where it stopped once they can be heard again
+            loudness = loudness_grain_stream(stream, grain);
+            cull_grain_stream(stream, grain, loudness);
+            if(grain->culled)
+                skip_envelope(grain->envelope, len);
+            else
+            {
+                // synthesise (timing each grain only while the costs are being calibrated)
+                if(stream->calibrating)
+                {
+                    fill_start = get_time_stats();
+                    grain->source->fill_grain(grain->specifics, &fake_buffer);
+                    grain->source->fill_time += get_time_stats() - fill_start;
+                    grain->source->fill_samples += len;
+                }
+                else
+                    grain->source->fill_grain(grain->specifics, &fake_buffer);            
+                
+                            
+                // apply envelope
+                envelope_buffer(grain->envelope, &fake_buffer);        
+                
+                // grains whose output has decayed away (once they have been playing long enough to tell)
+                // are ended; grains which last forever are kept, but not spatialized until they get louder
+                rms = follow_rms_grain(grain, &fake_buffer);
+                decayed = grain->samples_passed >= AMPLTIUDE_CUTOFF_TIME * GLOBAL_STATE.sample_rate && 
+                          rms * loudness < stream->cull_threshold;
+                if(decayed && grain->duration_samples != GRAIN_MAX_DURATION_SAMPLES && !grain->finished)
+                {
+                    stream->culled_grains++;
+                    finish_grain(grain);
+                }
+                
+                // fade out if the grain has been stolen
+                if(is_stolen_grain(grain))
+                    fade_stolen_grain(grain, &fake_buffer);
+                
+                if(!decayed)
+                {
+                    // spatializer (timed separately, only if statistics are being kept)
+                    if(stream->stats)
+                    {
+                        spatial_start = get_time_stats();
+                        spatialize_grain_stream(stream, grain, &fake_buffer, offset, len);
+                        spatial_time += get_time_stats() - spatial_start;
+                    }
+                    else
+                        spatialize_grain_stream(stream, grain, &fake_buffer, offset, len);
+                }
+            }
 
             // move on grain pointer
             grain->samples_passed += stream->temp_grain->n_samples;               
             
             // check if finished and remove if so!
+            // (unlinking in place means no list nodes are allocated here)
             if(grain->samples_passed >= grain->duration_samples || grain->finished)
-                list_append(&kill_list, grain);                                  
-            
+            {
+                remove_grain_stream(stream, grain);
+                continue;
+            }
       }
       else
       {
             // keep increasing samples_passed until the grain enters a buffer
              grain->samples_passed += stream->temp_grain->n_samples;                      
       }
+      link = &grain->next;
     }
     
-    list_iterator_stop(stream->grain_list);
-    
-    // remove all expired grains
-    list_iterator_start(&kill_list);    
-    while(list_iterator_hasnext(&kill_list))
-    {
-        grain = (Grain *) list_iterator_next(&kill_list);
-        kill_grain_stream(stream, grain);               
-    }    
-    list_iterator_stop(&kill_list);
-    list_destroy(&kill_list);
+    add_stage_time_stats(stream->stats, STATS_STAGE_SPATIALIZER, spatial_time);
+    add_stage_time_stats(stream->stats, STATS_STAGE_SYNTHESIZE, get_time_stats() - start - spatial_time);
 }
 
 
@@ -352,10 +872,10 @@ Spatializer *get_spatializer_stream(GrainStream *stream)
 }
 
 
-// manually trigger a single grain
+// manually trigger a single grain (rounded to the nearest sample)
 void trigger_single_grain_stream(GrainStream *stream, double in_time)
 {
-    add_grain_stream(stream, in_time * GLOBAL_STATE.sample_rate);
+    add_grain_stream(stream, (int)(in_time * GLOBAL_STATE.sample_rate + 0.5));
 }
 
 // manually trigger a number of grains over the next time period
@@ -28,6 +28,10 @@
 #include "spatializer.h"
 #include "convolver.h"
 #include "grain_model.h"
+#include "curve.h"
+#include "pool.h"
+#include "stats.h"
+#include "timing_wheel.h"
 
 
 #define DURATION_MODE_DETERMINISTIC
@@ -44,18 +48,54 @@
 
 #define DURATION_INFINITE 1e20
 
+// time constants (in seconds) used to rank grains when one has to be stolen:
+// a grain with this much time left counts half as much as one which has just begun,
+// and a grain which has played for this long counts half as much as a new one
+#define PRIORITY_REMAINING_TIME 0.05
+#define PRIORITY_AGE_TIME 1.0
+
+// number of the least important grains kept ready to be stolen, when a stream's cap is reached
+#define STREAM_MAX_VICTIMS 32
+
+
+/** @struct StreamVictim A grain which may be stolen to keep within a stream's cap */
+typedef struct StreamVictim
+{
+    Grain *grain;
+    unsigned int serial;    // the grain's serial when it was ranked (if it has changed, the grain has gone)
+    float priority;
+} StreamVictim;
+
 
 typedef struct GrainStream
 {        
     float time_until_next_grain;
     Spatializer *spatializer;
     Buffer *temp_grain;   
-    float gain;
-    float target_gain;
-    float gain_coeff;
+    Curve *gain;            // overall gain, computed for every sample of the block (by the mixer's curve manager)
     list_t *source_list;    
-    list_t *grain_list;
-    list_t *dead_grain_list;
+    Grain *active_grains;   // linked list of grains which are playing
+    TimingWheel *pending;   // grains which start in a later block (and culled grains, until they would have finished)
+    int in_block;           // set from start_waiting_grains_stream() to the end of sum_buffer_stream(), while the wheel is a block ahead
+    Pool *grain_pool;       // preallocated grains, so none are created during synthesis
+    int dropped_grains;     // number of grains which could not be played because a pool was empty
+    int n_active_grains;    // number of grains in the active list and the timing wheel
+    int n_waiting_grains;   // number of those which are in the timing wheel
+    int n_silent_grains;    // number of those which are culled, in the active list
+    int spawned_grains;     // total number of grains started
+    int killed_grains;      // total number of grains finished
+    int max_grains;         // cap on the number of grains playing at once
+    int n_fading_grains;    // number of active grains which have been stolen and are fading out
+    int stolen_grains;      // total number of grains stolen to stay within a cap
+    StreamVictim victims[STREAM_MAX_VICTIMS];   // the least important grains, most important first (emptied every block)
+    int n_victims;          // number of those
+    float victim_threshold; // every grain which is not in victims is at least this important
+    float cull_threshold;   // grains quieter than this (after attenuation and gain) are not synthesized
+    int culled_grains;      // total number of times grains have been culled as inaudible
+    float spawn_fraction;   // fraction of triggered grains which are actually started (reduced by the level of detail)
+    int calibrating;        // if true, time each source's fill_grain (set by the level of detail controller)
+    double grain_cost;      // sum of the estimated cost (seconds per sample) of the grains in the active list (not culled ones)
+    Statistics *stats;      // timing statistics (set by the mixer; may be NULL)
     StreamFX *fx;       
     GrainModel *model;
     int channels;
@@ -65,12 +105,23 @@ typedef struct GrainStream
 GrainModel *get_grain_model_stream(GrainStream *stream);
 Grain *revive_grain_stream(GrainStream *stream);
 void kill_grain_stream(GrainStream *stream, Grain *grain);
+void set_max_grains_stream(GrainStream *stream, int max_grains);
+int get_n_playing_grains_stream(GrainStream *stream);
+int get_n_sounding_grains_stream(GrainStream *stream);
+float loudness_grain_stream(GrainStream *stream, Grain *grain);
+float priority_grain_stream(GrainStream *stream, Grain *grain);
+void set_cull_threshold_stream(GrainStream *stream, float threshold_dB);
+Grain *find_victim_stream(GrainStream *stream, float *priority);
+void steal_grain_stream(GrainStream *stream, Grain *grain);
+void fade_out_grain_stream(GrainStream *stream, Grain *grain);
+void start_waiting_grains_stream(GrainStream *stream);
 Spatializer *get_spatializer_stream(GrainStream *stream);
 StreamFX *get_stream_fx_stream(GrainStream *stream);
 void synthesize_stream(GrainStream *stream);
 
 void set_gain_stream(GrainStream *stream, float gaindB);
 void fade_gain_stream(GrainStream *stream, float gaindB, float time);
+Curve *get_gain_curve_stream(GrainStream *stream);
 void add_grain_stream(GrainStream *stream, int when);
 GrainStream *create_stream(int channels);
 void destroy_stream(GrainStream *stream);
@@ -15,7 +15,9 @@
 #include "noisegrain.h"
 #include "distributions.h"
 #include "wavereader.h"
+#include "sample_cache.h"
 #include "wavegrain.h"
+#include "livegrain.h"
 #include "impulsegrain.h"
 #include "padsyngrain.h"
 #include "grain_model.h"
@@ -28,13 +30,11 @@
 #include "dsfgrain.h"
 #include "stream_fx.h"
 
-void test_hrtf_mode(GrainStream *stream);
-
-void test_default_grain_generation(GrainStream *stream)
+// default grain model settings, without setting up the spatializer
+void test_default_grain_model(GrainStream *stream)
 {
 
     
-    Spatializer *spatializer;
     GrainModel *model;
    
     
@@ -60,12 +60,14 @@ void test_default_grain_generation(GrainStream *stream)
     set_constant_distribution(model->decay, 0.9);
     set_constant_distribution(model->shape, 0.1);
     model->envelope_type = ENVELOPE_TYPE_EXP;
-    
-    spatializer = get_spatializer_stream(stream);
-    //set_spatializer_mode(spatializer, SPATIALIZATION_3D_FILTERING, SPATIALIZATION_PER_STREAM);
+}
+
+
+void test_default_grain_generation(GrainStream *stream)
+{
+    test_default_grain_model(stream);
+    //set_spatializer_mode(get_spatializer_stream(stream), SPATIALIZATION_3D_FILTERING, SPATIALIZATION_PER_STREAM);
     test_hrtf_mode(stream);
-    
-    
 }
 
 
@@ -172,7 +174,7 @@ void test_impulsegrain(GrainStream *stream)
     add_source_stream(stream, source);    
     impulse_parameters = create_impulse_parameters(source);
     
-    add_sound_bank_impulse_parameters(impulse_parameters, create_soundbank("..\\samples\\materials\\ping"));        
+    add_sound_bank_impulse_parameters(impulse_parameters, create_soundbank("..\\samples\\materials\\ping", WAVESOUND_STORAGE_INT16));        
     set_grain_source(source, create_impulsegrain, init_impulsegrain, destroy_impulsegrain, fill_impulsegrain, impulse_parameters);
 }
 
@@ -237,7 +239,7 @@ void test_wavegrain(GrainStream *stream)
     add_source_stream(stream, source);  
     
     wave_parameters = create_wave_parameters(source);
-    wave_sound = create_wave_sound("..\\samples\\speech.wav");
+    wave_sound = acquire_sample("..\\samples\\speech.wav", SAMPLE_CACHE_NATIVE_RATE, WAVESOUND_STORAGE_FLOAT | WAVESOUND_MIPMAP);
     phase = get_phase_distribution_wave_parameters(wave_parameters);
     set_source_wave_parameters(wave_parameters, wave_sound);
     set_single_component_distribution(phase, DISTRIBUTION_TYPE_UNIFORM, 0.0, 1, DISTRIBUTION_POLARITY_POSITIVE, 0);        
@@ -249,6 +251,25 @@ void test_wavegrain(GrainStream *stream)
 }
 
 
+
+void test_livegrain(GrainStream *stream, InputRing *ring)
+{
+    Distribution *delay, *pitch;
+    LiveGrainParameters *live_parameters;
+    GrainSource *source;
+    source = create_grain_source();
+    add_source_stream(stream, source);
+
+    live_parameters = create_live_parameters(source);
+    set_ring_live_parameters(live_parameters, ring);
+    set_interpolation_live_parameters(live_parameters, INTERPOLATION_CUBIC);
+    delay = get_delay_distribution_live_parameters(live_parameters);
+    set_single_component_distribution(delay, DISTRIBUTION_TYPE_UNIFORM, 0.05, 2.0, DISTRIBUTION_POLARITY_POSITIVE, 0);
+    pitch = get_pitch_shift_distribution_live_parameters(live_parameters);
+    set_single_component_distribution(pitch, DISTRIBUTION_TYPE_GAUSSIAN, 0.0, 3.0, DISTRIBUTION_POLARITY_UNCHANGED, 0);
+    set_grain_source(source, create_livegrain, init_livegrain, destroy_livegrain, fill_livegrain, live_parameters);
+}
+
 void test_glissgrain(GrainStream *stream)
 {
     Distribution *frequency;
@@ -286,7 +307,7 @@ void test_padsyngrain(GrainStream *stream)
     add_source_stream(stream, source);  
         
     padsyn_parameters = create_padsyn_parameters(source);
-    wave_sound = create_wave_sound("..\\samples\\right.wav");    
+    wave_sound = acquire_sample("..\\samples\\right.wav", SAMPLE_CACHE_NATIVE_RATE, WAVESOUND_STORAGE_FLOAT);    
     set_wave_padsyn_parameters(padsyn_parameters, wave_sound, 131072*4, 0.0);        
     pitch = get_pitch_shift_distribution_padsyn_parameters(padsyn_parameters);
     
@@ -305,7 +326,7 @@ void test_pluckgrain(GrainStream *stream)
     add_source_stream(stream, source);  
     
     pluck_parameters = create_pluck_parameters(source);
-    wave_sound = create_wave_sound("excite-plucked.wav");
+    wave_sound = acquire_sample("excite-plucked.wav", SAMPLE_CACHE_NATIVE_RATE, WAVESOUND_STORAGE_FLOAT);
     
     frequency = get_frequency_distribution_pluck_parameters(pluck_parameters);                
     set_single_component_distribution(frequency, DISTRIBUTION_TYPE_UNIFORM, 130.0, 240.0, DISTRIBUTION_POLARITY_POSITIVE, 0);    
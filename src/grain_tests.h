@@ -15,8 +15,12 @@
 #include "audio.h"
 #include "grain_stream.h"
 #include "grainmixer.h"
+#include "input_ring.h"
 
 void test_default_grain_generation(GrainStream *stream);
+void test_default_grain_model(GrainStream *stream);
+void test_hrtf_mode(GrainStream *stream);
+void test_cross_delay(GrainStream *stream);
 void test_default_mixer_settings(GrainMixer *mixer);
 
 void test_sinegrain(GrainStream *stream);
@@ -26,6 +30,7 @@ void test_fmgrain(GrainStream *stream);
 void test_analoggrain(GrainStream *stream);
 void test_dsfgrain(GrainStream *stream);
 void test_wavegrain(GrainStream *stream);
+void test_livegrain(GrainStream *stream, InputRing *ring);
 void test_glissgrain(GrainStream *stream);
 void test_padsyngrain(GrainStream *stream);
 void test_pluckgrain(GrainStream *stream);
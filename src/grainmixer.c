@@ -3,6 +3,8 @@
     @brief Mixes a set of GrainStreams together, and applies global effects. 
     Optional effects are reverb (randomized Datorro configuration),
     multiband equalization, dynamic range compression and stereo widening.
+    Mixes into any number of output channels (GLOBAL_STATE.n_channels, or stereo if 
+    the output is mono), each held in its own buffer.
     
     @author John Williamson
     
@@ -23,13 +25,18 @@ GrainMixer *create_mixer()
 {
     GrainMixer *mixer = malloc(sizeof(*mixer));
     
+    // mono output is mixed in stereo and folded down at the end
+    mixer->n_channels = MAX(2, GLOBAL_STATE.n_channels);
     
     // gain = 0.0 dB by default
+    mixer->curves = create_curve_manager();
+    mixer->gain = create_curve(1.0);
+    register_with_curve_manager(mixer->curves, mixer->gain);
     set_gain_mixer(mixer, 0.0);
     
     // effects
     
-    mixer->random_reverb = create_random_reverb(2);   
+    mixer->random_reverb = create_random_reverb(mixer->n_channels);   
     set_size_random_reverb(mixer->random_reverb, 0.2);
     
     set_modulation_random_reverb(mixer->random_reverb, 1.0);
@@ -38,7 +45,7 @@ GrainMixer *create_mixer()
     mixer->reverb_enabled = 0;
         
     
-    mixer->eq = create_eq();
+    mixer->eq = create_eq(mixer->n_channels);
     mixer->widener = create_widener();
     mixer->compressor = create_compressor();
     set_widener(mixer->widener, 0.0003, 0.02);
@@ -47,11 +54,12 @@ GrainMixer *create_mixer()
     mixer->compressor_enabled = 0;
     mixer->eq_enabled = 1;
     mixer->test_tone_enabled = 0;
+    mixer->test_tone_phase = 0.0;
     mixer->widener_enabled = 0;
     
-    mixer->temp_left = create_buffer(GLOBAL_STATE.frames_per_buffer);
-    mixer->temp_right = create_buffer(GLOBAL_STATE.frames_per_buffer);
     mixer->aux = create_buffer(GLOBAL_STATE.frames_per_buffer);
+    mixer->ins = malloc(sizeof(*mixer->ins) * (mixer->n_channels+1));
+    mixer->reverb_out = create_planar_buffers(mixer->n_channels, GLOBAL_STATE.frames_per_buffer);
     
     
     mixer->diffuse_lowpass = create_biquad();
@@ -59,12 +67,161 @@ GrainMixer *create_mixer()
     // create the stream list
     mixer->stream_list = malloc(sizeof(*mixer->stream_list));
     list_init(mixer->stream_list);
+    
+    mixer->stats = create_stats();
+    mixer->max_grains = GLOBAL_STATE.max_active_grains;
+    mixer->victims = malloc(sizeof(*mixer->victims) * MIXER_MAX_STEALS);
+    
+    mixer->lod = create_lod();
         
     return mixer;   
 }
 
 
 
+// set the maximum number of grains sounding across all of the streams (0 for no limit)
+// when the limit is reached, the least important grains (over all streams) are stolen
+void set_max_grains_mixer(GrainMixer *mixer, int max_grains)
+{
+    mixer->max_grains = MAX(0, max_grains);
+}
+
+
+// restore the heap order of the victims (most important at the top) below entry i
+static void sift_victims_mixer(GrainVictim *victims, int n, int i)
+{
+    GrainVictim swap;
+    int child;
+    while((child = 2*i+1) < n)
+    {
+        if(child+1 < n && victims[child+1].priority > victims[child].priority)
+            child++;
+        if(victims[child].priority <= victims[i].priority)
+            return;
+        swap = victims[i];
+        victims[i] = victims[child];
+        victims[child] = swap;
+        i = child;
+    }
+}
+
+
+// steal grains until the total number sounding is within the global cap. The least important
+// grains are picked out in one pass over all of the streams, keeping the best candidates so 
+// far in a heap, and are then all stolen at once
+static void limit_grains_mixer(GrainMixer *mixer)
+{
+    GrainStream *stream;
+    GrainVictim *victims, swap;
+    Grain *grain;
+    float priority;
+    int i, n, n_grains, n_steal;
+    
+    if(mixer->max_grains<=0)
+        return;
+    
+    n_grains = 0;
+    list_iterator_start(mixer->stream_list);
+    while(list_iterator_hasnext(mixer->stream_list))
+        n_grains += get_n_sounding_grains_stream((GrainStream *) list_iterator_next(mixer->stream_list));
+    list_iterator_stop(mixer->stream_list);
+    if(n_grains <= mixer->max_grains)
+        return;
+    n_steal = MIN(n_grains - mixer->max_grains, MIXER_MAX_STEALS);
+    
+    // keep the n_steal least important sounding grains; the top of the heap is the one to replace
+    victims = mixer->victims;
+    n = 0;
+    list_iterator_start(mixer->stream_list);
+    while(list_iterator_hasnext(mixer->stream_list))
+    {
+        stream = (GrainStream *) list_iterator_next(mixer->stream_list);
+        for(grain = stream->active_grains; grain; grain = grain->next)
+        {
+            if(is_stolen_grain(grain) || grain->culled)
+                continue;
+            priority = priority_grain_stream(stream, grain);
+            if(n < n_steal)
+            {
+                // add at the bottom, and move up into place
+                i = n++;
+                victims[i].grain = grain;
+                victims[i].stream = stream;
+                victims[i].priority = priority;
+                while(i>0 && victims[(i-1)/2].priority < victims[i].priority)
+                {
+                    swap = victims[i];
+                    victims[i] = victims[(i-1)/2];
+                    victims[(i-1)/2] = swap;
+                    i = (i-1)/2;
+                }
+            }
+            else if(priority < victims[0].priority)
+            {
+                victims[0].grain = grain;
+                victims[0].stream = stream;
+                victims[0].priority = priority;
+                sift_victims_mixer(victims, n, 0);
+            }
+        }
+    }
+    list_iterator_stop(mixer->stream_list);
+    
+    for(i=0;i<n;i++)
+        fade_out_grain_stream(victims[i].stream, victims[i].grain);
+}
+
+
+// apply the current level of detail to the streams and effects
+static void apply_lod_mixer(GrainMixer *mixer)
+{
+    GrainStream *stream;
+    int i, level;
+    
+    level = get_level_lod(mixer->lod);
+    GLOBAL_STATE.lod_level = level;
+    
+    for(i=0;i<list_size(mixer->stream_list);i++)
+    {
+        stream = (GrainStream *) list_get_at(mixer->stream_list, i);
+        if(level >= LOD_LEVEL_PAN)
+            set_lod_spatializer(stream->spatializer, LOD_PAN_DISTANCE, LOD_PAN_GAIN);
+        else
+            set_lod_spatializer(stream->spatializer, 1e20, 0.0);
+        stream->spawn_fraction = (level >= LOD_LEVEL_THIN) ? LOD_THIN_FRACTION : 1.0;
+    }
+    
+    // shorten the reverb tail (on top of whatever decay is set, so a decay set meanwhile isn't lost)
+    set_decay_factor_random_reverb(mixer->random_reverb, (level >= LOD_LEVEL_SHORT_REVERB) ? LOD_REVERB_DECAY_FACTOR : 1.0);
+}
+
+// return the level of detail controller
+LODController *get_lod_mixer(GrainMixer *mixer)
+{
+    return mixer->lod;
+}
+
+// let the mixer reduce quality automatically when it is close to the deadline (the default)
+void enable_lod_mixer(GrainMixer *mixer)
+{
+    enable_lod(mixer->lod);
+}
+
+// always synthesize at full quality
+void disable_lod_mixer(GrainMixer *mixer)
+{
+    disable_lod(mixer->lod, mixer->stream_list);
+    apply_lod_mixer(mixer);
+}
+
+
+// get the mixer's curve manager: curves registered with it are computed at the start of every block
+CurveManager *get_curve_manager_mixer(GrainMixer *mixer)
+{
+    return mixer->curves;
+}
+
+
 // Turn on the test tone (verifies audio is working correctly)
 void enable_test_tone_mixer(GrainMixer *mixer)
 {
@@ -146,16 +303,14 @@ void disable_widener_mixer(GrainMixer *mixer)
 void set_gain_mixer(GrainMixer *mixer, double dBgain)
 {
     mixer->dB_gain = dBgain;
-    mixer->again = dB_to_gain(mixer->dB_gain);    
-    mixer->again_target = mixer->again;
-    mixer->again_coeff = 1.0;
+    clear_curve(mixer->gain, dB_to_gain(mixer->dB_gain));
 }
 
-//Fade the mixer to a new level, over a given period of time
-void set_gain_mixer(GrainMixer *mixer, float dBgain, float time)
+//Fade the mixer to a new level, over a given period of time (in seconds, in a straight line in dB)
+void fade_gain_mixer(GrainMixer *mixer, float dBgain, float time)
 {
-    mixer->again_target = dB_to_gain(mixer->dB_gain);
-    mixer->again_coeff = rc_time(time, -80.0);
+    mixer->dB_gain = dBgain;
+    ramp_curve(mixer->gain, dB_to_gain(mixer->dB_gain), time, CURVE_EXPLOG);
 }
 
 // set the level of the reverb, in decibels
@@ -181,16 +336,77 @@ RandomReverb *get_random_reverb_mixer(GrainMixer *mixer)
 }
 
 // return the eq object
-StereoEQ *get_eq_mixer(GrainMixer *mixer)
+MultichannelEQ *get_eq_mixer(GrainMixer *mixer)
 {
     return mixer->eq;
 }
 
 
+// return the number of channels the mixer produces (what grain_mix() expects to be given)
+int get_n_channels_mixer(GrainMixer *mixer)
+{
+    return mixer->n_channels;
+}
+
+
+// return the timing statistics object
+Statistics *get_stats_mixer(GrainMixer *mixer)
+{
+    return mixer->stats;
+}
+
+
+// publish the grain counts of every stream into the statistics snapshot
+// (called once per block, from the audio thread, so other threads needn't read the stream list)
+void snapshot_stats_mixer(GrainMixer *mixer)
+{
+    StatsSnapshot *snapshot;
+    StreamCounts *counts;
+    GrainStream *stream;
+    int n;
+
+    snapshot = begin_snapshot_stats(mixer->stats);
+    memset(&snapshot->totals, 0, sizeof(snapshot->totals));
+    n = 0;
+    list_iterator_start(mixer->stream_list);
+    while(list_iterator_hasnext(mixer->stream_list))
+    {
+        stream = (GrainStream *) list_iterator_next(mixer->stream_list);
+        counts = n<STATS_MAX_STREAMS ? &snapshot->streams[n] : NULL;
+        if(counts)
+        {
+            counts->active_grains = stream->n_active_grains;
+            counts->spawned_grains = stream->spawned_grains;
+            counts->killed_grains = stream->killed_grains;
+            counts->dropped_grains = stream->dropped_grains;
+            counts->stolen_grains = stream->stolen_grains;
+            counts->culled_grains = stream->culled_grains;
+        }
+        snapshot->totals.active_grains += stream->n_active_grains;
+        snapshot->totals.spawned_grains += stream->spawned_grains;
+        snapshot->totals.killed_grains += stream->killed_grains;
+        snapshot->totals.dropped_grains += stream->dropped_grains;
+        snapshot->totals.stolen_grains += stream->stolen_grains;
+        snapshot->totals.culled_grains += stream->culled_grains;
+        n++;
+    }
+    list_iterator_stop(mixer->stream_list);
+    snapshot->n_streams = n;
+    end_snapshot_stats(mixer->stats);
+}
+
+
 // Add a grain stream to the mixer
 void add_stream(GrainMixer *mixer, GrainStream *stream)
 {
     list_append(mixer->stream_list, stream);
+    stream->stats = mixer->stats;
+    register_with_curve_manager(mixer->curves, stream->gain);
+    
+    // pick up the costs from the model, and the current level of detail
+    if(mixer->lod->calibrated)
+        assign_costs_lod(mixer->lod, stream);
+    apply_lod_mixer(mixer);
 }
 
 
@@ -201,6 +417,9 @@ void remove_stream(GrainMixer *mixer, GrainStream *stream)
     index = list_locate(mixer->stream_list, stream);
     if(index>=0)
         list_delete_at(mixer->stream_list, index);
+    remove_from_curve_manager(mixer->curves, stream->gain);
+    stream->stats = NULL;
+    stream->calibrating = 0;
 }
 
 
@@ -212,17 +431,25 @@ void destroy_mixer(GrainMixer *mixer)
     destroy_widener(mixer->widener);
     destroy_random_reverb(mixer->random_reverb);
     destroy_eq(mixer->eq);
+    destroy_stats(mixer->stats);
+    destroy_lod(mixer->lod);
+    destroy_buffer(mixer->aux);
+    free(mixer->victims);
+    destroy_curve(mixer->gain);
+    destroy_curve_manager(mixer->curves);
+    destroy_planar_buffers(mixer->reverb_out, mixer->n_channels);
+    free(mixer->ins);
 }
 
 
 
 // produce a stereo test tone
-void test_tone(Buffer *left, Buffer *right)
+void test_tone(GrainMixer *mixer, Buffer *left, Buffer *right)
 {
-   static double phase;
    float l,r;
-   double q, qpan;
+   double q, qpan, phase;
    int i;
+   phase = mixer->test_tone_phase;
    for(i=0;i<left->n_samples;i++)
     {   
         // sine oscillator, at 440.0Hz modulated at 8.8Hz  panning left to right at 1Hz
@@ -236,112 +463,117 @@ void test_tone(Buffer *left, Buffer *right)
         left->x[i] = l;
         right->x[i] = r;                        
     }
+    mixer->test_tone_phase = phase;
 }
 
 
 
-// Mix all off the streams into a stereo buffer
-void grain_mix(GrainMixer *mixer, Buffer *left, Buffer *right)
+/** Mix all of the streams into the output channels, and apply the master effects.
+    @arg mixer The mixer
+    @arg channels get_n_channels_mixer() buffers, one per output channel (e.g. from create_planar_buffers())
+*/
+void grain_mix(GrainMixer *mixer, Buffer **channels)
 {
-    int i;
-    float l, r, l0, r0, again;
-    Buffer *in_buffers[3], *out_buffers[2];    
+    int i, c, n_channels;
+    float l0, r0;
+    double t;
     GrainStream *stream;
+    Buffer *left, *right;
     
-    in_buffers[0] = left;
-    in_buffers[1] = right;
-    in_buffers[2] = mixer->aux;
-    
-    out_buffers[0] = mixer->temp_left;
-    out_buffers[1] = mixer->temp_right;
-    
-    
-    
-    //GrainStream *stream;
-    again = dB_to_gain(mixer->dB_gain);
+    n_channels = mixer->n_channels;
+    for(c=0;c<n_channels;c++)
+        mixer->ins[c] = channels[c];
+    mixer->ins[n_channels] = mixer->aux;
+    left = channels[0];
+    right = channels[1];
     
     // Clear the buffers
-    zero_buffer(left);
-    zero_buffer(right);
+    for(c=0;c<n_channels;c++)
+        zero_buffer(channels[c]);
     zero_buffer(mixer->aux);
     
+    // move every curve on to this block, before anything reads them
+    pump_curve_manager(mixer->curves, left->n_samples);
     
     // if there is a test tone, play that and don't compute anything else
     if(mixer->test_tone_enabled)
     {       
-        test_tone(left, right);        
+        test_tone(mixer, left, right);        
         return;
     }
     
     
 
+    // choose the level of detail from the load of the previous blocks
+    t = get_time_stats();
+    if(update_lod(mixer->lod, mixer->stream_list, mixer->stats))
+        apply_lod_mixer(mixer);
+    
+    // start the grains due in this block and new grains in every stream, then enforce the global cap before any are synthesized
+    list_iterator_start(mixer->stream_list);
+    while(list_iterator_hasnext(mixer->stream_list))
+    {
+          stream = (GrainStream *) list_iterator_next(mixer->stream_list);
+          start_waiting_grains_stream(stream);
+          auto_trigger_grains_stream(stream, left);
+    }
+    list_iterator_stop(mixer->stream_list);
+    limit_grains_mixer(mixer);
+    stage_stats(mixer->stats, STATS_STAGE_SPAWN, t);
+
     // sum up all the incoming streams
     list_iterator_start(mixer->stream_list);
     while(list_iterator_hasnext(mixer->stream_list))
     {
           
           stream = (GrainStream *) list_iterator_next(mixer->stream_list);            
-          sum_buffer_stream(stream, &in_buffers[0]); // add the values into the buffer    
+          sum_buffer_stream(stream, mixer->ins); // add the values into the buffers    
     }
     list_iterator_stop(mixer->stream_list);
 
    
+    t = get_time_stats();
         
-    // apply the final effects
-    for(i=0;i<left->n_samples;i++)
-    {   
-
-        l = left->x[i];
-        r = right->x[i];
-        
-        if(mixer->eq_enabled)
-        {
-            // eq
-            compute_eq(mixer->eq, l, r, &l0, &r0);
-            l = l0;
-            r = r0;
-        }
-        
-        if(mixer->compressor_enabled)
-        {
-            // compressor
-            compute_compressor(mixer->compressor, l, r, &l0, &r0);
-            l = l0;
-            r = r0;
-        }
+    // apply the final effects, a whole block of every channel at a time
+    if(mixer->eq_enabled)
+        process_eq(mixer->eq, channels, channels);
+    
+    if(mixer->compressor_enabled)
+        process_compressor(mixer->compressor, channels, channels, n_channels);
         
-        if(mixer->widener_enabled)
-        {
-            // stereo widening
-            compute_widener(mixer->widener, l,r, &l0, &r0);                    
-            l = l0;
-            r = r0;        
+    if(mixer->widener_enabled)
+    {
+        // stereo widening, of the first pair of channels
+        for(i=0;i<left->n_samples;i++)
+        {   
+            compute_widener(mixer->widener, left->x[i], right->x[i], &l0, &r0);                    
+            left->x[i] = l0;
+            right->x[i] = r0;        
         }
-                                               
     }
+    t = stage_stats(mixer->stats, STATS_STAGE_MASTER, t);
         
    if(mixer->reverb_enabled)
    { 
         // reverb
         scale_buffer(mixer->aux, dB_to_gain(-10.0));
         biquad_buffer(mixer->aux, mixer->diffuse_lowpass);
-        compute_random_reverb(mixer->random_reverb, &in_buffers[0], 3, &out_buffers[0]);        
-        mix_buffer(left, out_buffers[0], mixer->reverb_level);
-        mix_buffer(right, out_buffers[1], mixer->reverb_level);            
+        compute_random_reverb(mixer->random_reverb, mixer->ins, n_channels+1, mixer->reverb_out);        
+        for(c=0;c<n_channels;c++)
+            mix_buffer(channels[c], mixer->reverb_out[c], mixer->reverb_level);
     }        
+    t = stage_stats(mixer->stats, STATS_STAGE_REVERB, t);
     
-    // gain fade/clipping
-    for(i=0;i<left->n_samples;i++)
+    // gain/clipping (the gain curve has already been computed for the block)
+    for(c=0;c<n_channels;c++)
     {
-        left->x[i] *= mixer->again;
-        right->x[i] *= mixer->again;
-        mixer->again = mixer->again_coeff * mixer->again + (1.0-mixer->again_coeff)*mixer->again_target;        
+        if(is_constant_curve(mixer->gain))
+            scale_buffer(channels[c], get_value_curve(mixer->gain));
+        else
+            multiply_buffer(channels[c], get_values_curve(mixer->gain));
+        clip_buffer(channels[c]);
     }
-    
-    clip_buffer(left);
-    clip_buffer(right);
+    stage_stats(mixer->stats, STATS_STAGE_MASTER, t);
     
     
 }
-
-
@@ -19,6 +19,9 @@
 #include "eq.h"
 #include "widener.h"
 #include "compressor.h"
+#include "stats.h"
+#include "lod.h"
+#include "curve.h"
 
 
 /** @def Reverb mode bit flag for enabling the standard Dattoro reverb */
@@ -27,21 +30,32 @@
 /** @def Reverb mode bit flag for enabling the randomized Dattoro reverb */
 #define MIXER_REVERB_RANDOM 2
 
+/** @def Most grains stolen in one block to keep within the global cap (any more are stolen in the next block) */
+#define MIXER_MAX_STEALS 256
+
+
+/** @struct GrainVictim A grain chosen to be stolen to keep within the global cap */
+typedef struct GrainVictim
+{
+    Grain *grain;
+    GrainStream *stream;
+    float priority;
+} GrainVictim;
+
 
 /** @struct GrainMixer A grain mixer object which holds a number of streams
     and effects to apply to them. */
 typedef struct GrainMixer
 {    
     int n_streams;    
-    StereoEQ *eq;
+    int n_channels;             // output channels (at least 2)
+    MultichannelEQ *eq;
         
     RandomReverb *random_reverb;
     Widener *widener;
     StereoCompressor *compressor;
     float reverb_level;
-    float again;
-    float again_target;
-    float again_coeff;
+    Curve *gain;                // the master gain, for every sample of the block
     
     float dB_gain;
     list_t *stream_list;
@@ -52,15 +66,31 @@ typedef struct GrainMixer
     int reverb_enabled;
     int eq_enabled;
     int test_tone_enabled;    
+    double test_tone_phase;
     
     Biquad *diffuse_lowpass;
-    Buffer *temp_left, *temp_right, *aux, *temp_aux;
+    Buffer *aux, *temp_aux;
+    Buffer **ins;               // the output channels followed by aux, for the streams and reverb to read
+    Buffer **reverb_out;        // planar reverb output, one buffer per channel
+    
+    // timing statistics for every block (shared with the streams)
+    Statistics *stats;
+    
+    // cap on the number of grains sounding across all streams (0 = no cap), and the grains chosen to be stolen
+    int max_grains;
+    GrainVictim *victims;
+    
+    // adaptive level of detail
+    LODController *lod;
+    
+    // automation curves, computed once at the start of every block (including the stream gains)
+    CurveManager *curves;
     
 } GrainMixer;
 
 
 
-void test_tone(Buffer *left, Buffer *right);
+void test_tone(GrainMixer *mixer, Buffer *left, Buffer *right);
 GrainMixer *create_mixer();
 void destroy_mixer(GrainMixer *mixer);
 
@@ -72,9 +102,17 @@ void fade_gain_mixer(GrainMixer *mixer, float dBgain, float time);
 
 RandomReverb *get_random_reverb_mixer(GrainMixer *mixer);
 
-StereoEQ *get_eq_mixer(GrainMixer *mixer);
-
-void grain_mix(GrainMixer *mixer, Buffer *left, Buffer *right);
+MultichannelEQ *get_eq_mixer(GrainMixer *mixer);
+int get_n_channels_mixer(GrainMixer *mixer);
+Statistics *get_stats_mixer(GrainMixer *mixer);
+void snapshot_stats_mixer(GrainMixer *mixer);
+void set_max_grains_mixer(GrainMixer *mixer, int max_grains);
+LODController *get_lod_mixer(GrainMixer *mixer);
+void enable_lod_mixer(GrainMixer *mixer);
+void disable_lod_mixer(GrainMixer *mixer);
+CurveManager *get_curve_manager_mixer(GrainMixer *mixer);
+
+void grain_mix(GrainMixer *mixer, Buffer **channels);
 
 void enable_test_tone_mixer(GrainMixer *mixer);
 void disable_test_tone_mixer(GrainMixer *mixer);
@@ -11,6 +11,7 @@
 */              
 
 #include "hrtf.h"
+#include "sample_cache.h"
 
 
 const float MIT_azimuth_increments[] = {6.43, 6.0, 5.0, 5.0, 5.0, 5.0, 5.0, 6.0, 6.43, 8.0, 10.0, 15.0, 30.0, 180.0};
@@ -117,7 +118,8 @@ void load_MIT_hrtf_model(HRTFModel *model, char *path)
              // compute pathname
              sprintf(fname, "%s/elev%d/H%de%03da.wav", path, el, el, az);
     
-             sound = create_wave_sound(fname);
+             // (the impulses are copied, so the sound goes straight back to the cache)
+             sound = acquire_sample(fname, SAMPLE_CACHE_NATIVE_RATE, WAVESOUND_STORAGE_FLOAT);
              
              if(sound)
              {
@@ -126,6 +128,7 @@ void load_MIT_hrtf_model(HRTFModel *model, char *path)
                 list_append(model->impulses, impulse);                
                 impulse = create_hrtf_impulse(sound,  (azimuth-180), el, model->fft, 1);                                       
                 list_append(model->impulses, impulse);                            
+                release_sample(sound);
             }
             azimuth += increment;
         }           
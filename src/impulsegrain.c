@@ -108,28 +108,33 @@ void destroy_impulsegrain(void *impulsegrain)
 // copy a block from an impulse into a buffer
 void fill_impulsegrain(void *impulsegrain, Buffer *buffer)
 {
-    int i;
+    int i, len, frames;
     ImpulseGrain *impulse;
-    Buffer *channel;
     impulse = (ImpulseGrain *) impulsegrain;
-    channel = get_channel_wave_sound(impulse->sound, 0);
+    frames = impulse->sound->frames;
     
-    for(i=0;i<buffer->n_samples;i++)
+    // whole runs of the impulse are converted straight into the buffer
+    i = 0;
+    while(i<buffer->n_samples)
     {
-    
-        if(impulse->phase < channel->n_samples)
-            buffer->x[i] = channel->x[impulse->phase++];
+        len = MIN(buffer->n_samples - i, frames - impulse->phase);
+        if(len>0)
+        {
+            read_wave_sound(impulse->sound, 0, impulse->phase, len, &buffer->x[i]);
+            impulse->phase += len;
+            i += len;
+        }
     
         // if finished, force the grain to finish (even if it's early)
-        if(impulse->phase >= channel->n_samples)
+        if(impulse->phase >= frames)
         {
-            if(impulse->loop)
+            if(impulse->loop && frames>0)
                 impulse->phase = 0;
-            else    
+            else
+            {
                 finish_grain(impulse->master_grain);
+                return;
+            }
         }
     }
-           
-    
-    
 }
@@ -0,0 +1,172 @@
+/**
+    @file input_ring.c
+    @brief Single writer, multiple reader ring of mono input. The audio callback
+    deinterleaves each input block straight into the ring once, and every reader
+    (e.g. each live trigger) follows it with its own cursor, reading in place where
+    it can. The writer never waits; a reader that falls more than the ring's length
+    behind is flagged and skipped forward.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include "input_ring.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define INPUT_RING_MEMORY_BARRIER() MemoryBarrier()
+#else
+#define INPUT_RING_MEMORY_BARRIER() __sync_synchronize()
+#endif
+
+
+/** Create an input ring.
+    @arg capacity Frames to hold. Readers that always read whole blocks get their input
+    in place (without a copy) if this is a multiple of the block size.
+    @return The new ring
+*/
+InputRing *create_input_ring(int capacity)
+{
+    InputRing *ring;
+    ring = malloc(sizeof(*ring));
+    ring->capacity = capacity;
+    ring->wrap = capacity * (0x40000000 / capacity);
+    ring->data = calloc(capacity, sizeof(*ring->data));
+    ring->written = 0;
+    return ring;
+}
+
+
+// destroy an input ring (any readers must not be used again)
+void destroy_input_ring(InputRing *ring)
+{
+    free(ring->data);
+    free(ring);
+}
+
+
+// copy one channel of interleaved input into contiguous frames
+// (mono and stereo get constant strides, so the compiler can vectorise them)
+static void deinterleave_input_ring(float *out, float *in, int n_channels, int n_frames)
+{
+    int i;
+    if(n_channels==1)
+    {
+        memcpy(out, in, sizeof(*out) * n_frames);
+        return;
+    }
+    if(n_channels==2)
+    {
+        for(i=0;i<n_frames;i++)
+            out[i] = in[i*2];
+        return;
+    }
+    for(i=0;i<n_frames;i++)
+        out[i] = in[i*n_channels];
+}
+
+
+/** Write a block of input into the ring. Only one thread may write. Never blocks; input
+    nobody has read yet is overwritten.
+    @arg ring The ring
+    @arg in Interleaved input
+    @arg n_channels Number of channels in the input
+    @arg channel The channel to take
+    @arg n_frames Number of frames of input
+*/
+void write_interleaved_input_ring(InputRing *ring, float *in, int n_channels, int channel, int n_frames)
+{
+    int index, len;
+    unsigned int written;
+
+    written = ring->written;
+    in += channel;
+    while(n_frames > 0)
+    {
+        index = written % ring->capacity;
+        len = MIN(n_frames, ring->capacity - index);
+        deinterleave_input_ring(&ring->data[index], in, n_channels, len);
+        in += len * n_channels;
+        n_frames -= len;
+        written = (written + len) % ring->wrap;
+    }
+
+    // readers see the new position only once the data is in place
+    INPUT_RING_MEMORY_BARRIER();
+    ring->written = written;
+}
+
+
+// start a reader on a ring, at the next input to be written
+void attach_input_reader(InputReader *reader, InputRing *ring)
+{
+    reader->ring = ring;
+    reader->position = ring->written;
+    reader->lagging = 0;
+    reader->overruns = 0;
+}
+
+
+// the number of frames written that this reader has not read (more than the capacity if it has been lapped)
+int get_available_input_reader(InputReader *reader)
+{
+    InputRing *ring = reader->ring;
+    return (ring->written + ring->wrap - reader->position) % ring->wrap;
+}
+
+
+/** Read the next n_frames of input, if they have all been written.
+    If the reader has fallen so far behind that its input has been overwritten, it is
+    flagged as lagging and skips to the most recent n_frames.
+    @arg reader The reader
+    @arg n_frames Number of frames to read (no more than the ring capacity)
+    @arg scratch Space for n_frames, used if the frames wrap around the end of the ring
+    @return Pointer to the frames (into the ring itself, if they are contiguous, and valid until
+    the writer next writes over them), or NULL if there is not yet enough input
+*/
+float *read_input_reader(InputReader *reader, int n_frames, float *scratch)
+{
+    InputRing *ring = reader->ring;
+    float *frames;
+    int available, index, len;
+
+    available = get_available_input_reader(reader);
+    if(available < n_frames)
+        return NULL;
+    INPUT_RING_MEMORY_BARRIER();
+
+    if(available > ring->capacity)
+    {
+        reader->lagging = 1;
+        reader->overruns++;
+        reader->position = (reader->position + available - n_frames) % ring->wrap;
+    }
+
+    index = reader->position % ring->capacity;
+    if(index + n_frames <= ring->capacity)
+        frames = &ring->data[index];
+    else
+    {
+        len = ring->capacity - index;
+        memcpy(scratch, &ring->data[index], sizeof(*scratch) * len);
+        memcpy(&scratch[len], ring->data, sizeof(*scratch) * (n_frames - len));
+        frames = scratch;
+    }
+    reader->position = (reader->position + n_frames) % ring->wrap;
+    return frames;
+}
+
+
+// return whether the reader has ever fallen behind, and clear the flag
+int is_lagging_input_reader(InputReader *reader)
+{
+    int lagging;
+    lagging = reader->lagging;
+    reader->lagging = 0;
+    return lagging;
+}
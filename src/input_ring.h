@@ -0,0 +1,56 @@
+/**
+    @file input_ring.h
+    @brief Single writer, multiple reader ring of mono input. The audio callback
+    deinterleaves each input block straight into the ring once, and every reader
+    (e.g. each live trigger) follows it with its own cursor, reading in place where
+    it can. The writer never waits; a reader that falls more than the ring's length
+    behind is flagged and skipped forward.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#ifndef __INPUT_RING_H__
+#define __INPUT_RING_H__
+
+#include "audio.h"
+
+// length of the ring, in blocks of input
+#define INPUT_RING_BLOCKS 16
+
+
+/** @struct InputRing */
+typedef struct InputRing
+{
+    float *data;
+    int capacity;                   // frames of input held
+    unsigned int wrap;              // positions count up modulo this (a multiple of capacity)
+    volatile unsigned int written;  // position of the next frame to be written
+} InputRing;
+
+
+/** @struct InputReader
+    One reader's cursor into an InputRing. */
+typedef struct InputReader
+{
+    InputRing *ring;
+    unsigned int position;          // position of the next frame to be read
+    int lagging;                    // set when input was overwritten before this reader got to it
+    int overruns;                   // number of times that has happened
+} InputReader;
+
+
+InputRing *create_input_ring(int capacity);
+void destroy_input_ring(InputRing *ring);
+void write_interleaved_input_ring(InputRing *ring, float *in, int n_channels, int channel, int n_frames);
+
+void attach_input_reader(InputReader *reader, InputRing *ring);
+int get_available_input_reader(InputReader *reader);
+float *read_input_reader(InputReader *reader, int n_frames, float *scratch);
+int is_lagging_input_reader(InputReader *reader);
+
+#endif
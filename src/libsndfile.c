@@ -49,6 +49,11 @@ WaveSound *soundfile_load(char *fname)
  sound->sample_rate = sample_rate;
  sound->n_channels = file_info.channels;
  sound->frames = file_info.frames;
+ sound->n_mipmap_levels = 0;
+ sound->mipmap = NULL;
+ sound->mapping = NULL;
+ sound->storage = WAVESOUND_STORAGE_FLOAT;
+ sound->samples = NULL;
  
  sound->channels = malloc(sizeof(*sound->channels));
  list_init(sound->channels);
@@ -98,8 +103,12 @@ void *soundfile_open(int channels, int sample_rate, int bit_depth, int overwrite
     
     sndfile_info.channels = channels;
     
-    // always write WAV files
-    sndfile_info.format = SF_FORMAT_WAV | SF_ENDIAN_FILE;
+    // always write WAV files (as RF64, which is turned back into a plain WAV 
+    // when the file is closed, unless it has grown past 4Gb)
+    if(overwrite_mode == OVERWRITE_MODE_APPEND && file_exists(output_path_name))
+        sndfile_info.format = SF_FORMAT_WAV | SF_ENDIAN_FILE;
+    else
+        sndfile_info.format = SF_FORMAT_RF64 | SF_ENDIAN_FILE;
     
     // set the bit depth field
     if(bit_depth == WAVEWRITER_BIT_DEPTH_8)
@@ -125,6 +134,8 @@ void *soundfile_open(int channels, int sample_rate, int bit_depth, int overwrite
     else
     {
         handle = sf_open(output_path_name, SFM_WRITE, &sndfile_info);
+        if(handle)
+            sf_command(handle, SFC_RF64_AUTO_DOWNGRADE, NULL, SF_TRUE);
     }
     
     
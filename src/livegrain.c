@@ -0,0 +1,163 @@
+/**
+    @file livegrain.c
+    @brief Live granulation: grains read straight out of the shared input ring, at a
+    delay behind the input, so live input can be granulated without copying it per grain.
+
+    The ring is read in place as a looped wave, so the interpolators wrap around the
+    end of it like they do at the loop point of a sample. A grain's delay is taken from
+    its distribution when it spawns, and its read position is fixed against the write
+    head when it first sounds (grains can start in a later block than they spawn in).
+    The delay is clamped so that, over the grain's whole duration at its pitch, it
+    never reads input that has not arrived yet, or that has already been overwritten.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include "livegrain.h"
+#include "lod.h"
+
+
+// create a live grain parameter set (it reads nothing until it is given a ring)
+LiveGrainParameters *create_live_parameters(GrainSource *source)
+{
+    LiveGrainParameters *livegrain;
+    livegrain = malloc(sizeof(*livegrain));
+    livegrain->ring = NULL;
+    livegrain->delay = create_distribution();
+    livegrain->pitch_shift = create_distribution();
+    livegrain->interpolate = INTERPOLATION_LINEAR;
+    livegrain->kernel = create_sinc_kernel(SINC_KERNEL_CUTOFF);
+
+    // defaults
+    set_constant_distribution(livegrain->delay, 0.5);
+    set_constant_distribution(livegrain->pitch_shift, 0.0);
+    return livegrain;
+}
+
+
+// destroy a live grain parameter set (the ring is not destroyed)
+void destroy_live_parameters(LiveGrainParameters *livegrain)
+{
+    destroy_distribution(livegrain->delay);
+    destroy_distribution(livegrain->pitch_shift);
+    destroy_sinc_kernel(livegrain->kernel);
+    free(livegrain);
+}
+
+
+// set the ring to granulate (e.g. the output's input ring); grains that have already spawned keep reading the old one
+void set_ring_live_parameters(LiveGrainParameters *livegrain, InputRing *ring)
+{
+    livegrain->ring = ring;
+}
+
+
+// set the interpolation used for pitch shifted grains (one of INTERPOLATION_*)
+void set_interpolation_live_parameters(LiveGrainParameters *livegrain, int interpolate)
+{
+    livegrain->interpolate = interpolate;
+}
+
+
+// get the delay distribution (in seconds behind the input)
+Distribution *get_delay_distribution_live_parameters(LiveGrainParameters *livegrain)
+{
+    return livegrain->delay;
+}
+
+
+// get the pitch shift distribution (in semitones)
+Distribution *get_pitch_shift_distribution_live_parameters(LiveGrainParameters *livegrain)
+{
+    return livegrain->pitch_shift;
+}
+
+
+// create an empty live grain
+void *create_livegrain(void *source)
+{
+    LiveGrain *grain;
+    grain = malloc(sizeof(*grain));
+    grain->ring = NULL;
+    grain->wave.x = NULL;
+    grain->wave.n_samples = 0;
+    return grain;
+}
+
+
+// initialise a live grain, with its delay and pitch
+void init_livegrain(void *lgrain, void *source, Grain *grain)
+{
+    LiveGrain *livegrain;
+    LiveGrainParameters *parameters;
+    double delay, min_delay, max_delay;
+
+    parameters = (LiveGrainParameters *) source;
+    livegrain = (LiveGrain *) lgrain;
+
+    livegrain->ring = parameters->ring;
+    livegrain->grain = grain;
+    livegrain->started = 0;
+    livegrain->phase = 0.0;
+    livegrain->rate = SEMITONES_TO_RATE(sample_from_distribution(parameters->pitch_shift));
+    if(!livegrain->ring)
+    {
+        livegrain->wave.x = NULL;
+        livegrain->wave.n_samples = 0;
+        return;
+    }
+    livegrain->wave.x = livegrain->ring->data;
+    livegrain->wave.n_samples = livegrain->ring->capacity;
+
+    // grains shifted up catch up with the write head; grains shifted down fall back towards the oldest input
+    min_delay = LIVEGRAIN_GUARD_SAMPLES + MAX(0.0, (livegrain->rate - 1.0) * grain->duration_samples);
+    max_delay = livegrain->ring->capacity - GLOBAL_STATE.frames_per_buffer - LIVEGRAIN_GUARD_SAMPLES - MAX(0.0, (1.0 - livegrain->rate) * grain->duration_samples);
+    delay = sample_from_distribution(parameters->delay) * GLOBAL_STATE.sample_rate;
+    if(delay > max_delay)
+        delay = max_delay;
+    if(delay < min_delay)
+        delay = min_delay;
+    livegrain->delay = delay;
+
+    // interpolation is dropped when the level of detail is reduced
+    if(GLOBAL_STATE.lod_level < LOD_LEVEL_NO_INTERPOLATION)
+        livegrain->interpolate = parameters->interpolate;
+    else
+        livegrain->interpolate = INTERPOLATION_NONE;
+    livegrain->kernel = parameters->kernel;
+}
+
+
+// free a live grain structure
+void destroy_livegrain(void *lgrain)
+{
+    free(lgrain);
+}
+
+
+// read the grain out of the ring, in place
+void fill_livegrain(void *lgrain, Buffer *buffer)
+{
+    LiveGrain *livegrain;
+    int offset;
+    double head;
+    livegrain = (LiveGrain *) lgrain;
+
+    // first block: the grain's first sample lines up with the input delay samples before it
+    // (the ring already holds this block's input; the interpolators advance before they read)
+    if(!livegrain->started && livegrain->wave.n_samples>0)
+    {
+        offset = MAX(0, -livegrain->grain->samples_passed);
+        head = (double)(livegrain->ring->written % livegrain->ring->capacity);
+        livegrain->phase = fmod(head - GLOBAL_STATE.frames_per_buffer + offset - livegrain->delay - livegrain->rate, (double)livegrain->wave.n_samples);
+        if(livegrain->phase < 0)
+            livegrain->phase += livegrain->wave.n_samples;
+        livegrain->started = 1;
+    }
+    livegrain->phase = interpolate_wave(&livegrain->wave, livegrain->phase, livegrain->rate, livegrain->interpolate, livegrain->kernel, buffer);
+}
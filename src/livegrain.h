@@ -0,0 +1,65 @@
+/**
+    @file livegrain.h
+    @brief Live granulation: grains read straight out of the shared input ring, at a
+    delay behind the input, so live input can be granulated without copying it per grain.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#ifndef __LIVEGRAIN_H__
+#define __LIVEGRAIN_H__
+
+#include "audio.h"
+#include "distributions.h"
+#include "grain.h"
+#include "grain_source.h"
+#include "input_ring.h"
+#include "wave_interpolation.h"
+
+
+// samples kept clear of the write head (and of the oldest input), for the interpolation kernel
+#define LIVEGRAIN_GUARD_SAMPLES (SINC_KERNEL_TAPS+4)
+
+
+typedef struct LiveGrainParameters
+{
+    InputRing *ring;
+    Distribution *delay;        // in seconds behind the input
+    Distribution *pitch_shift;  // in semitones
+    int interpolate;            // one of INTERPOLATION_*
+    SincKernel *kernel;
+} LiveGrainParameters;
+
+typedef struct LiveGrain
+{
+    InputRing *ring;
+    Buffer wave;                // the ring's samples, read in place as a looped wave
+    Grain *grain;
+    double phase;
+    float rate;
+    float delay;                // in samples, when the grain starts
+    int started;
+    int interpolate;
+    SincKernel *kernel;
+} LiveGrain;
+
+
+LiveGrainParameters *create_live_parameters(GrainSource *source);
+void destroy_live_parameters(LiveGrainParameters *livegrain);
+void set_ring_live_parameters(LiveGrainParameters *livegrain, InputRing *ring);
+void set_interpolation_live_parameters(LiveGrainParameters *livegrain, int interpolate);
+Distribution *get_delay_distribution_live_parameters(LiveGrainParameters *livegrain);
+Distribution *get_pitch_shift_distribution_live_parameters(LiveGrainParameters *livegrain);
+
+void *create_livegrain(void *source);
+void init_livegrain(void *livegrain, void *source, Grain *grain);
+void destroy_livegrain(void *livegrain);
+void fill_livegrain(void *livegrain, Buffer *buffer);
+
+
+#endif
@@ -0,0 +1,334 @@
+/**
+    @file lod.c
+    @brief Adaptive level of detail. Watches the measured callback time, and a
+    prediction of it from a per source type cost model, and reduces the quality
+    of synthesis step by step as the load approaches the buffer deadline
+    (and restores it when the load falls again).
+
+    The cost model is calibrated over the first few blocks after the controller
+    is created: every grain's fill function is timed, and the times are pooled
+    by source type. The cost of spatialization is measured directly when the
+    controller is created.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include "lod.h"
+
+// number of blocks used to time the spatializer
+#define LOD_SPATIAL_CALIBRATION_BLOCKS 32
+
+
+// time spatialize() in one mode, in seconds per sample
+static float time_spatializer_lod(int mode)
+{
+    Spatializer *spatializer;
+    Location3D *location;
+    Buffer *mono;
+    double start;
+    int i;
+
+    spatializer = create_spatializer();
+    set_spatializer_mode(spatializer, mode, SPATIALIZATION_PER_GRAIN);
+    location = create_location();
+    set_spherical_location(location, 30.0, 0.0, 2.0);
+    mono = create_buffer(GLOBAL_STATE.frames_per_buffer);
+    for(i=0;i<mono->n_samples;i++)
+        mono->x[i] = uniform_double() * 2 - 1;
+
+    // only the per grain part is timed (the per block filtering is the same whatever the level)
+    start_spatializer(spatializer);
+    start = get_time_stats();
+    for(i=0;i<LOD_SPATIAL_CALIBRATION_BLOCKS;i++)
+        spatialize(spatializer, location, 0.5, mono, 0, mono->n_samples);
+    start = get_time_stats() - start;
+    stop_spatializer(spatializer);
+
+    destroy_buffer(mono);
+    destroy_location(location);
+    destroy_spatializer(spatializer);
+    return start / (LOD_SPATIAL_CALIBRATION_BLOCKS * (double)GLOBAL_STATE.frames_per_buffer);
+}
+
+
+// Create a level of detail controller, and measure the spatialization costs
+LODController *create_lod(void)
+{
+    LODController *lod;
+    lod = malloc(sizeof(*lod));
+    lod->enabled = 1;
+    lod->level = LOD_LEVEL_FULL;
+    lod->reason = LOD_REASON_CALIBRATING;
+    lod->load = 0.0;
+    lod->predicted_load = 0.0;
+    lod->last_block = 0;
+    lod->blocks_since_change = 0;
+    lod->calibration_blocks = LOD_CALIBRATION_BLOCKS;
+    lod->calibrated = 0;
+    lod->n_costs = 0;
+    lod->spatial_cost = time_spatializer_lod(SPATIALIZATION_3D_FILTERING);
+    lod->pan_cost = time_spatializer_lod(SPATIALIZATION_PAN);
+    return lod;
+}
+
+// Destroy a level of detail controller
+void destroy_lod(LODController *lod)
+{
+    free(lod);
+}
+
+
+// turn on adaptive level of detail (a calibration which was interrupted carries on)
+void enable_lod(LODController *lod)
+{
+    lod->enabled = 1;
+    lod->reason = lod->calibrated ? LOD_REASON_NONE : LOD_REASON_CALIBRATING;
+}
+
+// turn off adaptive level of detail; everything goes back to full quality, and the
+// streams stop timing their sources
+void disable_lod(LODController *lod, list_t *streams)
+{
+    int i;
+    lod->enabled = 0;
+    lod->level = LOD_LEVEL_FULL;
+    lod->reason = LOD_REASON_DISABLED;
+    lod->blocks_since_change = 0;
+    for(i=0;i<list_size(streams);i++)
+        ((GrainStream *) list_get_at(streams, i))->calibrating = 0;
+}
+
+// return the current level of detail (one of LOD_LEVEL_*)
+int get_level_lod(LODController *lod)
+{
+    return lod->level;
+}
+
+// return the reason the current level was chosen (one of LOD_REASON_*)
+int get_reason_lod(LODController *lod)
+{
+    return lod->reason;
+}
+
+// return a description of one of the LOD_REASON_* codes
+const char *get_reason_string_lod(int reason)
+{
+    switch(reason)
+    {
+        case LOD_REASON_NONE: return "No change";
+        case LOD_REASON_CALIBRATING: return "Calibrating source costs";
+        case LOD_REASON_MEASURED_LOAD: return "Measured load near deadline";
+        case LOD_REASON_PREDICTED_LOAD: return "Predicted load near deadline";
+        case LOD_REASON_OVERRUN: return "Deadline missed";
+        case LOD_REASON_RECOVERED: return "Load reduced";
+        case LOD_REASON_DISABLED: return "Disabled";
+    }
+    return "Unknown";
+}
+
+
+// find the cost entry for a type of source, adding it if it is new
+// returns NULL if the table is full
+static SourceCost *find_cost_lod(LODController *lod, fill_grain_func fill_grain)
+{
+    int i;
+    for(i=0;i<lod->n_costs;i++)
+        if(lod->costs[i].fill_grain == fill_grain)
+            return &lod->costs[i];
+
+    if(lod->n_costs==LOD_MAX_SOURCE_TYPES)
+        return NULL;
+    lod->costs[i].fill_grain = fill_grain;
+    lod->costs[i].time = 0.0;
+    lod->costs[i].samples = 0.0;
+    lod->costs[i].cost = 0.0;
+    lod->n_costs++;
+    return &lod->costs[i];
+}
+
+
+// cost to assume for source types which have not been measured: the mean of those which have
+static float default_cost_lod(LODController *lod)
+{
+    double total;
+    int i, n;
+    total = 0.0;
+    n = 0;
+    for(i=0;i<lod->n_costs;i++)
+    {
+        if(lod->costs[i].cost > 0)
+        {
+            total += lod->costs[i].cost;
+            n++;
+        }
+    }
+    return n>0 ? total / n : LOD_DEFAULT_COST;
+}
+
+
+// set the estimated cost of every source in a stream from the cost model
+// (call when a stream is added, after the calibration has been done)
+void assign_costs_lod(LODController *lod, GrainStream *stream)
+{
+    GrainSource *source;
+    SourceCost *cost;
+    Grain *grain;
+    int i;
+
+    for(i=0;i<list_size(stream->source_list);i++)
+    {
+        source = (GrainSource *) list_get_at(stream->source_list, i);
+        cost = find_cost_lod(lod, source->fill_grain);
+        if(cost && cost->cost > 0)
+            source->cost = cost->cost;
+        else
+            source->cost = default_cost_lod(lod);
+    }
+
+    // the costs of grains which are already playing have changed (grains waiting in the
+    // timing wheel keep the cost they spawned with, which is added when they start)
+    stream->grain_cost = 0.0;
+    for(grain = stream->active_grains; grain; grain = grain->next)
+    {
+        grain->cost = grain->source->cost;
+        if(!grain->culled)
+            stream->grain_cost += grain->cost;
+    }
+}
+
+
+// pool the fill times measured in every source by type, and work out the cost of each type
+static void finish_calibration_lod(LODController *lod, list_t *streams)
+{
+    GrainStream *stream;
+    GrainSource *source;
+    SourceCost *cost;
+    int i, j;
+
+    for(i=0;i<list_size(streams);i++)
+    {
+        stream = (GrainStream *) list_get_at(streams, i);
+        stream->calibrating = 0;
+        for(j=0;j<list_size(stream->source_list);j++)
+        {
+            source = (GrainSource *) list_get_at(stream->source_list, j);
+            cost = find_cost_lod(lod, source->fill_grain);
+            if(cost)
+            {
+                cost->time += source->fill_time;
+                cost->samples += source->fill_samples;
+            }
+            source->fill_time = 0.0;
+            source->fill_samples = 0.0;
+        }
+    }
+
+    for(i=0;i<lod->n_costs;i++)
+        if(lod->costs[i].samples > 0)
+            lod->costs[i].cost = lod->costs[i].time / lod->costs[i].samples;
+
+    for(i=0;i<list_size(streams);i++)
+        assign_costs_lod(lod, (GrainStream *) list_get_at(streams, i));
+    lod->calibrated = 1;
+}
+
+
+// predict the load (as a fraction of the deadline) of the grains now playing, at a given level
+// (only grains in the active list are synthesized; grains which are waiting to start, or culled, cost nothing)
+static double predict_load_lod(LODController *lod, list_t *streams, int level)
+{
+    GrainStream *stream;
+    double cost;
+    int i;
+
+    cost = 0.0;
+    for(i=0;i<list_size(streams);i++)
+    {
+        stream = (GrainStream *) list_get_at(streams, i);
+        cost += stream->grain_cost + (stream->n_active_grains - stream->n_waiting_grains - stream->n_silent_grains) *
+            (level >= LOD_LEVEL_PAN ? lod->pan_cost : lod->spatial_cost);
+    }
+    // cost is per sample of each block, and there are sample_rate samples per second of deadline
+    return cost * GLOBAL_STATE.sample_rate;
+}
+
+
+/** Update the controller at the start of a block. Uses the time the previous block
+    took (from the statistics history) and the cost model to choose the level of detail.
+    @arg lod The controller
+    @arg streams The list of GrainStreams being mixed
+    @arg stats The statistics the callback times are recorded in (may be NULL)
+    @return 1 if the level changed (and so needs to be applied), 0 otherwise
+*/
+int update_lod(LODController *lod, list_t *streams, Statistics *stats)
+{
+    BlockStats *block;
+    double measured, load, lower_load;
+    int i, overrun;
+
+    if(!lod->enabled)
+        return 0;
+
+    // time the sources over the first few blocks
+    if(lod->calibration_blocks > 0)
+    {
+        for(i=0;i<list_size(streams);i++)
+            ((GrainStream *) list_get_at(streams, i))->calibrating = 1;
+        lod->calibration_blocks--;
+        return 0;
+    }
+    if(!lod->calibrated)
+    {
+        finish_calibration_lod(lod, streams);
+        if(lod->reason == LOD_REASON_CALIBRATING)
+            lod->reason = LOD_REASON_NONE;
+    }
+
+    // the time taken by the last block
+    overrun = 0;
+    if(stats && stats->n_written > 0 && stats->n_written != lod->last_block)
+    {
+        lod->last_block = stats->n_written;
+        block = &stats->history[(stats->n_written-1) & (STATS_HISTORY_LENGTH-1)];
+        measured = block->callback_time / get_deadline_stats();
+        overrun = measured > 1.0;
+        lod->load += LOD_LOAD_SMOOTHING * (measured - lod->load);
+    }
+
+    lod->predicted_load = predict_load_lod(lod, streams, lod->level);
+    lod->blocks_since_change++;
+    load = MAX(lod->load, lod->predicted_load);
+
+    // reduce quality
+    if(lod->level < LOD_MAX_LEVEL && (overrun || (load > LOD_RAISE_LOAD && lod->blocks_since_change >= LOD_RAISE_HOLD_BLOCKS)))
+    {
+        lod->level++;
+        if(overrun)
+            lod->reason = LOD_REASON_OVERRUN;
+        else if(lod->load >= lod->predicted_load)
+            lod->reason = LOD_REASON_MEASURED_LOAD;
+        else
+            lod->reason = LOD_REASON_PREDICTED_LOAD;
+        lod->blocks_since_change = 0;
+        return 1;
+    }
+
+    // restore quality, if the level above would still be comfortably within the deadline
+    if(lod->level > LOD_LEVEL_FULL && lod->blocks_since_change >= LOD_LOWER_HOLD_BLOCKS)
+    {
+        lower_load = MAX(lod->load, predict_load_lod(lod, streams, lod->level-1));
+        if(lower_load < LOD_LOWER_LOAD)
+        {
+            lod->level--;
+            lod->reason = LOD_REASON_RECOVERED;
+            lod->blocks_since_change = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
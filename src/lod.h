@@ -0,0 +1,111 @@
+/**
+    @file lod.h
+    @brief Adaptive level of detail. Watches the measured callback time, and a
+    prediction of it from a per source type cost model, and reduces the quality
+    of synthesis step by step as the load approaches the buffer deadline
+    (and restores it when the load falls again).
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#ifndef __LOD_H__
+#define __LOD_H__
+#include "audio.h"
+#include "grain_stream.h"
+#include "stats.h"
+
+// the levels of detail; each level includes all of the reductions of the levels below it
+#define LOD_LEVEL_FULL 0                // everything at full quality
+#define LOD_LEVEL_PAN 1                 // distant or quiet grains are panned rather than 3D filtered
+#define LOD_LEVEL_NO_INTERPOLATION 2    // wave grains are not interpolated
+#define LOD_LEVEL_THIN 3                // only some of the triggered grains are started
+#define LOD_LEVEL_SHORT_REVERB 4        // reverb tails are shortened
+#define LOD_MAX_LEVEL 4
+
+// why the current level was chosen
+#define LOD_REASON_NONE 0               // no change has been made
+#define LOD_REASON_CALIBRATING 1        // still measuring the costs of the sources
+#define LOD_REASON_MEASURED_LOAD 2      // the measured callback time was close to the deadline
+#define LOD_REASON_PREDICTED_LOAD 3     // the cost model predicted the deadline would be close
+#define LOD_REASON_OVERRUN 4            // the last callback missed its deadline
+#define LOD_REASON_RECOVERED 5          // the load fell, so quality was increased
+#define LOD_REASON_DISABLED 6           // the controller is switched off
+
+// load (as a fraction of the deadline) above which quality is reduced, and below which it is restored
+#define LOD_RAISE_LOAD 0.8
+#define LOD_LOWER_LOAD 0.5
+
+// minimum number of blocks between reducing quality, and before restoring it
+#define LOD_RAISE_HOLD_BLOCKS 8
+#define LOD_LOWER_HOLD_BLOCKS 100
+
+// number of blocks at the start over which the sources are timed
+#define LOD_CALIBRATION_BLOCKS 64
+
+// smoothing of the measured load (0--1, larger is faster)
+#define LOD_LOAD_SMOOTHING 0.1
+
+#define LOD_MAX_SOURCE_TYPES 32
+
+// cost assumed for a source type which has not been measured, in seconds per sample
+#define LOD_DEFAULT_COST 50e-9
+
+// settings applied at each level
+#define LOD_PAN_DISTANCE 5.0
+#define LOD_PAN_GAIN 0.03
+#define LOD_THIN_FRACTION 0.5
+#define LOD_REVERB_DECAY_FACTOR 0.5
+
+
+/** @struct SourceCost
+    Measured cost of one type of source (identified by its fill function) */
+typedef struct SourceCost
+{
+    fill_grain_func fill_grain;
+    double time;
+    double samples;
+    float cost;     // seconds per sample
+} SourceCost;
+
+/** @struct LODController
+    Chooses the level of detail from the measured and predicted load */
+typedef struct LODController
+{
+    int enabled;
+    int level;
+    int reason;
+
+    double load;            // smoothed measured load, as a fraction of the deadline
+    double predicted_load;  // load predicted by the cost model for the current grains
+    unsigned int last_block;
+    int blocks_since_change;
+
+    int calibration_blocks; // blocks left to calibrate
+    int calibrated;         // true once the costs have been worked out from the calibration
+    SourceCost costs[LOD_MAX_SOURCE_TYPES];
+    int n_costs;
+
+    // spatialization cost, in seconds per grain sample, at full detail and when panned
+    float spatial_cost;
+    float pan_cost;
+} LODController;
+
+
+LODController *create_lod(void);
+void destroy_lod(LODController *lod);
+
+void enable_lod(LODController *lod);
+void disable_lod(LODController *lod, list_t *streams);
+int get_level_lod(LODController *lod);
+int get_reason_lod(LODController *lod);
+const char *get_reason_string_lod(int reason);
+
+void assign_costs_lod(LODController *lod, GrainStream *stream);
+int update_lod(LODController *lod, list_t *streams, Statistics *stats);
+
+#endif
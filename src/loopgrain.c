@@ -153,11 +153,11 @@ void fill_loopgrain(void *loopgrain, Buffer *buffer)
     float t;
     int index;
     LoopGrain *loop;
-    Buffer *channel;
+    WaveSound *sound;
     loop = (LoopGrain *) loopgrain;
     
     if(loop->attack && !loop->attack_finished)
-        channel = get_channel_wave_sound(loop->attack, 0);
+        sound = loop->attack;
     
     for(i=0;i<buffer->n_samples;i++)
     {
@@ -166,17 +166,17 @@ void fill_loopgrain(void *loopgrain, Buffer *buffer)
         t = loop->phase-index;
         
         // linear interpolation
-        if(loop->phase < channel->n_samples-1)
-            buffer->x[i] = (1-t*)*channel->x[index]+t*channel->x[index+1];
+        if(loop->phase < sound->frames-1)
+            buffer->x[i] = (1-t*)*get_sample_wave_sound(sound, 0, index)+t*get_sample_wave_sound(sound, 0, index+1);
     
         
-        if(loop->phase >= channel->n_samples)
+        if(loop->phase >= sound->frames)
         {
             // finish attack portion
             if(!loop->attack_finished)
             {
                 loop->attack_finished = 1;
-                channel = get_channel_wave_sound(loop->sustain, 0);
+                sound = loop->sustain;
             }
             loop->phase = 0;
         }
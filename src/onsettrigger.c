@@ -0,0 +1,282 @@
+/**
+    @file onsettrigger.c
+    @brief Multi-band onset detector. One short time Fourier transform of the input is
+    shared between all the bands, and each band looks for onsets in its own range of
+    bins by spectral flux, with its own thresholds and inhibit time, and can fire its
+    own grain stream.
+
+    Every hop_size samples the last window_size samples are Hann windowed and
+    transformed, and the level of every bin is taken in dB. A band's flux is the
+    average rise in level over its bins since the previous frame (falls count as zero),
+    so it measures how suddenly new energy arrives, not how much there is. A band
+    triggers when its flux and total level are both over its thresholds and it has
+    not triggered within its inhibit time. Adding bands only adds to the (cheap) sums
+    over bins; the transform is done once.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include "onsettrigger.h"
+#include <string.h>
+
+
+/** Create an onset trigger, with its bands spread evenly (in log frequency) from 50Hz to 16kHz.
+    @arg window_size Length of the analysis frames (even; 1024 or 2048 is typical)
+    @arg n_bands Number of bands
+    @return The new trigger
+*/
+OnsetTrigger *create_onset_trigger(int window_size, int n_bands)
+{
+    OnsetTrigger *trigger;
+    int i;
+    double sum;
+
+    trigger = malloc(sizeof(*trigger));
+    trigger->fft = create_fft(window_size);
+    trigger->spectrum = create_complex_buffer(window_size/2+1);
+    trigger->buffer = create_buffer(window_size);
+    trigger->frame = create_buffer(window_size);
+    trigger->levels = create_buffer(window_size/2+1);
+    trigger->rises = create_buffer(window_size/2+1);
+    trigger->window = create_buffer(window_size);
+    zero_buffer(trigger->buffer);
+    for(i=0;i<=window_size/2;i++)
+        trigger->levels->x[i] = ONSET_TRIGGER_FLOOR;
+    trigger->window_size = window_size;
+    trigger->buffer_ptr = 0;
+    trigger->hop_count = 0;
+    set_hop_size_onset_trigger(trigger, window_size/4);
+
+    // Hann window; a sine's peak bin has magnitude amplitude * sum(window) / 2
+    sum = 0.0;
+    for(i=0;i<window_size;i++)
+    {
+        trigger->window->x[i] = 0.5 - 0.5 * cos(2*M_PI*i/window_size);
+        sum += trigger->window->x[i];
+    }
+    trigger->level_offset = -20.0 * log10(sum / 2.0);
+
+    trigger->n_bands = MAX(1, n_bands);
+    trigger->bands = calloc(trigger->n_bands, sizeof(*trigger->bands));
+    set_log_bands_onset_trigger(trigger, 50.0, 16000.0);
+    set_threshold_onset_trigger(trigger, -1, -40.0, 6.0);
+    set_inhibit_onset_trigger(trigger, -1, 0.05);
+    for(i=0;i<trigger->n_bands;i++)
+    {
+        trigger->bands[i].level = ONSET_TRIGGER_FLOOR;
+        trigger->bands[i].stream = NULL;
+    }
+
+    trigger->copy_amplitude = 1;
+    trigger->copy_boost = 0.0;
+    return trigger;
+}
+
+
+// free an onset trigger
+void destroy_onset_trigger(OnsetTrigger *trigger)
+{
+    destroy_fft(trigger->fft);
+    destroy_complex_buffer(trigger->spectrum);
+    destroy_buffer(trigger->buffer);
+    destroy_buffer(trigger->frame);
+    destroy_buffer(trigger->levels);
+    destroy_buffer(trigger->rises);
+    destroy_buffer(trigger->window);
+    free(trigger->bands);
+    free(trigger);
+}
+
+
+// set the number of samples between analysis frames (this is also the timing resolution of the onsets)
+void set_hop_size_onset_trigger(OnsetTrigger *trigger, int hop_size)
+{
+    trigger->hop_size = MAX(1, MIN(trigger->window_size, hop_size));
+}
+
+
+// split low_frequency -> high_frequency (Hz) into the trigger's bands, evenly in log frequency
+void set_log_bands_onset_trigger(OnsetTrigger *trigger, float low_frequency, float high_frequency)
+{
+    int i;
+    float ratio;
+    ratio = high_frequency / low_frequency;
+    for(i=0;i<trigger->n_bands;i++)
+        set_band_onset_trigger(trigger, i, low_frequency * pow(ratio, i/(float)trigger->n_bands),
+            low_frequency * pow(ratio, (i+1)/(float)trigger->n_bands));
+}
+
+
+/** Set the frequency range of a band. Every band covers at least one bin.
+    @arg band Index of the band
+    @arg low_frequency Bottom of the band (Hz)
+    @arg high_frequency Top of the band (Hz)
+*/
+void set_band_onset_trigger(OnsetTrigger *trigger, int band, float low_frequency, float high_frequency)
+{
+    OnsetBand *b;
+    int max_bin;
+    if(band<0 || band>=trigger->n_bands)
+        return;
+    b = &trigger->bands[band];
+    b->low_frequency = low_frequency;
+    b->high_frequency = high_frequency;
+    max_bin = trigger->window_size/2;
+    b->low_bin = (int)ceil(low_frequency * trigger->window_size / GLOBAL_STATE.sample_rate);
+    b->high_bin = (int)ceil(high_frequency * trigger->window_size / GLOBAL_STATE.sample_rate);
+    b->low_bin = MAX(1, MIN(max_bin, b->low_bin));
+    b->high_bin = MIN(max_bin+1, b->high_bin);
+    if(b->high_bin <= b->low_bin)
+        b->high_bin = b->low_bin + 1;
+}
+
+
+// set the stream a band fires (NULL fires the stream the trigger is attached to)
+void set_stream_band_onset_trigger(OnsetTrigger *trigger, int band, GrainStream *stream)
+{
+    if(band<0 || band>=trigger->n_bands)
+        return;
+    trigger->bands[band].stream = stream;
+}
+
+
+/** Set the thresholds for a band.
+    @arg band Index of the band, or -1 for every band
+    @arg threshold Level (dB, 0dB = full scale sine) the band must be at to trigger
+    @arg flux_threshold Average rise in level (dB) over the band's bins since the last frame for an onset
+*/
+void set_threshold_onset_trigger(OnsetTrigger *trigger, int band, float threshold, float flux_threshold)
+{
+    int i;
+    for(i=0;i<trigger->n_bands;i++)
+    {
+        if(band>=0 && i!=band)
+            continue;
+        trigger->bands[i].threshold = threshold;
+        trigger->bands[i].flux_threshold = flux_threshold;
+    }
+}
+
+
+// set the time in which another event cannot occur on a band (or on every band, if band is -1)
+void set_inhibit_onset_trigger(OnsetTrigger *trigger, int band, float time)
+{
+    int i;
+    for(i=0;i<trigger->n_bands;i++)
+    {
+        if(band>=0 && i!=band)
+            continue;
+        trigger->bands[i].inhibit_time = time;
+        trigger->bands[i].inhibit = 0;
+    }
+}
+
+
+// set whether or not incoming levels are used for the amplitude
+void set_copy_amplitude_onset_trigger(OnsetTrigger *trigger, int copy_amplitude, float copy_boost)
+{
+    trigger->copy_amplitude = copy_amplitude;
+    trigger->copy_boost = copy_boost;
+}
+
+
+// window the history and update the levels of the bins; each band's flux and level.
+// Bands may share bins, so the rise of every bin is found once, before the bands sum them
+static void analyse_onset_trigger(OnsetTrigger *trigger)
+{
+    int i, j, n;
+    float *x, *w, *levels, *rises, level, rise;
+    kiss_fft_cpx *s;
+    double flux, power;
+    OnsetBand *band;
+
+    n = trigger->window_size;
+    x = trigger->frame->x;
+    w = trigger->window->x;
+    levels = trigger->levels->x;
+    rises = trigger->rises->x;
+    s = trigger->spectrum->x;
+
+    // unroll the history, oldest first, and window it
+    j = trigger->buffer_ptr;
+    for(i=0;i<n;i++)
+    {
+        x[i] = trigger->buffer->x[j] * w[i];
+        if(++j == n)
+            j = 0;
+    }
+    fft_buffer(trigger->fft, trigger->frame, trigger->spectrum);
+
+    for(j=0;j<=n/2;j++)
+    {
+        level = 10.0*log10(s[j].r*s[j].r + s[j].i*s[j].i + 1e-30) + trigger->level_offset;
+        if(level<ONSET_TRIGGER_FLOOR)
+            level = ONSET_TRIGGER_FLOOR;
+        rise = level - levels[j];
+        rises[j] = rise>0 ? rise : 0;
+        levels[j] = level;
+    }
+
+    for(i=0;i<trigger->n_bands;i++)
+    {
+        band = &trigger->bands[i];
+        flux = 0.0;
+        power = 0.0;
+        for(j=band->low_bin;j<band->high_bin;j++)
+        {
+            power += s[j].r*s[j].r + s[j].i*s[j].i;
+            flux += rises[j];
+        }
+        band->flux = flux / (band->high_bin - band->low_bin);
+        band->level = 10.0*log10(power + 1e-30) + trigger->level_offset;
+    }
+}
+
+
+// process a buffer, triggering grains on each band as onsets occur
+void process_onset_trigger(void *onset_trigger, Buffer *input, GrainStream *stream)
+{
+    int i, j;
+    double level;
+    OnsetTrigger *trigger;
+    OnsetBand *band;
+    GrainStream *band_stream;
+    trigger = (OnsetTrigger *)onset_trigger;
+    for(i=0;i<input->n_samples;i++)
+    {
+        // copy in data
+        trigger->buffer->x[trigger->buffer_ptr] = input->x[i];
+        if(++trigger->buffer_ptr == trigger->window_size)
+            trigger->buffer_ptr = 0;
+        if(++trigger->hop_count < trigger->hop_size)
+            continue;
+        trigger->hop_count = 0;
+
+        analyse_onset_trigger(trigger);
+        for(j=0;j<trigger->n_bands;j++)
+        {
+            band = &trigger->bands[j];
+            band->inhibit -= trigger->hop_size;
+
+            // trigger!
+            if(band->level > band->threshold && band->flux > band->flux_threshold && band->inhibit <= 0)
+            {
+                band->inhibit = band->inhibit_time * GLOBAL_STATE.sample_rate;
+                band_stream = band->stream ? band->stream : stream;
+                if(trigger->copy_amplitude)
+                {
+                    level = band->level + trigger->copy_boost; // allow cutting/amplifying incoming levels
+                    add_temporary_sequence_distribution(band_stream->model->amplitude, &level, 1);
+                }
+                trigger_single_grain_stream(band_stream, i/(double)GLOBAL_STATE.sample_rate);
+            }
+            if(band->inhibit < 0)
+                band->inhibit = 0;
+        }
+    }
+}
@@ -0,0 +1,78 @@
+/**
+    @file onsettrigger.h
+    @brief Multi-band onset detector. One short time Fourier transform of the input is
+    shared between all the bands, and each band looks for onsets in its own range of
+    bins by spectral flux, with its own thresholds and inhibit time, and can fire its
+    own grain stream.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#ifndef __ONSETTRIGGER_H__
+#define __ONSETTRIGGER_H__
+#include "audio.h"
+#include "grain_stream.h"
+#include "complex_buffer.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+// bin levels are floored at this (dB), so silence has no flux
+#define ONSET_TRIGGER_FLOOR -100.0
+
+
+/** @struct OnsetBand */
+typedef struct OnsetBand
+{
+    float low_frequency, high_frequency;
+    int low_bin, high_bin;      // bins low_bin -> high_bin-1 are in the band
+    float threshold;            // level the band must reach to trigger (dB)
+    float flux_threshold;       // average rise in level over the band's bins, between frames, to trigger (dB)
+    float inhibit_time;         // in seconds
+    int inhibit;                // samples until the band may trigger again
+    float level, flux;          // from the last frame
+    GrainStream *stream;        // stream to fire (NULL for the trigger's stream)
+} OnsetBand;
+
+
+/** @struct OnsetTrigger */
+typedef struct OnsetTrigger
+{
+    FFT *fft;
+    ComplexBuffer *spectrum;
+    Buffer *window;
+    Buffer *buffer;             // circular history of the last window_size samples
+    Buffer *frame;              // the windowed history, for analysis
+    Buffer *levels;             // level of each bin in the last frame (dB)
+    Buffer *rises;              // rise in level of each bin since the previous frame (dB, falls are zero)
+    int buffer_ptr;
+    int window_size;
+    int hop_size;
+    int hop_count;
+    float level_offset;         // dB to add so that a full scale sine reads 0dB
+
+    int n_bands;
+    OnsetBand *bands;
+
+    int copy_amplitude;
+    float copy_boost;
+} OnsetTrigger;
+
+OnsetTrigger *create_onset_trigger(int window_size, int n_bands);
+void destroy_onset_trigger(OnsetTrigger *trigger);
+void set_hop_size_onset_trigger(OnsetTrigger *trigger, int hop_size);
+void set_log_bands_onset_trigger(OnsetTrigger *trigger, float low_frequency, float high_frequency);
+void set_band_onset_trigger(OnsetTrigger *trigger, int band, float low_frequency, float high_frequency);
+void set_stream_band_onset_trigger(OnsetTrigger *trigger, int band, GrainStream *stream);
+void set_threshold_onset_trigger(OnsetTrigger *trigger, int band, float threshold, float flux_threshold);
+void set_inhibit_onset_trigger(OnsetTrigger *trigger, int band, float time);
+void set_copy_amplitude_onset_trigger(OnsetTrigger *trigger, int copy_amplitude, float copy_boost);
+void process_onset_trigger(void *onset_trigger, Buffer *input, GrainStream *stream);
+
+
+#endif
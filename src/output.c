@@ -13,6 +13,7 @@
 #include "output.h"
 #include "trigger_tests.h"
 #include "grain_tests.h"
+#include "alloc_tripwire.h"
 
 #ifdef USE_PORTAUDIO
 #include <portaudio.h>
@@ -23,101 +24,114 @@
 void fire_triggers_output_info(OutputInfo *info, float *in, int n_frames)
 {
     Trigger *trigger;
-    PaUtilRingBuffer *ringbuffer;
-    int i;            
     
-    // deinterleave stereo/multichannel input data
-    for(i=0;i<n_frames;i++)
-            info->input->x[i] = in[i*GLOBAL_STATE.n_input_channels + GLOBAL_STATE.input_channel];
+    // deinterleave the input channel into the shared ring, once for all the triggers
+    write_interleaved_input_ring(info->input_ring, in, GLOBAL_STATE.n_input_channels, GLOBAL_STATE.input_channel, n_frames);
     
-    // copy this buffer to all connected triggers
+    // each trigger reads it with its own cursor
     list_iterator_start(info->live_triggers);
     while(list_iterator_hasnext(info->live_triggers))
     {        
         trigger = list_iterator_next(info->live_triggers);   
-        
-        ringbuffer = get_ringbuffer_trigger(trigger);    
-        // if not enough room for this buffer, try again next time
-        if(PaUtil_GetRingBufferWriteAvailable(ringbuffer) >= n_frames)               
-            // write this block into all of the triggers' ringbuffers
-            PaUtil_WriteRingBuffer(ringbuffer, info->input->x, n_frames * sizeof(*info->input->x));                    
-            
         process_trigger(trigger);
     }    
     list_iterator_stop(info->live_triggers);    
 }
 
 
-// process a buffer of data
-// note that data is stereo interleaved
-void audio_callback_output_info(void *data, float *in, float *out)
+// synthesise one block; the mix is interleaved into out if write_out is set
+static void process_output_info(OutputInfo *info, float *in, float *out, int write_out)
 {
-    OutputInfo *info = *((OutputInfo **)data);
-    Buffer *output_buffers[2];
     int i;
     int n;
+    double t;
+    
+    // nothing in here should allocate
+    enter_realtime_alloc_tripwire();
+    start_block_stats(info->mixer->stats);
+    
     n = GLOBAL_STATE.frames_per_buffer;
+    t = get_time_stats();
     if(in)
         fire_triggers_output_info(info, in, n);
+    stage_stats(info->mixer->stats, STATS_STAGE_TRIGGERS, t);
     
     // do the synthesis!
-    grain_mix(info->mixer, info->left, info->right);    
+    grain_mix(info->mixer, info->channels);    
+    t = get_time_stats();
     
-    if(GLOBAL_STATE.n_channels==2)
+    if(write_out)
     {
-        // write to stereo audio buffer
-        if(info->output_mode & OUTPUT_REALTIME_AUDIO)
+        if(GLOBAL_STATE.n_channels==1)
         {
-            for( i=0; i<n; i++ )
-            {
-                *out++ = info->left->x[i];
-                *out++ = info->right->x[i];
-            }
+            // write to mono audio buffer (the mixer is always at least stereo)
+            for( i=0; i<n; i++ )            
+                *out++ = (info->channels[0]->x[i] + info->channels[1]->x[i])/2.0;                            
         }
+        else
+            // write every channel of the mix
+            interleave_buffers(info->channels, info->n_channels, out);
     }   
-    else
-    {
-        // write to mono audio buffer
-        if(info->output_mode & OUTPUT_REALTIME_AUDIO)
-        {
-            for( i=0; i<n; i++ )            
-                *out++ = (info->left->x[i] + info->right->x[i])/2.0;                            
-        }             
-    }
             
-    output_buffers[0] = info->left;
-    output_buffers[1] = info->right;
-    
-    // write to file (output is always stereo)
+    // write to file (with all the channels of the mix)
     if(info->output_mode & OUTPUT_WAVEFILE_AUDIO)        
-        write_wavewriter(info->writer, output_buffers);    
+        write_wavewriter(info->writer, info->channels);    
      
         
     // update time elapsed
     GLOBAL_STATE.elapsed_samples += n;
     GLOBAL_STATE.elapsed = GLOBAL_STATE.elapsed_samples / (double)GLOBAL_STATE.sample_rate;     
+    
+    stage_stats(info->mixer->stats, STATS_STAGE_OUTPUT, t);
+    snapshot_stats_mixer(info->mixer);
+    end_block_stats(info->mixer->stats);
+    leave_realtime_alloc_tripwire();
+}
+
+
+// process a buffer of data
+// note that data is interleaved, with GLOBAL_STATE.n_channels channels
+void audio_callback_output_info(void *data, float *in, float *out)
+{
+    OutputInfo *info = *((OutputInfo **)data);
+    bind_audio_state(info->state);
+    process_output_info(info, in, out, info->output_mode & OUTPUT_REALTIME_AUDIO);
+}
+
+
+// synthesise one block without the audio device (e.g. to render offline), into
+// out (frames_per_buffer frames of GLOBAL_STATE.n_channels interleaved channels)
+void render_output_info(OutputInfo *info, float *out)
+{
+    bind_audio_state(info->state);
+    process_output_info(info, NULL, out, 1);
 }
 
 // called when the audio stream is closed
 void audio_finished_output_info(void *data)
 {
     OutputInfo *info = *((OutputInfo **)data);
+    bind_audio_state(info->state);
     stop_wavewriter(info->writer);
 }
 
 OutputInfo *create_output_info(void)
 {
     GrainStream *stream;    
-    
+    int blocks;
   
     
     OutputInfo *info = malloc(sizeof(*info));
-    info->left = create_buffer(GLOBAL_STATE.frames_per_buffer);    
-    info->right = create_buffer(GLOBAL_STATE.frames_per_buffer);
-    info->input = create_buffer(GLOBAL_STATE.frames_per_buffer);
-    info->writer = create_wavewriter();
-    set_multichannel_wavewriter(info->writer, 2, MULTICHANNEL_INTERLEAVE);
+    info->state = CURRENT_AUDIO_STATE;
     info->mixer = create_mixer();
+    info->n_channels = get_n_channels_mixer(info->mixer);
+    info->channels = create_planar_buffers(info->n_channels, GLOBAL_STATE.frames_per_buffer);
+    
+    // a whole number of blocks, so triggers always read in place
+    blocks = (int)ceil(OUTPUT_INPUT_RING_SECONDS * GLOBAL_STATE.sample_rate / (double)GLOBAL_STATE.frames_per_buffer);
+    info->input_ring = create_input_ring(GLOBAL_STATE.frames_per_buffer * MAX(INPUT_RING_BLOCKS, blocks));
+    info->writer = create_wavewriter();
+    set_multichannel_wavewriter(info->writer, info->n_channels, MULTICHANNEL_INTERLEAVE);
     info->live_triggers = malloc(sizeof(*info->live_triggers));
     list_init(info->live_triggers);        
     set_output_mode_output_info(info, OUTPUT_REALTIME_AUDIO | OUTPUT_WAVEFILE_AUDIO);
@@ -125,7 +139,7 @@ OutputInfo *create_output_info(void)
     
     
     // testing 
-    stream = create_stream(2);
+    stream = create_stream(info->n_channels);
 
     
     add_stream(info->mixer, stream);    
@@ -140,6 +154,7 @@ OutputInfo *create_output_info(void)
 // connect a live trigger to receive data from the microphone input
 void connect_live_trigger(OutputInfo *info, Trigger *trigger)
 {
+    attach_input_trigger(trigger, info->input_ring);
     list_append(info->live_triggers, trigger);
   
 }
@@ -155,13 +170,20 @@ void disconnect_live_trigger(OutputInfo *info, Trigger *trigger)
 }
 
 
+// the ring live input is written into (for live grain sources to read from)
+InputRing *get_input_ring_output_info(OutputInfo *info)
+{
+    return info->input_ring;
+}
+
+
 // Destroy an output object, stopping any wavewriting first of all
 void destroy_output_info(OutputInfo *info)
 {
     stop_wavewriter(info->writer);
     destroy_wavewriter(info->writer);
-    destroy_buffer(info->left);
-    destroy_buffer(info->right);
+    destroy_planar_buffers(info->channels, info->n_channels);
+    destroy_input_ring(info->input_ring);
     destroy_mixer(info->mixer);
     
     list_destroy(info->live_triggers);
@@ -201,6 +223,8 @@ int main(void)
     prototype.input_channel = 0;
     prototype.in_device = -1;
     prototype.out_device = -1;
+    prototype.max_grains = 256;
+    prototype.max_active_grains = 0;
     
     
      
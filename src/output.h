@@ -16,13 +16,20 @@
 #include "random.h"
 #include "wavewriter.h"
 #include "trigger.h"
+#include "input_ring.h"
 
 
 
+// seconds of live input the input ring holds (how far back live grains can reach)
+#define OUTPUT_INPUT_RING_SECONDS 8
+
+
 typedef struct OutputInfo
 {
-    Buffer *left, *right;
-    Buffer *input;
+    AudioState *state;      // the engine this output belongs to (bound to the thread in the callbacks)
+    Buffer **channels;      // the mixer's output, one planar buffer per channel
+    int n_channels;
+    InputRing *input_ring;  // live input, shared by all the live triggers and live grain sources
     GrainMixer *mixer;
     int output_mode;
     WaveWriter *writer;
@@ -31,6 +38,7 @@ typedef struct OutputInfo
 
 void audio_callback_output_info(void *data, float *in, float *out);
 void audio_finished_output_info(void *data);
+void render_output_info(OutputInfo *info, float *out);
 void fire_triggers_output_info(OutputInfo *info, float *in, int n_frames);
 
 void fill_buffer_output_info(OutputInfo *info);
@@ -38,6 +46,7 @@ void set_output_mode_output_info(OutputInfo *info, int mode);
 
 void connect_live_trigger(OutputInfo *info, Trigger *trigger);
 void disconnect_live_trigger(OutputInfo *info, Trigger *trigger);
+InputRing *get_input_ring_output_info(OutputInfo *info);
 
 
 OutputInfo *create_output_info(void);
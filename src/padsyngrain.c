@@ -42,7 +42,6 @@ void set_wave_padsyn_parameters(PadSynGrainParameters *padsyn_parameters, WaveSo
     FFT *fft;
     ComplexBuffer *complex_buffer, *complex_accumulate_buffer;
     
-    Buffer *channel;
     Buffer *real_buffer;
     int  i,j, nbuffers;
     
@@ -55,15 +54,13 @@ void set_wave_padsyn_parameters(PadSynGrainParameters *padsyn_parameters, WaveSo
     // copy in the input buffer, 
     j = 0;
     nbuffers = 0;
-    channel = get_channel_wave_sound(sound,0);
-    
-    while(j < channel->n_samples)
+    while(j < sound->frames)
     {
         // copy in the input                 
         for(i=0;i<real_buffer->n_samples;i++)
         {
-            if(j < channel->n_samples)
-                real_buffer->x[i] = channel->x[j];
+            if(j < sound->frames)
+                real_buffer->x[i] = get_sample_wave_sound(sound, 0, j);
             else
                 real_buffer->x[i] = 0;                
             j++;
@@ -1,49 +1,166 @@
-/**    
+/**
     @file pitchtrigger.c
-    @brief
+    @brief Tracks the pitch of live input and drives a stream's rate from it.
+
+    Every hop_size samples, the last window_size samples are analysed with YIN: the
+    difference function d(t) = sum (x[j] - x[j+t])^2 over the first half of the window
+    is expanded into energy terms (a running sum of squares) and the autocorrelation,
+    which comes from FFTs rather than window_size^2/4 multiplies. The
+    period is the first dip of the cumulative mean normalised difference that comes
+    within the threshold of its deepest, refined with a parabola, and one minus the depth of that dip is the
+    confidence. Successive windows overlap, so the history is kept in a ring and each
+    hop only writes the new samples.
+
+    The window is made of whole hops, and each hop is transformed (zero padded to the
+    window size) once, when it arrives. The spectra of the window and of its first
+    half are the sums of the spectra of their hops, each shifted into place by a phase
+    ramp, so each hop costs one forward FFT and one inverse, not a transform of the
+    whole window per hop.
+
+    Hops smaller than window_size/PITCH_TRIGGER_MAX_BLOCKS would need too many spectra
+    combined, so the autocorrelation is kept up to date instead: each hop adds in the
+    products x[j] x[j+t] of the hop which has just entered the first half of the window,
+    and takes out those of the hop which has just left it, at window_size/2 multiplies
+    per sample whatever the hop.
     @author John Williamson
-    
+
     Copyright (c) 2011 All rights reserved.
     Licensed under the BSD 3 clause license. See COPYING.
-    
+
     This file is part of the OpenGrain distribution.
-    http://opengrain.sourceforge.net   
-*/              
+    http://opengrain.sourceforge.net
+*/
 
 #include "pitchtrigger.h"
 #include "complex_buffer.h"
+#include <string.h>
 
-// create an uninitialized trigger object
+// create an uninitialized trigger object (window_size must be even; the lowest pitch it finds is 2*sample_rate/window_size)
 PitchTrigger *create_pitch_trigger(int window_size)
 {
     PitchTrigger *trigger;
+    int i;
     trigger = malloc(sizeof(*trigger));
     trigger->fft = create_fft(window_size);
-    
+
     // create the buffers
-    trigger->complex_buffer = create_complex_buffer(window_size);
-    trigger->hps_buffer = create_buffer(window_size/2);
-    trigger->temp_buffer = create_buffer(window_size/2);    
+    trigger->spectrum = create_complex_buffer(window_size/2+1);
+    trigger->half_spectrum = create_complex_buffer(window_size/2+1);
+    for(i=0;i<PITCH_TRIGGER_MAX_BLOCKS;i++)
+        trigger->blocks[i] = create_complex_buffer(window_size/2+1);
+    trigger->twiddle = create_complex_buffer(window_size);
+    for(i=0;i<window_size;i++)
+    {
+        trigger->twiddle->x[i].r = cos(2*M_PI*i/window_size);
+        trigger->twiddle->x[i].i = -sin(2*M_PI*i/window_size);
+    }
     trigger->buffer = create_buffer(window_size);
+    trigger->frame = create_buffer(window_size);
+    trigger->block_frame = create_buffer(window_size);
+    trigger->correlation = create_buffer(window_size);
+    trigger->difference = create_buffer(window_size/2);
+    trigger->energy = malloc(sizeof(*trigger->energy) * (window_size+1));
+    trigger->products = NULL;
+    trigger->correlation_sum = malloc(sizeof(*trigger->correlation_sum) * window_size/2);
+    zero_buffer(trigger->buffer);
+    zero_buffer(trigger->block_frame);
     trigger->window_size = window_size;
     trigger->buffer_ptr = 0;
-    
+    set_hop_size_pitch_trigger(trigger, window_size/2);
+    set_threshold_pitch_trigger(trigger, PITCH_TRIGGER_DEFAULT_THRESHOLD, 0.5);
+
     // current tracking frequency
     trigger->frequency = 0.0;
-    trigger->target_frequency = 0.0;    
-    set_speed_pitch_trigger(trigger, 0.05);    
-    trigger->phase = 0.0;
-    
+    trigger->target_frequency = 0.0;
+    trigger->confidence = 0.0;
+    set_speed_pitch_trigger(trigger, 0.05);
+
     trigger->power_tracker = create_RMS();
     set_time_RMS(trigger->power_tracker, 0.05);
-    
+
     set_minimum_level_pitch_trigger(trigger, -20.0);
-    trigger->copy_amplitude = 1;    
+    trigger->copy_amplitude = 1;
     trigger->copy_boost = 0.0;
     return trigger;
 }
 
 
+/** Set the number of samples between pitch estimates (smaller is more responsive, but costs more).
+    Half of the window must be a whole number of hops, so the hop is rounded down to the nearest
+    such size, between PITCH_TRIGGER_MIN_HOP and window_size/2 (the default). Changing the hop 
+    allocates, so call this before the trigger is connected. Estimates start again once a whole
+    window has been heard.
+    @arg trigger The pitch trigger
+    @arg hop_size The number of samples wanted between estimates
+    @return The hop size actually used
+*/
+int set_hop_size_pitch_trigger(PitchTrigger *trigger, int hop_size)
+{
+    int half, per_half;
+    half = trigger->window_size/2;
+    hop_size = MAX(MIN(PITCH_TRIGGER_MIN_HOP, half), MIN(half, hop_size));
+    free(trigger->products);
+    trigger->products = NULL;
+    if(hop_size >= trigger->window_size / PITCH_TRIGGER_MAX_BLOCKS)
+    {
+        // few enough hops to combine their spectra
+        per_half = (half + hop_size - 1) / hop_size;
+        while(half % per_half)
+            per_half++;
+        trigger->hop_size = half / per_half;
+        trigger->n_blocks = 2 * per_half;
+        trigger->incremental = 0;
+    }
+    else
+    {
+        // the products of each hop of the first half of the window, for every lag
+        while(half % hop_size)
+            hop_size--;
+        trigger->hop_size = hop_size;
+        trigger->n_blocks = trigger->window_size / hop_size;
+        trigger->incremental = 1;
+        trigger->n_products = half / hop_size;
+        trigger->products = calloc(trigger->n_products * half, sizeof(*trigger->products));
+        memset(trigger->correlation_sum, 0, sizeof(*trigger->correlation_sum) * half);
+        trigger->product = 0;
+    }
+    trigger->block = 0;
+    trigger->hop_count = 0;
+    trigger->filled = 0;
+    return trigger->hop_size;
+}
+
+
+// the number of samples between pitch estimates
+int get_hop_size_pitch_trigger(PitchTrigger *trigger)
+{
+    return trigger->hop_size;
+}
+
+
+/** Set how clear the periodicity must be for the pitch to be used.
+    @arg threshold YIN threshold (typically 0.1-0.2); lower rejects more octave errors, but finds fewer pitches
+    @arg min_confidence Estimates with a lower confidence than this (0 -> 1) are ignored
+*/
+void set_threshold_pitch_trigger(PitchTrigger *trigger, float threshold, float min_confidence)
+{
+    trigger->threshold = threshold;
+    trigger->min_confidence = min_confidence;
+}
+
+
+// the pitch currently being tracked, in Hz (0 if none has been found yet)
+float get_frequency_pitch_trigger(PitchTrigger *trigger)
+{
+    return trigger->frequency;
+}
+
+
+// the confidence of the most recent estimate (0 -> 1)
+float get_confidence_pitch_trigger(PitchTrigger *trigger)
+{
+    return trigger->confidence;
+}
 
 
 // set the minimum level (in dB) at which the trigger will operate
@@ -59,9 +176,25 @@ void set_copy_amplitude_pitch_trigger(PitchTrigger *trigger, int copy_amplitude,
     trigger->copy_boost = copy_boost;
 }
 
-// free an impulse trigger
+// free a pitch trigger
 void destroy_pitch_trigger(PitchTrigger *trigger)
 {
+    int i;
+    destroy_fft(trigger->fft);
+    destroy_complex_buffer(trigger->spectrum);
+    destroy_complex_buffer(trigger->half_spectrum);
+    for(i=0;i<PITCH_TRIGGER_MAX_BLOCKS;i++)
+        destroy_complex_buffer(trigger->blocks[i]);
+    destroy_complex_buffer(trigger->twiddle);
+    destroy_buffer(trigger->buffer);
+    destroy_buffer(trigger->frame);
+    destroy_buffer(trigger->block_frame);
+    destroy_buffer(trigger->correlation);
+    destroy_buffer(trigger->difference);
+    destroy_RMS(trigger->power_tracker);
+    free(trigger->energy);
+    free(trigger->products);
+    free(trigger->correlation_sum);
     free(trigger);
 }
 
@@ -73,80 +206,293 @@ void set_speed_pitch_trigger(PitchTrigger *trigger, float time)
 }
 
 
+// transform the hop which has just arrived (the newest hop_size samples), replacing the oldest hop's spectrum
+static void add_block_pitch_trigger(PitchTrigger *trigger)
+{
+    int i, j, n;
+    float *x;
+
+    n = trigger->window_size;
+    x = trigger->block_frame->x;
+    j = trigger->buffer_ptr - trigger->hop_size;
+    if(j<0)
+        j += n;
+    for(i=0;i<trigger->hop_size;i++)
+    {
+        x[i] = trigger->buffer->x[j];
+        if(++j == n)
+            j = 0;
+    }
+    fft_buffer(trigger->fft, trigger->block_frame, trigger->blocks[trigger->block]);
+    trigger->block++;
+    if(trigger->block == trigger->n_blocks)
+        trigger->block = 0;
+}
+
+
+// add the spectrum of the k'th hop of the window to sum, shifted into place: a hop which starts at
+// sample k*hop_size is multiplied by exp(-2 pi i f k hop_size / n)
+static void shift_block_pitch_trigger(PitchTrigger *trigger, int k, kiss_fft_cpx *sum)
+{
+    int i, j, n, step;
+    kiss_fft_cpx *s, *w;
+
+    n = trigger->window_size;
+    s = trigger->blocks[(trigger->block + k) % trigger->n_blocks]->x;
+    w = trigger->twiddle->x;
+    step = k * trigger->hop_size;
+    j = 0;
+    for(i=0;i<=n/2;i++)
+    {
+        sum[i].r += s[i].r*w[j].r - s[i].i*w[j].i;
+        sum[i].i += s[i].r*w[j].i + s[i].i*w[j].r;
+        j += step;
+        if(j >= n)
+            j -= n;
+    }
+}
+
+
+// add in the products x[j] x[j+t] of the hop which has just entered the first half of the window (whose
+// partners, up to half a window later, have all arrived), in place of those of the hop which has just left it
+static void add_products_pitch_trigger(PitchTrigger *trigger)
+{
+    int i, t, k, half, hop;
+    float *x, *y, *c;
+    double *r;
+    float xi;
 
+    half = trigger->window_size/2;
+    hop = trigger->hop_size;
+    x = &trigger->frame->x[half - hop];
+    c = &trigger->products[trigger->product * half];
+    r = trigger->correlation_sum;
+    for(t=0;t<half;t++)
+    {
+        r[t] -= c[t];
+        c[t] = 0.0;
+    }
+    
+    // a sample at a time, for every lag, so the inner loop has no dependencies
+    for(i=0;i<hop;i++)
+    {
+        xi = x[i];
+        y = &x[i];
+        for(t=0;t<half;t++)
+            c[t] += xi * y[t];
+    }
+    for(t=0;t<half;t++)
+        r[t] += c[t];
 
-// process a buffer, triggering grains as they occur
+    // once every hop has been replaced, sum them afresh, so rounding errors don't build up
+    trigger->product++;
+    if(trigger->product == trigger->n_products)
+    {
+        trigger->product = 0;
+        memset(r, 0, sizeof(*r) * half);
+        for(k=0;k<trigger->n_products;k++)
+        {
+            c = &trigger->products[k * half];
+            for(t=0;t<half;t++)
+                r[t] += c[t];
+        }
+    }
+}
+
+
+// the spectra of the first half of the window (zero padded) and of the whole window, from the spectra of the hops
+static void combine_blocks_pitch_trigger(PitchTrigger *trigger)
+{
+    int k, half;
+    kiss_fft_cpx *a, *b;
+
+    half = trigger->window_size/2;
+    a = trigger->half_spectrum->x;
+    b = trigger->spectrum->x;
+
+    // the oldest hop is already in place
+    memcpy(a, trigger->blocks[trigger->block]->x, sizeof(*a) * (half+1));
+    for(k=1;k<trigger->n_blocks/2;k++)
+        shift_block_pitch_trigger(trigger, k, a);
+    memcpy(b, a, sizeof(*b) * (half+1));
+    for(k=trigger->n_blocks/2;k<trigger->n_blocks;k++)
+        shift_block_pitch_trigger(trigger, k, b);
+}
+
+
+// unroll the history into the frame, oldest first
+static void unroll_pitch_trigger(PitchTrigger *trigger)
+{
+    int n;
+    float *x;
+    n = trigger->window_size;
+    x = trigger->frame->x;
+    memcpy(x, &trigger->buffer->x[trigger->buffer_ptr], sizeof(*x) * (n - trigger->buffer_ptr));
+    memcpy(&x[n - trigger->buffer_ptr], trigger->buffer->x, sizeof(*x) * trigger->buffer_ptr);
+}
+
+
+// the YIN cumulative mean normalised difference of the current window (already unrolled into the frame), for lags 0 -> window_size/2
+static void difference_pitch_trigger(PitchTrigger *trigger)
+{
+    int i, n, half;
+    float *x, *r, *d, *e;
+    kiss_fft_cpx *a, *b;
+    float re, im, scale;
+    double sum;
+
+    n = trigger->window_size;
+    half = n/2;
+    x = trigger->frame->x;
+    r = trigger->correlation->x;
+    d = trigger->difference->x;
+    e = trigger->energy;
+
+    // r(t) = sum x[j] x[j+t], j < half: the cross correlation of the first half (zero padded) with
+    // the whole window; with the padding, the circular correlation never wraps for t < half
+    if(trigger->incremental)
+    {
+        // (already kept up to date, hop by hop)
+        for(i=0;i<half;i++)
+            r[i] = trigger->correlation_sum[i];
+        scale = 2.0;
+    }
+    else
+    {
+        combine_blocks_pitch_trigger(trigger);
+        a = trigger->half_spectrum->x;
+        b = trigger->spectrum->x;
+        for(i=0;i<=half;i++)
+        {
+            re = a[i].r*b[i].r + a[i].i*b[i].i;
+            im = a[i].r*b[i].i - a[i].i*b[i].r;
+            a[i].r = re;
+            a[i].i = im;
+        }
+        ifft_buffer(trigger->fft, trigger->half_spectrum, trigger->correlation);
+        scale = 2.0 / n;   // the inverse FFT is unscaled
+    }
+
+    // e[j] = sum of x^2 before j
+    sum = 0.0;
+    e[0] = 0.0;
+    for(i=0;i<n;i++)
+    {
+        sum += x[i]*x[i];
+        e[i+1] = sum;
+    }
+
+    // d(t) = sum x[j]^2 + sum x[j+t]^2 - 2 r(t), normalised by its mean over lags 1 -> t
+    d[0] = 1.0;
+    sum = 0.0;
+    for(i=1;i<half;i++)
+    {
+        d[i] = e[half] + (e[i+half] - e[i]) - scale * r[i];
+        if(d[i]<0)
+            d[i] = 0;
+        sum += d[i];
+        d[i] = sum>0 ? d[i] * i / sum : 1.0;
+    }
+}
+
+
+// estimate the pitch of the current window
+static void analyse_pitch_trigger(PitchTrigger *trigger)
+{
+    int i, best, deepest, min_lag, max_lag;
+    float *d, a, b, c, shift, confidence, threshold;
+
+    difference_pitch_trigger(trigger);
+    d = trigger->difference->x;
+    min_lag = MAX(2, (int)(GLOBAL_STATE.sample_rate / PITCH_TRIGGER_MAX_FREQUENCY));
+    max_lag = MIN(trigger->window_size/2 - 2, (int)(GLOBAL_STATE.sample_rate / PITCH_TRIGGER_MIN_FREQUENCY));
+    if(max_lag<=min_lag)
+        return;
+
+    // the first dip that comes within the threshold of the deepest, followed down to its minimum
+    // (in noise, the deepest dip is as likely to be at any multiple of the period as at the period)
+    deepest = min_lag;
+    for(i=min_lag;i<=max_lag;i++)
+        if(d[i] < d[deepest])
+            deepest = i;
+    threshold = d[deepest] + trigger->threshold;
+    best = deepest;
+    for(i=min_lag;i<=max_lag;i++)
+    {
+        if(d[i] < threshold)
+        {
+            while(i<max_lag && d[i+1] < d[i])
+                i++;
+            best = i;
+            break;
+        }
+    }
+
+    confidence = 1.0 - d[best];
+    trigger->confidence = confidence<0 ? 0 : confidence;
+    if(trigger->confidence < trigger->min_confidence)
+        return;
+
+    // refine the period with a parabola through the dip
+    a = d[best-1];
+    b = d[best];
+    c = d[best+1];
+    shift = 0.0;
+    if(a - 2*b + c > 0)
+        shift = 0.5 * (a - c) / (a - 2*b + c);
+    if(fabs(shift)>1)
+        shift = 0.0;
+
+    trigger->target_frequency = GLOBAL_STATE.sample_rate / (best + shift);
+
+    // jump straight to the first pitch found, rather than sliding up from nothing
+    if(trigger->frequency==0.0)
+        trigger->frequency = trigger->target_frequency;
+}
+
+
+// process a buffer, setting the rate of the stream to the pitch of the input
 void process_pitch_trigger(void *pitch_trigger, Buffer *input, GrainStream *stream)
 {
     int i;
-    float frequency;
-    int peak_index;
-   
+
     PitchTrigger *trigger;
     trigger = (PitchTrigger *)pitch_trigger;
     for(i=0;i<input->n_samples;i++)
-    {    
+    {
         // copy in data
-        trigger->buffer->x[trigger->buffer_ptr] = input->x[i];                
+        trigger->buffer->x[trigger->buffer_ptr] = input->x[i];
         trigger->buffer_ptr++;
-        
-        // if one whole buffer, update pitch info
         if(trigger->buffer_ptr == trigger->window_size)
-        {
-            // do fft and harmonic product spectrum
-            fft_buffer(trigger->fft, trigger->buffer, trigger->complex_buffer);
-            
-            harmonic_product_spectrum(trigger->hps_buffer, trigger->temp_buffer, trigger->complex_buffer, 4);
-            
-            // find the big peak
-            peak_index = find_absolute_peak(trigger->hps_buffer);
-            
-            // compute frequency
-            frequency = (peak_index / (double)trigger->window_size) * GLOBAL_STATE.sample_rate;
-            
-            trigger->target_frequency = frequency;
-            
-            // reset buffer ptr
             trigger->buffer_ptr = 0;
+        if(trigger->filled < trigger->window_size)
+            trigger->filled++;
+
+        // every hop, take in the new hop, and once there is a whole window, update pitch info
+        trigger->hop_count++;
+        if(trigger->hop_count >= trigger->hop_size)
+        {
+            unroll_pitch_trigger(trigger);
+            if(trigger->incremental)
+                add_products_pitch_trigger(trigger);
+            else
+                add_block_pitch_trigger(trigger);
+            if(trigger->filled == trigger->window_size)
+                analyse_pitch_trigger(trigger);
+            trigger->hop_count = 0;
         }
-        
+
         // slide frequency to the target
-        trigger->frequency = trigger->frequency_coeff*trigger->frequency + (1-trigger->frequency_coeff)*trigger->target_frequency;                       
-        trigger->phase++;
-        
+        trigger->frequency = trigger->frequency_coeff*trigger->frequency + (1-trigger->frequency_coeff)*trigger->target_frequency;
+
         // update RMS power
-         update_RMS(trigger->power_tracker, input->x[i]);
-        
-        if(compute_RMS(trigger->power_tracker) > trigger->min_level && frequency>10.0 && frequency<5000.0)
-        {            
-            set_constant_distribution(stream->model->rate, trigger->frequency);
-        }
-        else
-        {
-          //  set_constant_distribution(stream->rate, 10);
-        }
-        
-        /*
-        // trigger grains
-        if(trigger->phase >= GLOBAL_STATE.sample_rate / (trigger->frequency))
-        {
-            trigger->phase = 0;
-            
-            // generate a grain, if the level is high enough
-            if(compute_RMS(trigger->power_tracker) > trigger->min_level)
-            {                
-                printf("%f\n", trigger->frequency);
-                if(trigger->copy_amplitude)
-                {
-                    level += trigger->copy_boost ; // allow cutting/amplifying incoming levels               
-                    add_temporary_sequence_distribution(stream->amplitude, &level,  1);
-                }
-                //add_grain_stream(stream, i);
-                //trigger_single_grain_stream(stream, i/(double)GLOBAL_STATE.sample_rate);
-            }
-        }
-        
-        */
+        update_RMS(trigger->power_tracker, input->x[i]);
     }
-}
 
+    // only the rate at the end of the block is heard, so set it once
+    if(compute_RMS(trigger->power_tracker) > trigger->min_level && trigger->confidence >= trigger->min_confidence
+        && trigger->frequency>PITCH_TRIGGER_MIN_FREQUENCY && trigger->frequency<PITCH_TRIGGER_MAX_FREQUENCY)
+    {
+        set_constant_distribution(stream->model->rate, trigger->frequency);
+    }
+}
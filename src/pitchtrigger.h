@@ -1,6 +1,11 @@
 /**    
     @file pitchtrigger.h
-    @brief
+    @brief Tracks the pitch of live input and drives a stream's rate from it. The
+    pitch is estimated every hop with the YIN difference function, computed from an
+    FFT autocorrelation of the last window of input, and reported with a confidence.
+    Each hop of input is transformed once, as it arrives, and the spectra of the hops
+    are combined to give the spectrum of the window; small hops instead update the
+    autocorrelation directly, a hop at a time.
     @author John Williamson
     
     Copyright (c) 2011 All rights reserved.
@@ -23,19 +28,52 @@
 #include <math.h>
 
 
+// default YIN threshold: the first dip in the normalised difference within this of the deepest is taken as the period
+#define PITCH_TRIGGER_DEFAULT_THRESHOLD 0.15
+
+// pitches outside this range (Hz) are ignored
+#define PITCH_TRIGGER_MIN_FREQUENCY 10.0
+#define PITCH_TRIGGER_MAX_FREQUENCY 5000.0
+
+// the spectra of the hops are combined when the window is split into at most this many hops; beyond 
+// this, shifting them into place costs more than updating the autocorrelation a hop at a time
+#define PITCH_TRIGGER_MAX_BLOCKS 4
+
+// the smallest hop, in samples
+#define PITCH_TRIGGER_MIN_HOP 16
+
+
+/** @struct PitchTrigger */
 typedef struct PitchTrigger
 {
     
     FFT *fft;
-    ComplexBuffer *complex_buffer;
-    Buffer *hps_buffer;
-    Buffer *temp_buffer;
-    Buffer *buffer;    
+    ComplexBuffer *spectrum;        // spectrum of the whole window
+    ComplexBuffer *half_spectrum;   // spectrum of the first half of the window (zero padded)
+    ComplexBuffer *blocks[PITCH_TRIGGER_MAX_BLOCKS];   // spectrum of each hop in the window (zero padded), oldest at block
+    ComplexBuffer *twiddle;         // exp(-2 pi i j / window_size), to shift the hops into place
+    int n_blocks;                   // hops in the window (window_size / hop_size)
+    int block;
+    int incremental;                // set if the hop is too small to combine the spectra: the autocorrelation is updated every hop
+    float *products;                // (incremental) sum of x[j] x[j+t] over the j of each hop of the first half of the window, for every lag t
+    double *correlation_sum;        // (incremental) the sum of the products over the hops: the autocorrelation of the window
+    int n_products, product;        // (incremental) hops in the first half of the window, and the oldest of them
+    Buffer *buffer;                 // circular history of the last window_size samples
+    Buffer *frame;                  // the history, in order, for analysis
+    Buffer *block_frame;            // the newest hop, zero padded to window_size
+    Buffer *correlation;
+    Buffer *difference;             // cumulative mean normalised difference, for lags up to window_size/2
+    float *energy;                  // running sum of squares over the frame
     int buffer_ptr;
     int window_size;
+    int hop_size;
+    int hop_count;                  // samples since the last analysis
+    int filled;                     // samples in the history, until it is full
     
+    float threshold;
+    float confidence;               // confidence of the last estimate (0 -> 1)
+    float min_confidence;
     float frequency, target_frequency, frequency_coeff;
-    float phase;
  
     RMS *power_tracker;
     float min_level;
@@ -49,6 +87,11 @@ void set_minimum_level_pitch_trigger(PitchTrigger *trigger, float min_level);
 void set_copy_amplitude_pitch_trigger(PitchTrigger *trigger, int copy_amplitude, float copy_boost);
 void destroy_pitch_trigger(PitchTrigger *trigger);
 void set_speed_pitch_trigger(PitchTrigger *trigger, float time);
+int set_hop_size_pitch_trigger(PitchTrigger *trigger, int hop_size);
+int get_hop_size_pitch_trigger(PitchTrigger *trigger);
+void set_threshold_pitch_trigger(PitchTrigger *trigger, float threshold, float min_confidence);
+float get_frequency_pitch_trigger(PitchTrigger *trigger);
+float get_confidence_pitch_trigger(PitchTrigger *trigger);
 void process_pitch_trigger(void *pitch_trigger, Buffer *input, GrainStream *stream);
 
 
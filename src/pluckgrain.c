@@ -105,7 +105,7 @@ void init_pluckgrain(void *pluckgrain, void *source, Grain *grain)
     active->last_y = 0.0;
     
     if(parent->impulse)
-        active->impulse = get_channel_wave_sound(parent->impulse, 0);
+        active->impulse = parent->impulse;
     else
         active->impulse = NULL;
         
@@ -123,6 +123,7 @@ void *create_pluckgrain(void *source)
     PluckGrain *active;
     active = malloc(sizeof(*active));
     active->delay = create_thiran_allpass();
+    active->scratch = create_buffer(GLOBAL_STATE.frames_per_buffer);
     return (void*)active;
 }
 
@@ -131,7 +132,7 @@ void *create_pluckgrain(void *source)
 // fill a buffer with a karplus-strong plucked string
 void fill_pluckgrain(void *pluckgrain, Buffer *buffer)
 {
-    int i;
+    int i, impulse_len;
     float y;
     PluckGrain *active;
     active = (PluckGrain *)pluckgrain;
@@ -149,14 +150,25 @@ void fill_pluckgrain(void *pluckgrain, Buffer *buffer)
         {
             for(i=0;i<active->delay->delay;i++)
             {
-                if(active->impulse_phase < active->impulse->n_samples)
-                    insert_thiran_allpass(active->delay, active->impulse->x[active->impulse_phase++]);
+                if(active->impulse_phase < active->impulse->frames)
+                    insert_thiran_allpass(active->delay, get_sample_wave_sound(active->impulse, 0, active->impulse_phase++));
                 else
                     insert_thiran_allpass(active->delay, 0);
             }
         }
     }
     
+    // convert the rest of the impulse which is mixed in during this block
+    impulse_len = 0;
+    if(active->impulse!=NULL)
+    {
+        impulse_len = MIN(MIN(buffer->n_samples, active->scratch->n_samples), active->impulse->frames - active->impulse_phase);
+        if(impulse_len>0)
+        {
+            read_wave_sound(active->impulse, 0, active->impulse_phase, impulse_len, active->scratch->x);
+            active->impulse_phase += impulse_len;
+        }
+    }
     
     for(i=0;i<buffer->n_samples;i++)
     {                   
@@ -170,8 +182,8 @@ void fill_pluckgrain(void *pluckgrain, Buffer *buffer)
         // write out the value
         buffer->x[i] = y;
         
-        if(active->impulse!=NULL && active->impulse_phase < active->impulse->n_samples)
-            y += active->impulse->x[active->impulse_phase++];
+        if(i < impulse_len)
+            y += active->scratch->x[i];
         
         
         // damp and feedback 
@@ -185,6 +197,7 @@ void fill_pluckgrain(void *pluckgrain, Buffer *buffer)
 // destroy a sine grain object
 void destroy_pluckgrain(void *pluckgrain)
 {
+    destroy_buffer(((PluckGrain*)pluckgrain)->scratch);
     free((PluckGrain*)pluckgrain);
 
 }
\ No newline at end of file
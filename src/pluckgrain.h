@@ -39,8 +39,9 @@ typedef struct PluckGrain
     float last_y;
     ThiranAllpass *delay;
     float filter_coeff;
-    Buffer *impulse;    
+    WaveSound *impulse;    
     int impulse_phase;
+    Buffer *scratch;        // the part of the impulse mixed in during the current block
     float feedback;
 } PluckGrain;
 
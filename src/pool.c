@@ -0,0 +1,129 @@
+/**
+    @file pool.c
+    @brief A pool of preallocated objects. All of the objects are created
+    up front (outside of the audio callback), and are then handed out and
+    taken back without any further allocation.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include "pool.h"
+
+
+/** Create a new pool, and fill it with initial_capacity objects
+    created with create_fn.
+    @arg initial_capacity Number of objects to create up front
+    @arg create_fn Function which allocates one object. Is passed create_data.
+    @arg destroy_fn Function which frees one object.
+    @arg create_data Data passed to every call of create_fn
+    @return A newly allocated pool
+*/
+Pool *create_pool(int initial_capacity, PoolCreateFunction create_fn, PoolDestroyFunction destroy_fn, void *create_data)
+{
+    Pool *pool;
+    pool = malloc(sizeof(*pool));
+    pool->n_entries = 0;
+    pool->n_free = 0;
+    pool->entries = NULL;
+    pool->free_entries = NULL;
+    pool->exhausted = 0;
+    pool->create_fn = create_fn;
+    pool->destroy_fn = destroy_fn;
+    pool->create_data = create_data;
+    expand_pool(pool, initial_capacity);
+    return pool;
+}
+
+
+/** Add extra_capacity new objects to the pool. This allocates, so
+    must never be called from the audio callback.
+    @arg pool The pool to expand
+    @arg extra_capacity Number of new objects to create
+*/
+void expand_pool(Pool *pool, int extra_capacity)
+{
+    int i, n;
+    void *data;
+
+    if(extra_capacity<=0)
+        return;
+
+    n = pool->n_entries + extra_capacity;
+    pool->entries = realloc(pool->entries, sizeof(*pool->entries) * n);
+    pool->free_entries = realloc(pool->free_entries, sizeof(*pool->free_entries) * n);
+
+    for(i=pool->n_entries;i<n;i++)
+    {
+        data = pool->create_fn(pool->create_data);
+        pool->entries[i] = data;
+        pool->free_entries[pool->n_free++] = data;
+    }
+    pool->n_entries = n;
+}
+
+
+/** Take an object from the pool. Never allocates.
+    @arg pool The pool to take from
+    @return A free object, or NULL if the pool is exhausted
+*/
+void *get_from_pool(Pool *pool)
+{
+    if(pool->n_free==0)
+    {
+        pool->exhausted++;
+        return NULL;
+    }
+    return pool->free_entries[--pool->n_free];
+}
+
+
+/** Return an object previously taken from get_from_pool() to the pool.
+    @arg pool The pool the object came from
+    @arg data The object to return
+*/
+void return_to_pool(Pool *pool, void *data)
+{
+    if(data && pool->n_free<pool->n_entries)
+        pool->free_entries[pool->n_free++] = data;
+}
+
+
+// number of objects which can still be handed out
+int get_n_free_pool(Pool *pool)
+{
+    return pool->n_free;
+}
+
+// number of objects currently in use
+int get_n_used_pool(Pool *pool)
+{
+    return pool->n_entries - pool->n_free;
+}
+
+// total number of objects the pool owns
+int get_capacity_pool(Pool *pool)
+{
+    return pool->n_entries;
+}
+
+
+/** Destroy a pool and every object it created (whether in use or not).
+    @arg pool The pool to destroy
+*/
+void destroy_pool(Pool *pool)
+{
+    int i;
+    if(pool->destroy_fn)
+    {
+        for(i=0;i<pool->n_entries;i++)
+            pool->destroy_fn(pool->entries[i]);
+    }
+    free(pool->entries);
+    free(pool->free_entries);
+    free(pool);
+}
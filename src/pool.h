@@ -1,38 +1,48 @@
-/**    
+/**
     @file pool.h
-    @brief
+    @brief A pool of preallocated objects. All of the objects are created
+    up front (outside of the audio callback), and are then handed out and
+    taken back without any further allocation.
     @author John Williamson
-    
+
     Copyright (c) 2011 All rights reserved.
     Licensed under the BSD 3 clause license. See COPYING.
-    
+
     This file is part of the OpenGrain distribution.
-    http://opengrain.sourceforge.net   
-*/              
+    http://opengrain.sourceforge.net
+*/
 
 #ifndef __POOL_H__
 #define __POOL_H__
-typedef struct PoolEntry 
-{  
-    void *data
-    int free;
-} PoolEntry;
-
-// a pool of data that can be expanded and can allocate data as required
-typdef struct Pool
+#include <stdlib.h>
+
+typedef void *(*PoolCreateFunction)(void *);
+typedef void (*PoolDestroyFunction)(void *);
+
+/** @struct Pool
+    A pool of data that is allocated in advance and can be expanded
+    (outside of the audio callback) if required. */
+typedef struct Pool
 {
-    int n_entries;
-    int n_free;
-    PoolEntry *elements;
-    void *(*)create_fn;
-    void (*)destroy_fn;  
-}
-Pool;
-
-Pool *create_pool(int initial_capacity, void *(*)create_fn, void (*)destroy_fn);
-void expand_pool(Pool *pool);
+    int n_entries;      // total number of objects owned by the pool
+    int n_free;         // number of objects available to be handed out
+    void **entries;     // every object the pool owns (for destruction)
+    void **free_entries;    // stack of objects which are not in use
+    int exhausted;      // number of requests made when the pool was empty
+
+    PoolCreateFunction create_fn;
+    PoolDestroyFunction destroy_fn;
+    void *create_data;
+} Pool;
+
+Pool *create_pool(int initial_capacity, PoolCreateFunction create_fn, PoolDestroyFunction destroy_fn, void *create_data);
+void expand_pool(Pool *pool, int extra_capacity);
 void *get_from_pool(Pool *pool);
+void return_to_pool(Pool *pool, void *data);
+int get_n_free_pool(Pool *pool);
+int get_n_used_pool(Pool *pool);
+int get_capacity_pool(Pool *pool);
 void destroy_pool(Pool *pool);
 
 
-#endif
\ No newline at end of file
+#endif
@@ -13,26 +13,40 @@
 */              
 
 #include "random.h"
+#include "audio.h"
 
-static randctx *global_rand_stream; 
+// seed a random number stream
+static void seed_stream(randctx *stream, int seed)
+{
+    int i;
+    for(i=0;i<RANDSIZ;i++)    
+        stream->randrsl[i] = seed | i;    
+    randinit(stream,1);
+}
 
-/** Initialise the random number generator. Uses a static variable 
-    to hold the random stream. 
-    @arg seed The initial seed of the RNG */
-void init_random(int seed)
+/** Create a random number stream. Each engine has its own (see AudioState), and the 
+    functions below draw from the stream of the engine bound to the calling thread.
+    @arg seed The initial seed of the RNG 
+    @return The new stream */
+randctx *create_random(int seed)
 {    
-    global_rand_stream = malloc(sizeof(*global_rand_stream));
-    seed_random(seed);
+    randctx *stream;
+    stream = malloc(sizeof(*stream));
+    seed_stream(stream, seed);
+    return stream;
 }
 
-/** Reseed the random number generator. 
+// free a random number stream
+void destroy_random(randctx *stream)
+{
+    free(stream);
+}
+
+/** Reseed the random number generator of the current engine. 
     @arg seed The new seed of the RNG */
 void seed_random(int seed)
 {
-    int i;
-    for(i=0;i<RANDSIZ;i++)    
-        global_rand_stream->randrsl[i] = seed | i;    
-    randinit(global_rand_stream,1);
+    seed_stream(GLOBAL_STATE.random, seed);
 }
 
 
@@ -42,7 +56,7 @@ double uniform_double(void)
 {
     
     double d;    
-    d = rand(global_rand_stream)/(double)0x100000000;
+    d = rand(GLOBAL_STATE.random)/(double)0x100000000;
     return d;
 }
 
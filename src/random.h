@@ -17,7 +17,8 @@
 #include <stdlib.h>
 #include "rand.h"
 
-void init_random(int seed);
+randctx *create_random(int seed);
+void destroy_random(randctx *stream);
 int random_int(int a, int b);
 double uniform_double(void);
 double gamma_double(double shape);
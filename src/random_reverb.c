@@ -17,7 +17,7 @@
 // Set the default parameters for a Random reverberator
 void set_default_random_reverb(RandomReverb *reverb)
 {
-    reverb->decay = 0.9;
+    set_decay_random_reverb(reverb, 0.9);
     reverb->decay_diffusion_1 = 0.6;
     reverb->decay_diffusion_2 = 0.6;
     reverb->input_diffusion_1 = 0.55;
@@ -51,7 +51,15 @@ void set_damping_random_reverb(RandomReverb *reverb, double damping)
 // set the decay, from 0.0 to 0.99999
 void set_decay_random_reverb(RandomReverb *reverb, double decay)
 {
-   reverb->decay = decay;
+   reverb->set_decay = decay;
+   reverb->decay = decay * reverb->decay_factor;
+}
+
+// scale the decay which was set (and any set later) by a factor, from 0.0 to 1.0
+void set_decay_factor_random_reverb(RandomReverb *reverb, double factor)
+{
+   reverb->decay_factor = factor;
+   reverb->decay = reverb->set_decay * factor;
 }
 
 // set the first decay diffusion, from 0.0 to 0.99999
@@ -196,6 +204,7 @@ RandomReverb *create_random_reverb(int n_channels)
     reverb->n_channels = n_channels;
     reverb->channel_taps = malloc(sizeof(*reverb->channel_taps)*12*n_channels);
     reverb->random_mode = 0;
+    reverb->decay_factor = 1.0;
         
     for(i=0;i<12;i++)    
         reverb->delays[i] = create_mdelay();
@@ -25,7 +25,9 @@ typedef struct RandomReverb
     ModDelayLine *pre_delay;
     float bandwidth;
     float damping;
-    float decay;
+    float decay;            // the decay in use: the decay which was set, times decay_factor
+    float set_decay;        // the decay which was set
+    float decay_factor;     // scales the decay which was set (e.g. to shorten the tail at a low level of detail)
     float decay_diffusion_1;
     float decay_diffusion_2;
     float input_diffusion_1;
@@ -63,6 +65,7 @@ void set_predelay_random_reverb(RandomReverb *reverb, double predelay);
 void set_bandwidth_random_reverb(RandomReverb *reverb, double bandwidth);
 void set_damping_random_reverb(RandomReverb *reverb, double damping);
 void set_decay_random_reverb(RandomReverb *reverb, double decay);
+void set_decay_factor_random_reverb(RandomReverb *reverb, double factor);
 void set_decay_diffusion_1_random_reverb(RandomReverb *reverb, double decay_diffusion_1);
 void set_decay_diffusion_2_random_reverb(RandomReverb *reverb, double decay_diffusion_2);
 void set_input_diffusion_1_random_reverb(RandomReverb *reverb, double decay_diffusion_1);
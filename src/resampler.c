@@ -0,0 +1,186 @@
+/**
+    @file resampler.c
+    @brief Streaming polyphase sample rate converter, for running the engine at a
+    fixed internal rate whatever rate the audio device runs at, and for resampling
+    live input. Works on interleaved blocks of any length, and never allocates
+    after it has been created.
+
+    Each output frame is a windowed-sinc interpolation of the input history at a
+    fractional position; the coefficients for the position are blended from the two
+    nearest rows of a polyphase table, once per frame, and shared by every channel.
+    The history is held planar, so the inner loop is a dot product over contiguous
+    taps (written with four partial sums, so the compiler can vectorise it).
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include "resampler.h"
+#include <string.h>
+
+// the quality presets: taps (when upsampling), tabulated phases, cutoff (fraction of Nyquist), Kaiser beta
+static const int preset_taps[] = {8, 16, 32};
+static const int preset_phases[] = {64, 128, 256};
+static const double preset_cutoff[] = {0.85, 0.92, 0.96};
+static const double preset_beta[] = {6.0, 8.0, 10.0};
+
+
+/** Create a streaming resampler.
+    @arg ratio Output rate / input rate
+    @arg n_channels Number of interleaved channels
+    @arg quality One of RESAMPLER_QUALITY_*
+    @return The new resampler
+*/
+Resampler *create_resampler(double ratio, int n_channels, int quality)
+{
+    Resampler *resampler;
+    double scale;
+    int i;
+
+    quality = MAX(RESAMPLER_QUALITY_LOW, MIN(RESAMPLER_QUALITY_HIGH, quality));
+    resampler = malloc(sizeof(*resampler));
+    resampler->step = 1.0 / ratio;
+    resampler->n_channels = n_channels;
+
+    // when downsampling, the cutoff moves down to the new Nyquist rate, and the
+    // filter gets longer to keep the same transition band (in multiples of four taps)
+    scale = MIN(1.0, ratio);
+    resampler->taps = ((int)ceil(preset_taps[quality] / scale) + 3) & ~3;
+    resampler->taps = MIN(RESAMPLER_MAX_TAPS, resampler->taps);
+    resampler->phases = preset_phases[quality];
+    resampler->table = create_sinc_table(resampler->taps, resampler->phases, preset_cutoff[quality] * scale, preset_beta[quality]);
+    resampler->coeffs = malloc(sizeof(*resampler->coeffs) * resampler->taps);
+
+    resampler->capacity = resampler->taps + RESAMPLER_CHUNK_FRAMES;
+    resampler->history = malloc(sizeof(*resampler->history) * n_channels);
+    for(i=0;i<n_channels;i++)
+        resampler->history[i] = malloc(sizeof(*resampler->history[i]) * resampler->capacity);
+    reset_resampler(resampler);
+    return resampler;
+}
+
+
+// destroy a resampler
+void destroy_resampler(Resampler *resampler)
+{
+    int i;
+    for(i=0;i<resampler->n_channels;i++)
+        free(resampler->history[i]);
+    free(resampler->history);
+    free(resampler->coeffs);
+    free(resampler->table);
+    free(resampler);
+}
+
+
+// forget all input; the next output frame is aligned with the next input frame
+void reset_resampler(Resampler *resampler)
+{
+    int i;
+    for(i=0;i<resampler->n_channels;i++)
+        memset(resampler->history[i], 0, sizeof(*resampler->history[i]) * resampler->capacity);
+
+    // silence before the first input, so output starts straight away
+    resampler->available = resampler->taps/2 - 1;
+    resampler->position = resampler->available;
+}
+
+
+// the most output frames that n_in input frames can produce (the space process_resampler() needs)
+int get_max_output_resampler(Resampler *resampler, int n_in)
+{
+    return (int)ceil(n_in / resampler->step) + 2;
+}
+
+
+// the delay, in input frames, before an input frame affects the output
+int get_latency_resampler(Resampler *resampler)
+{
+    return resampler->taps/2;
+}
+
+
+// compute one output frame from the history around position
+static void interpolate_resampler(Resampler *resampler, int index, double position, float *out)
+{
+    float *row, *x;
+    float a, y0, y1, y2, y3;
+    double phase;
+    int c, k, j, taps;
+
+    taps = resampler->taps;
+    phase = (position - index) * resampler->phases;
+    j = (int)phase;
+    a = phase - j;
+    row = &resampler->table[j*taps];
+    for(k=0;k<taps;k++)
+        resampler->coeffs[k] = row[k] + a * (row[k+taps] - row[k]);
+
+    for(c=0;c<resampler->n_channels;c++)
+    {
+        x = &resampler->history[c][index - taps/2 + 1];
+        y0 = y1 = y2 = y3 = 0.0f;
+        for(k=0;k<taps;k+=4)
+        {
+            y0 += x[k] * resampler->coeffs[k];
+            y1 += x[k+1] * resampler->coeffs[k+1];
+            y2 += x[k+2] * resampler->coeffs[k+2];
+            y3 += x[k+3] * resampler->coeffs[k+3];
+        }
+        out[c] = (y0 + y1) + (y2 + y3);
+    }
+}
+
+
+/** Resample a block of interleaved input. Output is produced as soon as the input
+    around it has arrived (see get_latency_resampler()). Safe to call from the audio thread.
+    @arg resampler The resampler
+    @arg in n_in interleaved frames of input
+    @arg n_in Number of input frames (any number)
+    @arg out Output; must have room for get_max_output_resampler(n_in) interleaved frames
+    @return The number of frames written to out
+*/
+int process_resampler(Resampler *resampler, float *in, int n_in, float *out)
+{
+    int n_out, chunk, half, drop, index, i, c, n_channels;
+
+    n_channels = resampler->n_channels;
+    half = resampler->taps/2;
+    n_out = 0;
+    while(n_in > 0)
+    {
+        // take as much input as there is room for
+        chunk = MIN(n_in, resampler->capacity - resampler->available);
+        for(c=0;c<n_channels;c++)
+            for(i=0;i<chunk;i++)
+                resampler->history[c][resampler->available+i] = in[i*n_channels+c];
+        resampler->available += chunk;
+        in += chunk * n_channels;
+        n_in -= chunk;
+
+        // every output frame whose taps have all arrived
+        index = (int)resampler->position;
+        while(index + half < resampler->available)
+        {
+            interpolate_resampler(resampler, index, resampler->position, &out[n_out*n_channels]);
+            n_out++;
+            resampler->position += resampler->step;
+            index = (int)resampler->position;
+        }
+
+        // discard the history before the first tap of the next output frame
+        drop = MIN(index - half + 1, resampler->available);
+        if(drop > 0)
+        {
+            for(c=0;c<n_channels;c++)
+                memmove(resampler->history[c], &resampler->history[c][drop], sizeof(*resampler->history[c]) * (resampler->available - drop));
+            resampler->available -= drop;
+            resampler->position -= drop;
+        }
+    }
+    return n_out;
+}
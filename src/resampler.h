@@ -0,0 +1,57 @@
+/**
+    @file resampler.h
+    @brief Streaming polyphase sample rate converter, for running the engine at a
+    fixed internal rate whatever rate the audio device runs at, and for resampling
+    live input. Works on interleaved blocks of any length, and never allocates
+    after it has been created.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#ifndef __RESAMPLER_H__
+#define __RESAMPLER_H__
+
+#include "audio.h"
+#include "wave_interpolation.h"
+
+// quality presets
+#define RESAMPLER_QUALITY_LOW 0
+#define RESAMPLER_QUALITY_MEDIUM 1
+#define RESAMPLER_QUALITY_HIGH 2
+
+// limit on the length of the filter (which grows when downsampling, to keep the stopband)
+#define RESAMPLER_MAX_TAPS 256
+
+// input frames taken into the history at a time
+#define RESAMPLER_CHUNK_FRAMES 1024
+
+
+/** @struct Resampler */
+typedef struct Resampler
+{
+    double step;            // input frames per output frame
+    int n_channels;
+    int taps, phases;
+    float *table;           // (phases+1) rows of taps coefficients
+    float *coeffs;          // coefficients for the frame being computed
+
+    float **history;        // input history, one array per channel
+    int capacity;           // frames of history each array can hold
+    int available;          // frames of history held
+    double position;        // where the next output frame is, in frames of history
+} Resampler;
+
+
+Resampler *create_resampler(double ratio, int n_channels, int quality);
+void destroy_resampler(Resampler *resampler);
+void reset_resampler(Resampler *resampler);
+int get_max_output_resampler(Resampler *resampler, int n_in);
+int get_latency_resampler(Resampler *resampler);
+int process_resampler(Resampler *resampler, float *in, int n_in, float *out);
+
+#endif
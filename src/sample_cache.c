@@ -0,0 +1,307 @@
+/**
+    @file sample_cache.c
+    @brief A process-wide cache of loaded WaveSounds, keyed by canonical path,
+    modification time, sample rate and storage. Sounds are shared and reference counted;
+    sounds which are no longer referenced stay in the cache until it goes over
+    its memory budget, when the least recently used are freed.
+
+    Sounds handed out by the cache are shared, so must be treated as read-only:
+    don't resample them, build mip-maps of them or destroy them directly.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include "sample_cache.h"
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// the cache shared by the whole process
+static SampleCache *sample_cache = NULL;
+
+
+// get the process-wide cache, creating it the first time
+// (under the global lock, so loader threads can race to be first)
+static SampleCache *get_sample_cache(void)
+{
+    SampleCache *cache;
+    lock_global_mutex();
+    if(!sample_cache)
+    {
+        cache = malloc(sizeof(*cache));
+        cache->entries = malloc(sizeof(*cache->entries));
+        list_init(cache->entries);
+        cache->mutex = create_mutex();
+        cache->bytes = 0;
+        cache->budget = SAMPLE_CACHE_DEFAULT_BUDGET;
+        cache->tick = 0;
+        cache->hits = 0;
+        cache->misses = 0;
+        cache->evictions = 0;
+        sample_cache = cache;
+    }
+    cache = sample_cache;
+    unlock_global_mutex();
+    return cache;
+}
+
+
+// get the canonical form of a path and the modification time of the file
+// returns a new string, or NULL if the file doesn't exist
+static char *canonical_path_sample_cache(char *fname, time_t *mtime)
+{
+    struct stat info;
+    char *path;
+#ifdef _WIN32
+    path = _fullpath(NULL, fname, 0);
+#else
+    path = realpath(fname, NULL);
+#endif
+    if(!path)
+        return NULL;
+    if(stat(path, &info)<0)
+    {
+        free(path);
+        return NULL;
+    }
+    *mtime = info.st_mtime;
+    return path;
+}
+
+
+// find the entry for a file, or NULL if it isn't loaded (cache must be locked)
+static SampleCacheEntry *find_entry_sample_cache(SampleCache *cache, char *path, time_t mtime, int sample_rate, int storage)
+{
+    SampleCacheEntry *entry;
+    int i;
+    for(i=0;i<list_size(cache->entries);i++)
+    {
+        entry = (SampleCacheEntry *) list_get_at(cache->entries, i);
+        if(entry->mtime==mtime && entry->sample_rate==sample_rate && entry->storage==storage && !strcmp(entry->path, path))
+            return entry;
+    }
+    return NULL;
+}
+
+
+// find the entry holding a sound; returns its index, or -1 (cache must be locked)
+static int find_sound_sample_cache(SampleCache *cache, WaveSound *sound)
+{
+    int i;
+    for(i=0;i<list_size(cache->entries);i++)
+        if(((SampleCacheEntry *) list_get_at(cache->entries, i))->sound == sound)
+            return i;
+    return -1;
+}
+
+
+// free unreferenced sounds, least recently used first, until the cache is within budget
+// (cache must be locked)
+static void evict_sample_cache(SampleCache *cache)
+{
+    SampleCacheEntry *entry, *oldest;
+    int i, oldest_index;
+    
+    while(cache->bytes > cache->budget)
+    {
+        oldest = NULL;
+        oldest_index = -1;
+        for(i=0;i<list_size(cache->entries);i++)
+        {
+            entry = (SampleCacheEntry *) list_get_at(cache->entries, i);
+            if(entry->refs==0 && (!oldest || entry->last_used < oldest->last_used))
+            {
+                oldest = entry;
+                oldest_index = i;
+            }
+        }
+        
+        // everything left is in use
+        if(!oldest)
+            return;
+        
+        list_delete_at(cache->entries, oldest_index);
+        cache->bytes -= oldest->bytes;
+        cache->evictions++;
+        destroy_wave_sound(oldest->sound);
+        free(oldest->path);
+        free(oldest);
+    }
+}
+
+
+/** Get a shared handle to a sound, loading it if it is not already in the cache.
+    A file which has been modified since it was cached is loaded again.
+    Release the handle with release_sample() (never destroy_wave_sound()).
+    @arg fname The file to load
+    @arg sample_rate The rate to resample the sound to, or SAMPLE_CACHE_NATIVE_RATE
+    @arg storage How the samples are held (one of WAVESOUND_STORAGE_*), with WAVESOUND_MIPMAP to build a mip-map
+    @return The sound, or NULL if it couldn't be loaded
+*/
+WaveSound *acquire_sample(char *fname, int sample_rate, int storage)
+{
+    SampleCache *cache;
+    SampleCacheEntry *entry;
+    WaveSound *sound;
+    time_t mtime;
+    char *path;
+    
+    cache = get_sample_cache();
+    path = canonical_path_sample_cache(fname, &mtime);
+    if(!path)
+    {
+        opengrain_warning("File %s does not exist", fname);
+        return NULL;
+    }
+    
+    lock_mutex(cache->mutex);
+    entry = find_entry_sample_cache(cache, path, mtime, sample_rate, storage);
+    if(entry)
+    {
+        entry->refs++;
+        entry->last_used = ++cache->tick;
+        cache->hits++;
+        unlock_mutex(cache->mutex);
+        free(path);
+        return entry->sound;
+    }
+    cache->misses++;
+    unlock_mutex(cache->mutex);
+    
+    // load without holding the lock, so other sounds can be loaded at the same time
+    sound = create_wave_sound(path);
+    if(!sound)
+    {
+        free(path);
+        return NULL;
+    }
+    if(sample_rate!=SAMPLE_CACHE_NATIVE_RATE)
+        resample_wave_sound(sound, sample_rate);
+    set_storage_wave_sound(sound, storage & ~WAVESOUND_MIPMAP);
+    if(storage & WAVESOUND_MIPMAP)
+        build_mipmap_wave_sound(sound, WAVESOUND_MIPMAP_LEVELS);
+    
+    lock_mutex(cache->mutex);
+    
+    // another thread may have loaded the same file in the meantime
+    entry = find_entry_sample_cache(cache, path, mtime, sample_rate, storage);
+    if(entry)
+    {
+        entry->refs++;
+        entry->last_used = ++cache->tick;
+        unlock_mutex(cache->mutex);
+        destroy_wave_sound(sound);
+        free(path);
+        return entry->sound;
+    }
+    
+    entry = malloc(sizeof(*entry));
+    entry->path = path;
+    entry->mtime = mtime;
+    entry->sample_rate = sample_rate;
+    entry->storage = storage;
+    entry->sound = sound;
+    entry->refs = 1;
+    entry->bytes = get_bytes_wave_sound(sound);
+    entry->last_used = ++cache->tick;
+    list_append(cache->entries, entry);
+    cache->bytes += entry->bytes;
+    evict_sample_cache(cache);
+    unlock_mutex(cache->mutex);
+    return sound;
+}
+
+
+// take another reference to a sound from the cache
+void retain_sample(WaveSound *sound)
+{
+    SampleCache *cache;
+    int index;
+    cache = get_sample_cache();
+    lock_mutex(cache->mutex);
+    index = find_sound_sample_cache(cache, sound);
+    if(index>=0)
+        ((SampleCacheEntry *) list_get_at(cache->entries, index))->refs++;
+    unlock_mutex(cache->mutex);
+}
+
+
+// give back a handle from acquire_sample(). The sound stays cached until it has to be evicted.
+void release_sample(WaveSound *sound)
+{
+    SampleCache *cache;
+    SampleCacheEntry *entry;
+    int index;
+    
+    if(!sound)
+        return;
+    cache = get_sample_cache();
+    lock_mutex(cache->mutex);
+    index = find_sound_sample_cache(cache, sound);
+    if(index<0)
+    {
+        unlock_mutex(cache->mutex);
+        opengrain_warning("Released a sound which is not in the sample cache");
+        return;
+    }
+    entry = (SampleCacheEntry *) list_get_at(cache->entries, index);
+    if(entry->refs>0)
+        entry->refs--;
+    entry->last_used = ++cache->tick;
+    evict_sample_cache(cache);
+    unlock_mutex(cache->mutex);
+}
+
+
+// set the memory budget (in bytes) for the cache. Sounds in use are never evicted,
+// so the cache can go over budget while they are held
+void set_budget_sample_cache(size_t bytes)
+{
+    SampleCache *cache;
+    cache = get_sample_cache();
+    lock_mutex(cache->mutex);
+    cache->budget = bytes;
+    evict_sample_cache(cache);
+    unlock_mutex(cache->mutex);
+}
+
+
+// free every sound in the cache which is not in use
+void flush_sample_cache(void)
+{
+    SampleCache *cache;
+    size_t budget;
+    cache = get_sample_cache();
+    lock_mutex(cache->mutex);
+    budget = cache->budget;
+    cache->budget = 0;
+    evict_sample_cache(cache);
+    cache->budget = budget;
+    unlock_mutex(cache->mutex);
+}
+
+
+// get the usage of the cache
+void get_stats_sample_cache(SampleCacheStats *stats)
+{
+    SampleCache *cache;
+    int i;
+    cache = get_sample_cache();
+    lock_mutex(cache->mutex);
+    stats->entries = list_size(cache->entries);
+    stats->referenced_entries = 0;
+    for(i=0;i<stats->entries;i++)
+        if(((SampleCacheEntry *) list_get_at(cache->entries, i))->refs>0)
+            stats->referenced_entries++;
+    stats->bytes = cache->bytes;
+    stats->budget = cache->budget;
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    unlock_mutex(cache->mutex);
+}
@@ -0,0 +1,79 @@
+/**
+    @file sample_cache.h
+    @brief A process-wide cache of loaded WaveSounds, keyed by canonical path,
+    modification time, sample rate and storage. Sounds are shared and reference counted;
+    sounds which are no longer referenced stay in the cache until it goes over
+    its memory budget, when the least recently used are freed.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#ifndef __SAMPLE_CACHE_H__
+#define __SAMPLE_CACHE_H__
+
+#include "audio.h"
+#include "wavereader.h"
+#include "threads.h"
+#include <time.h>
+
+// default memory budget for sounds which are not in use, in bytes
+#define SAMPLE_CACHE_DEFAULT_BUDGET (256*1024*1024)
+
+// sample rate meaning "keep the rate of the file"
+#define SAMPLE_CACHE_NATIVE_RATE 0
+
+
+/** @struct SampleCacheEntry
+    One loaded sound */
+typedef struct SampleCacheEntry
+{
+    char *path;             // canonical path
+    time_t mtime;           // modification time of the file when it was loaded
+    int sample_rate;        // rate requested (or SAMPLE_CACHE_NATIVE_RATE)
+    int storage;            // WAVESOUND_STORAGE_* requested (and WAVESOUND_MIPMAP, so mip-mapped sounds are kept apart)
+    WaveSound *sound;
+    int refs;               // number of handles given out and not yet released
+    size_t bytes;
+    unsigned int last_used; // for choosing which unused entry to evict
+} SampleCacheEntry;
+
+
+/** @struct SampleCacheStats
+    Usage of the sample cache */
+typedef struct SampleCacheStats
+{
+    int entries;
+    int referenced_entries;
+    size_t bytes;
+    size_t budget;
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int evictions;
+} SampleCacheStats;
+
+
+/** @struct SampleCache */
+typedef struct SampleCache
+{
+    list_t *entries;
+    Mutex *mutex;
+    size_t bytes;
+    size_t budget;
+    unsigned int tick;
+    unsigned int hits, misses, evictions;
+} SampleCache;
+
+
+WaveSound *acquire_sample(char *fname, int sample_rate, int storage);
+void retain_sample(WaveSound *sound);
+void release_sample(WaveSound *sound);
+void set_budget_sample_cache(size_t bytes);
+void flush_sample_cache(void);
+void get_stats_sample_cache(SampleCacheStats *stats);
+
+#endif
@@ -19,14 +19,31 @@
 
 
 
+// read a 64 bit little endian value
+static unsigned long long get_little_endian_64(unsigned char *data)
+{
+    unsigned long long x;
+    int i;
+    x = 0;
+    for(i=7;i>=0;i--)
+        x = (x<<8) | data[i];
+    return x;
+}
+
+
 // load a wavefile from fname
+// reads 8, 16, 24 and 32 bit PCM, and float, from RIFF or RF64 WAV files
 struct WaveSound *soundfile_load(char *fname)
 {
     FILE *wavfile;
     unsigned char *data;
-    unsigned char header[44];
+    unsigned char header[40], id[4];
+    unsigned long long data_bytes, ds64_data_bytes;
+    unsigned int chunk_bytes;
     WaveSound *sound;
-    int frames, n_channels, sample_rate, bytes, format, depth;
+    int *expanded;
+    short *expanded16;
+    int frames, n_channels, sample_rate, format, depth, found_fmt, i;
     wavfile = fopen(fname, "rb");
     
     if(!wavfile)
@@ -35,50 +52,103 @@ struct WaveSound *soundfile_load(char *fname)
         return NULL;
     }
         
-    // read the header
-    fread(&header[0], 44, 1, wavfile);
-    
     // check it's really a wav file
-    if(header[0]!='R' || header[1]!='I' || header[2]!='F' || header[3]!='F')    
+    if(fread(&header[0], 12, 1, wavfile)!=1 || (memcmp(header, "RIFF", 4) && memcmp(header, "RF64", 4)) || memcmp(&header[8], "WAVE", 4))    
     {
         opengrain_warning("Not a RIFF WAV file");
+        fclose(wavfile);
         return NULL;
     }
-        
-    
-    format = get_little_endian(&header[20], 2);
     
-    
-    // check the format is PCM
-    if(format!=1)
+    // walk the chunks up to the data, picking up the format (and the 64 bit sizes, if RF64)
+    found_fmt = 0;
+    format = n_channels = sample_rate = depth = 0;
+    ds64_data_bytes = 0;
+    while(1)
     {
-        opengrain_warning("Not a PCM WAV file");
-        return NULL;
-    }
+        if(fread(&header[0], 8, 1, wavfile)!=1)
+        {
+            opengrain_warning("No data in WAV file %s", fname);
+            fclose(wavfile);
+            return NULL;
+        }
+        memcpy(id, header, 4);
+        chunk_bytes = (unsigned int)get_little_endian(&header[4], 4);
         
-    n_channels = get_little_endian(&header[22], 2);
-    bytes = get_little_endian(&header[40], 4);
-    sample_rate = get_little_endian(&header[24], 4);
-    depth = get_little_endian(&header[34], 2);
-    
-    
+        if(!memcmp(id, "data", 4))
+            break;
+            
+        if(!memcmp(id, "ds64", 4) && chunk_bytes>=16)
+        {
+            fread(&header[0], 16, 1, wavfile);
+            ds64_data_bytes = get_little_endian_64(&header[8]);
+            chunk_bytes -= 16;
+        }
+        
+        if(!memcmp(id, "fmt ", 4) && chunk_bytes>=16)
+        {
+            fread(&header[0], 16, 1, wavfile);
+            format = get_little_endian(&header[0], 2);
+            n_channels = get_little_endian(&header[2], 2);
+            sample_rate = get_little_endian(&header[4], 4);
+            depth = get_little_endian(&header[14], 2);
+            chunk_bytes -= 16;
+            // WAVE_FORMAT_EXTENSIBLE: the real format is at the start of the sub format GUID
+            if(format==0xfffe && chunk_bytes>=10)
+            {
+                fread(&header[0], 10, 1, wavfile);
+                format = get_little_endian(&header[8], 2);
+                chunk_bytes -= 10;
+            }
+            found_fmt = 1;
+        }
+        
+        // skip the rest of the chunk (chunks are padded to an even length)
+        fseek(wavfile, chunk_bytes + (chunk_bytes&1), SEEK_CUR);
+    }
     
-    frames = bytes / (2*n_channels);
+    data_bytes = chunk_bytes;
+    if(chunk_bytes==0xffffffff && ds64_data_bytes)
+        data_bytes = ds64_data_bytes;
     
-    // only 16 bit values supported!
-    if(depth!=16)
+    // check the format is PCM or float
+    if(!found_fmt || (format!=1 && format!=3) || (format==3 && depth!=32) || (depth!=8 && depth!=16 && depth!=24 && depth!=32) || n_channels<1)
     {
-        opengrain_warning("WAV file not 16 bit");
+        opengrain_warning("Not a PCM or float WAV file (%s)", fname);
+        fclose(wavfile);
         return NULL;
     }
         
+    frames = data_bytes / ((depth/8)*n_channels);
+    data_bytes = (unsigned long long)frames * (depth/8) * n_channels;
+        
     // read the raw data
-    data = malloc(bytes);
-    fread(data, bytes, 1, wavfile);
+    data = malloc(data_bytes);
+    frames = fread(data, (depth/8)*n_channels, frames, wavfile);
+    fclose(wavfile);
             
     // get the WaveSound
-    sound = wave_sound_from_raw((void*)data, frames, n_channels, sample_rate, PCM_SIGNED_16);
-        
+    if(depth==8)
+    {
+        // unsigned in the file; expand to 16 bit
+        expanded16 = malloc(sizeof(*expanded16) * frames * n_channels);
+        for(i=0;i<frames*n_channels;i++)
+            expanded16[i] = (short)((data[i] - 128) * 256);
+        sound = wave_sound_from_raw((void*)expanded16, frames, n_channels, sample_rate, PCM_SIGNED_16);
+        free(expanded16);
+    }
+    else if(depth==24)
+    {
+        // expand to 32 bit
+        expanded = malloc(sizeof(*expanded) * frames * n_channels);
+        for(i=0;i<frames*n_channels;i++)
+            expanded[i] = (int)(((unsigned int)data[i*3]<<8) | ((unsigned int)data[i*3+1]<<16) | ((unsigned int)data[i*3+2]<<24));
+        sound = wave_sound_from_raw((void*)expanded, frames, n_channels, sample_rate, PCM_SIGNED_32);
+        free(expanded);
+    }
+    else
+        sound = wave_sound_from_raw((void*)data, frames, n_channels, sample_rate, depth==16 ? PCM_SIGNED_16 : (format==3 ? PCM_FLOAT : PCM_SIGNED_32));
+    free(data);
     return sound;
 }
 
@@ -110,6 +180,18 @@ int get_little_endian(unsigned char *data, int n_bytes)
     return x;
 }
 
+// write a 64 bit little endian value into a block
+void little_endian_64(unsigned char *data, unsigned long long x)
+{
+    int i;    
+    for(i=0;i<8;i++)
+    {
+        data[i] = (x&255);
+        x>>=8;
+    }
+}
+
+
 // open a wavefile for writing from the given wavewriter specification
 void *soundfile_open(int channels, int sample_rate, int bit_depth, int overwrite_mode, char *output_path_name)
 {
@@ -118,6 +200,7 @@ void *soundfile_open(int channels, int sample_rate, int bit_depth, int overwrite
    
    info->n_channels = channels;        
    info->sample_rate = sample_rate;   
+   info->bit_depth = bit_depth;
    //ignores append mode
    soundfile_sub_open(info, output_path_name);
    return info;
@@ -128,7 +211,7 @@ void soundfile_sub_open(void *ptr, char *fname)
 {
     SimpleWavInfo *info = ptr;
     
-    
+    info->output_buffer = NULL;
     info->wavfile = fopen(fname, "wb");
     if(!info->wavfile)
     {
@@ -137,58 +220,77 @@ void soundfile_sub_open(void *ptr, char *fname)
         return;
     }
     
-    info->frames = 0;
-    info->output_buffer = malloc(GLOBAL_STATE.frames_per_buffer * 2);
+    info->sample_bytes = info->bit_depth / 8;
+    info->output_buffer = malloc(SIMPLEWAV_OUTPUT_BYTES);
     info->output_ptr = 0;
-    info->output_len = GLOBAL_STATE.frames_per_buffer * 2;    
+    info->output_len = SIMPLEWAV_OUTPUT_BYTES;    
+    info->output_total = 0;
     
-        
+    memset(info->header, 0, SIMPLEWAV_HEADER_BYTES);
     memcpy(&info->header[0], "RIFF", 4); // RIFF
-    little_endian(&info->header[4], 4, 36); // number of bytes in this file + 36
+    little_endian(&info->header[4], 4, SIMPLEWAV_HEADER_BYTES-8); // number of bytes in the rest of the file
     memcpy(&info->header[8], "WAVE", 4); // WAVE
-    memcpy(&info->header[12],"fmt ",4); // fmt           
-    little_endian(&info->header[16], 4, 16); // Subchunk 1 size: PCM = 16
-    little_endian(&info->header[20], 2, 1);  // Format 1: for PCM
-    little_endian(&info->header[22], 2, info->n_channels); // channels
-    little_endian(&info->header[24], 4, info->sample_rate); // sample rate
-    little_endian(&info->header[28], 4, info->sample_rate*info->n_channels*2); // byte rate
-    little_endian(&info->header[32], 2, info->n_channels*2); // block align
-    little_endian(&info->header[34], 2, 16); // bit depth
-    memcpy(&info->header[36], "data",4);
-    little_endian(&info->header[40], 4, 0); // number of bytes in this file    
-    fwrite(info->header, 44, 1, info->wavfile);        
+    memcpy(&info->header[SIMPLEWAV_DS64_OFFSET], "JUNK", 4); // space for a ds64 chunk
+    little_endian(&info->header[SIMPLEWAV_DS64_OFFSET+4], 4, 28);
+    memcpy(&info->header[SIMPLEWAV_FMT_OFFSET],"fmt ",4); // fmt           
+    little_endian(&info->header[SIMPLEWAV_FMT_OFFSET+4], 4, 18); // Subchunk 1 size (with an empty extension)
+    little_endian(&info->header[SIMPLEWAV_FMT_OFFSET+8], 2, info->bit_depth==WAVEWRITER_BIT_DEPTH_FLOAT ? 3 : 1);  // Format 1: PCM, 3: float
+    little_endian(&info->header[SIMPLEWAV_FMT_OFFSET+10], 2, info->n_channels); // channels
+    little_endian(&info->header[SIMPLEWAV_FMT_OFFSET+12], 4, info->sample_rate); // sample rate
+    little_endian(&info->header[SIMPLEWAV_FMT_OFFSET+16], 4, info->sample_rate*info->n_channels*info->sample_bytes); // byte rate
+    little_endian(&info->header[SIMPLEWAV_FMT_OFFSET+20], 2, info->n_channels*info->sample_bytes); // block align
+    little_endian(&info->header[SIMPLEWAV_FMT_OFFSET+22], 2, info->bit_depth); // bit depth
+    memcpy(&info->header[SIMPLEWAV_DATA_OFFSET], "data",4);
+    little_endian(&info->header[SIMPLEWAV_DATA_OFFSET+4], 4, 0); // number of bytes of data
+    fwrite(info->header, SIMPLEWAV_HEADER_BYTES, 1, info->wavfile);        
     
     
 }
 
 
-// write a block of data to a wave file
+// convert a block of data to the file's format, and write it to the wave file
 void soundfile_write(void *ptr, float *data, int n)
 {
     SimpleWavInfo *info = ptr;
+    unsigned char *out;
     int i;
     double x;
+    
+    if(!info->wavfile)
+        return;
 
     for(i=0;i<n;i++)
     {
+      out = &info->output_buffer[info->output_ptr];
       x = data[i];
-      // clip
-      if(x>=0.999999)
-        x = 0.999999;
-      if(x<=-0.999999)
-        x = -0.999999;
-        
-      // scale
-      x *= 32767;
-            
-      // update buffer
-      little_endian(&info->output_buffer[info->output_ptr], 2, (int)x);         
       
-      info->output_total+=2;
-      info->output_ptr+=2;
+      if(info->bit_depth==WAVEWRITER_BIT_DEPTH_FLOAT)
+      {
+        // (files are little endian, like the hosts this runs on)
+        memcpy(out, &data[i], 4);
+      }
+      else
+      {
+        // clip
+        if(x>=0.999999)
+          x = 0.999999;
+        if(x<=-0.999999)
+          x = -0.999999;
+          
+        // scale (rounding to the nearest level)
+        if(info->bit_depth==WAVEWRITER_BIT_DEPTH_8)
+          out[0] = (int)floor(x*127 + 0.5) + 128; // 8 bit is unsigned
+        if(info->bit_depth==WAVEWRITER_BIT_DEPTH_16)
+          little_endian(out, 2, (int)floor(x*32767 + 0.5));         
+        if(info->bit_depth==WAVEWRITER_BIT_DEPTH_24)
+          little_endian(out, 3, (int)floor(x*8388607 + 0.5));         
+      }
+      
+      info->output_total += info->sample_bytes;
+      info->output_ptr += info->sample_bytes;
     
       // write buffer if it's time
-      if(info->output_ptr >= info->output_len)
+      if(info->output_ptr + 4 > info->output_len)
       {
         fwrite(info->output_buffer, 1, info->output_ptr, info->wavfile);
         info->output_ptr = 0;
@@ -199,18 +301,41 @@ void soundfile_write(void *ptr, float *data, int n)
 
 
 
-
+// write out anything buffered, and bring the header up to date
+// files too large for a RIFF header are turned into RF64
 void soundfile_sync(void *ptr)
 {    
     SimpleWavInfo *info = ptr;
-    // update header
-    fseek(info->wavfile, SEEK_SET, 0);
-    little_endian(&info->header[4], 4, 36+info->output_total); // number of bytes in this file + 36
-    little_endian(&info->header[40], 4, info->output_total); // number of bytes in this file   
-    fwrite(info->header, 44, 1, info->wavfile);
+    unsigned long long riff_bytes;
+    
+    fwrite(info->output_buffer, 1, info->output_ptr, info->wavfile);
+    info->output_ptr = 0;
+    
+    // chunks have an even length
+    riff_bytes = SIMPLEWAV_HEADER_BYTES - 8 + info->output_total + (info->output_total&1);
+    
+    if(riff_bytes > SIMPLEWAV_MAX_RIFF_BYTES)
+    {
+        // RF64: the sizes live in the ds64 chunk, which replaces the JUNK chunk
+        memcpy(&info->header[0], "RF64", 4);
+        little_endian(&info->header[4], 4, 0xffffffff);
+        memcpy(&info->header[SIMPLEWAV_DS64_OFFSET], "ds64", 4);
+        little_endian_64(&info->header[SIMPLEWAV_DS64_OFFSET+8], riff_bytes);
+        little_endian_64(&info->header[SIMPLEWAV_DS64_OFFSET+16], info->output_total);
+        little_endian_64(&info->header[SIMPLEWAV_DS64_OFFSET+24], info->output_total / (info->n_channels*info->sample_bytes));
+        little_endian(&info->header[SIMPLEWAV_DATA_OFFSET+4], 4, 0xffffffff);
+    }
+    else
+    {
+        little_endian(&info->header[4], 4, (int)riff_bytes); // number of bytes in the rest of the file
+        little_endian(&info->header[SIMPLEWAV_DATA_OFFSET+4], 4, (int)info->output_total); // number of bytes of data   
+    }
+    
+    fseek(info->wavfile, 0, SEEK_SET);
+    fwrite(info->header, SIMPLEWAV_HEADER_BYTES, 1, info->wavfile);
 
     // jump back to the end of the file
-    fseek(info->wavfile, SEEK_END, 0);
+    fseek(info->wavfile, 0, SEEK_END);
 
 }
 
@@ -220,7 +345,14 @@ void soundfile_sync(void *ptr)
 void soundfile_stop(void *ptr)
 {
     SimpleWavInfo *info = ptr;
-    soundfile_sync(info);
+    if(info->wavfile)
+    {
+        soundfile_sync(info);
+        // pad the data chunk to an even length
+        if(info->output_total&1)
+            fputc(0, info->wavfile);
+        fclose(info->wavfile);       
+    }
     free(info->output_buffer);
-    fclose(info->wavfile);       
+    free(info);
 }
@@ -15,22 +15,37 @@
 struct WaveSound;
 
 
+// bytes of converted samples held before each fwrite()
+#define SIMPLEWAV_OUTPUT_BYTES 65536
+
+// header layout: RIFF, a JUNK chunk which becomes the ds64 chunk if the file 
+// has to be turned into RF64, fmt (18 bytes, for float) and the data chunk header
+#define SIMPLEWAV_DS64_OFFSET 12
+#define SIMPLEWAV_FMT_OFFSET 48
+#define SIMPLEWAV_DATA_OFFSET 74
+#define SIMPLEWAV_HEADER_BYTES 82
+
+// largest data chunk a plain RIFF WAV file can describe
+#define SIMPLEWAV_MAX_RIFF_BYTES 4294967295.0
+
 typedef struct SimpleWavInfo
 {
     FILE *wavfile;
     int n_channels;
     int sample_rate;
-    int frames;
+    int bit_depth;              // one of WAVEWRITER_BIT_DEPTH_*
+    int sample_bytes;
     unsigned char *output_buffer;
     int output_ptr;
     int output_len;
-    int output_total;
-    unsigned char header[44];    
+    unsigned long long output_total;     // bytes of sample data written so far
+    unsigned char header[SIMPLEWAV_HEADER_BYTES];    
 } SimpleWavInfo;
 
 void soundfile_sub_open(void *ptr, char *fname);
 int get_little_endian(unsigned char *data, int n_bytes);
 void little_endian(unsigned char *data, int n_bytes, int x);
+void little_endian_64(unsigned char *data, unsigned long long x);
 
 
 
@@ -48,6 +48,11 @@ Spatializer *create_spatializer()
     spatializer->distance_attenuation_factor = 0.1; 
        
     spatializer->spatialization_mode = SPATIALIZATION_PAN;
+    
+    // full detail for every grain
+    spatializer->lod_distance = 1e20;
+    spatializer->lod_gain = 0.0;
+    
     spatializer->stream_location = create_location();
     set_spherical_location(spatializer->stream_location, 0, 0, 1);
     spatializer->global_mode = SPATIALIZATION_PER_GRAIN;
@@ -64,6 +69,11 @@ Spatializer *create_spatializer()
     spatializer->speaker_locations = NULL;
     spatializer->channels = NULL;
     spatializer->channel_excesses = NULL;
+    spatializer->channel_buffers = NULL;
+    spatializer->excess_buffers = NULL;
+    spatializer->vbap = NULL;
+    spatializer->n_channels = 0;
+    spatializer->ambisonic = NULL;
     spatializer->hrtf = NULL;
     
 
@@ -111,8 +121,14 @@ int get_n_channels_spatializer(Spatializer *spatializer)
             return 2;
             break;
         case SPATIALIZATION_MULTICHANNEL:
+        case SPATIALIZATION_VBAP:
             return spatializer->n_channels;
             break;
+        case SPATIALIZATION_AMBISONIC:
+            if(spatializer->ambisonic && !spatializer->ambisonic->binaural && spatializer->channel_buffers)
+                return spatializer->n_channels;
+            return 2;
+            break;
     }
     return 0;           
 }
@@ -135,7 +151,13 @@ Buffer *get_channel_spatializer(Spatializer *spatializer, int i)
                 return spatializer->right;
             break;
         case SPATIALIZATION_MULTICHANNEL:
-            return (Buffer *)list_get_at(spatializer->channels, i);
+        case SPATIALIZATION_VBAP:
+            return spatializer->channel_buffers[i];
+            break;
+        case SPATIALIZATION_AMBISONIC:
+            if(spatializer->ambisonic && !spatializer->ambisonic->binaural && spatializer->channel_buffers)
+                return spatializer->channel_buffers[i];
+            return i==0 ? spatializer->left : spatializer->right;
             break;
     }
     return NULL;           
@@ -148,30 +170,52 @@ void set_world_matrix_spatializer(Spatializer *spatializer, Matrix3D *matrix)
 }
 
 // destroy any multichannel data
+// (each channel owns the block it shares with its excess buffer)
 void destroy_channels_spatializer(Spatializer *spatializer)
 {   
     int i;    
     if(spatializer->channels)
     {
         for(i=0;i<list_size(spatializer->channels);i++)        
+        {
             destroy_buffer((Buffer*)list_get_at(spatializer->channels, i));            
+            free(list_get_at(spatializer->channel_excesses, i));
+        }
         list_destroy(spatializer->channels);
+        list_destroy(spatializer->channel_excesses);
         free(spatializer->channels);       
+        free(spatializer->channel_excesses);       
+        free(spatializer->channel_buffers);
+        free(spatializer->excess_buffers);
+        destroy_vbap_table(spatializer->vbap);
+        spatializer->channels = NULL;
+        spatializer->channel_excesses = NULL;
+        spatializer->channel_buffers = NULL;
+        spatializer->excess_buffers = NULL;
+        spatializer->vbap = NULL;
+        spatializer->n_channels = 0;
     }    
 }
 
 // set the hrtf model for spatialization, and enable HRTF mode
 // HRTF spatialization can _only_ be used with per stream spatialization
+// the convolver is only recreated if the model changes, so switching back 
+// into HRTF mode does not allocate
 void set_hrtf_spatializer(Spatializer *spatializer, HRTFModel *model)
 {   
     spatializer->spatialization_mode = SPATIALIZATION_3D_HRTF;
     spatializer->global_mode = SPATIALIZATION_PER_STREAM;
+    if(spatializer->hrtf && spatializer->hrtf->model == model)
+        return;
     if(spatializer->hrtf)
         destroy_hrtf_convolver(spatializer->hrtf);
     spatializer->hrtf = create_hrtf_convolver(model);   
 }
 
-// set the speaker locations for multichannel spatialization
+// set the speaker locations for multichannel spatialization (SPATIALIZATION_MULTICHANNEL,
+// or SPATIALIZATION_VBAP/SPATIALIZATION_AMBISONIC if one of those is already set); this also
+// triangulates the layout for VBAP and redesigns any ambisonic speaker decoder, so call it
+// when the layout changes, not from the audio thread
 // takes a _reference_ to the speaker location list!
 void set_multichannel_spatializer(Spatializer *spatializer, list_t *speaker_locations)
 {
@@ -186,19 +230,27 @@ void set_multichannel_spatializer(Spatializer *spatializer, list_t *speaker_loca
     spatializer->channel_excesses = malloc(sizeof(*spatializer->channel_excesses));
     list_init(spatializer->channels);
     list_init(spatializer->channel_excesses);
-    spatializer->spatialization_mode = SPATIALIZATION_MULTICHANNEL;
+    if(spatializer->spatialization_mode != SPATIALIZATION_VBAP && spatializer->spatialization_mode != SPATIALIZATION_AMBISONIC)
+        spatializer->spatialization_mode = SPATIALIZATION_MULTICHANNEL;
     
     // allocate buffers
+    spatializer->channel_buffers = malloc(sizeof(*spatializer->channel_buffers) * MAX(1,list_size(speaker_locations)));
+    spatializer->excess_buffers = malloc(sizeof(*spatializer->excess_buffers) * MAX(1,list_size(speaker_locations)));
     for(i=0;i<list_size(speaker_locations);i++)
     {
         create_split_buffer(GLOBAL_STATE.frames_per_buffer, &channel, &channel_excess);
         zero_buffer(channel);
         zero_buffer(channel_excess);
         list_append(spatializer->channels, channel);
-        list_append(spatializer->channels, channel_excess);
+        list_append(spatializer->channel_excesses, channel_excess);
+        spatializer->channel_buffers[i] = channel;
+        spatializer->excess_buffers[i] = channel_excess;
     }
             
     spatializer->n_channels = list_size(speaker_locations);
+    spatializer->vbap = create_vbap_table(speaker_locations);
+    if(spatializer->ambisonic && !spatializer->ambisonic->binaural)
+        set_speakers_ambisonic_bus(spatializer->ambisonic, speaker_locations);
     
 }
 
@@ -217,6 +269,8 @@ void destroy_spatializer(Spatializer *spatializer)
     destroy_buffer(spatializer->right_distance);
     
     destroy_channels_spatializer(spatializer);
+    if(spatializer->ambisonic)
+        destroy_ambisonic_bus(spatializer->ambisonic);
     destroy_matrix(spatializer->working_matrix);
     destroy_matrix(spatializer->matrix);
     
@@ -226,6 +280,42 @@ void destroy_spatializer(Spatializer *spatializer)
     free(spatializer);        
 }
 
+// decode an ambisonic bus to a stereo pair (speakers at +/-30 degrees)
+static void set_stereo_ambisonic_spatializer(Spatializer *spatializer)
+{
+    list_t speakers;
+    Location3D left, right;
+    list_init(&speakers);
+    set_spherical_location(&left, -30, 0, 1);
+    set_spherical_location(&right, 30, 0, 1);
+    list_append(&speakers, &left);
+    list_append(&speakers, &right);
+    set_speakers_ambisonic_bus(spatializer->ambisonic, &speakers);
+    list_destroy(&speakers);
+}
+
+/** Enable ambisonic spatialization: every grain is encoded into a B-format bus, which is
+    decoded once per block. With an HRTF model the bus is decoded binaurally; otherwise
+    it is decoded to the speaker layout (see set_multichannel_spatializer()) or, if there is
+    none, to stereo. Designs the decoder, so don't call this from the audio thread.
+    @arg spatializer The spatializer
+    @arg order Ambisonic order (1-3); the cost per grain is 4, 9 or 16 multiply-adds per sample
+    @arg model HRTF model for binaural decoding, or NULL
+*/
+void set_ambisonic_spatializer(Spatializer *spatializer, int order, HRTFModel *model)
+{
+    if(spatializer->ambisonic)
+        destroy_ambisonic_bus(spatializer->ambisonic);
+    spatializer->ambisonic = create_ambisonic_bus(order);
+    if(model)
+        set_binaural_ambisonic_bus(spatializer->ambisonic, model);
+    else if(spatializer->channel_buffers)
+        set_speakers_ambisonic_bus(spatializer->ambisonic, spatializer->speaker_locations);
+    else
+        set_stereo_ambisonic_spatializer(spatializer);
+    spatializer->spatialization_mode = SPATIALIZATION_AMBISONIC;
+}
+
 // return the location object of this stream
 Location3D *get_location_spatializer(Spatializer *spatializer)
 {
@@ -238,6 +328,15 @@ Matrix3D *get_matrix_spatializer(Spatializer *spatializer)
 }
 
 // set the spatialization mode (mono, stereo pan, pan + iad, fake 3d, hrtf 3d) and per stream/per grain
+// set the level of detail; in 3D filtering mode, grains further than distance or with
+// a gain (after attenuation) below gain are panned instead of filtered
+void set_lod_spatializer(Spatializer *spatializer, float distance, float gain)
+{
+    spatializer->lod_distance = distance;
+    spatializer->lod_gain = gain;
+}
+
+
 void set_spatializer_mode(Spatializer *spatializer, int mode, int per_stream)
 {
     spatializer->spatialization_mode = mode;
@@ -267,16 +366,17 @@ void start_spatializer(Spatializer *spatializer)
        
     zero_buffer(spatializer->mono);
     zero_buffer(spatializer->reverb);
+    if(spatializer->ambisonic)
+        zero_ambisonic_bus(spatializer->ambisonic);
     
     // only for multichannel spatialization
     if(spatializer->channels)
     {        
-        for(i=0;i<list_size(spatializer->channels);i++)
+        for(i=0;i<spatializer->n_channels;i++)
         {
-            channel = (Buffer*)list_get_at(spatializer->channels, i);
-            channel_excess = (Buffer*)list_get_at(spatializer->channel_excesses, i);            
+            channel = spatializer->channel_buffers[i];
+            channel_excess = spatializer->excess_buffers[i];
             copy_buffer(channel, channel_excess);            
-            zero_buffer(channel);
             zero_buffer(channel_excess);            
         }
     }
@@ -296,6 +396,18 @@ void stop_spatializer(Spatializer *spatializer)
   if(spatializer->global_mode == SPATIALIZATION_PER_STREAM)
     spatialize(spatializer, spatializer->stream_location, 1.0, spatializer->mono, 0, spatializer->mono->n_samples);
     
+  // decode the ambisonic bus into the output channels
+  if(spatializer->spatialization_mode == SPATIALIZATION_AMBISONIC && spatializer->ambisonic)
+  {
+      Buffer *stereo[2];
+      stereo[0] = spatializer->left;
+      stereo[1] = spatializer->right;
+      if(!spatializer->ambisonic->binaural && spatializer->channel_buffers)
+          decode_ambisonic_bus(spatializer->ambisonic, spatializer->channel_buffers);
+      else
+          decode_ambisonic_bus(spatializer->ambisonic, stereo);
+  }
+    
     
   
   
@@ -330,6 +442,57 @@ int get_sample_delay_spatializer(Spatializer *spatializer, float distance)
 
 
 
+// get a location relative to the listener (world followed by local matrix)
+static void transform_spatializer(Spatializer *spatializer, Location3D *location, Location3D *transformed)
+{
+    if(spatializer->world_matrix)
+        copy_matrix(spatializer->working_matrix, spatializer->world_matrix);
+    else
+        // identity if no world matrix
+        identity_matrix(spatializer->working_matrix);        
+        
+    multiply_matrix(spatializer->working_matrix, spatializer->matrix);
+    transform_location(transformed, location, spatializer->working_matrix);
+}
+
+
+/** Work out the ambisonic encoding of a grain as it spawns, so that spatialize_encoded()
+    can mix it without transforming its location every block. The encoding is only
+    valid in per grain SPATIALIZATION_AMBISONIC mode.
+    @arg spatializer The spatializer
+    @arg location The grain's location
+    @arg encoding Set to the grain's encoding
+*/
+void encode_spatializer(Spatializer *spatializer, Location3D *location, AmbisonicEncoding *encoding)
+{
+    Location3D transformed;
+    float attenuation;
+    int c;
+    
+    encoding->valid = 0;
+    if(spatializer->spatialization_mode != SPATIALIZATION_AMBISONIC || !spatializer->ambisonic || spatializer->global_mode != SPATIALIZATION_PER_GRAIN)
+        return;
+        
+    transform_spatializer(spatializer, location, &transformed);
+    
+    // encoded at the highest order, so the bus order can change while the grain plays
+    attenuation = 1.0 / (1+transformed.distance * spatializer->distance_attenuation_factor);
+    encode_ambisonic(AMBISONIC_MAX_ORDER, transformed.x, transformed.y, transformed.z, encoding->gains);
+    for(c=0;c<AMBISONIC_MAX_COMPONENTS;c++)
+        encoding->gains[c] *= attenuation;
+    encoding->reverb_gain = 1.0 / (1+sqrt(transformed.distance) * spatializer->distance_attenuation_factor);
+    encoding->valid = 1;
+}
+
+
+// mix a grain into the ambisonic bus with the gains from encode_spatializer() (as spatialize() would)
+void spatialize_encoded(Spatializer *spatializer, AmbisonicEncoding *encoding, float amplitude, Buffer *mono, int offset, int len)
+{
+    mix_buffer_offset_weighted(spatializer->reverb, mono, offset, len, amplitude * encoding->reverb_gain);
+    mix_ambisonic_bus(spatializer->ambisonic, encoding->gains, mono, offset, len, amplitude);
+}
+
+
 // apply amplitude, grain RMS monitoring and spatialisation.
 void spatialize(Spatializer *spatializer, Location3D *location, float amplitude, Buffer *mono,  int offset, int len)
 {
@@ -340,16 +503,7 @@ void spatialize(Spatializer *spatializer, Location3D *location, float amplitude,
     
     spatialization_mode = spatializer->spatialization_mode;    
     
-    // get transformed location (world followed by local matrix)
-    if(spatializer->world_matrix)
-        copy_matrix(spatializer->working_matrix, spatializer->world_matrix);
-    else
-        // identity if no world matrix
-        identity_matrix(spatializer->working_matrix);        
-        
-    multiply_matrix(spatializer->working_matrix, spatializer->matrix);
-    
-    transform_location(&transformed, location, spatializer->working_matrix);
+    transform_spatializer(spatializer, location, &transformed);
     location = &transformed; // point location to the _transformed_ position
     
     
@@ -364,6 +518,11 @@ void spatialize(Spatializer *spatializer, Location3D *location, float amplitude,
     // gains
     attenuation = 1.0 / (1+location->distance * spatializer->distance_attenuation_factor);
     overall_gain = amplitude * attenuation;
+    
+    // cheaper spatialization for far away or quiet grains, if the level of detail is reduced
+    if(spatialization_mode==SPATIALIZATION_3D_FILTERING && (location->distance > spatializer->lod_distance || overall_gain < spatializer->lod_gain))
+        spatialization_mode = SPATIALIZATION_PAN;
+    
     reverb_gain = amplitude / (1+sqrt(location->distance) * spatializer->distance_attenuation_factor);
     // always mix some into the additional reverb buffer...
     // mix less attenuated copy into the reverb buffer
@@ -462,7 +621,7 @@ void spatialize(Spatializer *spatializer, Location3D *location, float amplitude,
                // get gain
                attenuation = 1.0 / (1+d * spatializer->distance_attenuation_factor);
                overall_gain = amplitude * attenuation; 
-               channel = list_get_at(spatializer->channels, i);
+               channel = spatializer->channel_buffers[i];
                
                // get delay (and cap it)
                // should use normalized delays (normalized to nearest speaker = 0, to avoid delay saturation)
@@ -476,6 +635,26 @@ void spatialize(Spatializer *spatializer, Location3D *location, float amplitude,
              
      }
      
+     // vector base amplitude panning: a table lookup, and at most three speakers
+     if(spatialization_mode==SPATIALIZATION_VBAP && spatializer->vbap)
+     {
+        VBAPGain gain;
+        int i;
+        
+        get_gains_vbap_table(spatializer->vbap, location->azimuth, location->elevation, &gain);
+        for(i=0;i<3;i++)
+            if(gain.gains[i]>0)
+                mix_buffer_offset_weighted(spatializer->channel_buffers[gain.speakers[i]], mono, offset, len, gain.gains[i] * overall_gain);
+     }
+     
+     // ambisonic encoding (see encode_spatializer() for grains, which are encoded as they spawn)
+     if(spatialization_mode==SPATIALIZATION_AMBISONIC && spatializer->ambisonic)
+     {
+        float gains[AMBISONIC_MAX_COMPONENTS];
+        encode_ambisonic(spatializer->ambisonic->order, location->x, location->y, location->z, gains);
+        mix_ambisonic_bus(spatializer->ambisonic, gains, mono, offset, len, overall_gain);
+     }
+     
      // HRTF spatialization
      if(spatialization_mode==SPATIALIZATION_3D_HRTF && spatializer->hrtf && spatializer->global_mode == SPATIALIZATION_PER_STREAM)
     {
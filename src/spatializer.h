@@ -17,6 +17,8 @@
 #include "grain.h"
 #include "location.h"
 #include "hrtf.h"
+#include "vbap.h"
+#include "ambisonic.h"
 #include <stdlib.h>
 #include <math.h>
 
@@ -32,6 +34,10 @@
 #define SPATIALIZATION_3D_HRTF 4 
 // level/delay per speaker. no filtering.
 #define SPATIALIZATION_MULTICHANNEL 5
+// vector base amplitude panning between (at most) three speakers. no delays.
+#define SPATIALIZATION_VBAP 6
+// encoded into an ambisonic bus, decoded once per block to the speakers (or binaural, or stereo)
+#define SPATIALIZATION_AMBISONIC 7
 
 
 #define SPATIALIZATION_PER_STREAM 0
@@ -72,6 +78,11 @@ typedef struct Spatializer
     
     int spatializing;
     
+    // level of detail: in SPATIALIZATION_3D_FILTERING mode, grains further away than lod_distance
+    // or quieter than lod_gain (after attenuation) are just panned
+    float lod_distance;
+    float lod_gain;
+    
     Buffer *left, *right, *left_distance, *right_distance, *mono, *reverb;        
     Buffer *left_excess, *right_excess;
     Buffer *left_distance_excess, *right_distance_excess;
@@ -85,6 +96,12 @@ typedef struct Spatializer
     list_t *channels;
     int n_channels;
     list_t *channel_excesses;
+    Buffer **channel_buffers;   // the channels and their excesses, as arrays for the audio thread
+    Buffer **excess_buffers;
+    VBAPTable *vbap;            // panning gains for the speaker layout
+    
+    // for ambisonic spatialization
+    AmbisonicBus *ambisonic;
     
     // transformation matrix
     Matrix3D *matrix;
@@ -110,6 +127,10 @@ Spatializer *create_spatializer();
 void destroy_spatializer(Spatializer *spatializer);
 void set_spatializer_mode(Spatializer *spatializer, int mode, int per_stream);
 void spatialize(Spatializer *spatializer, Location3D *location, float amplitude, Buffer *mono,  int offset, int len);
+void encode_spatializer(Spatializer *spatializer, Location3D *location, AmbisonicEncoding *encoding);
+void spatialize_encoded(Spatializer *spatializer, AmbisonicEncoding *encoding, float amplitude, Buffer *mono, int offset, int len);
+void set_ambisonic_spatializer(Spatializer *spatializer, int order, HRTFModel *model);
 void set_hrtf_spatializer(Spatializer *spatializer, HRTFModel *model);
+void set_lod_spatializer(Spatializer *spatializer, float distance, float gain);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,204 @@
+/**
+    @file stats.c
+    @brief Per-block timing and load statistics. The audio callback records
+    how long each stage of synthesis takes, and how many grains are active,
+    and pushes one record per block into a history ring. The ring is written
+    only by the audio thread and can be read from any other thread without locking.
+    Once per block the audio thread also publishes a snapshot of the grain counts
+    of every stream, so that other threads never have to walk the stream list.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include "stats.h"
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define STATS_MEMORY_BARRIER() MemoryBarrier()
+#else
+#include <time.h>
+#define STATS_MEMORY_BARRIER() __sync_synchronize()
+#endif
+
+
+// Create a new, empty statistics object
+Statistics *create_stats(void)
+{
+    Statistics *stats;
+    stats = malloc(sizeof(*stats));
+    memset(&stats->current, 0, sizeof(stats->current));
+    stats->history = calloc(STATS_HISTORY_LENGTH, sizeof(*stats->history));
+    stats->n_written = 0;
+    stats->overruns = 0;
+    stats->block_start = 0.0;
+    memset(&stats->snapshot, 0, sizeof(stats->snapshot));
+    stats->snapshot_sequence = 0;
+    return stats;
+}
+
+// Destroy a statistics object
+void destroy_stats(Statistics *stats)
+{
+    free(stats->history);
+    free(stats);
+}
+
+
+// return a monotonic timestamp, in seconds
+double get_time_stats(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (double)count.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+// return the time available to compute one block, in seconds
+double get_deadline_stats(void)
+{
+    return GLOBAL_STATE.frames_per_buffer / (double)GLOBAL_STATE.sample_rate;
+}
+
+
+// begin timing a new block
+void start_block_stats(Statistics *stats)
+{
+    memset(&stats->current, 0, sizeof(stats->current));
+    stats->block_start = get_time_stats();
+}
+
+
+/** Add the time since a previous timestamp to one of the stages of the current block.
+    Returns the current time, so that consecutive stages can be chained:
+    t = stage_stats(stats, STATS_STAGE_SPAWN, t);
+    @arg stats The statistics object (may be NULL, in which case nothing is recorded)
+    @arg stage The stage to add the time to (one of STATS_STAGE_*)
+    @arg since The timestamp at which the stage started
+    @return The current time
+*/
+double stage_stats(Statistics *stats, int stage, double since)
+{
+    double now;
+    now = get_time_stats();
+    if(stats)
+        stats->current.stage_time[stage] += now - since;
+    return now;
+}
+
+// add an already measured time to one of the stages of the current block
+void add_stage_time_stats(Statistics *stats, int stage, double time)
+{
+    if(stats)
+        stats->current.stage_time[stage] += time;
+}
+
+// add grain counts to the current block
+void count_grains_stats(Statistics *stats, int active, int spawned, int killed)
+{
+    if(!stats)
+        return;
+    stats->current.active_grains += active;
+    stats->current.spawned_grains += spawned;
+    stats->current.killed_grains += killed;
+}
+
+
+// finish the current block, and push it onto the history
+void end_block_stats(Statistics *stats)
+{
+    stats->current.callback_time = get_time_stats() - stats->block_start;
+    if(stats->current.callback_time > get_deadline_stats())
+        stats->overruns++;
+
+    // write the entry, and only then publish it
+    stats->history[stats->n_written & (STATS_HISTORY_LENGTH-1)] = stats->current;
+    STATS_MEMORY_BARRIER();
+    stats->n_written++;
+}
+
+
+/** Copy the most recent blocks out of the history ring, oldest first.
+    Safe to call from any thread while the audio thread is running.
+    @arg stats The statistics object to read from
+    @arg blocks Array to copy the blocks into
+    @arg max_blocks Maximum number of blocks to copy (blocks must have space for this many)
+    @return The number of blocks copied
+*/
+int get_history_stats(Statistics *stats, BlockStats *blocks, int max_blocks)
+{
+    unsigned int start, end, first_valid;
+    int i, n, skip;
+
+    end = stats->n_written;
+    STATS_MEMORY_BARRIER();
+
+    n = MIN(end, STATS_HISTORY_LENGTH);
+    n = MIN(n, max_blocks);
+    start = end - n;
+
+    for(i=0;i<n;i++)
+        blocks[i] = stats->history[(start+i) & (STATS_HISTORY_LENGTH-1)];
+
+    // discard any entries the writer may have overwritten while they were copied
+    STATS_MEMORY_BARRIER();
+    end = stats->n_written;
+    first_valid = (end >= STATS_HISTORY_LENGTH) ? end - STATS_HISTORY_LENGTH + 1 : 0;
+    if(start < first_valid)
+    {
+        skip = MIN(n, (int)(first_valid - start));
+        n -= skip;
+        memmove(blocks, blocks+skip, n * sizeof(*blocks));
+    }
+    return n;
+}
+
+
+/** Start writing the stream snapshot. Only the audio thread may call this,
+    and it must call end_snapshot_stats() once the snapshot has been filled in.
+    @arg stats The statistics object
+    @return The snapshot to fill in
+*/
+StatsSnapshot *begin_snapshot_stats(Statistics *stats)
+{
+    // mark the snapshot as being written before touching it
+    stats->snapshot_sequence++;
+    STATS_MEMORY_BARRIER();
+    return &stats->snapshot;
+}
+
+// publish the stream snapshot written since begin_snapshot_stats()
+void end_snapshot_stats(Statistics *stats)
+{
+    STATS_MEMORY_BARRIER();
+    stats->snapshot_sequence++;
+}
+
+
+/** Copy the most recent stream snapshot. Safe to call from any thread while
+    the audio thread is running; if the snapshot changes during the copy, it is copied again.
+    @arg stats The statistics object to read from
+    @arg snapshot Structure to copy the snapshot into
+*/
+void get_snapshot_stats(Statistics *stats, StatsSnapshot *snapshot)
+{
+    unsigned int sequence;
+    do
+    {
+        sequence = stats->snapshot_sequence;
+        STATS_MEMORY_BARRIER();
+        memcpy(snapshot, (const void *)&stats->snapshot, sizeof(*snapshot));
+        STATS_MEMORY_BARRIER();
+    } while((sequence & 1) || sequence != stats->snapshot_sequence);
+}
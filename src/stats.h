@@ -0,0 +1,109 @@
+/**
+    @file stats.h
+    @brief Per-block timing and load statistics. The audio callback records
+    how long each stage of synthesis takes, and how many grains are active,
+    and pushes one record per block into a history ring. The ring is written
+    only by the audio thread and can be read from any other thread without locking.
+    Once per block the audio thread also publishes a snapshot of the grain counts
+    of every stream, so that other threads never have to walk the stream list.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#ifndef __STATS_H__
+#define __STATS_H__
+#include "audio.h"
+
+// the stages of synthesis which are timed
+#define STATS_STAGE_TRIGGERS 0
+#define STATS_STAGE_SPAWN 1
+#define STATS_STAGE_SYNTHESIZE 2
+#define STATS_STAGE_SPATIALIZER 3
+#define STATS_STAGE_STREAM_FX 4
+#define STATS_STAGE_MASTER 5
+#define STATS_STAGE_REVERB 6
+#define STATS_STAGE_OUTPUT 7
+#define STATS_N_STAGES 8
+
+// number of blocks kept in the history (must be a power of 2)
+#define STATS_HISTORY_LENGTH 1024
+
+// number of streams whose counts are kept in the snapshot (the totals include every stream)
+#define STATS_MAX_STREAMS 64
+
+/** @struct BlockStats
+    Timing and grain counts for a single block. All times are in seconds. */
+typedef struct BlockStats
+{
+    double stage_time[STATS_N_STAGES];
+    double callback_time;
+    int active_grains;
+    int spawned_grains;
+    int killed_grains;
+} BlockStats;
+
+/** @struct StreamCounts
+    Grain counts for one stream (or the totals over all of them), since the stream was created */
+typedef struct StreamCounts
+{
+    int active_grains;
+    int spawned_grains;
+    int killed_grains;
+    int dropped_grains;
+    int stolen_grains;
+    int culled_grains;
+} StreamCounts;
+
+/** @struct StatsSnapshot
+    The grain counts of every stream, as of the end of a block */
+typedef struct StatsSnapshot
+{
+    int n_streams;                          // number of streams in the mixer (only the first STATS_MAX_STREAMS are in streams)
+    StreamCounts totals;
+    StreamCounts streams[STATS_MAX_STREAMS];
+} StatsSnapshot;
+
+/** @struct Statistics
+    Accumulates the current block, and holds the history of previous blocks */
+typedef struct Statistics
+{
+    BlockStats current;
+    double block_start;
+
+    // history ring; only the audio thread writes to this
+    BlockStats *history;
+    volatile unsigned int n_written;
+
+    // number of blocks which took longer than the buffer deadline
+    volatile int overruns;
+
+    // stream counts, written only by the audio thread; the sequence is odd while it is being written
+    StatsSnapshot snapshot;
+    volatile unsigned int snapshot_sequence;
+} Statistics;
+
+
+Statistics *create_stats(void);
+void destroy_stats(Statistics *stats);
+
+double get_time_stats(void);
+double get_deadline_stats(void);
+
+void start_block_stats(Statistics *stats);
+double stage_stats(Statistics *stats, int stage, double since);
+void add_stage_time_stats(Statistics *stats, int stage, double time);
+void count_grains_stats(Statistics *stats, int active, int spawned, int killed);
+void end_block_stats(Statistics *stats);
+
+int get_history_stats(Statistics *stats, BlockStats *blocks, int max_blocks);
+
+StatsSnapshot *begin_snapshot_stats(Statistics *stats);
+void end_snapshot_stats(Statistics *stats);
+void get_snapshot_stats(Statistics *stats, StatsSnapshot *snapshot);
+
+#endif
@@ -12,6 +12,7 @@
 
 #include "sys_audio.h"
 #include "audio.h"
+#include <stdio.h>
 
 const char *driver_name_sys_audio = "Dummy driver";
 
@@ -31,13 +32,26 @@ int shutdown_sys_audio(void *ptr)
     destroy_buffer(stream->in);
     destroy_buffer(stream->out);    
     free(stream);
+    return 0;
 }
 
 
-int pump_sys_audio(void *ptr)
+// synthesize one buffer (immediately discarded)
+int pump_sys_audio(void *ptr, int synthesize)
 {
     DummyStream *stream = (DummyStream *)ptr;
-    stream->callback(stream->user_data, stream->in->x, stream->out->x);
+    if(synthesize && stream->callback)
+    {
+        stream->callback(stream->user_data, stream->in->x, stream->out->x);
+        return SYSAUDIO_WRITE_SUCCEEDED;
+    }
+    return 0;
+}
+
+// nothing is ever queued
+int buffers_remaining_sys_audio(void *ptr)
+{
+    return 0;
 }
 
 
@@ -65,8 +79,8 @@ void *init_sys_audio(AudioInfo *info)
     stream->user_data = info->user_data;
     
     // some temporary space to read/write data
-    stream->in = create_buffer(info->state->frames_per_buffer * info->state->n_input_channels);
-    stream->out = create_buffer(info->state->frames_per_buffer * info->state->n_channels);
+    stream->in = create_buffer(info->device_frames_per_buffer * info->state->n_input_channels);
+    stream->out = create_buffer(info->device_frames_per_buffer * info->state->n_channels);
     
     return stream;
 }
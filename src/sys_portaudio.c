@@ -28,8 +28,8 @@ PortaudioInfo *create_portaudio_info(AudioInfo *info)
     paInfo = malloc(sizeof(*paInfo));
   
         // size of one input buffer
-    paInfo->in_block_size = sizeof(*paInfo->in_buffer) * info->state->n_input_channels * info->state->frames_per_buffer;
-    paInfo->out_block_size = sizeof(*paInfo->out_buffer) * info->state->n_channels * info->state->frames_per_buffer;
+    paInfo->in_block_size = sizeof(*paInfo->in_buffer) * info->state->n_input_channels * info->device_frames_per_buffer;
+    paInfo->out_block_size = sizeof(*paInfo->out_buffer) * info->state->n_channels * info->device_frames_per_buffer;
 
     paInfo->in_buffer = malloc(paInfo->in_block_size);
     paInfo->out_buffer = malloc(paInfo->out_block_size);
@@ -160,7 +160,8 @@ static int paTestCallback( const void *inputBuffer, void *outputBuffer,
             // oh dear.
             // A stall has happened, try copying out and then attenuating it
             // get an echo effect instead of buffer mayhem            
-            for(i=0;i<GLOBAL_STATE.frames_per_buffer * GLOBAL_STATE.n_channels;i++)
+            info->audio_info->state->dropped_buffers++;
+            for(i=0;i<info->audio_info->device_frames_per_buffer * info->audio_info->state->n_channels;i++)
             {
                 out[i] = info->out_buffer[i];
                 info->out_buffer[i] *= 0.95;
@@ -173,6 +174,8 @@ static int paTestCallback( const void *inputBuffer, void *outputBuffer,
     {
         // straightforward synthesis in this thread
         // WARNING! If synthesis doesn't complete on time, very bad things happen        
+        if(statusFlags & paOutputUnderflow)
+            info->audio_info->state->dropped_buffers++;
         if(info->audio_info->callback)
             info->audio_info->callback(info->audio_info->user_data, in, out);    
     
@@ -261,8 +264,8 @@ void *init_sys_audio(AudioInfo *info)
               &stream,
               &inputParameters, /* stereo input */
               &outputParameters,
-              info->state->sample_rate,
-              info->state->frames_per_buffer,
+              info->device_sample_rate,
+              info->device_frames_per_buffer,
               paNoFlag,      
               paTestCallback,
               paInfo );
@@ -272,8 +275,8 @@ void *init_sys_audio(AudioInfo *info)
               &stream,
               NULL, /* no input */
               &outputParameters,
-              info->state->sample_rate,
-              info->state->frames_per_buffer,
+              info->device_sample_rate,
+              info->device_frames_per_buffer,
               paNoFlag,      
               paTestCallback,
               paInfo );
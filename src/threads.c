@@ -0,0 +1,251 @@
+/**
+    @file threads.c
+    @brief Minimal portable threading primitives (Win32 or POSIX threads).
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include "threads.h"
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+struct Mutex
+{
+    CRITICAL_SECTION section;
+};
+struct Condition
+{
+    CONDITION_VARIABLE condition;
+};
+struct Thread
+{
+    HANDLE handle;
+    thread_func func;
+    void *data;
+};
+static SRWLOCK global_lock = SRWLOCK_INIT;
+#else
+#include <pthread.h>
+#include <unistd.h>
+struct Mutex
+{
+    pthread_mutex_t mutex;
+};
+struct Condition
+{
+    pthread_cond_t condition;
+};
+struct Thread
+{
+    pthread_t thread;
+    thread_func func;
+    void *data;
+};
+static pthread_mutex_t global_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+// lock the process-wide mutex (statically initialised, so it can guard creating other things)
+void lock_global_mutex(void)
+{
+#ifdef _WIN32
+    AcquireSRWLockExclusive(&global_lock);
+#else
+    pthread_mutex_lock(&global_mutex);
+#endif
+}
+
+// unlock the process-wide mutex
+void unlock_global_mutex(void)
+{
+#ifdef _WIN32
+    ReleaseSRWLockExclusive(&global_lock);
+#else
+    pthread_mutex_unlock(&global_mutex);
+#endif
+}
+
+
+// create a (non-recursive) mutex
+Mutex *create_mutex(void)
+{
+    Mutex *mutex;
+    mutex = malloc(sizeof(*mutex));
+#ifdef _WIN32
+    InitializeCriticalSection(&mutex->section);
+#else
+    pthread_mutex_init(&mutex->mutex, NULL);
+#endif
+    return mutex;
+}
+
+// destroy a mutex (which must not be locked)
+void destroy_mutex(Mutex *mutex)
+{
+#ifdef _WIN32
+    DeleteCriticalSection(&mutex->section);
+#else
+    pthread_mutex_destroy(&mutex->mutex);
+#endif
+    free(mutex);
+}
+
+// lock a mutex, waiting if another thread holds it
+void lock_mutex(Mutex *mutex)
+{
+#ifdef _WIN32
+    EnterCriticalSection(&mutex->section);
+#else
+    pthread_mutex_lock(&mutex->mutex);
+#endif
+}
+
+// unlock a mutex
+void unlock_mutex(Mutex *mutex)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(&mutex->section);
+#else
+    pthread_mutex_unlock(&mutex->mutex);
+#endif
+}
+
+
+// a full memory barrier: no load or store is moved across it, by the compiler or the processor
+void memory_barrier(void)
+{
+#ifdef _WIN32
+    MemoryBarrier();
+#else
+    __sync_synchronize();
+#endif
+}
+
+
+// create a condition variable, for threads to wait on while holding a mutex
+Condition *create_condition(void)
+{
+    Condition *condition;
+    condition = malloc(sizeof(*condition));
+#ifdef _WIN32
+    InitializeConditionVariable(&condition->condition);
+#else
+    pthread_cond_init(&condition->condition, NULL);
+#endif
+    return condition;
+}
+
+// destroy a condition variable (which no thread must be waiting on)
+void destroy_condition(Condition *condition)
+{
+#ifndef _WIN32
+    pthread_cond_destroy(&condition->condition);
+#endif
+    free(condition);
+}
+
+// unlock the mutex (which must be locked) and wait for the condition to be broadcast;
+// the mutex is locked again on return. Can wake spuriously, so always check what was waited for
+void wait_condition(Condition *condition, Mutex *mutex)
+{
+#ifdef _WIN32
+    SleepConditionVariableCS(&condition->condition, &mutex->section, INFINITE);
+#else
+    pthread_cond_wait(&condition->condition, &mutex->mutex);
+#endif
+}
+
+// wake every thread waiting on a condition
+void broadcast_condition(Condition *condition)
+{
+#ifdef _WIN32
+    WakeAllConditionVariable(&condition->condition);
+#else
+    pthread_cond_broadcast(&condition->condition);
+#endif
+}
+
+
+// entry point of every thread: run the thread's function
+#ifdef _WIN32
+static DWORD WINAPI run_thread(LPVOID arg)
+{
+    ((Thread *)arg)->func(((Thread *)arg)->data);
+    return 0;
+}
+#else
+static void *run_thread(void *arg)
+{
+    ((Thread *)arg)->func(((Thread *)arg)->data);
+    return NULL;
+}
+#endif
+
+
+/** Start a thread running a function. The thread must be joined with join_thread().
+    @arg func The function to run
+    @arg data Passed to the function
+    @return The thread, or NULL if it couldn't be started
+*/
+Thread *create_thread(thread_func func, void *data)
+{
+    Thread *thread;
+    thread = malloc(sizeof(*thread));
+    thread->func = func;
+    thread->data = data;
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, run_thread, thread, 0, NULL);
+    if(!thread->handle)
+#else
+    if(pthread_create(&thread->thread, NULL, run_thread, thread))
+#endif
+    {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+// wait for a thread to finish, and free it
+void join_thread(Thread *thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->thread, NULL);
+#endif
+    free(thread);
+}
+
+
+// number of processors available (at least 1)
+int get_n_processors(void)
+{
+    int n;
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    n = info.dwNumberOfProcessors;
+#else
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return n > 0 ? n : 1;
+}
+
+
+// sleep the calling thread for (at least) ms milliseconds
+void sleep_thread(int ms)
+{
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+}
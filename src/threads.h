@@ -0,0 +1,52 @@
+/**
+    @file threads.h
+    @brief Minimal portable threading primitives (Win32 or POSIX threads).
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#ifndef __THREADS_H__
+#define __THREADS_H__
+
+// opaque; defined per platform in threads.c
+typedef struct Mutex Mutex;
+typedef struct Condition Condition;
+typedef struct Thread Thread;
+
+// storage with one copy per thread
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+// the function a thread runs
+typedef void (*thread_func)(void *data);
+
+// a single process-wide lock which needs no creation, for one-time initialisation
+void lock_global_mutex(void);
+void unlock_global_mutex(void);
+
+Mutex *create_mutex(void);
+void destroy_mutex(Mutex *mutex);
+void lock_mutex(Mutex *mutex);
+void unlock_mutex(Mutex *mutex);
+
+Condition *create_condition(void);
+void destroy_condition(Condition *condition);
+void wait_condition(Condition *condition, Mutex *mutex);
+void broadcast_condition(Condition *condition);
+
+void memory_barrier(void);
+
+Thread *create_thread(thread_func func, void *data);
+void join_thread(Thread *thread);
+int get_n_processors(void);
+void sleep_thread(int ms);
+
+#endif
@@ -0,0 +1,110 @@
+/**
+    @file timing_wheel.c
+    @brief A hierarchical timing wheel holding grains which are waiting to start.
+    Level 0 has one slot per block; a slot at level n covers a full turn of level n-1.
+    Whenever level 0 wraps round, the next slot of level 1 is cascaded down (re-filed
+    by the exact due time of each grain), and so on up the levels.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include "timing_wheel.h"
+
+
+// Create an empty timing wheel, starting at block 0
+TimingWheel *create_timing_wheel(void)
+{
+    TimingWheel *wheel;
+    int i, j;
+    wheel = malloc(sizeof(*wheel));
+    for(i=0;i<TIMING_WHEEL_LEVELS;i++)
+        for(j=0;j<TIMING_WHEEL_SLOTS;j++)
+            wheel->slots[i][j] = NULL;
+    wheel->now = 0;
+    return wheel;
+}
+
+// Destroy a timing wheel. Any grains still in it are not freed (they belong to a pool).
+void destroy_timing_wheel(TimingWheel *wheel)
+{
+    free(wheel);
+}
+
+
+/** Put a grain into the wheel.
+    @arg wheel The wheel
+    @arg grain The grain (its next and prev pointers are used to chain it into the wheel)
+    @arg due The block in which the grain should be expired. Must not be before wheel->now.
+*/
+void insert_timing_wheel(TimingWheel *wheel, Grain *grain, unsigned int due)
+{
+    unsigned int delta, slot;
+    int level;
+    
+    grain->due = due;
+    delta = due - wheel->now;
+    
+    // grains beyond the range of the wheel wait in the furthest slot
+    if(delta >= TIMING_WHEEL_RANGE)
+        due = wheel->now + TIMING_WHEEL_RANGE - 1;
+    
+    // find the finest level which can hold the grain
+    for(level=0;level<TIMING_WHEEL_LEVELS-1;level++)
+        if(delta < (1u<<(TIMING_WHEEL_BITS*(level+1))))
+            break;
+    
+    slot = (due >> (TIMING_WHEEL_BITS*level)) & TIMING_WHEEL_MASK;
+    grain->next = wheel->slots[level][slot];
+    if(grain->next)
+        grain->next->prev = &grain->next;
+    grain->prev = &wheel->slots[level][slot];
+    wheel->slots[level][slot] = grain;
+}
+
+
+// move every grain in a slot down into the finer levels
+// returns the index of the slot (so the caller knows whether this level has wrapped too)
+static int cascade_timing_wheel(TimingWheel *wheel, int level)
+{
+    Grain *grain, *next;
+    int slot;
+    
+    slot = (wheel->now >> (TIMING_WHEEL_BITS*level)) & TIMING_WHEEL_MASK;
+    grain = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+    while(grain)
+    {
+        next = grain->next;
+        insert_timing_wheel(wheel, grain, grain->due);
+        grain = next;
+    }
+    return slot;
+}
+
+
+/** Take out all of the grains due in the current block, and move on to the next block.
+    @arg wheel The wheel
+    @return The grains which are due, chained through their next pointers (NULL if there are none)
+*/
+Grain *expire_timing_wheel(TimingWheel *wheel)
+{
+    Grain *due;
+    int level, slot;
+    
+    // level 0 has wrapped: bring down the grains due in the next turn
+    slot = wheel->now & TIMING_WHEEL_MASK;
+    if(slot==0)
+        for(level=1;level<TIMING_WHEEL_LEVELS;level++)
+            if(cascade_timing_wheel(wheel, level)!=0)
+                break;
+    
+    due = wheel->slots[0][slot];
+    wheel->slots[0][slot] = NULL;
+    wheel->now++;
+    return due;
+}
@@ -0,0 +1,47 @@
+/**
+    @file timing_wheel.h
+    @brief A hierarchical timing wheel holding grains which are waiting to start.
+    Grains are keyed by the absolute time (in blocks) at which they are due, and
+    are only touched again when that block comes round (or when a coarser level
+    of the wheel is cascaded into a finer one), so waiting grains cost nothing
+    per block.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#ifndef __TIMING_WHEEL_H__
+#define __TIMING_WHEEL_H__
+#include "audio.h"
+#include "grain.h"
+
+// each level has 2^TIMING_WHEEL_BITS slots; each slot of a level spans a whole turn of the level below
+#define TIMING_WHEEL_BITS 6
+#define TIMING_WHEEL_SLOTS (1<<TIMING_WHEEL_BITS)
+#define TIMING_WHEEL_MASK (TIMING_WHEEL_SLOTS-1)
+#define TIMING_WHEEL_LEVELS 4
+
+// furthest ahead (in blocks) a grain can be placed exactly; later grains are
+// parked in the last slot and re-filed when it comes round
+#define TIMING_WHEEL_RANGE (1u<<(TIMING_WHEEL_BITS*TIMING_WHEEL_LEVELS))
+
+
+/** @struct TimingWheel
+    Grains are chained through their next pointers, so the wheel never allocates */
+typedef struct TimingWheel
+{
+    Grain *slots[TIMING_WHEEL_LEVELS][TIMING_WHEEL_SLOTS];
+    unsigned int now;       // the next block to be expired
+} TimingWheel;
+
+
+TimingWheel *create_timing_wheel(void);
+void destroy_timing_wheel(TimingWheel *wheel);
+void insert_timing_wheel(TimingWheel *wheel, Grain *grain, unsigned int due);
+Grain *expire_timing_wheel(TimingWheel *wheel);
+
+#endif
@@ -12,9 +12,7 @@
 
 #include "trigger.h"
 
-#define RINGBUFFER_SIZE 65536
-
-// create an empty trigger object, with a ringbuffer ready to go
+// create an empty trigger object (in realtime mode, it reads nothing until it is attached to an input ring)
 Trigger *create_trigger(void)
 {   
     Trigger *trigger;
@@ -26,18 +24,15 @@ Trigger *create_trigger(void)
     trigger->trigger_data = NULL;
     trigger->process_callback = NULL;
     trigger->grain_stream = NULL;    
-    trigger->ringbuffer = malloc(sizeof(*trigger->ringbuffer));
-    trigger->ringdata = malloc(RINGBUFFER_SIZE);    
+    trigger->reader.ring = NULL;
     trigger->input = create_buffer(GLOBAL_STATE.frames_per_buffer);
-    PaUtil_InitializeRingBuffer(trigger->ringbuffer, RINGBUFFER_SIZE, trigger->ringdata);            
     return trigger;
 }
 
 // destroy a trigger object
 void destroy_trigger(Trigger *trigger)
 {    
-    free(trigger->ringdata);
-    free(trigger->ringbuffer);    
+    destroy_buffer(trigger->input);
     free(trigger);
 }
 
@@ -72,10 +67,19 @@ void set_wave_trigger(Trigger *trigger, WaveSound *sound)
 }
 
 
-// return the ring buffer for input to this trigger to write into
-PaUtilRingBuffer *get_ringbuffer_trigger(Trigger *trigger)
+// follow the given input ring (from the next block written to it)
+void attach_input_trigger(Trigger *trigger, InputRing *ring)
 {
-        return trigger->ringbuffer;
+    attach_input_reader(&trigger->reader, ring);
+}
+
+
+// return true if the trigger has fallen behind its input ring (and lost input) since this was last called
+int is_lagging_trigger(Trigger *trigger)
+{
+    if(!trigger->reader.ring)
+        return 0;
+    return is_lagging_input_reader(&trigger->reader);
 }
 
 
@@ -83,8 +87,9 @@ PaUtilRingBuffer *get_ringbuffer_trigger(Trigger *trigger)
 // from the currently active wave sound
 void process_trigger(Trigger *trigger)
 {
-    int wave_end, len, i, data_bytes;
-    Buffer *channel;
+    int wave_end, len, i;
+    WaveSound *sound;
+    Buffer ring_input;
     
     // can't trigger without a callback and a grain stream
     if(!trigger->process_callback || !trigger->grain_stream)
@@ -95,35 +100,39 @@ void process_trigger(Trigger *trigger)
         return;
             
     
-    // ringbuffer mode
+    // ringbuffer mode: read a block in place from the shared input ring (or
+    // into the input buffer, if the block wraps around the end of the ring)
     if(trigger->mode==TRIGGER_FROM_RINGBUFFER)
     {
-        data_bytes =trigger->input->n_samples * sizeof(*trigger->input->x);
-        // is there enough data waiting?
-        if(PaUtil_GetRingBufferReadAvailable(trigger->ringbuffer) >= data_bytes)        
-            PaUtil_ReadRingBuffer(trigger->ringbuffer, &(trigger->input->x[0]), data_bytes);                
-        else        
-           // not enough data, try again next buffer
-            return;        
+        if(!trigger->reader.ring)
+            return;
+        ring_input.n_samples = trigger->input->n_samples;
+        ring_input.x = read_input_reader(&trigger->reader, ring_input.n_samples, trigger->input->x);
+        
+        // not enough data, try again next buffer
+        if(!ring_input.x)
+            return;
+        trigger->process_callback(trigger->trigger_data, &ring_input, trigger->grain_stream);
+        return;
     }
     
     // wavefile mode
     if(trigger->mode==TRIGGER_FROM_WAVE)
     {
-        channel = get_channel_wave_sound(trigger->sound, 0);
+        sound = trigger->sound;
         wave_end = trigger->wave_input_phase + trigger->input->n_samples;
         
         // need to split if the wave block runs over the end of the wave file
-        if(wave_end >= channel->n_samples)
+        if(wave_end >= sound->frames)
         {
-            len = channel->n_samples - trigger->wave_input_phase;
-            copy_buffer_partial(trigger->input, 0,  len, channel, trigger->wave_input_phase, len);
+            len = sound->frames - trigger->wave_input_phase;
+            read_wave_sound(sound, 0, trigger->wave_input_phase, len, trigger->input->x);
             if(trigger->loop)
             {                
                 trigger->wave_input_phase += trigger->input->n_samples;
-                trigger->wave_input_phase -= channel->n_samples;
+                trigger->wave_input_phase -= sound->frames;
                 // copy in wrapped block from the start of the audio
-                copy_buffer_partial(trigger->input, len,  trigger->input->n_samples-len, channel, trigger->wave_input_phase, trigger->input->n_samples-len);                
+                read_wave_sound(sound, 0, 0, trigger->input->n_samples-len, &trigger->input->x[len]);                
                 
             }
             else
@@ -139,7 +148,7 @@ void process_trigger(Trigger *trigger)
         else 
         {
            len = trigger->input->n_samples;
-           copy_buffer_partial(trigger->input, 0,  len, channel, trigger->wave_input_phase, len);
+           read_wave_sound(sound, 0, trigger->wave_input_phase, len, trigger->input->x);
            trigger->wave_input_phase += trigger->input->n_samples;           
         }            
     }
@@ -15,7 +15,7 @@
 #include "audio.h"
 #include "wavereader.h"
 #include "grain_stream.h"
-#include "pa_ringbuffer.h"
+#include "input_ring.h"
 
 #include <stdlib.h>
 #include <math.h>
@@ -25,6 +25,7 @@
 
 
 
+// the input buffer may point straight into the shared input ring: it must not be modified
 typedef  void(*TriggerProcessCallback)(void *, Buffer *, GrainStream *);
 
 typedef struct Trigger
@@ -33,8 +34,7 @@ typedef struct Trigger
     int mode;
     Buffer *input;
     TriggerProcessCallback process_callback;
-    PaUtilRingBuffer *ringbuffer; // for realtime
-    char *ringdata; // for ringbuffer
+    InputReader reader; // for realtime (a cursor into the shared input ring)
     void *trigger_data;
     GrainStream *grain_stream;
     int wave_input_phase;    
@@ -49,7 +49,8 @@ void set_processor_trigger(Trigger *trigger, TriggerProcessCallback callback, vo
 void set_grain_stream_trigger(Trigger *trigger, GrainStream  *stream);
 void set_mode_trigger(Trigger *trigger, int mode, int loop);
 void set_wave_trigger(Trigger *trigger, WaveSound *sound);
-PaUtilRingBuffer *get_ringbuffer_trigger(Trigger *trigger);
+void attach_input_trigger(Trigger *trigger, InputRing *ring);
+int is_lagging_trigger(Trigger *trigger);
 void process_trigger(Trigger *trigger);
 
 
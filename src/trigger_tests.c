@@ -35,7 +35,9 @@ void test_pitchtrigger(OutputInfo *info, GrainStream *stream)
     PitchTrigger *pitch_trigger;    
     trigger = create_trigger();
     set_grain_stream_trigger(trigger, stream);          
-    pitch_trigger = create_pitch_trigger(128);
+    // long enough for bass pitches, reacting every 128 samples
+    pitch_trigger = create_pitch_trigger(2048);
+    set_hop_size_pitch_trigger(pitch_trigger, 128);
     set_processor_trigger(trigger, process_pitch_trigger, pitch_trigger);       
     set_minimum_level_pitch_trigger(pitch_trigger, -15.0);
     set_copy_amplitude_pitch_trigger(pitch_trigger, 1, -10.0);
@@ -43,4 +45,23 @@ void test_pitchtrigger(OutputInfo *info, GrainStream *stream)
 }
 
 
+void test_onsettrigger(OutputInfo *info, GrainStream *low_stream, GrainStream *high_stream)
+{
+    Trigger *trigger;
+    OnsetTrigger *onset_trigger;
+    int i;
+    trigger = create_trigger();
+    set_grain_stream_trigger(trigger, low_stream);
+    onset_trigger = create_onset_trigger(1024, 8);
+    set_processor_trigger(trigger, process_onset_trigger, onset_trigger);
+    set_threshold_onset_trigger(onset_trigger, -1, -45.0, 8.0);
+    set_inhibit_onset_trigger(onset_trigger, -1, 0.05);
 
+    // the top half of the bands fire the other stream, and need a sharper attack
+    for(i=4;i<8;i++)
+    {
+        set_stream_band_onset_trigger(onset_trigger, i, high_stream);
+        set_threshold_onset_trigger(onset_trigger, i, -50.0, 10.0);
+    }
+    connect_live_trigger(info, trigger);
+}
@@ -18,10 +18,12 @@
 #include "trigger.h"
 #include "pitchtrigger.h"
 #include "impulsetrigger.h"
+#include "onsettrigger.h"
 
 struct OutputInfo;
 void test_impulsetrigger(struct OutputInfo *info, GrainStream *stream);
 void test_pitchtrigger(struct  OutputInfo *info, GrainStream *stream);
+void test_onsettrigger(struct OutputInfo *info, GrainStream *low_stream, GrainStream *high_stream);
 
 
 
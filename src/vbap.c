@@ -0,0 +1,383 @@
+/**
+    @file vbap.c
+    @brief Vector base amplitude panning over an arbitrary speaker layout. The layout
+    is triangulated once (or split into adjacent pairs, if every speaker is on the
+    horizontal plane), and the base covering each direction on a grid is tabulated, so
+    panning a source is a table lookup and one small matrix product (giving the exact
+    gains for its direction), and writes to at most three speakers.
+
+    Triangles are the faces of the convex hull of the speaker directions; a direction
+    is panned with the base whose gains are all positive (or, outside the area the
+    speakers cover, the base that comes closest, with negative gains dropped). Gains
+    are normalised to constant power. The tabulated base is only a guess for directions
+    between grid points: if it doesn't cover the direction (near the edge of a base),
+    every base is searched.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include "vbap.h"
+#include <string.h>
+
+typedef struct VBAPBases
+{
+    VBAPBase *bases;
+    int n_bases, size;
+} VBAPBases;
+
+
+// unit direction of a speaker (flattened onto the horizontal plane for 2D layouts)
+static void speaker_direction_vbap(Location3D *location, int two_d, double *v)
+{
+    double r;
+    v[0] = location->x;
+    v[1] = location->y;
+    v[2] = two_d ? 0.0 : location->z;
+    r = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+    if(r<1e-9)
+    {
+        v[0] = 1.0; v[1] = 0.0; v[2] = 0.0;
+        return;
+    }
+    v[0] /= r; v[1] /= r; v[2] /= r;
+}
+
+static void cross_vbap(double *a, double *b, double *out)
+{
+    out[0] = a[1]*b[2] - a[2]*b[1];
+    out[1] = a[2]*b[0] - a[0]*b[2];
+    out[2] = a[0]*b[1] - a[1]*b[0];
+}
+
+static double dot_vbap(double *a, double *b)
+{
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+// append a base to the list, growing it as needed
+static VBAPBase *add_base_vbap(VBAPBases *bases)
+{
+    if(bases->n_bases == bases->size)
+    {
+        bases->size = bases->size ? bases->size*2 : 16;
+        bases->bases = realloc(bases->bases, sizeof(*bases->bases) * bases->size);
+    }
+    memset(&bases->bases[bases->n_bases], 0, sizeof(*bases->bases));
+    return &bases->bases[bases->n_bases++];
+}
+
+
+// the pairs of speakers adjacent in azimuth
+static void find_pairs_vbap(double *directions, int n_speakers, VBAPBases *bases)
+{
+    int *order;
+    double *a, *b, det;
+    int i, j, t;
+    VBAPBase *base;
+
+    // sort the speakers by azimuth (insertion sort; layouts are small)
+    order = malloc(sizeof(*order) * n_speakers);
+    for(i=0;i<n_speakers;i++)
+    {
+        t = i;
+        for(j=i;j>0 && atan2(directions[order[j-1]*3+1], directions[order[j-1]*3]) > atan2(directions[t*3+1], directions[t*3]);j--)
+            order[j] = order[j-1];
+        order[j] = t;
+    }
+
+    for(i=0;i<n_speakers;i++)
+    {
+        a = &directions[order[i]*3];
+        b = &directions[order[(i+1)%n_speakers]*3];
+        det = a[0]*b[1] - a[1]*b[0];
+
+        // pairs that are 180 degrees or more apart cannot pan between them
+        if(det<1e-6)
+            continue;
+        base = add_base_vbap(bases);
+        base->n = 2;
+        base->speakers[0] = order[i];
+        base->speakers[1] = order[(i+1)%n_speakers];
+        base->inverse[0] = b[1]/det;  base->inverse[1] = -b[0]/det;
+        base->inverse[3] = -a[1]/det; base->inverse[4] = a[0]/det;
+    }
+    free(order);
+}
+
+
+// the triangles of the convex hull of the speaker directions
+static void find_triangles_vbap(double *directions, int n_speakers, VBAPBases *bases)
+{
+    double ab[3], ac[3], normal[3], d[3], bc[3], ca[3], *a, *b, *c;
+    double offset, length, det;
+    int i, j, k, m, q, outside;
+    VBAPBase *base;
+
+    for(i=0;i<n_speakers;i++)
+        for(j=i+1;j<n_speakers;j++)
+            for(k=j+1;k<n_speakers;k++)
+            {
+                a = &directions[i*3];
+                b = &directions[j*3];
+                c = &directions[k*3];
+                for(q=0;q<3;q++)
+                {
+                    ab[q] = b[q] - a[q];
+                    ac[q] = c[q] - a[q];
+                }
+                cross_vbap(ab, ac, normal);
+                length = sqrt(dot_vbap(normal, normal));
+                offset = dot_vbap(normal, a);
+                if(offset<0)
+                {
+                    for(q=0;q<3;q++)
+                        normal[q] = -normal[q];
+                    offset = -offset;
+                }
+
+                // planes through the listener are not a base (the speakers are coplanar with the origin)
+                if(length<1e-9 || offset < 1e-6*length)
+                    continue;
+
+                // a hull face has every other speaker on the listener's side of it
+                outside = 0;
+                for(m=0;m<n_speakers && !outside;m++)
+                {
+                    for(q=0;q<3;q++)
+                        d[q] = directions[m*3+q] - a[q];
+                    if(dot_vbap(normal, d) > 1e-6*length)
+                        outside = 1;
+                }
+                if(outside)
+                    continue;
+
+                // the rows of the inverse of [a b c] are (b x c, c x a, a x b) / det
+                cross_vbap(b, c, bc);
+                cross_vbap(c, a, ca);
+                cross_vbap(a, b, d);
+                det = dot_vbap(a, bc);
+                base = add_base_vbap(bases);
+                base->n = 3;
+                base->speakers[0] = i;
+                base->speakers[1] = j;
+                base->speakers[2] = k;
+                for(q=0;q<3;q++)
+                {
+                    base->inverse[q] = bc[q]/det;
+                    base->inverse[3+q] = ca[q]/det;
+                    base->inverse[6+q] = d[q]/det;
+                }
+            }
+}
+
+
+// compute the (unnormalised) gains of a base for a direction
+// returns the smallest gain (negative if the base doesn't cover the direction)
+static double base_gains_vbap(VBAPBase *base, double *p, double *g)
+{
+    double worst;
+    int j;
+    worst = 1e20;
+    for(j=0;j<base->n;j++)
+    {
+        g[j] = dot_vbap(&base->inverse[j*3], p);
+        if(g[j]<worst)
+            worst = g[j];
+    }
+    return worst;
+}
+
+
+// find the base that best contains a direction (the one whose smallest gain is largest)
+// returns -1 if there are no bases
+static int find_base_vbap(VBAPTable *vbap, double *p)
+{
+    double g[3], worst, best_worst;
+    int i, best;
+
+    best = -1;
+    best_worst = -1e20;
+    for(i=0;i<vbap->n_bases;i++)
+    {
+        worst = base_gains_vbap(&vbap->bases[i], p, g);
+        if(worst>best_worst)
+        {
+            best_worst = worst;
+            best = i;
+        }
+    }
+    return best;
+}
+
+
+// compute the gains for one direction from a base (-1 for none)
+static void compute_gains_vbap(VBAPTable *vbap, int base, double *p, VBAPGain *gain)
+{
+    double g[3], power;
+    int i, j, nearest;
+
+    for(j=0;j<3;j++)
+    {
+        gain->speakers[j] = 0;
+        gain->gains[j] = 0.0;
+    }
+
+    // outside the covered area, negative gains are dropped
+    power = 0.0;
+    if(base>=0)
+    {
+        base_gains_vbap(&vbap->bases[base], p, g);
+        for(j=0;j<vbap->bases[base].n;j++)
+        {
+            if(g[j]<0)
+                g[j] = 0;
+            power += g[j] * g[j];
+        }
+    }
+
+    // no usable base: just use the nearest speaker
+    if(power<1e-12)
+    {
+        if(vbap->n_speakers==0)
+            return;
+        nearest = 0;
+        for(i=1;i<vbap->n_speakers;i++)
+            if(dot_vbap(&vbap->directions[i*3], p) > dot_vbap(&vbap->directions[nearest*3], p))
+                nearest = i;
+        gain->speakers[0] = nearest;
+        gain->gains[0] = 1.0;
+        return;
+    }
+
+    power = sqrt(power);
+    for(j=0;j<vbap->bases[base].n;j++)
+    {
+        gain->speakers[j] = vbap->bases[base].speakers[j];
+        gain->gains[j] = g[j] / power;
+    }
+}
+
+
+// unit vector for a direction (in radians)
+static void direction_vbap(double azimuth, double elevation, double *p)
+{
+    p[0] = cos(elevation) * cos(azimuth);
+    p[1] = cos(elevation) * sin(azimuth);
+    p[2] = sin(elevation);
+}
+
+
+/** Triangulate a speaker layout and tabulate the base for each direction. Slow; call this when
+    the layout is set, not while synthesizing.
+    @arg speaker_locations List of Location3D* speaker positions, relative to the listener
+    @return The new table
+*/
+VBAPTable *create_vbap_table(list_t *speaker_locations)
+{
+    VBAPTable *vbap;
+    VBAPBases bases;
+    Location3D *location;
+    double *directions, p[3], azimuth, elevation;
+    int i, j, n_speakers;
+
+    vbap = malloc(sizeof(*vbap));
+    n_speakers = list_size(speaker_locations);
+    vbap->n_speakers = n_speakers;
+
+    // pan in 2D if every speaker is level with the listener
+    vbap->two_d = 1;
+    for(i=0;i<n_speakers;i++)
+    {
+        location = (Location3D *)list_get_at(speaker_locations, i);
+        if(fabs(location->elevation) > VBAP_2D_TOLERANCE)
+            vbap->two_d = 0;
+    }
+
+    directions = malloc(sizeof(*directions) * 3 * MAX(1,n_speakers));
+    bases.bases = NULL;
+    bases.n_bases = bases.size = 0;
+    if(!vbap->two_d)
+    {
+        for(i=0;i<n_speakers;i++)
+            speaker_direction_vbap((Location3D *)list_get_at(speaker_locations, i), 0, &directions[i*3]);
+        find_triangles_vbap(directions, n_speakers, &bases);
+
+        // no triangles at all (e.g. every speaker on one great circle): fall back to pairs
+        if(bases.n_bases==0)
+            vbap->two_d = 1;
+    }
+    if(vbap->two_d)
+    {
+        for(i=0;i<n_speakers;i++)
+            speaker_direction_vbap((Location3D *)list_get_at(speaker_locations, i), 1, &directions[i*3]);
+        if(n_speakers>1)
+            find_pairs_vbap(directions, n_speakers, &bases);
+    }
+
+    vbap->directions = directions;
+    vbap->bases = bases.bases;
+    vbap->n_bases = bases.n_bases;
+
+    // tabulate the base over the grid of directions (a single level row in 2D)
+    vbap->n_elevations = vbap->two_d ? 1 : VBAP_ELEVATION_STEPS;
+    vbap->table = malloc(sizeof(*vbap->table) * vbap->n_elevations * VBAP_AZIMUTH_STEPS);
+    for(j=0;j<vbap->n_elevations;j++)
+        for(i=0;i<VBAP_AZIMUTH_STEPS;i++)
+        {
+            azimuth = TO_RADIANS(i*VBAP_GRID_STEP - 180.0);
+            elevation = vbap->two_d ? 0.0 : TO_RADIANS(j*VBAP_GRID_STEP - 90.0);
+            direction_vbap(azimuth, elevation, p);
+            vbap->table[j*VBAP_AZIMUTH_STEPS+i] = find_base_vbap(vbap, p);
+        }
+
+    return vbap;
+}
+
+
+// destroy a gain table
+void destroy_vbap_table(VBAPTable *vbap)
+{
+    free(vbap->table);
+    free(vbap->bases);
+    free(vbap->directions);
+    free(vbap);
+}
+
+
+/** Compute the speakers and gains for a direction. The base is looked up at the nearest
+    grid point, and the gains are worked out exactly for the direction itself.
+    @arg vbap The table
+    @arg azimuth Azimuth in degrees (any range)
+    @arg elevation Elevation in degrees, -90 -> 90 (ignored for 2D layouts)
+    @arg gain Filled in with the speakers and gains for the direction
+*/
+void get_gains_vbap_table(VBAPTable *vbap, float azimuth, float elevation, VBAPGain *gain)
+{
+    double p[3], g[3];
+    int i, j, base;
+    i = (int)floor((azimuth + 180.0) / VBAP_GRID_STEP + 0.5);
+    i = ((i % VBAP_AZIMUTH_STEPS) + VBAP_AZIMUTH_STEPS) % VBAP_AZIMUTH_STEPS;
+    j = 0;
+    if(vbap->two_d)
+        elevation = 0.0;
+    else
+    {
+        j = (int)floor((elevation + 90.0) / VBAP_GRID_STEP + 0.5);
+        if(j<0)
+            j = 0;
+        if(j>=vbap->n_elevations)
+            j = vbap->n_elevations-1;
+    }
+    direction_vbap(TO_RADIANS(azimuth), TO_RADIANS(elevation), p);
+
+    // the base at the grid point doesn't cover the direction: search them all
+    base = vbap->table[j*VBAP_AZIMUTH_STEPS+i];
+    if(base<0 || base_gains_vbap(&vbap->bases[base], p, g) < 0)
+        base = find_base_vbap(vbap, p);
+    compute_gains_vbap(vbap, base, p, gain);
+}
@@ -0,0 +1,67 @@
+/**
+    @file vbap.h
+    @brief Vector base amplitude panning over an arbitrary speaker layout. The layout
+    is triangulated once (or split into adjacent pairs, if every speaker is on the
+    horizontal plane), and the base covering each direction on a grid is tabulated, so
+    panning a source is a table lookup and one small matrix product (giving the exact
+    gains for its direction), and writes to at most three speakers.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#ifndef __VBAP_H__
+#define __VBAP_H__
+
+#include "audio.h"
+#include "location.h"
+#include "simclist.h"
+
+// spacing of the direction grid, in degrees
+#define VBAP_GRID_STEP 2
+#define VBAP_AZIMUTH_STEPS (360/VBAP_GRID_STEP)
+#define VBAP_ELEVATION_STEPS (180/VBAP_GRID_STEP+1)
+
+// layouts whose speakers are all within this many degrees of the horizontal are panned in 2D
+#define VBAP_2D_TOLERANCE 5.0
+
+/** @struct VBAPGain
+    The (up to) three speakers a direction is panned between, and their gains. Unused
+    slots have zero gain. */
+typedef struct VBAPGain
+{
+    short speakers[3];
+    float gains[3];
+} VBAPGain;
+
+/** @struct VBAPBase
+    A pair or triangle of speakers, with the inverse of the matrix of their directions */
+typedef struct VBAPBase
+{
+    int speakers[3];
+    int n;
+    double inverse[9];
+} VBAPBase;
+
+/** @struct VBAPTable */
+typedef struct VBAPTable
+{
+    int n_speakers;
+    int two_d;              // all speakers on the horizontal plane: one row of azimuths only
+    int n_elevations;
+    double *directions;     // unit direction of each speaker
+    VBAPBase *bases;
+    int n_bases;
+    int *table;             // the base covering each grid direction (-1 if none does); n_elevations rows of VBAP_AZIMUTH_STEPS entries
+} VBAPTable;
+
+
+VBAPTable *create_vbap_table(list_t *speaker_locations);
+void destroy_vbap_table(VBAPTable *vbap);
+void get_gains_vbap_table(VBAPTable *vbap, float azimuth, float elevation, VBAPGain *gain);
+
+#endif
@@ -0,0 +1,300 @@
+/**
+    @file wave_interpolation.c
+    @brief Interpolation kernels for reading a looped waveform at a fractional rate
+    (none, linear, cubic Hermite and polyphase windowed-sinc), and the half-band
+    filter used to build mip-maps of WaveSounds.
+
+    The kernels avoid floor() and only take the (slower) wrapping path near the
+    loop point; the inner loop of the sinc kernel runs over contiguous taps so that
+    the compiler can vectorize it.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include "wave_interpolation.h"
+
+
+// zeroth order modified Bessel function of the first kind (for the Kaiser window)
+static double bessel_i0(double x)
+{
+    double sum, term;
+    int k;
+    sum = 1.0;
+    term = 1.0;
+    for(k=1;k<32;k++)
+    {
+        term *= (x / (2.0*k)) * (x / (2.0*k));
+        sum += term;
+    }
+    return sum;
+}
+
+// normalised sinc
+static double sinc(double x)
+{
+    if(fabs(x)<1e-9)
+        return 1.0;
+    return sin(M_PI*x) / (M_PI*x);
+}
+
+// wrap an index which may have run off either end of a looped wave
+static int wrap_index(int i, int n)
+{
+    while(i<0)
+        i += n;
+    while(i>=n)
+        i -= n;
+    return i;
+}
+
+
+/** Tabulate a Kaiser windowed sinc for polyphase interpolation: taps coefficients for each of
+    phases+1 fractional positions from 0 to 1. Tap k of a row is at distance k-(taps/2-1)-f from the
+    point being interpolated, so the point lies between taps taps/2-1 and taps/2. Every row has unity gain at DC.
+    @arg taps Number of taps (even)
+    @arg phases Number of fractional positions tabulated
+    @arg cutoff The cutoff, as a fraction of the Nyquist rate
+    @arg beta The Kaiser window parameter
+    @return The table (free with free())
+*/
+float *create_sinc_table(int taps, int phases, double cutoff, double beta)
+{
+    float *table, *row;
+    int p, k, half;
+    double d, f, w, sum;
+    
+    table = malloc(sizeof(*table) * taps * (phases+1));
+    half = taps / 2;
+    
+    for(p=0;p<=phases;p++)
+    {
+        row = &table[p*taps];
+        f = p / (double)phases;
+        sum = 0.0;
+        for(k=0;k<taps;k++)
+        {
+            // distance of this tap from the point being interpolated (always within +-half)
+            d = k - (half-1) - f;
+            // (the window is offset to reach zero at +-half, so the last phase
+            // matches the first one tap along, and there is no step between them)
+            w = 1.0 - (d/half)*(d/half);
+            w = (bessel_i0(beta * sqrt(MAX(0.0, w))) - 1.0) / (bessel_i0(beta) - 1.0);
+            row[k] = cutoff * sinc(cutoff * d) * w;
+            sum += row[k];
+        }
+        // unity gain at DC for every phase
+        for(k=0;k<taps;k++)
+            row[k] /= sum;
+    }
+    return table;
+}
+
+
+/** Create a polyphase windowed-sinc kernel (Kaiser windowed, SINC_KERNEL_TAPS long)
+    @arg cutoff The cutoff, as a fraction of the Nyquist rate (e.g. SINC_KERNEL_CUTOFF)
+    @return The new kernel
+*/
+SincKernel *create_sinc_kernel(float cutoff)
+{
+    SincKernel *kernel;
+    kernel = malloc(sizeof(*kernel));
+    kernel->table = create_sinc_table(SINC_KERNEL_TAPS, SINC_KERNEL_PHASES, cutoff, SINC_KERNEL_BETA);
+    return kernel;
+}
+
+// destroy a sinc kernel
+void destroy_sinc_kernel(SincKernel *kernel)
+{
+    free(kernel->table);
+    free(kernel);
+}
+
+
+// no interpolation: nearest sample below the phase
+static double interpolate_none(float *x, int n, double phase, double rate, float *out, int n_out)
+{
+    int i;
+    for(i=0;i<n_out;i++)
+    {
+        phase += rate;
+        while(phase >= n)
+            phase -= n;
+        out[i] = x[(int)phase];
+    }
+    return phase;
+}
+
+
+// linear interpolation between the two samples around the phase
+static double interpolate_linear(float *x, int n, double phase, double rate, float *out, int n_out)
+{
+    int i, j, k;
+    float f;
+    for(i=0;i<n_out;i++)
+    {
+        phase += rate;
+        while(phase >= n)
+            phase -= n;
+        j = (int)phase;
+        f = phase - j;
+        k = j+1<n ? j+1 : 0;
+        out[i] = x[j] + f * (x[k] - x[j]);
+    }
+    return phase;
+}
+
+
+// cubic Hermite (Catmull-Rom) interpolation over the four samples around the phase
+static double interpolate_cubic(float *x, int n, double phase, double rate, float *out, int n_out)
+{
+    int i, j;
+    float f, xm1, x0, x1, x2, c1, c2, c3;
+    for(i=0;i<n_out;i++)
+    {
+        phase += rate;
+        while(phase >= n)
+            phase -= n;
+        j = (int)phase;
+        f = phase - j;
+        
+        if(j>=1 && j+2<n)
+        {
+            xm1 = x[j-1]; x0 = x[j]; x1 = x[j+1]; x2 = x[j+2];
+        }
+        else
+        {
+            // near the loop point
+            xm1 = x[wrap_index(j-1, n)]; x0 = x[j]; x1 = x[wrap_index(j+1, n)]; x2 = x[wrap_index(j+2, n)];
+        }
+        
+        c1 = 0.5f * (x1 - xm1);
+        c2 = xm1 - 2.5f*x0 + 2.0f*x1 - 0.5f*x2;
+        c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+        out[i] = ((c3*f + c2)*f + c1)*f + x0;
+    }
+    return phase;
+}
+
+
+// windowed-sinc interpolation, using the two nearest tabulated phases of the kernel
+static double interpolate_sinc(SincKernel *kernel, float *x, int n, double phase, double rate, float *out, int n_out)
+{
+    int i, j, k, p, start;
+    float f, g, acc;
+    float *row0, *row1, *src;
+    
+    for(i=0;i<n_out;i++)
+    {
+        phase += rate;
+        while(phase >= n)
+            phase -= n;
+        j = (int)phase;
+        f = (phase - j) * SINC_KERNEL_PHASES;
+        p = (int)f;
+        g = f - p;
+        row0 = &kernel->table[p*SINC_KERNEL_TAPS];
+        row1 = row0 + SINC_KERNEL_TAPS;
+        start = j - SINC_KERNEL_TAPS/2 + 1;
+        
+        acc = 0.0;
+        if(start>=0 && start+SINC_KERNEL_TAPS<=n)
+        {
+            src = &x[start];
+            for(k=0;k<SINC_KERNEL_TAPS;k++)
+                acc += src[k] * (row0[k] + g * (row1[k] - row0[k]));
+        }
+        else
+        {
+            // near the loop point
+            for(k=0;k<SINC_KERNEL_TAPS;k++)
+                acc += x[wrap_index(start+k, n)] * (row0[k] + g * (row1[k] - row0[k]));
+        }
+        out[i] = acc;
+    }
+    return phase;
+}
+
+
+/** Read a looped wave at a fractional rate. The phase is advanced before each sample is read.
+    @arg wave The wave to read
+    @arg phase The current phase, in samples (0 <= phase < wave->n_samples)
+    @arg rate The number of samples of the wave to advance per output sample
+    @arg mode One of INTERPOLATION_*
+    @arg kernel The kernel to use for INTERPOLATION_SINC (if NULL, cubic interpolation is used instead)
+    @arg out The buffer to fill (overwritten)
+    @return The new phase
+*/
+double interpolate_wave(Buffer *wave, double phase, double rate, int mode, SincKernel *kernel, Buffer *out)
+{
+    if(wave->n_samples<=0)
+    {
+        zero_buffer(out);
+        return 0.0;
+    }
+    
+    switch(mode)
+    {
+        case INTERPOLATION_LINEAR:
+            return interpolate_linear(wave->x, wave->n_samples, phase, rate, out->x, out->n_samples);
+        case INTERPOLATION_CUBIC:
+            return interpolate_cubic(wave->x, wave->n_samples, phase, rate, out->x, out->n_samples);
+        case INTERPOLATION_SINC:
+            if(kernel)
+                return interpolate_sinc(kernel, wave->x, wave->n_samples, phase, rate, out->x, out->n_samples);
+            return interpolate_cubic(wave->x, wave->n_samples, phase, rate, out->x, out->n_samples);
+    }
+    return interpolate_none(wave->x, wave->n_samples, phase, rate, out->x, out->n_samples);
+}
+
+
+/** Filter a looped wave with a half-band lowpass filter and take every second sample,
+    to make the next octave of a mip-map. Sample k of the result lines up with sample 2k of the input.
+    @arg in The wave to decimate
+    @return A new buffer, half as long
+*/
+Buffer *half_band_decimate(Buffer *in)
+{
+    Buffer *out;
+    float h[HALF_BAND_TAPS/2+1];
+    double sum, w;
+    int i, m, centre, half;
+    float acc;
+    
+    half = HALF_BAND_TAPS/2;
+    
+    // Blackman windowed half-band filter; only the centre and odd taps are non-zero
+    sum = 0.0;
+    for(m=0;m<=half;m++)
+    {
+        w = 0.42 + 0.5*cos(M_PI*m/(half+1)) + 0.08*cos(2*M_PI*m/(half+1));
+        h[m] = 0.5 * sinc(0.5*m) * w;
+        sum += (m==0) ? h[m] : 2*h[m];
+    }
+    for(m=0;m<=half;m++)
+        h[m] /= sum;
+    
+    out = create_buffer((in->n_samples+1)/2);
+    for(i=0;i<out->n_samples;i++)
+    {
+        centre = 2*i;
+        acc = h[0] * in->x[centre];
+        if(centre-half>=0 && centre+half<in->n_samples)
+        {
+            for(m=1;m<=half;m+=2)
+                acc += h[m] * (in->x[centre-m] + in->x[centre+m]);
+        }
+        else
+        {
+            // the wave loops, so the filter wraps round at the ends
+            for(m=1;m<=half;m+=2)
+                acc += h[m] * (in->x[wrap_index(centre-m, in->n_samples)] + in->x[wrap_index(centre+m, in->n_samples)]);
+        }
+        out->x[i] = acc;
+    }
+    return out;
+}
@@ -0,0 +1,53 @@
+/**
+    @file wave_interpolation.h
+    @brief Interpolation kernels for reading a looped waveform at a fractional rate
+    (none, linear, cubic Hermite and polyphase windowed-sinc), and the half-band
+    filter used to build mip-maps of WaveSounds.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#ifndef __WAVE_INTERPOLATION_H__
+#define __WAVE_INTERPOLATION_H__
+
+#include "audio.h"
+#include <math.h>
+
+#define INTERPOLATION_NONE 0
+#define INTERPOLATION_LINEAR 1
+#define INTERPOLATION_CUBIC 2
+#define INTERPOLATION_SINC 3
+
+// polyphase sinc kernel: number of taps, and number of fractional positions tabulated
+// (coefficients in between are linearly interpolated)
+#define SINC_KERNEL_TAPS 16
+#define SINC_KERNEL_PHASES 128
+#define SINC_KERNEL_CUTOFF 0.95
+#define SINC_KERNEL_BETA 8.0
+
+// length of the half-band filter used to build mip-maps (must be 4k+3)
+#define HALF_BAND_TAPS 47
+
+
+/** @struct SincKernel
+    Table of windowed-sinc coefficients, SINC_KERNEL_TAPS for each of
+    SINC_KERNEL_PHASES+1 fractional positions from 0 to 1 */
+typedef struct SincKernel
+{
+    float *table;
+} SincKernel;
+
+
+float *create_sinc_table(int taps, int phases, double cutoff, double beta);
+SincKernel *create_sinc_kernel(float cutoff);
+void destroy_sinc_kernel(SincKernel *kernel);
+
+double interpolate_wave(Buffer *wave, double phase, double rate, int mode, SincKernel *kernel, Buffer *out);
+Buffer *half_band_decimate(Buffer *in);
+
+#endif
@@ -11,6 +11,8 @@
 */              
 
 #include "wavegrain.h"
+#include "lod.h"
+#include "wavemap.h"
 
 
 
@@ -26,7 +28,9 @@ WaveGrainParameters *create_wave_parameters(GrainSource *source)
    wavegrain->phase_offset = GLOBAL_STATE.elapsed_samples;
    
    wavegrain->phase_rate = 0.0;
-   wavegrain->interpolate = 0;
+   wavegrain->interpolate = INTERPOLATION_NONE;
+   wavegrain->channel = 0;
+   wavegrain->kernel = create_sinc_kernel(SINC_KERNEL_CUTOFF);
    
    wavegrain->grain_phase = 0;
    // defaults
@@ -42,6 +46,7 @@ void destroy_wave_parameters(WaveGrainParameters *wavegrain)
 {
     destroy_distribution(wavegrain->phase);    
     destroy_distribution(wavegrain->pitch_shift);    
+    destroy_sinc_kernel(wavegrain->kernel);
     free(wavegrain);
     
     // don't free the sound, we don't own it!
@@ -84,12 +89,18 @@ void set_phase_mode_wave_parameters(WaveGrainParameters *wavegrain, int mode)
     wavegrain->phase_mode = mode;
 }
 
-// enable/disable linear interpolation for pitch rates != 0.0
+// set the interpolation used for pitch rates != 1.0 (one of INTERPOLATION_*)
 void set_interpolation_wave_parameters(WaveGrainParameters *wavegrain, int interpolate)
 {
     wavegrain->interpolate = interpolate;
 }
 
+// set the channel of the sound to play (0 by default), or WAVEGRAIN_CHANNEL_MIX to mix all of them
+void set_channel_wave_parameters(WaveGrainParameters *wavegrain, int channel)
+{
+    wavegrain->channel = channel;
+}
+
 // set the source waveform
 void set_source_wave_parameters(WaveGrainParameters *wavegrain, WaveSound *sound)
 {
@@ -104,10 +115,9 @@ void set_source_wave_parameters(WaveGrainParameters *wavegrain, WaveSound *sound
 void *create_wavegrain(void *source)
 {
     WaveGrain *grain;
-    WaveGrainParameters *parameters;
-    parameters = (WaveGrainParameters *) source;
     grain = malloc(sizeof(*grain));
-        
+    grain->scratch = create_buffer(GLOBAL_STATE.frames_per_buffer);
+    grain->span = create_buffer(WAVEGRAIN_SPAN_LENGTH);
     return grain;
 }
 
@@ -116,9 +126,10 @@ void *create_wavegrain(void *source)
 void init_wavegrain(void *wgrain, void *source, Grain *grain)
 {
     WaveGrain *wavegrain;
-    Buffer *channel;
     WaveGrainParameters *parameters;
     int increment;
+    long long frames;
+    float rate;
     
     parameters = (WaveGrainParameters *) source;
     wavegrain = (WaveGrain*) wgrain;
@@ -138,13 +149,26 @@ void init_wavegrain(void *wgrain, void *source, Grain *grain)
     // set the waveform, phase, and pitch rate
     wavegrain->sound = parameters->sound;    
     
-    channel = get_channel_wave_sound(wavegrain->sound, 0);
+ 
+    frames = wavegrain->sound->frames;
+    wavegrain->phase = sample_from_distribution(parameters->phase) * frames + increment;        
+    wavegrain->phase = fmod(floor(wavegrain->phase), (double)frames);        
     
-    wavegrain->phase = sample_from_distribution(parameters->phase) * channel->n_samples + increment;        
-    wavegrain->phase = ((int) wavegrain->phase) % channel->n_samples;        
+    // if the sound has a mip-map, read from the octave where the rate is at most 1
+    rate = SEMITONES_TO_RATE(sample_from_distribution(parameters->pitch_shift));
+    wavegrain->level = get_mipmap_level_wave_sound(wavegrain->sound, rate);
+    wavegrain->rate = ldexp(rate, -wavegrain->level);
+    wavegrain->phase = ldexp(wavegrain->phase, -wavegrain->level);
+    if(wavegrain->level>0 && wavegrain->phase >= get_mipmap_wave_sound(wavegrain->sound, 0, wavegrain->level)->n_samples)
+        wavegrain->phase = 0;
     
-    wavegrain->rate = SEMITONES_TO_RATE(sample_from_distribution(parameters->pitch_shift));
-    wavegrain->interpolate = parameters->interpolate;
+    // interpolation is dropped when the level of detail is reduced
+    if(GLOBAL_STATE.lod_level < LOD_LEVEL_NO_INTERPOLATION)
+        wavegrain->interpolate = parameters->interpolate;
+    else
+        wavegrain->interpolate = INTERPOLATION_NONE;
+    wavegrain->kernel = parameters->kernel;
+    wavegrain->channel = parameters->channel;
     
 }
 
@@ -153,58 +177,86 @@ void destroy_wavegrain(void *wgrain)
 {
     WaveGrain *wavegrain;
     wavegrain = (WaveGrain*) wgrain;
+    destroy_buffer(wavegrain->scratch);
+    destroy_buffer(wavegrain->span);
     free(wavegrain);        
 }
 
 
-// copy a waveform into a buffer, optionally with interpolation
-void fill_wavegrain(void *wgrain, Buffer *buffer)
+// read one channel of a memory mapped or compact sound: the span of the sound that the
+// kernel will touch is converted into the span buffer, and interpolated from there
+static double read_span_wavegrain(WaveGrain *wavegrain, int channel, Buffer *out)
 {
-    int i, j;
-    float fractional;
-    Buffer *channel;
-    WaveGrain *wavegrain;    
-    wavegrain = (WaveGrain*) wgrain;
-    
-    channel = get_channel_wave_sound(wavegrain->sound, 0);
+    Buffer span, chunk;
+    double phase;
+    int done, length;
+    long long start, frames;
     
-    if(wavegrain->interpolate)
+    frames = wavegrain->sound->frames;
+    phase = wavegrain->phase;
+    done = 0;
+    while(done < out->n_samples)
     {
-        for(i=0;i<buffer->n_samples;i++)
-        {
-            
-            wavegrain->phase += wavegrain->rate;           
-            
-            // loop wave
-            if(wavegrain->phase >= channel->n_samples)        
-                wavegrain->phase -= channel->n_samples;
-                    
-            fractional = wavegrain->phase - floor(wavegrain->phase);
-            j = (int)wavegrain->phase;
-            
-            if(wavegrain->phase>0)
-                buffer->x[i] = (1-fractional)*channel->x[j-1] +(fractional)*channel->x[j];
-                else
-                buffer->x[i] = channel->x[j]; // no sample before
+        // as many output samples as the span buffer has room for at this rate
+        chunk.x = &out->x[done];
+        chunk.n_samples = MIN(out->n_samples - done, MAX(1, (int)((wavegrain->span->n_samples - WAVEGRAIN_SPAN_MARGIN - 1) / wavegrain->rate)));
         
-        }
-    
-    }
-    else
-    {   
-        for(i=0;i<buffer->n_samples;i++)
-        {
-            wavegrain->phase += wavegrain->rate;           
-            // loop wave
-            if(wavegrain->phase >= channel->n_samples)        
-                wavegrain->phase -= channel->n_samples;
-            j = (int)wavegrain->phase;        
-            // no interpolation!
-            buffer->x[i] = channel->x[j];
+        // from just before the first point read to just after the last
+        start = (long long)(phase + wavegrain->rate) - SINC_KERNEL_TAPS/2;
+        length = (int)(phase + wavegrain->rate * chunk.n_samples) - (int)(phase + wavegrain->rate) + WAVEGRAIN_SPAN_MARGIN;
+        read_wave_sound(wavegrain->sound, channel, start, length, wavegrain->span->x);
+        span.x = wavegrain->span->x;
+        span.n_samples = length;
         
-        }
+        phase = interpolate_wave(&span, phase - start, wavegrain->rate, wavegrain->interpolate, wavegrain->kernel, &chunk) + start;
+        while(phase >= frames)
+            phase -= frames;
+        while(phase < 0)
+            phase += frames;
+        done += chunk.n_samples;
     }
+    return phase;
+}
 
+
+// read one channel of the grain's sound, returning the new phase (the grain's phase is not changed)
+static double read_channel_wavegrain(WaveGrain *wavegrain, int channel, Buffer *out)
+{
+    if(wavegrain->sound->mapping || wavegrain->sound->storage!=WAVESOUND_STORAGE_FLOAT)
+        return read_span_wavegrain(wavegrain, channel, out);
+    return interpolate_wave(get_mipmap_wave_sound(wavegrain->sound, channel, wavegrain->level), 
+            wavegrain->phase, wavegrain->rate, wavegrain->interpolate, wavegrain->kernel, out);
 }
 
 
+// copy a waveform into a buffer, optionally with interpolation
+void fill_wavegrain(void *wgrain, Buffer *buffer)
+{
+    int i, c, n_channels;
+    double phase;
+    Buffer scratch;
+    WaveGrain *wavegrain;    
+    wavegrain = (WaveGrain*) wgrain;
+    
+    if(wavegrain->channel != WAVEGRAIN_CHANNEL_MIX || wavegrain->sound->n_channels==1)
+    {
+        wavegrain->phase = read_channel_wavegrain(wavegrain, MAX(0, wavegrain->channel), buffer);
+        return;
+    }
+    
+    // mix every channel together, each read with the same phase
+    n_channels = wavegrain->sound->n_channels;
+    phase = read_channel_wavegrain(wavegrain, 0, buffer);
+    
+    scratch.x = wavegrain->scratch->x;
+    scratch.n_samples = MIN(buffer->n_samples, wavegrain->scratch->n_samples);
+    for(c=1;c<n_channels;c++)
+    {
+        read_channel_wavegrain(wavegrain, c, &scratch);
+        for(i=0;i<scratch.n_samples;i++)
+            buffer->x[i] += scratch.x[i];
+    }
+    for(i=0;i<buffer->n_samples;i++)
+        buffer->x[i] *= 1.0f / n_channels;
+    wavegrain->phase = phase;
+}
@@ -20,11 +20,20 @@
 #include "grain.h"
 #include "grain_source.h"
 #include "wavereader.h"
+#include "wave_interpolation.h"
 
 
 #define WAVEGRAIN_PHASE_REALTIME 0
 #define WAVEGRAIN_PHASE_GRAINTIME 1
 
+// read every channel of the sound and mix them together (otherwise a channel number)
+#define WAVEGRAIN_CHANNEL_MIX -1
+
+// memory mapped and compact sounds are converted into a span buffer before being interpolated;
+// the margin covers the kernel on either side of the points read
+#define WAVEGRAIN_SPAN_MARGIN (SINC_KERNEL_TAPS+4)
+#define WAVEGRAIN_SPAN_LENGTH (2*GLOBAL_STATE.frames_per_buffer + WAVEGRAIN_SPAN_MARGIN)
+
 
 // each structure always has a parameter structure
 // and an active structure representing a specific instance of a grain
@@ -34,7 +43,9 @@ typedef struct WaveGrainParameters
     
     Distribution *pitch_shift; // in semitones
     WaveSound *sound;
-    int interpolate;
+    int interpolate;    // one of INTERPOLATION_*
+    int channel;        // channel to read, or WAVEGRAIN_CHANNEL_MIX
+    SincKernel *kernel;
     float phase_rate; // 1.0 == original speed
     int phase_offset;    
     int phase_mode;
@@ -45,11 +56,15 @@ typedef struct WaveGrainParameters
 
 typedef struct WaveGrain
 {
-    float rate;
+    float rate;         // in samples of the mip-map level being read
     WaveSound *sound;
-    float phase;
+    double phase;       // in samples of the mip-map level being read
+    int level;
     int interpolate;
-    
+    int channel;
+    SincKernel *kernel;
+    Buffer *scratch;    // for mixing channels
+    Buffer *span;       // samples converted from a memory mapped or compact sound
     
 } WaveGrain;
 
@@ -63,6 +78,7 @@ void restart_wave_parameters(WaveGrainParameters *wavegrain);
 void set_rate_wave_parameters(WaveGrainParameters *wavegrain, float rate);
 void set_phase_mode_wave_parameters(WaveGrainParameters *wavegrain, int mode);
 void set_interpolation_wave_parameters(WaveGrainParameters *wavegrain, int interpolate);
+void set_channel_wave_parameters(WaveGrainParameters *wavegrain, int channel);
 Distribution * get_phase_distribution_wave_parameters(WaveGrainParameters *wavegrain);
 
 Distribution * get_pitch_shift_distribution_wave_parameters(WaveGrainParameters *wavegrain);
@@ -0,0 +1,371 @@
+/**
+    @file wavemap.c
+    @brief A WaveSound backend which memory maps the PCM data of a WAV file and
+    converts it to float as it is read. Sounds opened this way have no channel
+    buffers: they can only be played by sources which read through
+    read_mapped_wave_sound() (currently WaveGrain).
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include "wavemap.h"
+#include "stats.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// number of pages checked for residency at a time
+#define WAVEMAP_RESIDENCY_PAGES 64
+
+
+// read a little endian value from a block
+static unsigned int read_little_endian(unsigned char *data, int n_bytes)
+{
+    unsigned int x;
+    int i;
+    x = 0;
+    for(i=n_bytes-1;i>=0;i--)
+        x = (x<<8) | data[i];
+    return x;
+}
+
+// read a 64 bit little endian value from a block
+static unsigned long long read_little_endian_64(unsigned char *data)
+{
+    return read_little_endian(data, 4) | ((unsigned long long)read_little_endian(data+4, 4) << 32);
+}
+
+
+// map a whole file read-only; returns the start of the mapping, or NULL on failure
+static void *map_file_wave_map(WaveMap *map, char *fname)
+{
+#ifdef _WIN32
+    LARGE_INTEGER size;
+    map->file = CreateFile(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if(map->file==INVALID_HANDLE_VALUE)
+        return NULL;
+    GetFileSizeEx(map->file, &size);
+    map->length = (size_t)size.QuadPart;
+    map->mapping = CreateFileMapping(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!map->mapping)
+    {
+        CloseHandle(map->file);
+        return NULL;
+    }
+    // residency can't be queried on Windows; only the read times are recorded
+    map->page_size = 0;
+    return MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    struct stat info;
+    void *base;
+    int fd;
+    fd = open(fname, O_RDONLY);
+    if(fd<0)
+        return NULL;
+    if(fstat(fd, &info)<0 || info.st_size==0)
+    {
+        close(fd);
+        return NULL;
+    }
+    if((unsigned long long)info.st_size > (size_t)-1)
+    {
+        // too big to map in this address space
+        close(fd);
+        return NULL;
+    }
+    map->length = info.st_size;
+    // shared, so every process playing the file uses the same pages
+    base = mmap(NULL, map->length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base==MAP_FAILED)
+        return NULL;
+    // grains read from all over the file, so read-ahead mostly wastes I/O
+    madvise(base, map->length, MADV_RANDOM);
+    map->page_size = sysconf(_SC_PAGESIZE);
+    return base;
+#endif
+}
+
+// undo map_file_wave_map
+static void unmap_file_wave_map(WaveMap *map)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(map->base);
+    CloseHandle(map->mapping);
+    CloseHandle(map->file);
+#else
+    munmap(map->base, map->length);
+#endif
+}
+
+
+/** Open a WAV file as a memory mapped WaveSound. The sample data is not read until it is played.
+    16, 24 and 32 bit integer and 32 bit float data is supported, in RIFF files or (for files
+    over 4GB) RF64 files, whose sizes are held in a ds64 chunk.
+    @arg fname The file to open
+    @return The new sound (destroy with destroy_wave_sound()), or NULL if the file could not be mapped
+*/
+WaveSound *create_mapped_wave_sound(char *fname)
+{
+    WaveMap *map;
+    WaveSound *sound;
+    unsigned char *chunk, *end, *fmt;
+    unsigned long long chunk_size, data_size, ds64_data_size;
+    int tag, bits, channels, sample_rate, rf64;
+    
+    map = malloc(sizeof(*map));
+    memset(&map->stats, 0, sizeof(map->stats));
+    map->base = map_file_wave_map(map, fname);
+    if(!map->base)
+    {
+        opengrain_warning("Could not map wave file %s", fname);
+        free(map);
+        return NULL;
+    }
+    
+    // find the format and data chunks
+    chunk = (unsigned char *)map->base;
+    end = chunk + map->length;
+    rf64 = map->length>=12 && !memcmp(chunk, "RF64", 4);
+    if(map->length<12 || (memcmp(chunk, "RIFF", 4) && !rf64) || memcmp(chunk+8, "WAVE", 4))
+    {
+        opengrain_warning("%s is not a RIFF or RF64 WAV file", fname);
+        destroy_wave_map(map);
+        return NULL;
+    }
+    
+    fmt = NULL;
+    map->data = NULL;
+    data_size = 0;
+    ds64_data_size = 0;
+    chunk += 12;
+    while(chunk+8 <= end)
+    {
+        chunk_size = read_little_endian(chunk+4, 4);
+        
+        // RF64: the 64 bit sizes are in the ds64 chunk (riff size, data size, sample count)
+        if(rf64 && !memcmp(chunk, "ds64", 4) && chunk_size>=24 && chunk+8+24 <= end)
+            ds64_data_size = read_little_endian_64(chunk+8+8);
+        if(!memcmp(chunk, "fmt ", 4) && chunk_size>=16)
+            fmt = chunk+8;
+        if(!memcmp(chunk, "data", 4))
+        {
+            map->data = chunk+8;
+            data_size = (rf64 && chunk_size==0xffffffff) ? ds64_data_size : chunk_size;
+            break;
+        }
+        // chunks are padded to an even length
+        if(chunk_size > (unsigned long long)(end - chunk))
+            break;
+        chunk += 8 + chunk_size + (chunk_size&1);
+    }
+    
+    if(!fmt || !map->data)
+    {
+        opengrain_warning("%s has no format or data chunk", fname);
+        destroy_wave_map(map);
+        return NULL;
+    }
+    
+    // the data may run to the end of the file (and the size may be a placeholder)
+    if(data_size > (unsigned long long)(end - map->data))
+        data_size = end - map->data;
+    
+    tag = read_little_endian(fmt, 2);
+    channels = read_little_endian(fmt+2, 2);
+    sample_rate = read_little_endian(fmt+4, 4);
+    bits = read_little_endian(fmt+14, 2);
+    
+    // WAVE_FORMAT_EXTENSIBLE: the real format is the start of the sub-format GUID
+    if(tag==0xfffe && read_little_endian(fmt-4, 4)>=26)
+        tag = read_little_endian(fmt+24, 2);
+    
+    map->format = -1;
+    if(tag==1 && bits==16)
+        map->format = WAVEMAP_PCM_16;
+    if(tag==1 && bits==24)
+        map->format = WAVEMAP_PCM_24;
+    if(tag==1 && bits==32)
+        map->format = WAVEMAP_PCM_32;
+    if(tag==3 && bits==32)
+        map->format = WAVEMAP_FLOAT_32;
+    if(map->format<0 || channels<1)
+    {
+        opengrain_warning("%s has an unsupported sample format", fname);
+        destroy_wave_map(map);
+        return NULL;
+    }
+    
+    map->bytes_per_sample = bits/8;
+    map->frame_bytes = map->bytes_per_sample * channels;
+    
+    sound = malloc(sizeof(*sound));
+    sound->sample_rate = sample_rate;
+    sound->n_channels = channels;
+    sound->frames = (long long)(data_size / map->frame_bytes);
+    sound->n_mipmap_levels = 0;
+    sound->mipmap = NULL;
+    sound->mapping = map;
+    sound->storage = WAVESOUND_STORAGE_FLOAT;
+    sound->samples = NULL;
+    // no channel buffers; the samples stay in the file
+    sound->channels = malloc(sizeof(*sound->channels));
+    list_init(sound->channels);
+    return sound;
+}
+
+
+// unmap a file and free the mapping
+void destroy_wave_map(WaveMap *map)
+{
+    unmap_file_wave_map(map);
+    free(map);
+}
+
+
+// return true if a sound is memory mapped (and so has no channel buffers)
+int is_mapped_wave_sound(WaveSound *sound)
+{
+    return sound->mapping != NULL;
+}
+
+
+// count the pages of a range of the mapping which are not in memory
+static int count_pages_in_wave_map(WaveMap *map, unsigned char *start, size_t n_bytes)
+{
+#ifdef _WIN32
+    return 0;
+#else
+    unsigned char resident[WAVEMAP_RESIDENCY_PAGES];
+    unsigned char *page;
+    size_t n_pages, length;
+    int i, missing;
+    
+    if(map->page_size<=0)
+        return 0;
+    page = (unsigned char *)map->base + (((start - (unsigned char *)map->base) / map->page_size) * map->page_size);
+    n_pages = (start + n_bytes - page + map->page_size - 1) / map->page_size;
+    missing = 0;
+    while(n_pages>0)
+    {
+        length = MIN(n_pages, WAVEMAP_RESIDENCY_PAGES);
+        if(mincore((void *)page, length * map->page_size, (void *)resident)<0)
+            return missing;
+        for(i=0;i<length;i++)
+            if(!(resident[i]&1))
+                missing++;
+        page += length * map->page_size;
+        n_pages -= length;
+    }
+    return missing;
+#endif
+}
+
+
+// convert a run of frames of one channel to float
+static void convert_wave_map(WaveMap *map, unsigned char *src, int n, float *out)
+{
+    int i;
+    float f;
+    switch(map->format)
+    {
+        case WAVEMAP_PCM_16:
+            for(i=0;i<n;i++, src+=map->frame_bytes)
+                out[i] = (short)(src[0] | (src[1]<<8)) * (1.0f/32768.0f);
+            break;
+        case WAVEMAP_PCM_24:
+            for(i=0;i<n;i++, src+=map->frame_bytes)
+                out[i] = (int)(((unsigned int)src[0]<<8) | ((unsigned int)src[1]<<16) | ((unsigned int)src[2]<<24)) * (1.0f/2147483648.0f);
+            break;
+        case WAVEMAP_PCM_32:
+            for(i=0;i<n;i++, src+=map->frame_bytes)
+                out[i] = (int)read_little_endian(src, 4) * (1.0f/2147483648.0f);
+            break;
+        case WAVEMAP_FLOAT_32:
+            for(i=0;i<n;i++, src+=map->frame_bytes)
+            {
+                memcpy(&f, src, sizeof(f));
+                out[i] = f;
+            }
+            break;
+    }
+}
+
+
+/** Read a run of samples from one channel of a mapped sound, converting to float.
+    The sound is treated as a loop, so the run may start before 0 or run past the end.
+    One read in WAVEMAP_STATS_INTERVAL is timed, and has the pages which had to be 
+    brought in from disk counted (checking costs a system call, so isn't done every read).
+    @arg sound A sound opened with create_mapped_wave_sound()
+    @arg channel The channel to read (clipped to the last channel)
+    @arg start The first frame to read
+    @arg n The number of frames to read
+    @arg out Where to put the samples
+*/
+void read_mapped_wave_sound(WaveSound *sound, int channel, long long start, int n, float *out)
+{
+    WaveMap *map;
+    unsigned char *src;
+    double t;
+    int len, sampled;
+    
+    map = sound->mapping;
+    if(sound->frames<=0)
+    {
+        memset(out, 0, sizeof(*out)*n);
+        return;
+    }
+    
+    sampled = (map->stats.reads++ % WAVEMAP_STATS_INTERVAL) == 0;
+    t = sampled ? get_time_stats() : 0.0;
+    channel = MIN(channel, sound->n_channels-1);
+    start %= sound->frames;
+    if(start<0)
+        start += sound->frames;
+    while(n>0)
+    {
+        len = MIN(n, sound->frames - start);
+        src = map->data + (size_t)start * map->frame_bytes + channel * map->bytes_per_sample;
+        if(sampled)
+            map->stats.pages_in += count_pages_in_wave_map(map, src, (size_t)len * map->frame_bytes);
+        convert_wave_map(map, src, len, out);
+        out += len;
+        n -= len;
+        start = 0;
+    }
+    if(!sampled)
+        return;
+    
+    t = get_time_stats() - t;
+    map->stats.sampled_reads++;
+    if(t > map->stats.max_read_time)
+        map->stats.max_read_time = t;
+    if(t > WAVEMAP_STALL_TIME)
+    {
+        map->stats.stalls++;
+        map->stats.stall_time += t;
+    }
+}
+
+
+// get the paging statistics of a mapped sound (all zero if the sound is not mapped)
+void get_stats_mapped_wave_sound(WaveSound *sound, WaveMapStats *stats)
+{
+    if(sound->mapping)
+        *stats = sound->mapping->stats;
+    else
+        memset(stats, 0, sizeof(*stats));
+}
@@ -0,0 +1,75 @@
+/**
+    @file wavemap.h
+    @brief A WaveSound backend which memory maps the PCM data of a WAV file and
+    converts it to float as it is read, so that very large sounds are paged in
+    by the operating system on demand (and shared between processes), rather
+    than loaded into memory up front.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#ifndef __WAVEMAP_H__
+#define __WAVEMAP_H__
+
+#include "audio.h"
+#include "wavereader.h"
+
+// sample formats of mapped data
+#define WAVEMAP_PCM_16 0
+#define WAVEMAP_PCM_24 1
+#define WAVEMAP_PCM_32 2
+#define WAVEMAP_FLOAT_32 3
+
+// a read which takes longer than this (in seconds) is counted as a stall
+#define WAVEMAP_STALL_TIME 100e-6
+
+
+// one read in this many is timed and has its pages checked for residency
+#define WAVEMAP_STATS_INTERVAL 16
+
+
+/** @struct WaveMapStats
+    Paging statistics for a mapped sound, since it was opened. Only one read in
+    WAVEMAP_STATS_INTERVAL is measured; the other fields cover those reads */
+typedef struct WaveMapStats
+{
+    unsigned int reads;         // number of reads
+    unsigned int sampled_reads; // number of reads which were measured
+    unsigned int pages_in;      // pages which were not resident when they were read
+    unsigned int stalls;        // reads which took longer than WAVEMAP_STALL_TIME
+    double stall_time;          // total time spent in stalled reads (seconds)
+    double max_read_time;       // longest single read (seconds)
+} WaveMapStats;
+
+
+/** @struct WaveMap
+    A read-only mapping of the sample data of a WAV file */
+typedef struct WaveMap
+{
+    void *base;             // start of the mapping
+    size_t length;          // length of the mapping, in bytes (size_t, so files over 4GB can be mapped on 64 bit systems)
+    unsigned char *data;    // first byte of sample data
+    int format;             // one of WAVEMAP_*
+    int bytes_per_sample;
+    int frame_bytes;
+    int page_size;          // 0 if residency can't be checked on this platform
+#ifdef _WIN32
+    void *file;             // file and mapping handles
+    void *mapping;
+#endif
+    WaveMapStats stats;
+} WaveMap;
+
+
+WaveSound *create_mapped_wave_sound(char *fname);
+void destroy_wave_map(WaveMap *map);
+int is_mapped_wave_sound(WaveSound *sound);
+void read_mapped_wave_sound(WaveSound *sound, int channel, long long start, int n, float *out);
+void get_stats_mapped_wave_sound(WaveSound *sound, WaveMapStats *stats);
+
+#endif
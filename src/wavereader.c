@@ -12,6 +12,10 @@
 
 #include "wavereader.h"
 #include "simplewav.h"
+#include "wave_interpolation.h"
+#include "wavemap.h"
+#include "sample_cache.h"
+#include "resampler.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,9 +35,12 @@ WaveSound *create_wave_sound(char *fname)
 
 
 // get a channel of a wavesound. returns the last valid channel
-// if channels > number of channels in this sound
+// if channels > number of channels in this sound (or NULL if the sound is memory mapped,
+// or held in compact storage; use read_wave_sound() for those)
 Buffer *get_channel_wave_sound(WaveSound *sound, int channel)
 {
+    if(sound->mapping || sound->storage!=WAVESOUND_STORAGE_FLOAT)
+        return NULL;
     if(channel<sound->n_channels)
         return list_get_at(sound->channels, channel);
     else    
@@ -41,11 +48,313 @@ Buffer *get_channel_wave_sound(WaveSound *sound, int channel)
 }
 
 
+// convert a float to an IEEE half float (round to nearest even; out of range values become infinity)
+static unsigned short float_to_half(float x)
+{
+    union { float f; unsigned int u; } v, denormal;
+    unsigned int sign, odd;
+    unsigned short h;
+    
+    v.f = x;
+    sign = v.u & 0x80000000u;
+    v.u ^= sign;
+    if(v.u >= 0x47800000u)
+    {
+        // too large for a half (or inf/nan)
+        h = v.u > 0x7f800000u ? 0x7e00 : 0x7c00;
+    }
+    else if(v.u < 0x38800000u)
+    {
+        // denormal half: let the float addition do the rounding
+        denormal.u = 0x3f000000u;
+        v.f += denormal.f;
+        h = v.u - denormal.u;
+    }
+    else
+    {
+        odd = (v.u >> 13) & 1;
+        v.u += 0xc8000fffu + odd;
+        h = v.u >> 13;
+    }
+    return h | (sign >> 16);
+}
+
+
+// convert an IEEE half float to a float (branches are only taken for denormals, inf and nan)
+static float half_to_float(unsigned short h)
+{
+    union { float f; unsigned int u; } v, denormal;
+    unsigned int exponent;
+    
+    v.u = (h & 0x7fff) << 13;
+    exponent = v.u & 0x0f800000u;
+    v.u += 0x38000000u;
+    if(exponent==0x0f800000u)
+        v.u += 0x38000000u;
+    else if(exponent==0)
+    {
+        denormal.u = 0x38800000u;
+        v.u += 0x00800000u;
+        v.f -= denormal.f;
+    }
+    v.u |= (h & 0x8000) << 16;
+    return v.f;
+}
+
+
+// convert a run of samples from compact storage to float. Kept as simple
+// loops over contiguous arrays, so the compiler can vectorise them
+static void convert_wave_sound(int storage, void *samples, int n, float *out)
+{
+    short *int16;
+    unsigned short *half;
+    int i;
+    
+    if(storage==WAVESOUND_STORAGE_INT16)
+    {
+        int16 = (short *)samples;
+        for(i=0;i<n;i++)
+            out[i] = int16[i] * (1.0f/32768.0f);
+    }
+    else
+    {
+        half = (unsigned short *)samples;
+        for(i=0;i<n;i++)
+            out[i] = half_to_float(half[i]);
+    }
+}
+
+
+// convert a run of float samples into compact storage
+static void compact_wave_sound(int storage, float *in, int n, void *samples)
+{
+    short *int16;
+    unsigned short *half;
+    float x;
+    int i;
+    
+    if(storage==WAVESOUND_STORAGE_INT16)
+    {
+        int16 = (short *)samples;
+        for(i=0;i<n;i++)
+        {
+            x = floor(in[i] * 32768.0f + 0.5f);
+            int16[i] = (short) (x > 32767.0f ? 32767.0f : (x < -32768.0f ? -32768.0f : x));
+        }
+    }
+    else
+    {
+        half = (unsigned short *)samples;
+        for(i=0;i<n;i++)
+            half[i] = float_to_half(in[i]);
+    }
+}
+
+
+/** Read samples from one channel of a sound, converting them to float, whatever
+    the storage (float, compact or memory mapped). Reads wrap around the end of the sound.
+    Safe to call from the audio thread.
+    @arg sound The sound
+    @arg channel The channel (clamped to the last channel)
+    @arg start The first frame to read (may be negative, or past the end)
+    @arg n Number of samples to read
+    @arg out The samples read
+*/
+void read_wave_sound(WaveSound *sound, int channel, long long start, int n, float *out)
+{
+    Buffer *buffer;
+    int len;
+    
+    if(sound->mapping)
+    {
+        read_mapped_wave_sound(sound, channel, start, n, out);
+        return;
+    }
+    if(sound->frames<=0)
+    {
+        memset(out, 0, sizeof(*out)*n);
+        return;
+    }
+    
+    channel = MIN(channel, sound->n_channels-1);
+    buffer = get_channel_wave_sound(sound, channel);
+    start %= sound->frames;
+    if(start<0)
+        start += sound->frames;
+    while(n>0)
+    {
+        len = MIN(n, sound->frames - start);
+        if(buffer)
+            memcpy(out, &buffer->x[start], sizeof(*out)*len);
+        else
+            convert_wave_sound(sound->storage, (short *)sound->samples + (size_t)channel*sound->frames + start, len, out);
+        out += len;
+        n -= len;
+        start = 0;
+    }
+}
+
+
+// read a single sample of a sound (index must be within the sound)
+float get_sample_wave_sound(WaveSound *sound, int channel, int index)
+{
+    float x;
+    read_wave_sound(sound, channel, index, 1, &x);
+    return x;
+}
+
+
+/** Change how the samples of a sound are held in memory. Compact storage (WAVESOUND_STORAGE_INT16
+    or WAVESOUND_STORAGE_HALF) keeps every channel in one block at half the size of float storage;
+    samples are converted back to float as grains read them. Compact sounds have no channel
+    Buffers (get_channel_wave_sound() returns NULL) and no mip-map.
+    Call after loading (not while the sound is playing). Memory mapped sounds are left alone.
+    @arg sound The sound
+    @arg storage One of WAVESOUND_STORAGE_*
+*/
+void set_storage_wave_sound(WaveSound *sound, int storage)
+{
+    Buffer *buffer;
+    void *samples;
+    int i;
+    
+    if(storage==sound->storage || sound->mapping)
+        return;
+    
+    // go via float
+    if(sound->storage!=WAVESOUND_STORAGE_FLOAT)
+    {
+        for(i=0;i<sound->n_channels;i++)
+        {
+            buffer = create_buffer(sound->frames);
+            convert_wave_sound(sound->storage, (short *)sound->samples + (size_t)i*sound->frames, sound->frames, buffer->x);
+            list_append(sound->channels, buffer);
+        }
+        free(sound->samples);
+        sound->samples = NULL;
+        sound->storage = WAVESOUND_STORAGE_FLOAT;
+    }
+    if(storage==WAVESOUND_STORAGE_FLOAT)
+        return;
+    
+    // the mip-map levels are float buffers built from the channels
+    destroy_mipmap_wave_sound(sound);
+    samples = malloc(sizeof(short) * (size_t)sound->n_channels * sound->frames);
+    for(i=0;i<sound->n_channels;i++)
+    {
+        buffer = list_extract_at(sound->channels, 0);
+        compact_wave_sound(storage, buffer->x, MIN(buffer->n_samples, sound->frames), (short *)samples + (size_t)i*sound->frames);
+        destroy_buffer(buffer);
+    }
+    sound->samples = samples;
+    sound->storage = storage;
+}
+
+
+// memory used by the samples of a sound, including its mip-map (0 for mapped sounds)
+size_t get_bytes_wave_sound(WaveSound *sound)
+{
+    size_t bytes;
+    int i, j;
+    if(sound->mapping)
+        return 0;
+    if(sound->storage!=WAVESOUND_STORAGE_FLOAT)
+        return sizeof(short) * (size_t)sound->n_channels * sound->frames;
+    
+    bytes = 0;
+    for(i=0;i<sound->n_channels;i++)
+    {
+        bytes += get_channel_wave_sound(sound, i)->n_samples * sizeof(float);
+        for(j=1;j<sound->n_mipmap_levels;j++)
+            bytes += get_mipmap_wave_sound(sound, i, j)->n_samples * sizeof(float);
+    }
+    return bytes;
+}
+
+
+/** Build a mip-map of a sound: each channel is repeatedly half-band filtered and decimated,
+    so that grains played back at high rates can read from a band-limited copy instead of aliasing.
+    Call after loading (not from the audio thread). Any existing mip-map is replaced.
+    @arg sound The sound
+    @arg n_levels Number of levels, including the original (e.g. WAVESOUND_MIPMAP_LEVELS)
+*/
+void build_mipmap_wave_sound(WaveSound *sound, int n_levels)
+{
+    int i, j;
+    Buffer *level;
+    
+    destroy_mipmap_wave_sound(sound);
+    if(n_levels<2)
+        return;
+    if(sound->mapping || sound->storage!=WAVESOUND_STORAGE_FLOAT)
+    {
+        opengrain_warning("Can't build a mip-map of a memory mapped or compact sound");
+        return;
+    }
+    
+    sound->mipmap = malloc(sizeof(*sound->mipmap) * n_levels * sound->n_channels);
+    for(i=0;i<sound->n_channels;i++)
+    {
+        level = get_channel_wave_sound(sound, i);
+        sound->mipmap[i*n_levels] = level;
+        for(j=1;j<n_levels;j++)
+        {
+            level = half_band_decimate(level);
+            sound->mipmap[i*n_levels+j] = level;
+        }
+    }
+    sound->n_mipmap_levels = n_levels;
+}
+
+
+// free the mip-map of a sound (if it has one)
+void destroy_mipmap_wave_sound(WaveSound *sound)
+{
+    int i, j;
+    if(!sound->mipmap)
+        return;
+    
+    // level 0 is the channel itself, which the mip-map doesn't own
+    for(i=0;i<sound->n_channels;i++)
+        for(j=1;j<sound->n_mipmap_levels;j++)
+            destroy_buffer(sound->mipmap[i*sound->n_mipmap_levels+j]);
+    free(sound->mipmap);
+    sound->mipmap = NULL;
+    sound->n_mipmap_levels = 0;
+}
+
+
+// choose the mip-map level to play a sound at a given rate: the first octave
+// in which the rate is at most 1, so nothing can alias (0 if there is no mip-map)
+int get_mipmap_level_wave_sound(WaveSound *sound, float rate)
+{
+    int level;
+    level = 0;
+    while(rate > 1.0 && level < sound->n_mipmap_levels-1)
+    {
+        rate *= 0.5;
+        level++;
+    }
+    return level;
+}
+
+
+// get one level of the mip-map of a channel (the channel itself if there is no mip-map)
+Buffer *get_mipmap_wave_sound(WaveSound *sound, int channel, int level)
+{
+    if(!sound->mipmap)
+        return get_channel_wave_sound(sound, channel);
+    if(channel>=sound->n_channels)
+        channel = sound->n_channels-1;
+    return sound->mipmap[channel*sound->n_mipmap_levels + MIN(level, sound->n_mipmap_levels-1)];
+}
+
+
 // get the number of bytes needed to store the data in sound in the given byte format
 int wave_sound_get_raw_bytes(WaveSound *sound, int format)
 {
     int bytes;
-    bytes = get_channel_wave_sound(sound, 0)->n_samples;
+    bytes = sound->frames;
     
     bytes *= sound->n_channels;
         
@@ -70,27 +379,27 @@ int wave_sound_get_raw_bytes(WaveSound *sound, int format)
 void wave_sound_to_raw(WaveSound *sound, int format, void *bytes)
 {
     int i,j,index;
-    Buffer *buffer;
+    float x;
     index = 0;    
             
     for(i=0;i<sound->frames;i++)
     {
         for(j=0;j<sound->n_channels;j++)     
         { 
-            buffer = list_get_at(sound->channels, j);  
+            x = get_sample_wave_sound(sound, j, i);
             
             if(format==PCM_SIGNED_8)
-                ((char *)bytes)[index++] = buffer->x[i];
+                ((char *)bytes)[index++] = x;
             if(format==PCM_UNSIGNED_8)
-                ((unsigned char *)bytes)[index++] = buffer->x[i];
+                ((unsigned char *)bytes)[index++] = x;
             if(format==PCM_SIGNED_16)
-                ((short *)bytes)[index++] = buffer->x[i];
+                ((short *)bytes)[index++] = x;
             if(format==PCM_SIGNED_32)
-                ((int *)bytes)[index++] = buffer->x[i];
+                ((int *)bytes)[index++] = x;
             if(format==PCM_FLOAT)
-                ((float *)bytes)[index++] = buffer->x[i];
+                ((float *)bytes)[index++] = x;
             if(format==PCM_DOUBLE)
-                ((double *)bytes)[index++] = buffer->x[i];
+                ((double *)bytes)[index++] = x;
         }
     }
         
@@ -113,6 +422,11 @@ WaveSound *wave_sound_from_raw(void *bytes, int frames, int channels, int sample
     sound->frames = frames;
     sound->n_channels = channels;
     sound->sample_rate = sample_rate;
+    sound->n_mipmap_levels = 0;
+    sound->mipmap = NULL;
+    sound->mapping = NULL;
+    sound->storage = WAVESOUND_STORAGE_FLOAT;
+    sound->samples = NULL;
     sound->channels = malloc(sizeof(*sound->channels));
     list_init(sound->channels);
         
@@ -156,24 +470,35 @@ WaveSound *wave_sound_from_raw(void *bytes, int frames, int channels, int sample
 Buffer *resample_buffer(Buffer *in, double rate)
 {
     void *resample_handle;       
-    int used;
+    int used, n;
     Buffer *resampled;
+    Resampler *resampler;
+    float *flush;
 
     // fix unused variable warning if ifdef'd out below
     (void) used;
     (void) resample_handle;
-    
-     // create the destination buffer
-    resampled = create_buffer(in->n_samples * rate + 100);
+    (void) resampler;
+    (void) flush;
+    (void) n;
     
     // resample
 #ifdef USE_LIBRESAMPLE
+    resampled = create_buffer(in->n_samples * rate + 100);
     resample_handle = resample_open(1, rate, rate);      
     resample_process(resample_handle, rate, in->x, in->n_samples, 0, &used, 
     resampled->x, resampled->n_samples);    
     resample_close(resample_handle);    
 #else
-    linear_resample_buffer(resampled, in, rate);
+    // the streaming resampler, with enough silence after the input to flush out the end of it
+    resampler = create_resampler(rate, 1, RESAMPLER_QUALITY_HIGH);
+    flush = calloc(get_latency_resampler(resampler), sizeof(*flush));
+    resampled = create_buffer(get_max_output_resampler(resampler, in->n_samples + get_latency_resampler(resampler)));
+    n = process_resampler(resampler, in->x, in->n_samples, resampled->x);
+    n += process_resampler(resampler, flush, get_latency_resampler(resampler), &resampled->x[n]);
+    resampled->n_samples = MIN(n, (int)ceil(in->n_samples * rate));
+    free(flush);
+    destroy_resampler(resampler);
 #endif    
     
     return resampled;
@@ -186,16 +511,24 @@ Buffer *resample_buffer(Buffer *in, double rate)
 // resample a wavesound to a new sample rate
 void resample_wave_sound(WaveSound *wave_sound, int new_rate)
 {
-  int i;
+  int i, n_mipmap_levels, storage;
   Buffer *resampled, *original;
    
   // compute sampling rate
   double rate_ratio = (double)new_rate / (double)wave_sound->sample_rate;
   
-  // do nothing if sample rate not changed!
-  if(new_rate==wave_sound->sample_rate)
+  // do nothing if sample rate not changed! (or if the samples are in a mapped file)
+  if(new_rate==wave_sound->sample_rate || wave_sound->mapping)
     return;
   
+  // compact sounds are resampled as floats, and compacted again afterwards
+  storage = wave_sound->storage;
+  set_storage_wave_sound(wave_sound, WAVESOUND_STORAGE_FLOAT);
+  
+  // the mip-map refers to the old channels, so is rebuilt afterwards
+  n_mipmap_levels = wave_sound->n_mipmap_levels;
+  destroy_mipmap_wave_sound(wave_sound);
+  
   
   for(i=0;i<wave_sound->n_channels;i++)
   {
@@ -204,6 +537,10 @@ void resample_wave_sound(WaveSound *wave_sound, int new_rate)
     destroy_buffer(original);
     list_append(wave_sound->channels, resampled);
   }
+  wave_sound->sample_rate = new_rate;
+  wave_sound->frames = get_channel_wave_sound(wave_sound, 0)->n_samples;
+  build_mipmap_wave_sound(wave_sound, n_mipmap_levels);
+  set_storage_wave_sound(wave_sound, storage);
     
  }
   
@@ -215,6 +552,11 @@ void destroy_wave_sound(WaveSound *wave_sound)
 {
     Buffer *buffer;
     
+    destroy_mipmap_wave_sound(wave_sound);
+    if(wave_sound->mapping)
+        destroy_wave_map(wave_sound->mapping);
+    free(wave_sound->samples);
+    
     // destroy each channel
     list_iterator_start(wave_sound->channels);
     while(list_iterator_hasnext(wave_sound->channels))
@@ -233,32 +575,143 @@ void destroy_wave_sound(WaveSound *wave_sound)
 }
 
 
-// load a sequence of filenames of the type "xxx000.wav", "xxx001.wav" etc.
-list_t *create_soundbank(char *basename)
-{    
+// load the files of a soundbank on one thread, taking the next file to load until there are none left
+static void load_soundbank_thread(void *data)
+{
+    SoundbankLoader *loader;
+    WaveSound *sound;
     int index;
+    loader = (SoundbankLoader *)data;
+    
+    lock_mutex(loader->mutex);
+    while(loader->next < loader->n_files)
+    {
+        index = loader->next++;
+        unlock_mutex(loader->mutex);
+        
+        // the sample cache loads (and resamples) without holding its lock, so files load in parallel
+        sound = acquire_sample(loader->fnames[index], loader->sample_rate, loader->storage);
+        
+        lock_mutex(loader->mutex);
+        loader->sounds[index] = sound;
+        loader->loaded++;
+        broadcast_condition(loader->progress);
+    }
+    unlock_mutex(loader->mutex);
+}
+
+
+/** Load a sequence of files of the type "xxx000.wav", "xxx001.wav" etc. (up to the first
+    missing number), decoding and resampling them on a number of threads. The bank is in
+    file order, whatever order the files finish loading in; if a file can't be loaded, the bank
+    stops before it, as if it were missing. The sounds come from the sample cache, so banks
+    loaded more than once share their samples.
+    @arg basename The start of the file names
+    @arg sample_rate The rate to resample the sounds to, or SAMPLE_CACHE_NATIVE_RATE
+    @arg storage How the samples are held (one of WAVESOUND_STORAGE_*), with WAVESOUND_MIPMAP to build mip-maps
+    @arg n_threads Number of loading threads, or SOUNDBANK_ALL_PROCESSORS
+    @arg progress Called on the calling thread with the number of files loaded so far (may be NULL)
+    @arg data Passed to the progress callback
+    @return A list of WaveSounds; free with destroy_soundbank()
+*/
+list_t *load_soundbank(char *basename, int sample_rate, int storage, int n_threads, soundbank_progress_func progress, void *data)
+{
+    SoundbankLoader loader;
+    Thread **threads;
     char fname[1024];
     list_t *bank;
-    WaveSound *sound;
+    FILE *file;
+    int i, n_started, reported;
     
     bank = malloc(sizeof(*bank));
     list_init(bank);
-      
-    index = 0;
-    do
+    
+    // find the files first, so they can be shared out between the threads
+    loader.fnames = NULL;
+    loader.n_files = 0;
+    while(1)
     {
-        sprintf(fname, "%s%03d.wav", basename, index++);
-        sound = create_wave_sound(fname);
-        if(sound)       
-            list_append(bank, sound);        
-        
+        sprintf(fname, "%s%03d.wav", basename, loader.n_files);
+        file = fopen(fname, "rb");
+        if(!file)
+            break;
+        fclose(file);
+        loader.fnames = realloc(loader.fnames, sizeof(*loader.fnames) * (loader.n_files+1));
+        loader.fnames[loader.n_files] = malloc(strlen(fname)+1);
+        strcpy(loader.fnames[loader.n_files], fname);
+        loader.n_files++;
+    }
+    if(loader.n_files==0)
+        return bank;
     
-    } while(sound);
-
+    loader.sounds = malloc(sizeof(*loader.sounds) * loader.n_files);
+    loader.next = 0;
+    loader.loaded = 0;
+    loader.sample_rate = sample_rate;
+    loader.storage = storage;
+    loader.mutex = create_mutex();
+    loader.progress = create_condition();
+    
+    if(n_threads==SOUNDBANK_ALL_PROCESSORS)
+        n_threads = get_n_processors();
+    n_threads = MAX(1, MIN(n_threads, loader.n_files));
+    threads = malloc(sizeof(*threads) * n_threads);
+    n_started = 0;
+    for(i=0;i<n_threads;i++)
+    {
+        threads[n_started] = create_thread(load_soundbank_thread, &loader);
+        if(threads[n_started])
+            n_started++;
+    }
+    
+    // if no thread could be started, load everything here
+    if(n_started==0)
+        load_soundbank_thread(&loader);
+    
+    // report progress as files finish
+    reported = 0;
+    lock_mutex(loader.mutex);
+    while(reported < loader.n_files)
+    {
+        while(loader.loaded==reported)
+            wait_condition(loader.progress, loader.mutex);
+        reported = loader.loaded;
+        unlock_mutex(loader.mutex);
+        if(progress)
+            progress(data, reported, loader.n_files);
+        lock_mutex(loader.mutex);
+    }
+    unlock_mutex(loader.mutex);
+    
+    for(i=0;i<n_started;i++)
+        join_thread(threads[i]);
+    free(threads);
+    
+    // build the bank in file order, stopping at the first file which didn't load
+    for(i=0;i<loader.n_files && loader.sounds[i];i++)
+        list_append(bank, loader.sounds[i]);
+    for(;i<loader.n_files;i++)
+        if(loader.sounds[i])
+            release_sample(loader.sounds[i]);
+    
+    for(i=0;i<loader.n_files;i++)
+        free(loader.fnames[i]);
+    free(loader.fnames);
+    free(loader.sounds);
+    destroy_condition(loader.progress);
+    destroy_mutex(loader.mutex);
     return bank;
 }
 
-// destroy a list of wavesounds
+
+// load a sequence of filenames of the type "xxx000.wav", "xxx001.wav" etc., held in the given
+// storage (one of WAVESOUND_STORAGE_*), using a thread per processor
+list_t *create_soundbank(char *basename, int storage)
+{    
+    return load_soundbank(basename, SAMPLE_CACHE_NATIVE_RATE, storage, SOUNDBANK_ALL_PROCESSORS, NULL, NULL);
+}
+
+// destroy a list of wavesounds (handing the sounds back to the sample cache)
 void destroy_soundbank(list_t *bank)
 {
     WaveSound *sound;
@@ -268,7 +721,7 @@ void destroy_soundbank(list_t *bank)
     while(list_iterator_hasnext(bank))
     {
         sound = (WaveSound *) list_iterator_next(bank);
-        destroy_wave_sound(sound);    
+        release_sample(sound);    
     }
     list_iterator_stop(bank);
     list_destroy(bank);
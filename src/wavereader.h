@@ -15,6 +15,7 @@
 
 #include "audio.h"
 #include "soundfile.h"
+#include "threads.h"
 #include <math.h>
 
 
@@ -26,18 +27,72 @@
 #define PCM_FLOAT 5
 #define PCM_DOUBLE 6
 
+// default number of octaves in a WaveSound mip-map (including the original)
+#define WAVESOUND_MIPMAP_LEVELS 6
+
+// OR with WAVESOUND_STORAGE_FLOAT when loading (acquire_sample(), load_soundbank()) to build
+// a mip-map of WAVESOUND_MIPMAP_LEVELS octaves as the sound is loaded
+#define WAVESOUND_MIPMAP 0x100
+
+// how the samples of a WaveSound are held in memory
+#define WAVESOUND_STORAGE_FLOAT 0   // one float Buffer per channel
+#define WAVESOUND_STORAGE_INT16 1   // planar 16 bit integers in one block (lossless for 16 bit files)
+#define WAVESOUND_STORAGE_HALF 2    // planar 16 bit (IEEE half) floats in one block
+
+// number of loading threads meaning "one per processor"
+#define SOUNDBANK_ALL_PROCESSORS 0
+
+
+struct WaveMap;
 
 typedef struct WaveSound
 {    
     int sample_rate;
     int n_channels;
-    int frames;
-    list_t *channels;
+    long long frames;       // 64 bit, so that memory mapped sounds can be longer than 2^31 frames
+    list_t *channels;       // empty unless the storage is WAVESOUND_STORAGE_FLOAT
+    
+    // compact storage: every channel in one block, one after the other (NULL for float storage)
+    int storage;
+    void *samples;
+    
+    // optional mip-map: half-band filtered octaves of each channel, for playback at high rates
+    int n_mipmap_levels;    // 0 if there is no mip-map
+    Buffer **mipmap;        // mipmap[channel*n_mipmap_levels + level]; level 0 is the channel itself
+    
+    // if the sound is memory mapped, the mapping (and there are no channel buffers)
+    struct WaveMap *mapping;
 } WaveSound;
 
 
+// called on the loading thread as the files of a soundbank are loaded
+typedef void (*soundbank_progress_func)(void *data, int loaded, int total);
+
+/** @struct SoundbankLoader
+    The state shared by the threads loading a soundbank */
+typedef struct SoundbankLoader
+{
+    char **fnames;
+    WaveSound **sounds;     // in file order; NULL where a file failed to load
+    int n_files;
+    int next;               // next file to be taken by a thread
+    int loaded;             // number of files finished
+    int sample_rate, storage;
+    Mutex *mutex;
+    Condition *progress;    // broadcast when a file is finished
+} SoundbankLoader;
+
+
 
 Buffer *get_channel_wave_sound(WaveSound *sound, int channel);
+void read_wave_sound(WaveSound *sound, int channel, long long start, int n, float *out);
+float get_sample_wave_sound(WaveSound *sound, int channel, int index);
+void set_storage_wave_sound(WaveSound *sound, int storage);
+size_t get_bytes_wave_sound(WaveSound *sound);
+void build_mipmap_wave_sound(WaveSound *sound, int n_levels);
+void destroy_mipmap_wave_sound(WaveSound *sound);
+int get_mipmap_level_wave_sound(WaveSound *sound, float rate);
+Buffer *get_mipmap_wave_sound(WaveSound *sound, int channel, int level);
 
 int wave_sound_get_raw_bytes(WaveSound *sound, int format);
 void wave_sound_to_raw(WaveSound *sound, int format, void *bytes);
@@ -47,9 +102,9 @@ WaveSound *create_wave_sound(char *fname);
 void destroy_wave_sound(WaveSound *wave_sound);
 Buffer *resample_buffer(Buffer *in, double rate);
 void resample_wave_sound(WaveSound *wave_sound, int new_rate);
-list_t *load_soundbank(char *basename);
+list_t *load_soundbank(char *basename, int sample_rate, int storage, int n_threads, soundbank_progress_func progress, void *data);
 
-list_t *create_soundbank(char *basename);
+list_t *create_soundbank(char *basename, int storage);
 void destroy_soundbank(list_t *bank);
 
 #endif
\ No newline at end of file
@@ -26,7 +26,15 @@ WaveWriter* create_wavewriter(void)
     writer->bit_depth = WAVEWRITER_BIT_DEPTH_16;
     writer->path = "output";
     writer->write_buffer = NULL;    
+    writer->ring = NULL;
+    writer->ring_storage = NULL;
+    writer->thread = NULL;
+    writer->running = 0;
+    writer->disk_buffer = NULL;
+    writer->file_buffer = NULL;
+    writer->overruns = 0;
     writer->writing = 0;
+    writer->in_write = 0;
     writer->channels = 0;
     writer->out_channels = 0;
     writer->speaker_locations = NULL;
@@ -151,11 +159,97 @@ int file_exists(char *path)
 }
 
 
-// open a new wav file for writing to
+// write frames of interleaved data (as queued by write_wavewriter()) to the open files
+// called only from the disk thread
+static void write_files_wavewriter(WaveWriter *writer, float *data, int frames)
+{
+    int i, k, channels;
+    void *handle;
+    
+    channels = writer->channels;
+    
+    // interleaved data
+    if(writer->channel_mode == MULTICHANNEL_INTERLEAVE)
+    {
+        handle = list_get_at(writer->handles, 0);
+        soundfile_write(handle, data, frames*channels);    
+    }
+    
+    // mixed data
+    if(writer->channel_mode == MULTICHANNEL_MIX)
+    {
+        for(i=0;i<frames;i++)
+        {
+            writer->file_buffer[i] = 0.0;
+            for(k=0;k<channels;k++)            
+                writer->file_buffer[i] += data[i*channels+k] / channels;            
+        }           
+        handle = list_get_at(writer->handles, 0);
+        soundfile_write(handle, writer->file_buffer, frames);    
+    }
+    
+    // separate file data
+    if(writer->channel_mode == MULTICHANNEL_SEPARATE)
+    {
+        for(k=0;k<channels;k++)            
+        {
+            for(i=0;i<frames;i++)                       
+                writer->file_buffer[i] = data[i*channels+k];                                              
+            handle = list_get_at(writer->handles, k);
+            soundfile_write(handle, writer->file_buffer, frames);    
+        }                
+    }
+    
+    // hrtf faked surround
+    if(writer->channel_mode == MULTICHANNEL_HRTF)
+    {
+        // fix: not rendered through the HRTFs yet, just the first two channels
+        for(i=0;i<frames;i++)
+        {
+            writer->file_buffer[i*2] = data[i*channels];
+            writer->file_buffer[i*2+1] = data[i*channels + MIN(1, channels-1)];
+        }
+        handle = list_get_at(writer->handles, 0);
+        soundfile_write(handle, writer->file_buffer, 2*frames);    
+    }
+}
+
+
+// The disk thread: waits until a large run of frames has been queued, then converts 
+// and writes them all at once. Drains the ring and exits once running is cleared.
+static void disk_thread_wavewriter(void *data)
+{
+    WaveWriter *writer = (WaveWriter *)data;
+    long frame_bytes, frames;
+    int stopping;
+    
+    frame_bytes = sizeof(*writer->disk_buffer) * writer->channels;
+    while(1)
+    {
+        // check the flag first, so nothing queued before stop_wavewriter() is missed
+        stopping = !writer->running;
+        frames = PaUtil_GetRingBufferReadAvailable(writer->ring) / frame_bytes;
+        
+        if(frames >= WAVEWRITER_DISK_FRAMES || (stopping && frames > 0))
+        {
+            frames = MIN(frames, WAVEWRITER_DISK_FRAMES);
+            PaUtil_ReadRingBuffer(writer->ring, writer->disk_buffer, frames * frame_bytes);
+            write_files_wavewriter(writer, writer->disk_buffer, frames);
+        }
+        else if(stopping)
+            break;
+        else
+            sleep_thread(WAVEWRITER_POLL_MS);
+    }
+}
+
+
+// open a new wav file for writing to, and start the disk thread
 void start_wavewriter(WaveWriter *writer)
 {   
     int exists, index, i;
     int file_channels;
+    long ring_bytes;
     char output_path_name[1024];
     void *handle;
    
@@ -206,111 +300,128 @@ void start_wavewriter(WaveWriter *writer)
         for(i=0;i<writer->channels;i++)
         {
             sprintf(output_path_name, "%s_%03d_c%d.wav", writer->path, index-1, i);
-            handle = soundfile_open(file_channels, GLOBAL_STATE.sample_rate, WAVEWRITER_BIT_DEPTH_16, writer->overwrite_mode, &output_path_name[0]);
+            handle = soundfile_open(file_channels, GLOBAL_STATE.sample_rate, writer->bit_depth, writer->overwrite_mode, &output_path_name[0]);
             list_append(writer->handles, handle);
         }
     }
     else
     {
-        handle = soundfile_open(file_channels, GLOBAL_STATE.sample_rate, WAVEWRITER_BIT_DEPTH_16, writer->overwrite_mode, &output_path_name[0]);
+        handle = soundfile_open(file_channels, GLOBAL_STATE.sample_rate, writer->bit_depth, writer->overwrite_mode, &output_path_name[0]);
         list_append(writer->handles, handle);
     }
+    
+    // the ring (whose size must be a power of two bytes)
+    ring_bytes = 1;
+    while(ring_bytes < WAVEWRITER_RING_SECONDS * GLOBAL_STATE.sample_rate * writer->channels * sizeof(float))
+        ring_bytes <<= 1;
+    writer->ring = malloc(sizeof(*writer->ring));
+    writer->ring_storage = malloc(ring_bytes);
+    PaUtil_InitializeRingBuffer(writer->ring, ring_bytes, writer->ring_storage);
+    writer->disk_buffer = malloc(sizeof(*writer->disk_buffer) * writer->channels * WAVEWRITER_DISK_FRAMES);
+    writer->file_buffer = malloc(sizeof(*writer->file_buffer) * MAX(2, file_channels) * WAVEWRITER_DISK_FRAMES);
+    writer->overruns = 0;
+    
+    writer->running = 1;
+    writer->thread = create_thread(disk_thread_wavewriter, writer);
+    if(!writer->thread)
+        opengrain_error("Could not start the disk thread for wavewriting.");
+    
+    // everything is set up before the audio callback can see that writing has started
+    memory_barrier();
     writer->writing = 1;    
         
 }    
         
     
 
-// close the currently active file and NULL the handle
+// stop the disk thread once it has written everything queued, then close the files.
+// Can be called from any thread, including the audio callback.
 void stop_wavewriter(WaveWriter *writer)
 {
     int i;
     void *handle;
-    if(writer->out_channels)
+    if(!writer->writing)
+        return;
+    writer->writing = 0;
+    
+    // the audio callback may be part way through queueing a block: wait for it to leave
+    // write_wavewriter() before anything it uses is freed (it won't go back in, as writing
+    // is now clear; write_wavewriter() sets in_write before it checks writing)
+    memory_barrier();
+    while(writer->in_write)
+        sleep_thread(1);
+    
+    if(writer->thread)
     {
-        for(i=0;i<writer->out_channels;i++)
-        {
-            handle = list_get_at(writer->handles, i);
-            soundfile_stop(handle);    
-        }
+        writer->running = 0;
+        join_thread(writer->thread);
+        writer->thread = NULL;
     }
+    
+    for(i=0;i<list_size(writer->handles);i++)
+    {
+        handle = list_get_at(writer->handles, i);
+        soundfile_stop(handle);    
+    }
+    list_clear(writer->handles);
+    
+    if(writer->overruns)
+        opengrain_warning("%d blocks were dropped from the recording, as the disk could not keep up", writer->overruns);
+    
     if(writer->write_buffer)
         destroy_buffer(writer->write_buffer);
     writer->write_buffer = NULL;
-    writer->writing = 0;
+    free(writer->ring_storage);
+    free(writer->ring);
+    free(writer->disk_buffer);
+    free(writer->file_buffer);
+    writer->ring = NULL;
+    writer->ring_storage = NULL;
+    writer->disk_buffer = NULL;
+    writer->file_buffer = NULL;
+}
+
+
+// number of blocks dropped from the current (or last) recording because the ring was full
+int get_overruns_wavewriter(WaveWriter *writer)
+{
+    return writer->overruns;
 }
 
 
-// Write a stereo buffer to disk
+/** Queue a block for writing. Called from the audio callback; never blocks or touches the disk.
+    If the disk thread has fallen so far behind that the ring is full, the block is dropped 
+    and counted as an overrun.
+    @arg writer The wavewriter
+    @arg channels One buffer for each of the writer's channels
+*/
 void write_wavewriter(WaveWriter *writer, Buffer **channels)
 {
-    int i, j,k;
-    void *handle;
-    if(!writer->writing)
-        return;
-        
-    j = 0;
+    int i, j, k;
+    long bytes;
     
-    // interleaved data
-    if(writer->channel_mode == MULTICHANNEL_INTERLEAVE)
+    // announce that the ring is in use, then check that it still exists (see stop_wavewriter())
+    writer->in_write = 1;
+    memory_barrier();
+    if(!writer->writing)
     {
-        for(i=0;i<channels[0]->n_samples;i++)
-        {
-            for(k=0;k<writer->channels;k++)            
-                writer->write_buffer->x[j++] = channels[k]->x[i];            
-        }           
-        
-        handle = list_get_at(writer->handles, 0);
-        // write the data to disk        
-        soundfile_write(handle,  writer->write_buffer->x, channels[0]->n_samples*writer->channels);    
+        writer->in_write = 0;
+        return;
     }
-    
-    // mixed data
-    if(writer->channel_mode == MULTICHANNEL_MIX)
-    {
-        zero_buffer(writer->write_buffer);
-        for(i=0;i<channels[0]->n_samples;i++)
-        {
-            for(k=0;k<writer->channels;k++)            
-                writer->write_buffer->x[i] += channels[k]->x[i] / writer->channels;            
-        }           
         
-        handle = list_get_at(writer->handles, 0);
-        // write the data to disk        
-        soundfile_write(handle,  writer->write_buffer->x, channels[0]->n_samples);    
-    }
-    
-    // separate file data
-    if(writer->channel_mode == MULTICHANNEL_SEPARATE)
+    // interleave
+    j = 0;
+    for(i=0;i<channels[0]->n_samples;i++)
     {
         for(k=0;k<writer->channels;k++)            
-        {
-            for(i=0;i<channels[0]->n_samples;i++)                       
-                writer->write_buffer->x[i] = channels[k]->x[i];                                              
-        handle = list_get_at(writer->handles, k);
-        // write the data to disk        
-        soundfile_write(handle,  writer->write_buffer->x, channels[k]->n_samples);    
-        }                
-    }
+            writer->write_buffer->x[j++] = channels[k]->x[i];            
+    }           
     
-    // hrtf faked surround
-    if(writer->channel_mode == MULTICHANNEL_HRTF)
-    {
-        if(!writer->speaker_locations)
-            opengrain_error("Speaker locations not set when using HRTF mode in a wavewriter!");
-        else
-        {
-            for(k=0;k<writer->channels;k++)            
-            {
-                for(i=0;i<channels[0]->n_samples;i++)                           
-                    writer->write_buffer->x[i] = channels[k]->x[i];            
-                                       //fix
-                handle = list_get_at(writer->handles, 0);
-                // write the data to disk        
-                soundfile_write(handle,  writer->write_buffer->x, 2*channels[0]->n_samples);    
-            }
-        }
-    }
-    
-    
-}
\ No newline at end of file
+    bytes = sizeof(*writer->write_buffer->x) * j;
+    if(PaUtil_GetRingBufferWriteAvailable(writer->ring) >= bytes)
+        PaUtil_WriteRingBuffer(writer->ring, writer->write_buffer->x, bytes);
+    else
+        writer->overruns++;
+    memory_barrier();
+    writer->in_write = 0;
+}
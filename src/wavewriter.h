@@ -16,6 +16,8 @@
 #include "audio.h"
 #include "soundfile.h"
 #include "location.h"
+#include "threads.h"
+#include "pa_ringbuffer.h"
 #include <math.h>
 
 
@@ -42,13 +44,24 @@
 #define WAVEWRITER_BIT_DEPTH_FLOAT 32
 
 
+// seconds of audio the ring between the audio callback and the disk thread can hold
+#define WAVEWRITER_RING_SECONDS 2.0
+
+// frames the disk thread waits for before writing, so that writes are large and sequential
+#define WAVEWRITER_DISK_FRAMES 8192
+
+// how often the disk thread checks the ring (ms)
+#define WAVEWRITER_POLL_MS 10
+
+
 typedef struct WaveWriter
 {
     int channel_mode;
     int bit_depth;
     int overwrite_mode;
     char *path;
-    int writing;
+    volatile int writing;
+    volatile int in_write;      // set while the audio callback is inside write_wavewriter()
     
     list_t *handles;
     
@@ -56,7 +69,17 @@ typedef struct WaveWriter
     int channels;
     int out_channels;
     
-    Buffer *write_buffer;
+    Buffer *write_buffer;       // interleaved block, filled in the audio callback
+    
+    // blocks are queued in the ring by the audio callback, and converted and written 
+    // to disk by the disk thread
+    PaUtilRingBuffer *ring;
+    void *ring_storage;
+    Thread *thread;
+    volatile int running;       // cleared to make the disk thread drain the ring and exit
+    float *disk_buffer;         // interleaved frames read from the ring (disk thread only)
+    float *file_buffer;         // data for one file (disk thread only)
+    volatile int overruns;      // blocks dropped because the ring was full, since start_wavewriter()
     
 } WaveWriter;
 
@@ -73,6 +96,7 @@ void set_overwrite_wavewriter(WaveWriter *writer, int overwrite_mode);
 void start_wavewriter(WaveWriter *writer);
 void write_wavewriter(WaveWriter *writer, Buffer **channels);
 void stop_wavewriter(WaveWriter *writer);
+int get_overruns_wavewriter(WaveWriter *writer);
 int file_exists(char *path);
 
 #endif
\ No newline at end of file
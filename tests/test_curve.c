@@ -0,0 +1,152 @@
+/**
+    @file test_curve.c
+    @brief Tests breakpoint curves: ramp end values across block boundaries, loops,
+    zero length segments, seeking, queued edits and the finished curve fast path.
+    Returns the number of failed checks.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "audio.h"
+#include "curve.h"
+
+#define SAMPLE_RATE 44100
+#define BLOCK 256
+
+static int failures = 0;
+
+// report a check, counting the failures
+static void check(int ok, char *what)
+{
+    printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+    if(!ok)
+        failures++;
+}
+
+
+// run a curve for n blocks, keeping every sample
+static void run_curve(Curve *curve, float *out, int blocks)
+{
+    int i;
+    for(i=0;i<blocks;i++)
+    {
+        update_curve(curve, BLOCK);
+        memcpy(&out[i*BLOCK], get_values_curve(curve)->x, sizeof(*out) * BLOCK);
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    AudioState prototype, *state;
+    Curve *curve;
+    static float out[BLOCK*40];
+    float err, expected;
+    int k;
+
+    memset(&prototype, 0, sizeof(prototype));
+    prototype.sample_rate = SAMPLE_RATE;
+    prototype.frames_per_buffer = BLOCK;
+    prototype.n_channels = 2;
+    prototype.max_grains = 16;
+    state = init_audio_state(&prototype);
+    curve = create_curve(0.0);
+
+    // edits wait for the next block
+    add_segment_curve(curve, 1.0, 1000.0/SAMPLE_RATE, CURVE_LINEAR);
+    check(curve->n_segments==0, "edits are queued until the next block");
+
+    // linear ramp, 1000 samples, over four blocks
+    run_curve(curve, out, 6);
+    err = 0.0;
+    for(k=0;k<BLOCK*6;k++)
+    {
+        expected = k<1000 ? k/1000.0 : 1.0;
+        err = MAX(err, fabs(out[k] - expected));
+    }
+    check(err < 1e-5, "linear ramp follows the line across blocks");
+    check(get_value_curve(curve)==1.0, "linear ramp ends exactly on its value");
+    check(is_constant_curve(curve), "finished curve is constant");
+
+    // the finished curve isn't recomputed: the fast path leaves the value buffer alone
+    get_values_curve(curve)->x[5] = -1.0;
+    update_curve(curve, BLOCK);
+    check(get_values_curve(curve)->x[5]==-1.0 && get_value_curve(curve)==1.0, "finished curve takes the fast path");
+    check(fabs(get_position_curve(curve) - 7.0*BLOCK/SAMPLE_RATE) < 1e-6, "finished curve keeps time");
+
+    // and an edit brings it back
+    clear_curve(curve, 2.0);
+    update_curve(curve, BLOCK);
+    check(get_values_curve(curve)->x[5]==2.0 && get_value_curve(curve)==2.0, "edit after finishing is applied");
+
+    // exponential, 1 -> 0.001 over a fractional number of samples, crossing blocks
+    clear_curve(curve, 1.0);
+    add_segment_curve(curve, 0.001, 1000.5/SAMPLE_RATE, CURVE_EXPLOG);
+    run_curve(curve, out, 5);
+    err = 0.0;
+    for(k=0;k<1000;k++)
+    {
+        expected = pow(0.001, k/1000.5);
+        err = MAX(err, fabs(out[k] - expected) / expected);
+    }
+    check(err < 1e-4, "exponential ramp follows the curve across blocks");
+    check(out[1001]==(float)0.001 && get_value_curve(curve)==(float)0.001, "exponential ramp ends exactly on its value");
+
+    // ramp from wherever the curve is
+    ramp_curve(curve, 0.5, 100.0/SAMPLE_RATE, CURVE_LINEAR);
+    run_curve(curve, out, 1);
+    check(fabs(out[0] - 0.001) < 1e-6 && out[200]==0.5, "ramp starts from the current value");
+
+    // a loop of two segments with fractional lengths adding up to 200 samples repeats exactly
+    clear_curve(curve, 0.0);
+    add_segment_curve(curve, 1.0, 100.3/SAMPLE_RATE, CURVE_LINEAR);
+    add_segment_curve(curve, 0.0, 99.7/SAMPLE_RATE, CURVE_LINEAR);
+    set_loop_curve(curve, 0, 1);
+    run_curve(curve, out, 40);
+    err = 0.0;
+    for(k=0;k+200<BLOCK*40;k++)
+        err = MAX(err, fabs(out[k] - out[k+200]));
+    check(err < 1e-4, "loop repeats with its period");
+    check(!is_constant_curve(curve), "looping curve never finishes");
+
+    // zero length segments jump straight to their value
+    clear_curve(curve, 0.0);
+    add_segment_curve(curve, 5.0, 0.0, CURVE_LINEAR);
+    add_segment_curve(curve, 3.0, 0.0, CURVE_STEP);
+    run_curve(curve, out, 1);
+    check(out[0]==3.0 && out[BLOCK-1]==3.0, "zero length segments are passed through");
+
+    // and a loop with no length doesn't hang
+    clear_curve(curve, 0.0);
+    add_segment_curve(curve, 1.0, 0.0, CURVE_STEP);
+    set_loop_curve(curve, 0, 0);
+    run_curve(curve, out, 1);
+    check(out[0]==1.0 && curve->segment==curve->n_segments, "zero length loop finishes");
+
+    // seeking half way into a one second ramp
+    clear_curve(curve, 0.0);
+    add_segment_curve(curve, 1.0, 1.0, CURVE_LINEAR);
+    set_position_curve(curve, 0.5);
+    update_curve(curve, 1);
+    check(fabs(get_value_curve(curve) - 0.5) < 1e-5, "set_position_curve seeks into a segment");
+    check(fabs(get_position_curve(curve) - (0.5 + 1.0/SAMPLE_RATE)) < 1e-6, "set_position_curve sets the time");
+
+    // removing the playing segment finishes the curve
+    remove_segment_curve(curve, 0);
+    update_curve(curve, BLOCK);
+    check(curve->n_segments==0 && is_constant_curve(curve), "removing the playing segment finishes the curve");
+
+    destroy_curve(curve);
+    destroy_audio_state(state);
+    printf("%d failed\n", failures);
+    return failures;
+}
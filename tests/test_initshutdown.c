@@ -17,6 +17,8 @@
 
 int main(int argc, char **argv)
 {
+    GRContext *context, *other;
+    
     grInit();
     
     printf("grInit()\n");
@@ -25,6 +27,20 @@ int main(int argc, char **argv)
     if(grGetLastError() != GR_ERROR_NONE)    
         fprintf(stderr, "%s", grGetLastErrorMessage());
         
+    // a second, independent context
+    context = grGetCurrentContext();
+    other = grCreateContext();
+    grMakeCurrent(other);
+    printf("grCreateContext()\n");
+    if(grGetLastError() != GR_ERROR_NONE)    
+        fprintf(stderr, "%s", grGetLastErrorMessage());
+    grDestroyContext(other);
+    printf("grDestroyContext()\n");
+    // the thread falls back to the default context (the first made current)
+    if(grGetCurrentContext() != context)
+        fprintf(stderr, "Default context not current after grDestroyContext()\n");
+    
+    grMakeCurrent(context);
     grShutdown();
     printf("grShutdown()\n");
         
@@ -0,0 +1,156 @@
+/**
+    @file test_mipmap.c
+    @brief Tests WaveSound mip-maps: loading with WAVESOUND_MIPMAP builds the octaves,
+    each level is half the length of the one before, low frequencies pass through
+    the levels and frequencies above a level's band are removed. Writes a short WAV
+    file to the current directory. Returns the number of failed checks.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "audio.h"
+#include "wavereader.h"
+#include "sample_cache.h"
+
+#define SAMPLE_RATE 44100
+#define FRAMES 32768
+#define TEST_FILE "test_mipmap.wav"
+
+static int failures = 0;
+
+// report a check, counting the failures
+static void check(int ok, char *what)
+{
+    printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+    if(!ok)
+        failures++;
+}
+
+
+// write a little endian value
+static void write_little_endian(FILE *f, unsigned int x, int n_bytes)
+{
+    int i;
+    for(i=0;i<n_bytes;i++)
+        fputc((x >> (8*i)) & 0xff, f);
+}
+
+
+// write a mono 16 bit WAV of two sines: one at 500Hz on the left half, one at 15kHz on the right half
+static int write_test_file(void)
+{
+    FILE *f;
+    int i;
+    double x, frequency;
+    f = fopen(TEST_FILE, "wb");
+    if(!f)
+        return 0;
+    fwrite("RIFF", 1, 4, f);
+    write_little_endian(f, 36 + FRAMES*2, 4);
+    fwrite("WAVEfmt ", 1, 8, f);
+    write_little_endian(f, 16, 4);
+    write_little_endian(f, 1, 2);
+    write_little_endian(f, 1, 2);
+    write_little_endian(f, SAMPLE_RATE, 4);
+    write_little_endian(f, SAMPLE_RATE*2, 4);
+    write_little_endian(f, 2, 2);
+    write_little_endian(f, 16, 2);
+    fwrite("data", 1, 4, f);
+    write_little_endian(f, FRAMES*2, 4);
+    for(i=0;i<FRAMES;i++)
+    {
+        frequency = i < FRAMES/2 ? 500.0 : 15000.0;
+        x = 0.5 * sin(2*M_PI*frequency*i/SAMPLE_RATE);
+        write_little_endian(f, (unsigned int)(short)(x*32767), 2);
+    }
+    fclose(f);
+    return 1;
+}
+
+
+// the peak level of a range of a buffer
+static float peak(Buffer *buffer, int start, int end)
+{
+    int i;
+    float p;
+    p = 0.0;
+    for(i=start;i<end && i<buffer->n_samples;i++)
+        p = MAX(p, fabs(buffer->x[i]));
+    return p;
+}
+
+
+int main(int argc, char **argv)
+{
+    AudioState prototype, *state;
+    WaveSound *sound, *plain;
+    Buffer *level, *next;
+    int i, ok;
+
+    memset(&prototype, 0, sizeof(prototype));
+    prototype.sample_rate = SAMPLE_RATE;
+    prototype.frames_per_buffer = 256;
+    prototype.n_channels = 2;
+    prototype.max_grains = 16;
+    state = init_audio_state(&prototype);
+
+    if(!write_test_file())
+    {
+        fprintf(stderr, "Couldn't write %s\n", TEST_FILE);
+        return 1;
+    }
+
+    // without the flag, there is no mip-map
+    plain = acquire_sample(TEST_FILE, SAMPLE_CACHE_NATIVE_RATE, WAVESOUND_STORAGE_FLOAT);
+    check(plain && plain->n_mipmap_levels==0, "sounds have no mip-map by default");
+    check(plain && get_mipmap_level_wave_sound(plain, 4.0)==0, "without a mip-map, every rate plays the original");
+
+    // with it, the octaves are built at load, as a separate sound in the cache
+    sound = acquire_sample(TEST_FILE, SAMPLE_CACHE_NATIVE_RATE, WAVESOUND_STORAGE_FLOAT | WAVESOUND_MIPMAP);
+    if(!sound)
+    {
+        fprintf(stderr, "Couldn't load %s\n", TEST_FILE);
+        return 1;
+    }
+    check(sound != plain, "mip-mapped sound is cached apart from the plain one");
+    check(sound->n_mipmap_levels==WAVESOUND_MIPMAP_LEVELS, "WAVESOUND_MIPMAP builds every level");
+    check(get_mipmap_wave_sound(sound, 0, 0)==get_channel_wave_sound(sound, 0), "level 0 is the sound itself");
+
+    ok = 1;
+    for(i=1;i<sound->n_mipmap_levels;i++)
+    {
+        level = get_mipmap_wave_sound(sound, 0, i-1);
+        next = get_mipmap_wave_sound(sound, 0, i);
+        if(abs(next->n_samples - level->n_samples/2) > 1)
+            ok = 0;
+    }
+    check(ok, "each level is half the length of the one before");
+
+    // level 1 is at half the rate: 500Hz passes, 15kHz (above its 11kHz band) is removed
+    level = get_mipmap_wave_sound(sound, 0, 1);
+    check(fabs(peak(level, FRAMES/16, FRAMES/4 - FRAMES/16) - 0.5) < 0.02, "low frequencies pass into the next level");
+    check(peak(level, FRAMES/4 + FRAMES/16, FRAMES/2 - FRAMES/16) < 0.01, "frequencies above a level's band are removed");
+
+    // levels are chosen so that nothing aliases
+    check(get_mipmap_level_wave_sound(sound, 0.5)==0, "rates below 1 play the original");
+    check(get_mipmap_level_wave_sound(sound, 2.0)==1, "rate 2 plays the first octave");
+    check(get_mipmap_level_wave_sound(sound, 3.0)==2, "rate 3 plays the second octave");
+    check(get_mipmap_level_wave_sound(sound, 1000.0)==WAVESOUND_MIPMAP_LEVELS-1, "high rates play the last octave");
+
+    release_sample(sound);
+    release_sample(plain);
+    flush_sample_cache();
+    remove(TEST_FILE);
+    destroy_audio_state(state);
+    printf("%d failed\n", failures);
+    return failures;
+}
@@ -0,0 +1,119 @@
+/**
+    @file test_schedule.c
+    @brief Tests that grains triggered from outside the mixer (as the control thread
+    and the live triggers do) start exactly as far ahead as they were scheduled, for
+    delays shorter than, equal to and longer than a block, including those which wait
+    in the timing wheel. Returns the number of failed checks.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "audio.h"
+#include "grainmixer.h"
+#include "grain_tests.h"
+
+#define SAMPLE_RATE 44100
+#define BLOCK 256
+#define BLOCKS 12
+
+static int failures = 0;
+
+// report a check, counting the failures
+static void check(int ok, char *what)
+{
+    printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+    if(!ok)
+        failures++;
+}
+
+
+// trigger a single grain delay samples ahead, between blocks, and return the
+// first sample (counted from the start of the next block) at which it sounds
+static int first_sample(int delay)
+{
+    GrainMixer *mixer;
+    GrainStream *stream;
+    Buffer **channels;
+    int i, k, first;
+
+    mixer = create_mixer();
+    stream = create_stream(2);
+    test_sinegrain(stream);
+    test_default_grain_model(stream);
+    // no grains of its own: only the one triggered below
+    set_constant_distribution(get_grain_model_stream(stream)->rate, 0.0);
+    add_stream(mixer, stream);
+    channels = create_planar_buffers(get_n_channels_mixer(mixer), BLOCK);
+
+    // move the timing wheel on a little first
+    for(i=0;i<3;i++)
+        grain_mix(mixer, channels);
+
+    trigger_single_grain_stream(stream, delay / (double)SAMPLE_RATE);
+
+    first = -1;
+    for(i=0;i<BLOCKS && first<0;i++)
+    {
+        grain_mix(mixer, channels);
+        for(k=0;k<BLOCK;k++)
+            if(fabs(channels[0]->x[k]) > 1e-9)
+            {
+                first = i*BLOCK + k;
+                break;
+            }
+    }
+
+    remove_stream(mixer, stream);
+    destroy_stream(stream);
+    destroy_planar_buffers(channels, get_n_channels_mixer(mixer));
+    destroy_mixer(mixer);
+    return first;
+}
+
+
+int main(int argc, char **argv)
+{
+    AudioState prototype, *state;
+    static int delays[] = {1, 100, BLOCK-1, BLOCK, BLOCK+1, 300, 2*BLOCK, 3*BLOCK, 3*BLOCK+17, 2000};
+    int i, n, reference, first, last, exact, monotonic;
+    char what[128];
+
+    memset(&prototype, 0, sizeof(prototype));
+    prototype.sample_rate = SAMPLE_RATE;
+    prototype.frames_per_buffer = BLOCK;
+    prototype.n_channels = 2;
+    prototype.max_grains = 16;
+    state = init_audio_state(&prototype);
+
+    // the grain scheduled for now gives the latency of the source and spatializer
+    reference = first_sample(0);
+    check(reference>=0 && reference<BLOCK, "grain scheduled for now sounds in the next block");
+
+    n = sizeof(delays)/sizeof(delays[0]);
+    monotonic = 1;
+    last = reference;
+    for(i=0;i<n;i++)
+    {
+        first = first_sample(delays[i]);
+        exact = first - reference == delays[i];
+        sprintf(what, "grain scheduled %d samples ahead starts %d samples later", delays[i], first - reference);
+        check(exact, what);
+        if(first <= last)
+            monotonic = 0;
+        last = first;
+    }
+    check(monotonic, "later grains always start later");
+
+    destroy_audio_state(state);
+    printf("%d failed\n", failures);
+    return failures;
+}
@@ -0,0 +1,121 @@
+/**
+    @file test_steal.c
+    @brief Tests stealing at a stream's cap under a burst of grains: a burst of grains
+    triggered at once, in a shuffled order and due at different times, must leave only
+    the grains which start soonest, and none of the later ones. Returns the number of
+    failed checks.
+    @author John Williamson
+
+    Copyright (c) 2011 All rights reserved.
+    Licensed under the BSD 3 clause license. See COPYING.
+
+    This file is part of the OpenGrain distribution.
+    http://opengrain.sourceforge.net
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "audio.h"
+#include "grainmixer.h"
+#include "grain_tests.h"
+
+#define SAMPLE_RATE 44100
+#define BLOCK 256
+#define CAP 8
+#define BURST 2000
+#define SPACING 64
+
+static int failures = 0;
+
+// report a check, counting the failures
+static void check(int ok, char *what)
+{
+    printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+    if(!ok)
+        failures++;
+}
+
+
+// run the mixer for a number of samples
+static void run(GrainMixer *mixer, Buffer **channels, int n_samples)
+{
+    int i;
+    for(i=0;i<n_samples;i+=BLOCK)
+        grain_mix(mixer, channels);
+}
+
+
+int main(int argc, char **argv)
+{
+    AudioState prototype, *state;
+    GrainMixer *mixer;
+    GrainStream *stream;
+    Buffer **channels;
+    static int delays[BURST];
+    int i, j, swap, most_playing;
+    unsigned int seed;
+    char what[128];
+
+    memset(&prototype, 0, sizeof(prototype));
+    prototype.sample_rate = SAMPLE_RATE;
+    prototype.frames_per_buffer = BLOCK;
+    prototype.n_channels = 2;
+    prototype.max_grains = 64;
+    state = init_audio_state(&prototype);
+
+    mixer = create_mixer();
+    stream = create_stream(2);
+    test_sinegrain(stream);
+    test_default_grain_model(stream);
+    // no grains of its own: only the burst below, all alike except for when they start
+    set_constant_distribution(get_grain_model_stream(stream)->rate, 0.0);
+    set_constant_distribution(get_grain_model_stream(stream)->duration, 0.5);
+    set_max_grains_stream(stream, CAP);
+    add_stream(mixer, stream);
+    channels = create_planar_buffers(get_n_channels_mixer(mixer), BLOCK);
+    run(mixer, channels, 3*BLOCK);
+
+    // the burst is due over the next few seconds, triggered in a shuffled order
+    for(i=0;i<BURST;i++)
+        delays[i] = (i+1) * SPACING;
+    seed = 12345;
+    for(i=BURST-1;i>0;i--)
+    {
+        seed = seed * 1103515245 + 12345;
+        j = (seed >> 16) % (i+1);
+        swap = delays[i];
+        delays[i] = delays[j];
+        delays[j] = swap;
+    }
+
+    most_playing = 0;
+    for(i=0;i<BURST;i++)
+    {
+        trigger_single_grain_stream(stream, delays[i] / (double)SAMPLE_RATE);
+        if(get_n_playing_grains_stream(stream) > most_playing)
+            most_playing = get_n_playing_grains_stream(stream);
+    }
+    sprintf(what, "at most %d grains are kept during the burst (%d)", CAP, most_playing);
+    check(most_playing <= CAP, what);
+    check(stream->n_active_grains == CAP, "the grains which are not kept are gone, not left waiting");
+
+    // the grains which start soonest (within the first CAP*SPACING samples) are the ones kept
+    run(mixer, channels, CAP*SPACING + BLOCK);
+    sprintf(what, "the %d soonest grains are all sounding (%d)", CAP, get_n_sounding_grains_stream(stream));
+    check(get_n_sounding_grains_stream(stream) == CAP, what);
+    check(stream->n_waiting_grains == 0, "no later grains are still waiting");
+
+    // and nothing is left once they have finished
+    run(mixer, channels, SAMPLE_RATE);
+    check(stream->n_active_grains == 0, "no grains are left after the burst");
+
+    remove_stream(mixer, stream);
+    destroy_stream(stream);
+    destroy_planar_buffers(channels, get_n_channels_mixer(mixer));
+    destroy_mixer(mixer);
+    destroy_audio_state(state);
+    printf("%d failed\n", failures);
+    return failures;
+}